@@ -8,10 +8,33 @@
 #include "Options.h"
 #include "GfxAPI/GfxAPI.h"
 #include "GfxAPI/Window.h"
+#include "Jobs/JobSystem.h"
+#include "Jobs/JobBenchmark.h"
+#include "Renderer/BvhBenchmark.h"
+
+// Longest time the application sleeps while idle, in seconds. It wakes up this often to check the config file.
+static const double tmIdleWaitTimeout = 0.25;
+// Most simulation steps run for one frame. When frames take longer, the scene slows down instead of the simulation
+// taking ever more of each frame.
+static const uint32_t ctMaxStepsPerFrame = 4;
 
 
 // Run the application - initialize, run the main loop, cleanup at the end.
 void Application::Run() {
+    // measure the job system instead, if asked to
+    if (Options::Get().ShouldRunJobBenchmark()) {
+        RunJobBenchmark();
+        return;
+    }
+
+    // start the threads that run the engine's jobs
+    JobSystem::Initialize(Options::Get().GetJobThreadCount());
+    // measure the scene hierarchy instead, if asked to - it builds on the job system
+    if (Options::Get().ShouldRunBvhBenchmark()) {
+        RunBvhBenchmark();
+        JobSystem::Shutdown();
+        return;
+    }
     // start the graphics API
     InitializeGraphics();
     // program's main loop
@@ -35,8 +58,10 @@ void Application::InitializeGraphics() {
         throw std::runtime_error("Graphics API type not specified on options");
     }
 
+    // place the objects in the scene
+    ssSimulation.Initialize();
     // initialize the API and let it create the window
-    apiGfxAPI->Initialize(options.GetWindowWidth(), options.GetWindowHeight());
+    apiGfxAPI->Initialize(options.GetWindowWidth(), options.GetWindowHeight(), ssSimulation);
 }
 
 
@@ -45,18 +70,87 @@ void Application::MainLoop() {
     // cache the graphics API
     GfxAPI *apiGfx = GfxAPI::Get();
 
-	// loop until the user closes the window
+    // without a window there is nothing to close, so render a fixed number of frames - one simulation step each,
+    // regardless of how long the frames take, so that every run renders the same frames and results are comparable
     std::shared_ptr<Window> wndWindow = apiGfx->GetWindow();
+    if (wndWindow == nullptr) {
+        const uint32_t ctFrames = Options::Get().GetNullFrameCount();
+        for (uint32_t iFrame = 0; iFrame < ctFrames; iFrame++) {
+            ssSimulation.Step(1.0f / Options::Get().GetSimulationRate());
+            apiGfx->Render(ssSimulation, 1.0f);
+        }
+        return;
+    }
+
+    // was the application sleeping instead of rendering?
+    bool bIdle = false;
+    // start of the last frame, which the simulation caught up to
+    auto tmPreviousFrame = std::chrono::high_resolution_clock::now();
+    // the renderer may read the options on its own thread, so they only change once it rendered what it was given
+    const std::function<void()> fnFlushRenderer = [apiGfx]() { apiGfx->Flush(); };
+
+	// loop until the user closes the window
 	while (!wndWindow->ShouldClose()) {
+        // sleep while minimized, since there is nothing to render to, and when rendering on demand, until something
+        // changes the image - input, a resize, animation or changed options
+        const bool bFrameNeeded = !Options::Get().ShouldRenderOnDemand() || Options::Get().ShouldAnimateScene() || wndWindow->IsRedrawRequested();
+        if (wndWindow->IsMinimized() || !bFrameNeeded) {
+            wndWindow->WaitForMessages(tmIdleWaitTimeout);
+            JobSystem::RunMainThreadJobs();
+            if (Options::ReloadIfModified(fnFlushRenderer)) {
+                wndWindow->RequestRedraw();
+            }
+            bIdle = true;
+            continue;
+        }
+        // the pause isn't part of the frame rhythm, nor is it simulated
+        if (bIdle) {
+            apiGfx->ResumeAfterIdle();
+            tmPreviousFrame = std::chrono::high_resolution_clock::now();
+            bIdle = false;
+        }
+
+        // wait for the frame's start before sampling input, so that the input is as fresh as possible when it's displayed
+        apiGfx->WaitForNextFrame();
+        const auto tmFrameStart = std::chrono::high_resolution_clock::now();
         wndWindow->ProcessMessages();
-        apiGfx->Render();
+        // run the jobs that need the main thread, like window calls
+        JobSystem::RunMainThreadJobs();
+        // pick up options edited while the application runs
+        Options::ReloadIfModified(fnFlushRenderer);
+        // this frame shows everything that happened so far, so only later changes need another one
+        wndWindow->ClearRedrawRequest();
+        // bring the simulation up to the frame's start
+        const float fInterpolation = AdvanceSimulation(std::chrono::duration<double>(tmFrameStart - tmPreviousFrame).count());
+        tmPreviousFrame = tmFrameStart;
+        // hand the frame to the renderer - this returns while it renders, so the events keep being processed
+        apiGfx->Render(ssSimulation, fInterpolation);
 	}
 }
 
 
+// Run the simulation steps for the time that passed.
+float Application::AdvanceSimulation(double tmElapsed) {
+    const double tmStep = 1.0 / Options::Get().GetSimulationRate();
+
+    // time beyond the most steps a frame may run is dropped
+    tmSimulationLag = std::min(tmSimulationLag + tmElapsed, ctMaxStepsPerFrame * tmStep);
+    while (tmSimulationLag >= tmStep) {
+        ssSimulation.Step(static_cast<float>(tmStep));
+        tmSimulationLag -= tmStep;
+    }
+
+    // the frame shows the scene up to a step behind the simulation, so that it can interpolate between two known
+    // states instead of guessing ahead
+    return static_cast<float>(tmSimulationLag / tmStep);
+}
+
+
 // Clean up Vulkan API and destroy the application window
 void Application::Cleanup() {
     GfxAPI::Get()->Destroy();
+    // the renderer's jobs are done, stop the workers
+    JobSystem::Shutdown();
 }
 
 
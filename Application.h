@@ -2,10 +2,11 @@
 
 #include <vector>
 #include <vulkan/vulkan.h>
+#include "Renderer/SceneSimulation.h"
 
 class Application {
 public:
-    Application() : apiGfxAPI(nullptr) {}
+    Application() : apiGfxAPI(nullptr), tmSimulationLag(0.0) {}
 
     // Run the application - initialize, run the main loop, cleanup at the end.
 	void Run();
@@ -13,11 +14,18 @@ public:
 private:
     // Grapics API to use in the application.
     class GfxAPI *apiGfxAPI;
+    // The scene, simulated in fixed steps.
+    SceneSimulation ssSimulation;
+    // Time that passed and wasn't simulated yet, in seconds - less than a step after each frame.
+    double tmSimulationLag;
 
     // Start the graphics API and create the window.
     void InitializeGraphics();
 	// Program's main loop
 	void MainLoop();
+    // Run the simulation steps for the time that passed, in seconds. Returns where the frame to render falls between
+    // the last two steps.
+    float AdvanceSimulation(double tmElapsed);
 	// Clean up Vulkan API and destroy the application window
 	void Cleanup();
 };
@@ -6,7 +6,30 @@ enum GfxAPIType {
     GFX_API_TYPE_VULKAN = 1,
 };
 
+// How rendered images are handed to the display.
+enum PresentMode {
+    // pick the lowest latency mode without tearing that the display supports
+    PRESENT_MODE_AUTO = 0,
+    // wait for vertical blank, queueing images
+    PRESENT_MODE_FIFO = 1,
+    // wait for vertical blank, replacing the queued image with newer ones
+    PRESENT_MODE_MAILBOX = 2,
+    // present right away, with tearing
+    PRESENT_MODE_IMMEDIATE = 3,
+};
+
+// Whether the scene's depth is laid down in a pre-pass, so that the main pass shades each pixel only once.
+enum DepthPrepassMode {
+    // measure the scene's overdraw, and use the pre-pass if it is high enough
+    DEPTH_PREPASS_AUTO = 0,
+    // never use the pre-pass
+    DEPTH_PREPASS_OFF = 1,
+    // always use the pre-pass
+    DEPTH_PREPASS_ON = 2,
+};
+
 class Window;
+class SceneSimulation;
 
 // This is a base class for graphics APIs. It defines the interface that an API needs to provide
 // for the application and the render. The class is abstract, all required methods need to be implemented
@@ -22,15 +45,24 @@ public:
     static GfxAPI *CreateNull();
     
 public:
-    // Initialize the API. Returns true if successfull. Pass window dimensions.
-    virtual bool Initialize(uint32_t dimWidth, uint32_t dimHeight) = 0;
+    // Initialize the API. Returns true if successfull. Pass window dimensions, and the scene to render.
+    virtual bool Initialize(uint32_t dimWidth, uint32_t dimHeight, const SceneSimulation &ssScene) = 0;
     // Destroy the API. Returns true if successfull.
     virtual bool Destroy() = 0;
     // Get the main application window.
     std::shared_ptr<Window> &GetWindow() { return _wndWindow;  }
 
-    // Render a frame.
-    virtual void Render() = 0;
+    // Wait until the next frame should start. Called before input is processed, so that frame pacing delays the
+    // sampling of input together with the rendering.
+    virtual void WaitForNextFrame() {};
+    // Called when rendering resumes after the application slept, because the window was minimized or nothing changed.
+    virtual void ResumeAfterIdle() {};
+    // Render a frame of the scene, between its last two simulation steps as given by fInterpolation. The API may hand
+    // the frame to a render thread and return before it is rendered.
+    virtual void Render(const SceneSimulation &ssScene, float fInterpolation) = 0;
+    // Wait until all frames handed to the renderer are rendered. Until the next frame, nothing else touches the API's
+    // objects or reads the options, so they can be changed.
+    virtual void Flush() {};
 
 protected:
     // Constructor and destructor are only available to derived classes.
@@ -1,8 +1,16 @@
 #include "../PrecompiledHeader.h"
 #include "Window.h"
+#include "GfxAPI.h"
 #include <GLFW/glfw3.h>
 
 
+// Ask the application window for a new frame. GLFW callbacks have no way to carry the window object, and the window
+// user pointer belongs to the graphics API, so the window is found through the API.
+static void RequestRedrawFromCallback() {
+    GfxAPI::Get()->GetWindow()->RequestRedraw();
+}
+
+
 // Set the window data
 void Window::Initialize(uint32_t dimWidth, uint32_t dimHeight, GLFWwindow *wndWindow) {
     assert(dimWidth > 0);
@@ -12,6 +20,15 @@ void Window::Initialize(uint32_t dimWidth, uint32_t dimHeight, GLFWwindow *wndWi
     _dimWidth = dimWidth;
     _dimHeight = dimHeight;
     _wndWindow = wndWindow;
+
+    // input may change what is displayed, and so may the window being resized, restored or uncovered
+    glfwSetKeyCallback(wndWindow, [](GLFWwindow *, int, int, int, int) { RequestRedrawFromCallback(); });
+    glfwSetMouseButtonCallback(wndWindow, [](GLFWwindow *, int, int, int) { RequestRedrawFromCallback(); });
+    glfwSetCursorPosCallback(wndWindow, [](GLFWwindow *, double, double) { RequestRedrawFromCallback(); });
+    glfwSetScrollCallback(wndWindow, [](GLFWwindow *, double, double) { RequestRedrawFromCallback(); });
+    glfwSetFramebufferSizeCallback(wndWindow, [](GLFWwindow *, int, int) { RequestRedrawFromCallback(); });
+    glfwSetWindowIconifyCallback(wndWindow, [](GLFWwindow *, int) { RequestRedrawFromCallback(); });
+    glfwSetWindowRefreshCallback(wndWindow, [](GLFWwindow *) { RequestRedrawFromCallback(); });
 }
 
 // Should the window be closed?
@@ -28,6 +45,12 @@ void Window::ProcessMessages() {
 }
 
 
+// Sleep until a window message arrives or the timeout passes, then process the messages.
+void Window::WaitForMessages(double tmTimeout) {
+    glfwWaitEventsTimeout(tmTimeout);
+}
+
+
 // Close the window.
 void Window::Close() {
     glfwDestroyWindow(_wndWindow);
@@ -43,3 +66,12 @@ void Window::UpdateDimensions() {
     _dimWidth = dimWidth;
     _dimHeight = dimHeight;
 }
+
+
+// Is the window minimized, i.e. has nothing to render to?
+bool Window::IsMinimized() const {
+    // a minimized window has no framebuffer, and a swap chain can't be created for a zero extent
+    int dimWidth, dimHeight;
+    glfwGetFramebufferSize(_wndWindow, &dimWidth, &dimHeight);
+    return dimWidth == 0 || dimHeight == 0;
+}
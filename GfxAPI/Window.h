@@ -1,12 +1,14 @@
 #pragma once
+#include <atomic>
 struct GLFWwindow;
 
 // One instance of this class exists for each window the aplication opens.
-// Windows are created by the graphics API, since the setup requires API specific configuration.
+// Windows are created by the graphics API, since the setup requires API specific configuration. Messages are
+// processed on the main thread, but the dimensions and redraw requests are also used by the render thread.
 class Window {
 
 public:
-    Window() : _dimWidth(0), _dimHeight(0), _wndWindow(nullptr) {};
+    Window() : _dimWidth(0), _dimHeight(0), _wndWindow(nullptr), _bRedrawRequested(true) {};
     ~Window() {};
 
     // Set the window data
@@ -16,6 +18,8 @@ public:
     bool ShouldClose();
     // Process window messages.
     void ProcessMessages();
+    // Sleep until a window message arrives or the timeout, in seconds, passes, then process the messages.
+    void WaitForMessages(double tmTimeout);
     // Close the window.
     void Close();
 
@@ -28,12 +32,24 @@ public:
     uint32_t GetHeight() const { return _dimHeight; }
     // Make the window to update its dimensions from the underlying implementation.
     void UpdateDimensions();
+    // Is the window minimized, i.e. has nothing to render to?
+    bool IsMinimized() const;
+
+    // Ask for a new frame to be rendered. Input and changes to the window ask for it themselves.
+    void RequestRedraw() { _bRedrawRequested = true; }
+    // Was a new frame asked for since the last one was rendered?
+    bool IsRedrawRequested() const { return _bRedrawRequested; }
+    // Mark the request as handled, when a frame starts.
+    void ClearRedrawRequest() { _bRedrawRequested = false; }
 
 private:
     // Window width and height.
-    uint32_t _dimWidth;
-    uint32_t _dimHeight;
+    std::atomic<uint32_t> _dimWidth;
+    std::atomic<uint32_t> _dimHeight;
 
     // GLFW window info
     struct GLFWwindow *_wndWindow;
+
+    // Does the image need rendering again, since input arrived or the window changed?
+    std::atomic<bool> _bRedrawRequested;
 };
\ No newline at end of file
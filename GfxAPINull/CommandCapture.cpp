@@ -0,0 +1,111 @@
+#include "../PrecompiledHeader.h"
+#include "CommandCapture.h"
+
+#include <cstring>
+
+// Marks bound state as not bound to anything.
+static const uint32_t iNothingBound = ~0u;
+
+
+// Start capturing a new frame, discarding the previous one. The stream's memory is reused.
+void CommandCapture::Reset() {
+    // clear() keeps the capacity, so a steady state frame doesn't allocate
+    _abStream.clear();
+    _csStatistics = {};
+    // nothing is bound at the start of a command buffer
+    _iBoundPipeline = iNothingBound;
+    _iBoundMesh = iNothingBound;
+    _iBoundDescriptorSet = iNothingBound;
+}
+
+
+// Get the total number of captured commands.
+uint32_t CommandCapture::GetCommandCount() const {
+    uint32_t ctCommands = 0;
+    for (uint32_t iType = 0; iType < COMMAND_COUNT; iType++) {
+        ctCommands += _csStatistics.actCommands[iType];
+    }
+    return ctCommands;
+}
+
+
+// Append a command to the stream.
+void CommandCapture::WriteCommand(CommandType cmdType, const void *pPayload, uint32_t ctPayloadSize) {
+    const CommandHeader chHeader = { cmdType, ctPayloadSize };
+    const size_t ctOffset = _abStream.size();
+    _abStream.resize(ctOffset + sizeof(CommandHeader) + ctPayloadSize);
+    // copy the header and the payload behind it
+    memcpy(&_abStream[ctOffset], &chHeader, sizeof(CommandHeader));
+    if (ctPayloadSize > 0) {
+        memcpy(&_abStream[ctOffset + sizeof(CommandHeader)], pPayload, ctPayloadSize);
+    }
+
+    // count the command
+    _csStatistics.actCommands[cmdType]++;
+    _csStatistics.ctBytes += sizeof(CommandHeader) + ctPayloadSize;
+}
+
+
+// Count a bind, checking whether it changes the bound state.
+void CommandCapture::CountBind(uint32_t &iBound, uint32_t iNew) {
+    if (iBound == iNew) {
+        _csStatistics.ctRedundantBinds++;
+    } else {
+        _csStatistics.ctStateChanges++;
+        iBound = iNew;
+    }
+}
+
+
+// Begin the main render pass, clearing color and depth.
+void CommandCapture::BeginRenderPass() {
+    WriteCommand(COMMAND_BEGIN_RENDER_PASS, nullptr, 0);
+}
+
+
+// Move from the depth pre-pass subpass to the subpass that shades the scene.
+void CommandCapture::NextSubpass() {
+    WriteCommand(COMMAND_NEXT_SUBPASS, nullptr, 0);
+}
+
+
+// End the main render pass.
+void CommandCapture::EndRenderPass() {
+    WriteCommand(COMMAND_END_RENDER_PASS, nullptr, 0);
+}
+
+
+// Bind a graphics pipeline.
+void CommandCapture::BindPipeline(uint32_t iPipeline) {
+    WriteCommand(COMMAND_BIND_PIPELINE, &iPipeline, sizeof(iPipeline));
+    CountBind(_iBoundPipeline, iPipeline);
+}
+
+
+// Bind the vertex and index buffers of a mesh.
+void CommandCapture::BindMeshBuffers(uint32_t iMesh) {
+    WriteCommand(COMMAND_BIND_MESH_BUFFERS, &iMesh, sizeof(iMesh));
+    CountBind(_iBoundMesh, iMesh);
+}
+
+
+// Bind a descriptor set holding per-frame data.
+void CommandCapture::BindDescriptorSet(uint32_t iDescriptorSet) {
+    WriteCommand(COMMAND_BIND_DESCRIPTOR_SET, &iDescriptorSet, sizeof(iDescriptorSet));
+    CountBind(_iBoundDescriptorSet, iDescriptorSet);
+}
+
+
+// Set the per-draw constants.
+void CommandCapture::PushConstants(const void *pData, uint32_t ctSize) {
+    // the data is copied into the stream, like a command buffer stores push constants
+    WriteCommand(COMMAND_PUSH_CONSTANTS, pData, ctSize);
+}
+
+
+// Issue a range of draw commands from the frame's indirect buffer.
+void CommandCapture::DrawIndexedIndirect(uint32_t iFirstCommand, uint32_t ctCommands) {
+    const uint32_t aiRange[] = { iFirstCommand, ctCommands };
+    WriteCommand(COMMAND_DRAW_INDEXED_INDIRECT, aiRange, sizeof(aiRange));
+    _csStatistics.ctIndirectDraws += ctCommands;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "../Renderer/CommandSink.h"
+
+// Command sink that stores the renderer's commands in memory instead of executing them, like a command buffer would.
+// Each command is written as a header followed by its payload. Counts commands, bytes and state changes, so the
+// CPU cost of the renderer and the quality of its draw ordering can be measured without a GPU.
+class CommandCapture : public CommandSink {
+public:
+    // Kinds of captured commands.
+    enum CommandType : uint8_t {
+        COMMAND_BEGIN_RENDER_PASS,
+        COMMAND_NEXT_SUBPASS,
+        COMMAND_END_RENDER_PASS,
+        COMMAND_BIND_PIPELINE,
+        COMMAND_BIND_MESH_BUFFERS,
+        COMMAND_BIND_DESCRIPTOR_SET,
+        COMMAND_PUSH_CONSTANTS,
+        COMMAND_DRAW_INDEXED_INDIRECT,
+        COMMAND_COUNT,
+    };
+
+    // Counters for one captured frame.
+    struct CaptureStatistics {
+        // Number of commands of each type.
+        uint32_t actCommands[COMMAND_COUNT];
+        // Size of the captured stream, in bytes.
+        uint32_t ctBytes;
+        // Binds that changed the bound state.
+        uint32_t ctStateChanges;
+        // Binds of state that was already bound, these are wasted work.
+        uint32_t ctRedundantBinds;
+        // Draws issued by the indirect commands.
+        uint32_t ctIndirectDraws;
+    };
+
+public:
+    CommandCapture() { Reset(); };
+    virtual ~CommandCapture() {};
+
+    // Start capturing a new frame, discarding the previous one. The stream's memory is reused.
+    void Reset();
+
+    // Get the captured command stream.
+    const std::vector<uint8_t> &GetStream() const { return _abStream; }
+    // Get the counters of the captured frame.
+    const CaptureStatistics &GetStatistics() const { return _csStatistics; }
+    // Get the total number of captured commands.
+    uint32_t GetCommandCount() const;
+
+    virtual void BeginRenderPass();
+    virtual void NextSubpass();
+    virtual void EndRenderPass();
+    virtual void BindPipeline(uint32_t iPipeline);
+    virtual void BindMeshBuffers(uint32_t iMesh);
+    virtual void BindDescriptorSet(uint32_t iDescriptorSet);
+    virtual void PushConstants(const void *pData, uint32_t ctSize);
+    virtual void DrawIndexedIndirect(uint32_t iFirstCommand, uint32_t ctCommands);
+
+private:
+    // Header in front of each captured command.
+    struct CommandHeader {
+        // Type of the command.
+        CommandType cmdType;
+        // Size of the payload that follows the header.
+        uint32_t ctPayloadSize;
+    };
+
+    // Append a command to the stream.
+    void WriteCommand(CommandType cmdType, const void *pPayload, uint32_t ctPayloadSize);
+    // Count a bind, checking whether it changes the bound state.
+    void CountBind(uint32_t &iBound, uint32_t iNew);
+
+private:
+    // Captured commands.
+    std::vector<uint8_t> _abStream;
+    // Counters for the captured frame.
+    CaptureStatistics _csStatistics;
+    // Currently bound state, to find the redundant binds.
+    uint32_t _iBoundPipeline;
+    uint32_t _iBoundMesh;
+    uint32_t _iBoundDescriptorSet;
+};
@@ -1,19 +1,108 @@
 #include "../PrecompiledHeader.h"
 #include "GfxAPINull.h"
+#include "../Memory/AllocationCounter.h"
+
+// Frames that may still allocate, while the arenas and the renderer's arrays grow to what a frame needs.
+static const uint32_t ctWarmupFrames = 10;
+
+
+// Stands in for vkCmdPipelineBarrier when executing the frame graph, the Null API has no command buffer to record to.
+static VKAPI_ATTR void VKAPI_CALL SkipPipelineBarrier(VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags, VkDependencyFlags,
+    uint32_t, const VkMemoryBarrier *, uint32_t, const VkBufferMemoryBarrier *, uint32_t, const VkImageMemoryBarrier *) {
+}
 
 
 // Initialize the API. Returns true if successfull.
-bool GfxAPINull::Initialize(uint32_t dimWidth, uint32_t dimHeight) {
+bool GfxAPINull::Initialize(uint32_t dimWidth, uint32_t dimHeight, const SceneSimulation &ssScene) {
+    // load the model for the scene's objects
+    srRenderer.Initialize(ssScene.GetObjectCount());
+    // there is no swap chain, the window dimensions are used as the render extent
+    srRenderer.SetExtent(dimWidth, dimHeight);
+    // allocate the memory the renderer writes the draw commands to
+    adicIndirectCommands.resize(srRenderer.GetMaxIndirectCommands());
+    // the frames' transient memory, with room for the job workers
+    for (FrameArena &faFrame : afaFrameArenas) {
+        faFrame.Initialize();
+    }
+    // the texture would be uploaded and ready for sampling
+    isTexture = RenderGraph::GetIdleState(RenderGraph::IMAGE_USAGE_SHADER_READ);
     return true;
 }
 
 
-// Destroy the API. Returns true if successfull.
+// Destroy the API. Returns true if successfull. Reports the per-frame averages of the captured frames, and the heap
+// allocations of the frames after the warm-up ones.
 bool GfxAPINull::Destroy() {
+    if (ctFrames == 0) {
+        return true;
+    }
+
+    const double fFrames = ctFrames;
+    std::cout << "Null renderer, " << ctFrames << " frames:" << std::endl
+        << "  prepare " << tmTotalPrepare / fFrames * 1000000.0 << " us, record " << tmTotalRecord / fFrames * 1000000.0 << " us per frame" << std::endl
+        << "  " << ctTotalCommands / fFrames << " commands, " << ctTotalBytes / fFrames << " bytes, "
+        << ctTotalDraws / fFrames << " indirect draws per frame" << std::endl
+        << "  " << ctTotalStateChanges / fFrames << " state changes, " << ctTotalRedundantBinds / fFrames << " redundant binds per frame" << std::endl
+        << "  " << ctTotalImageBarriers / fFrames << " image barriers per frame" << std::endl;
+    if (!bHeapAllocationsCounted) {
+        std::cout << "  heap allocations not counted, build with COUNT_HEAP_ALLOCATIONS to count them" << std::endl;
+    } else if (ctSteadyFrames > 0) {
+        std::cout << "  " << double(ctSteadyAllocations) / ctSteadyFrames << " heap allocations per frame after " << ctWarmupFrames << " warm-up frames" << std::endl;
+    }
     return true;
 }
 
+
 // Render a frame.
-void GfxAPINull::Render() {
-    return;
+void GfxAPINull::Render(const SceneSimulation &ssScene, float fInterpolation) {
+    // frames are rendered one after the other, so the frames that used the next arena are finished
+    const uint64_t ctStartAllocations = GetHeapAllocationCount();
+    FrameArena &faFrame = afaFrameArenas[iFrameArena];
+    iFrameArena = (iFrameArena + 1) % ctFrameArenaSlots;
+    faFrame.Reset();
+
+    // run the frame logic
+    auto tmPrepareStart = std::chrono::high_resolution_clock::now();
+    ssScene.WriteFramePacket(fInterpolation, fpPacket);
+    // the Null API has no depth to test against, so all objects are drawn in the early phase
+    srRenderer.PrepareFrame(fpPacket, uboUniforms, adicIndirectCommands.data(), nullptr, faFrame);
+
+    // capture the commands instead of recording a command buffer, through the same frame graph as the Vulkan API - the
+    // images are null handles, so only the scheduling of the barriers runs, over the frame's arena
+    auto tmRecordStart = std::chrono::high_resolution_clock::now();
+    ccCapture.Reset();
+    isColorTarget = RenderGraph::GetAcquiredState();
+    rgFrameGraph.Reset(faFrame.GetArena());
+    const uint32_t iColorTarget = rgFrameGraph.ImportImage(VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, isColorTarget);
+    rgFrameGraph.MarkOutput(iColorTarget, RenderGraph::IMAGE_USAGE_PRESENT);
+    const uint32_t iDepthTarget = rgFrameGraph.ImportTransientImage(VK_NULL_HANDLE, VK_IMAGE_ASPECT_DEPTH_BIT);
+    const uint32_t iTexture = rgFrameGraph.ImportImage(VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, isTexture);
+    const uint32_t iMainPass = rgFrameGraph.AddPass("Main", [this](VkCommandBuffer) {
+        srRenderer.RecordFrame(ccCapture, false);
+    });
+    rgFrameGraph.WriteImage(iMainPass, iColorTarget, RenderGraph::IMAGE_USAGE_COLOR_ATTACHMENT);
+    rgFrameGraph.WriteImage(iMainPass, iDepthTarget, RenderGraph::IMAGE_USAGE_DEPTH_ATTACHMENT);
+    rgFrameGraph.ReadImage(iMainPass, iTexture, RenderGraph::IMAGE_USAGE_SHADER_READ);
+    rgFrameGraph.Compile();
+    rgFrameGraph.Execute(VK_NULL_HANDLE, SkipPipelineBarrier);
+    auto tmRecordEnd = std::chrono::high_resolution_clock::now();
+
+    // accumulate the timings and counters
+    tmTotalPrepare += std::chrono::duration<double>(tmRecordStart - tmPrepareStart).count();
+    tmTotalRecord += std::chrono::duration<double>(tmRecordEnd - tmRecordStart).count();
+    const CommandCapture::CaptureStatistics &csStatistics = ccCapture.GetStatistics();
+    ctTotalCommands += ccCapture.GetCommandCount();
+    ctTotalBytes += csStatistics.ctBytes;
+    ctTotalStateChanges += csStatistics.ctStateChanges;
+    ctTotalRedundantBinds += csStatistics.ctRedundantBinds;
+    ctTotalDraws += csStatistics.ctIndirectDraws;
+    ctTotalImageBarriers += rgFrameGraph.GetStatistics().ctImageBarriers;
+    ctFrames++;
+    // once everything grew to its size, a frame shouldn't touch the heap at all
+    if (ctFrames > ctWarmupFrames) {
+        const uint64_t ctFrameAllocations = GetHeapAllocationCount() - ctStartAllocations;
+        assert(ctFrameAllocations == 0);
+        ctSteadyAllocations += ctFrameAllocations;
+        ctSteadyFrames++;
+    }
 }
@@ -1,20 +1,62 @@
 #pragma once
 #include "../GfxAPI/GfxAPI.h"
+#include "../Renderer/SceneRenderer.h"
+#include "../GfxAPIVulkan/RenderGraph.h"
+#include "CommandCapture.h"
 
-// Implementation of the Null graphics api. It reports success on all commands, but doesn't actually do anything.
+// Implementation of the Null graphics api. It doesn't talk to any GPU, but runs the full frame logic of the renderer
+// and captures the resulting commands in memory, so that the CPU side of rendering can be profiled on any machine.
+// Frames are rendered on the calling thread, one after the other.
 class GfxAPINull : public GfxAPI {
 private:
-    GfxAPINull() {};
+    GfxAPINull() : iFrameArena(0), ctFrames(0), ctSteadyFrames(0), ctSteadyAllocations(0), tmTotalPrepare(0.0), tmTotalRecord(0.0), ctTotalCommands(0), ctTotalBytes(0), ctTotalStateChanges(0), ctTotalRedundantBinds(0), ctTotalDraws(0), ctTotalImageBarriers(0) {};
     ~GfxAPINull() {};
     friend class GfxAPI;
 
 public:
     // Initialize the API. Returns true if successfull.
-    virtual bool Initialize(uint32_t dimWidth, uint32_t dimHeight);
-    // Destroy the API. Returns true if successfull.
+    virtual bool Initialize(uint32_t dimWidth, uint32_t dimHeight, const SceneSimulation &ssScene);
+    // Destroy the API. Returns true if successfull. Reports the per-frame averages of the captured frames, and the heap
+    // allocations of the frames after the warm-up ones, in builds that count them.
     virtual bool Destroy();
 
     // Render a frame.
-    virtual void Render();
-};
+    virtual void Render(const SceneSimulation &ssScene, float fInterpolation);
+
+private:
+    // State of the scene in the current frame.
+    FramePacket fpPacket;
+    // API independent part of rendering - culling and draw list.
+    SceneRenderer srRenderer;
+    // Receives the commands of the current frame.
+    CommandCapture ccCapture;
+    // Frame constants, in CPU memory instead of a uniform buffer.
+    UniformBufferObject uboUniforms;
+    // Draw commands, in CPU memory instead of an indirect buffer.
+    std::vector<VkDrawIndexedIndirectCommand> adicIndirectCommands;
+    // Transient memory of the frames, used in turn, and the one the next frame uses.
+    std::array<FrameArena, ctFrameArenaSlots> afaFrameArenas;
+    uint32_t iFrameArena;
+    // Passes of the frame and the barriers between them, scheduled like in the Vulkan API but on images that don't exist.
+    RenderGraph rgFrameGraph;
+    // States of the stand-ins for the swap chain image and the texture between frames.
+    RenderGraph::ImageState isColorTarget;
+    RenderGraph::ImageState isTexture;
 
+    // Number of rendered frames.
+    uint32_t ctFrames;
+    // Frames after the warm-up, and the heap allocations made in them.
+    uint32_t ctSteadyFrames;
+    uint64_t ctSteadyAllocations;
+    // Time spent preparing and recording frames, in seconds.
+    double tmTotalPrepare;
+    double tmTotalRecord;
+    // Totals of the capture counters over all frames.
+    uint64_t ctTotalCommands;
+    uint64_t ctTotalBytes;
+    uint64_t ctTotalStateChanges;
+    uint64_t ctTotalRedundantBinds;
+    uint64_t ctTotalDraws;
+    // Total of the image barriers the frame graph scheduled.
+    uint64_t ctTotalImageBarriers;
+};
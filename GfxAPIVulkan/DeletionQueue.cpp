@@ -0,0 +1,75 @@
+#include "../PrecompiledHeader.h"
+#include "DeletionQueue.h"
+
+
+// Set the timeline of the queue that uses the objects, and the pools that retired handles are returned to.
+void DeletionQueue::Initialize(QueueTimeline &qtTimeline, BufferPool &bpBuffers, ImagePool &ipImages, PipelinePool &ppPipelines) {
+    _pqtTimeline = &qtTimeline;
+    _pbpBuffers = &bpBuffers;
+    _pipImages = &ipImages;
+    _pppPipelines = &ppPipelines;
+}
+
+
+// Destroy the retired objects whose work completed.
+void DeletionQueue::Collect() {
+    CollectUpTo(_pqtTimeline->GetCompletedValue());
+}
+
+
+// Destroy all retired objects.
+void DeletionQueue::Drain() {
+    CollectUpTo(std::numeric_limits<uint64_t>::max());
+}
+
+
+// Destroy the retired objects last used by work up to a timeline value.
+void DeletionQueue::CollectUpTo(uint64_t iCompletedValue) {
+    // take the objects out under the lock, and destroy them without it, so that destroying may retire more objects
+    std::vector<RetiredObject> aroCollected;
+    {
+        std::lock_guard<std::mutex> lock(_mtxRetired);
+        auto itFirstKept = std::find_if(_aroRetired.begin(), _aroRetired.end(), [iCompletedValue](const RetiredObject &roObject) {
+            return roObject.iLastUse > iCompletedValue;
+        });
+        if (itFirstKept == _aroRetired.begin()) {
+            return;
+        }
+        aroCollected.assign(std::make_move_iterator(_aroRetired.begin()), std::make_move_iterator(itFirstKept));
+        _aroRetired.erase(_aroRetired.begin(), itFirstKept);
+    }
+    for (RetiredObject &roObject : aroCollected) {
+        roObject.fnDestroy();
+    }
+}
+
+
+// Retire a buffer.
+void DeletionQueue::Retire(BufferHandle bhBuffer) {
+    BufferPool *pbpBuffers = _pbpBuffers;
+    Retire([pbpBuffers, bhBuffer]() { pbpBuffers->Destroy(bhBuffer); });
+}
+
+
+// Retire an image.
+void DeletionQueue::Retire(ImageHandle ihImage) {
+    ImagePool *pipImages = _pipImages;
+    Retire([pipImages, ihImage]() { pipImages->Destroy(ihImage); });
+}
+
+
+// Retire a pipeline.
+void DeletionQueue::Retire(PipelineHandle phPipeline) {
+    PipelinePool *pppPipelines = _pppPipelines;
+    Retire([pppPipelines, phPipeline]() { pppPipelines->Destroy(phPipeline); });
+}
+
+
+// Retire any other object.
+void DeletionQueue::Retire(const std::function<void()> &fnDestroy) {
+    std::lock_guard<std::mutex> lock(_mtxRetired);
+    RetiredObject roObject;
+    roObject.iLastUse = _pqtTimeline->GetSubmittedValue();
+    roObject.fnDestroy = fnDestroy;
+    _aroRetired.push_back(std::move(roObject));
+}
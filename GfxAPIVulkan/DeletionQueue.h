@@ -0,0 +1,50 @@
+#pragma once
+#include "ResourcePools.h"
+#include "QueueTimeline.h"
+#include <functional>
+
+// Objects that were replaced while the GPU may still use them, destroyed once it no longer does. A retired object may
+// be used by any work submitted so far, so it is tagged with the last value submitted on the queue's timeline and
+// destroyed once the timeline reached it - replacing a resource then never waits for the device.
+// Pooled resources are retired by their handles, other objects with a function that destroys them.
+class DeletionQueue {
+public:
+    DeletionQueue() : _pqtTimeline(nullptr), _pbpBuffers(nullptr), _pipImages(nullptr), _pppPipelines(nullptr) {};
+    ~DeletionQueue() {};
+
+    // Set the timeline of the queue that uses the objects, and the pools that retired handles are returned to.
+    void Initialize(QueueTimeline &qtTimeline, BufferPool &bpBuffers, ImagePool &ipImages, PipelinePool &ppPipelines);
+
+    // Destroy the retired objects whose work completed.
+    void Collect();
+    // Destroy all retired objects. Only once the device is idle.
+    void Drain();
+
+    // Retire a pooled resource, destroying it once the work submitted so far completed.
+    void Retire(BufferHandle bhBuffer);
+    void Retire(ImageHandle ihImage);
+    void Retire(PipelineHandle phPipeline);
+    // Retire any other object, calling fnDestroy once the work submitted so far completed.
+    void Retire(const std::function<void()> &fnDestroy);
+
+private:
+    // Destroy the retired objects last used by work up to a timeline value.
+    void CollectUpTo(uint64_t iCompletedValue);
+
+private:
+    // A retired object.
+    struct RetiredObject {
+        // Timeline value of the last work that may use the object.
+        uint64_t iLastUse;
+        std::function<void()> fnDestroy;
+    };
+
+    QueueTimeline *_pqtTimeline;
+    BufferPool *_pbpBuffers;
+    ImagePool *_pipImages;
+    PipelinePool *_pppPipelines;
+    // Retired objects, in the order they were retired, so their timeline values only grow.
+    std::vector<RetiredObject> _aroRetired;
+    // Guards the retired objects - objects may be retired on any thread.
+    std::mutex _mtxRetired;
+};
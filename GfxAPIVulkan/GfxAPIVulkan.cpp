@@ -7,18 +7,28 @@
 #include "../Options.h"
 #include "../GfxAPI/Window.h"
 
+#include "../Mesh/MeshCache.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "../ThirdParty/stb_image.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "../ThirdParty/tiny_obj_loader.h"
-
 // List of validation layers' names that we want to enable.
 const std::vector<const char*> validationLayers = {
     // this is a standard set of validation layers, not a single layer
     "VK_LAYER_LUNARG_standard_validation"
 };
 
+// Longest time the main thread waits for room in the packet queue, before it goes back to processing events.
+static const std::chrono::milliseconds tmMaxPacketWait(4);
+
+// Formats the depth buffer can use, in order of preference.
+static const std::vector<VkFormat> afmtDepthFormats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+
+// Most buffers, images and pipelines the resource pools hold.
+static const uint32_t ctMaxBuffers = 4096;
+static const uint32_t ctMaxImages = 1024;
+static const uint32_t ctMaxPipelines = 256;
+
 
 // Callback that will be invoked on errors in validation layers
 static VKAPI_ATTR VkBool32 VKAPI_CALL ValidationErrorCallback(
@@ -43,7 +53,7 @@ void GfxAPIVulkan::OnWindowResizedCallback(GLFWwindow* window, int width, int he
 }
 
 // Initialize the API. Returns true if successfull.
-bool GfxAPIVulkan::Initialize(uint32_t dimWidth, uint32_t dimHeight) {
+bool GfxAPIVulkan::Initialize(uint32_t dimWidth, uint32_t dimHeight, const SceneSimulation &ssScene) {
     // create a window with the required dimensions
     CreateWindow(dimWidth, dimHeight);
     // create the vulkan instance
@@ -56,11 +66,35 @@ bool GfxAPIVulkan::Initialize(uint32_t dimWidth, uint32_t dimHeight) {
     SelectPhysicalDevice();
     // create the logical device
     CreateLogicalDevice();
+    // and the timeline its work is submitted through
+    qtGraphics.Initialize(vkhLogicalDevice, vkhGraphicsQueue);
+    iUploadTicket = 0;
+    // as are the pooled resources
+    bpBuffers.Initialize(vkhLogicalDevice, ctMaxBuffers);
+    ipImages.Initialize(vkhLogicalDevice, ctMaxImages);
+    ppPipelines.Initialize(vkhLogicalDevice, ctMaxPipelines);
+    dqRetired.Initialize(qtGraphics, bpBuffers, ipImages, ppPipelines);
+    // transient attachments are created on it
+    tapAttachments.Initialize(vkhPhysicalDevice, vkhLogicalDevice);
+    // and staging buffers for uploads
+    ubUploads.Initialize(vkhLogicalDevice);
+    // create the compute pipelines that cull occluded objects
+    InitializeOcclusionCulling();
+    // create the queries for measuring GPU frame time
+    CreateTimestampQueries();
+    // and for counting fragment shader invocations
+    CreateStatisticsQueries();
+    // pace frames to the configured frame rate
+    fpPacer.Initialize(Options::Get().GetTargetFrameRate());
 
     // create the swap chain
-    CreateSwapChain();
+    CreateSwapChain(VK_NULL_HANDLE);
     // create image views
     CreateImageViews();
+    // select the sample count of the render targets
+    SelectSampleCount();
+    // and the extent the scene is rendered at
+    SelectRenderExtent();
     // create the render pass
     CreateRenderPass();
     // create descriptor set layout
@@ -70,8 +104,8 @@ bool GfxAPIVulkan::Initialize(uint32_t dimWidth, uint32_t dimHeight) {
     // create the command pool
     CreateCommandPool();
 
-    // create resources needed for depth testing
-    CreateDepthResources();
+    // create the depth buffer and the multisampled color target
+    CreateAttachments();
     // create the framebuffers
     CreateFramebuffers();
 
@@ -82,14 +116,26 @@ bool GfxAPIVulkan::Initialize(uint32_t dimWidth, uint32_t dimHeight) {
     // create a sampler for the texture
     CreateImageSampler();
 
-    // load the example model
-    LoadModel();
+    // load the example model and place the objects in the scene
+    LoadModel(ssScene.GetObjectCount());
+    // measure the scene's overdraw to decide on the depth pre-pass
+    dpsDepthPrepass.Initialize(Options::Get().GetDepthPrepassMode(), Options::Get().GetDepthPrepassOverdraw());
+    // create the indirect buffer, large enough for all meshlets of all objects
+    CreateIndirectBuffer();
+    // and the buffers for testing the objects against the depth pyramid
+    ocOcclusion.SetObjects(srRenderer.GetObjectCount(), bpBuffers.GetBuffer(bhIndirectBuffer), sizeof(VkDrawIndexedIndirectCommand) * srRenderer.GetMaxIndirectCommands());
     // create the vertex buffer
     CreateVertexBuffers();
+    // and the position-only stream for the depth pre-pass
+    CreatePositionBuffer();
     // create the index buffer
     CreateIndexBuffers();
+    // upload the texture, vertices and indices, all at once
+    SubmitUploads();
     // create uniform buffer
     CreateUniformBuffers();
+    // set up the renderer's camera for the render extent
+    srRenderer.SetExtent(exRenderExtent.width, exRenderExtent.height);
     // create the descriptor pool
     CreateDescriptorPool();
     // create the descriptor set
@@ -98,54 +144,80 @@ bool GfxAPIVulkan::Initialize(uint32_t dimWidth, uint32_t dimHeight) {
     // allocate command buffers
     CreateCommandBuffers();
 
-    // record the command buffers - NOTE: this is for the simple drawing from the tutorial.
-    RecordCommandBuffers();
-
     // create the semaphores
     CreateSemaphores();
 
+    // the frames' transient memory, with room for the job workers
+    for (FrameArena &faFrame : afaFrameArenas) {
+        faFrame.Initialize();
+    }
+    iFrameArena = 0;
+
+    // apply options changed while running
+    iOptionsListener = Options::AddChangeListener([this](uint32_t flgChanged) { OnOptionsChanged(flgChanged); });
+
+    // from here on, the render thread renders the frames
+    StartRenderThread();
+
     return true;
 }
 
 
 // Destroy the API. Returns true if successfull.
 bool GfxAPIVulkan::Destroy() {
+    // let the render thread finish the frames it was given
+    StopRenderThread();
     // wait for the logical device to finish its current batch of work
     vkDeviceWaitIdle(vkhLogicalDevice);
 
-    // destroy the swap chain
-    DestroySwapChain();
+    // report how well frames were paced
+    fpPacer.Report();
+    // and what each multisampling setting cost
+    for (const auto &dicCost : dicSampleCountCosts) {
+        std::cout << "MSAA " << dicCost.first << "x: " << dicCost.second.tmTotalGpu / dicCost.second.ctFrames * 1000.0 << " ms GPU per frame, "
+            << dicCost.second.ctFrames << " frames" << std::endl;
+    }
+    // and how many fragments were shaded with and without the depth pre-pass
+    dpsDepthPrepass.Report();
+    // and how many objects occlusion culling saved drawing
+    if (ctOcclusionFrames > 0) {
+        std::cout << "Occlusion culling: " << static_cast<double>(ctTotalOccluded) / ctOcclusionFrames << " objects culled per frame, "
+            << ctOcclusionFrames << " frames" << std::endl;
+    }
+    // stop listening for option changes
+    Options::RemoveChangeListener(iOptionsListener);
+
+    // retire the swap chain, and everything using it - destroyed with the other retired objects below
+    RetireSwapChain();
+
+    // destroy the occlusion culling pipelines and buffers
+    ocOcclusion.Destroy();
+
+    // destroy the timestamp and statistics queries
+    vkDestroyQueryPool(vkhLogicalDevice, vkhTimestampQueryPool, nullptr);
+    if (vkhStatisticsQueryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(vkhLogicalDevice, vkhStatisticsQueryPool, nullptr);
+    }
     
     // destroy the desctiptor pool
     vkDestroyDescriptorPool(vkhLogicalDevice, vkhDescriptorPool, nullptr);
     // destroy the descriptor set layout
     vkDestroyDescriptorSetLayout(vkhLogicalDevice, vkhDescriptorSetLayout, nullptr);
-    // destroy the uniform buffer
-    vkDestroyBuffer(vkhLogicalDevice, vkhUniformBuffer, nullptr);
-    // release memory used by the uniform buffer
-    vkFreeMemory(vkhLogicalDevice, vkhUniformBufferMemory, nullptr);
-
     // destroy the texture sampler
     vkDestroySampler(vkhLogicalDevice, vkhImageSampler, nullptr);
-    // destroy the image view for the texture
-    vkDestroyImageView(vkhLogicalDevice, vkhImageView, nullptr);
-    // destroy the texture
-    vkDestroyImage(vkhLogicalDevice, vkhImageData, nullptr);
-    // release memory used by the texture
-    vkFreeMemory(vkhLogicalDevice, vkhImageMemory, nullptr);
-
-    // destroy the vertex buffer
-    vkDestroyBuffer(vkhLogicalDevice, vkhVertexBuffer, nullptr);
-    // release memory used by the vertex buffer
-    vkFreeMemory(vkhLogicalDevice, vkhVertexBufferMemory, nullptr);
-
-    // destroy the uniform buffer
-    vkDestroyBuffer(vkhLogicalDevice, vkhIndexBuffer, nullptr);
-    // release memory used by the uniform buffer
-    vkFreeMemory(vkhLogicalDevice, vkhIndexBufferMemory, nullptr);
+
+    // the device is idle, so the retired objects are no longer used
+    dqRetired.Drain();
+    // destroy the pooled resources - the texture, and the vertex, index, uniform and indirect buffers, releasing
+    // their memory and the mappings of the ones that stayed mapped
+    ipImages.DestroyAll();
+    bpBuffers.DestroyAll();
+    ppPipelines.DestroyAll();
 
     // destroy semaphores
     DestroySemaphores();
+    // and the timeline, after the retired objects that waited for it
+    qtGraphics.Destroy();
     // destoy the command pool
     vkDestroyCommandPool(vkhLogicalDevice, vkhCommandPool, nullptr);
 
@@ -165,58 +237,148 @@ bool GfxAPIVulkan::Destroy() {
     return true;
 }
 
-// Initialize swap chain. Called on first initialization, but also on window resize.
+// Rebuild the swap chain and everything depending on it for the surface's current size. Called on window resize.
 void GfxAPIVulkan::InitializeSwapChain() {
-    // wait for the logical device to be idne
-    vkDeviceWaitIdle(vkhLogicalDevice);
-
-    // destroy the swap chain
-    DestroySwapChain();
-
-    // create the swap chain
-    CreateSwapChain();
+    // nothing waits for the device - the replaced objects are retired, and destroyed once the frames submitted so far
+    // completed; the descriptor sets pointing at them are rewritten in place, as each frame waited for its ticket
+    RetireRenderTargets();
+    RetireCommandBuffers();
+    RetireImageViews();
+
+    // create the swap chain for the surface's current size, from the old one
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkhPhysicalDevice, sfcSurface, &capsSurface);
+    CreateSwapChainFromCurrent();
     // create image views
     CreateImageViews();
+    // select the sample count of the render targets
+    SelectSampleCount();
+    // and the extent the scene is rendered at
+    SelectRenderExtent();
     // create the render pass
     CreateRenderPass();
     // create the graphics pipeline
     CreateGraphicsPipeline();
-    // create resources needed for depth testing
-    CreateDepthResources();
+    // create the depth buffer and the multisampled color target
+    CreateAttachments();
     // create the framebuffers
     CreateFramebuffers();
     // allocate command buffers
     CreateCommandBuffers();
-    // record the command buffers - NOTE: this is for the simple drawing from the tutorial.
-    RecordCommandBuffers();
-}
-
-// Destroy the swap chain.
-void GfxAPIVulkan::DestroySwapChain() {
-    // destroy the image view for depth
-    vkDestroyImageView(vkhLogicalDevice, vkhDeptImageView, nullptr);
-    // destroy the depth bugger
-    vkDestroyImage(vkhLogicalDevice, vkhDepthImageData, nullptr);
-    // release memory used by the depth buffer
-    vkFreeMemory(vkhLogicalDevice, vkhDepthImageMemory, nullptr);
-
-    // delete the command buffers
-    if (avkhCommandBuffers.size() > 0) {
-        vkFreeCommandBuffers(vkhLogicalDevice, vkhCommandPool, (uint32_t)avkhCommandBuffers.size(), avkhCommandBuffers.data());
-    }
-    // destroy the framebuffers
-    DestroyFramebuffers();
-
-    // destroy the pipeline
-    vkDestroyPipeline(vkhLogicalDevice, vkhPipeline, nullptr);
-	// destroy the pipeline layout
-	vkDestroyPipelineLayout(vkhLogicalDevice, vkhPipelineLayout, nullptr);
-	// destroy the render pass
-	vkDestroyRenderPass(vkhLogicalDevice, vkhRenderPass, nullptr);
-	// destroy the image views
-    DestroyImageViews();
-    // destroy the swap chain
-    vkDestroySwapchainKHR(vkhLogicalDevice, vkhSwapChain, nullptr);
+    // the projection depends on the extent, so the renderer's camera needs to be updated
+    srRenderer.SetExtent(exRenderExtent.width, exRenderExtent.height);
+}
+
+// Replace the swap chain with one using the current present mode and image count.
+void GfxAPIVulkan::ReplaceSwapChain() {
+    // if the surface's extent changed as well, everything that depends on the extent has to be rebuilt
+    const VkExtent2D exOldExtent = exExtent;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkhPhysicalDevice, sfcSurface, &capsSurface);
+    SelectSwapChainExtent();
+    if (exExtent.width != exOldExtent.width || exExtent.height != exOldExtent.height) {
+        InitializeSwapChain();
+        return;
+    }
+
+    // retire the objects that refer to the swap chain images - the render pass, pipeline and depth buffer stay
+    RetireCommandBuffers();
+    RetireFramebuffers();
+    RetireImageViews();
+
+    // create the new swap chain from the old one, which is retired too
+    CreateSwapChainFromCurrent();
+
+    // recreate the objects for the new images
+    CreateImageViews();
+    CreateFramebuffers();
+    CreateCommandBuffers();
+}
+
+
+// Recreate the render targets and the objects that depend on their sample count and extent.
+void GfxAPIVulkan::RecreateRenderTargets() {
+    // the frames submitted so far may still render to the old targets, they are destroyed once those completed
+    RetireRenderTargets();
+
+    // select the new sample count and render extent, and rebuild everything that uses them
+    SelectSampleCount();
+    SelectRenderExtent();
+    CreateRenderPass();
+    CreateGraphicsPipeline();
+    CreateAttachments();
+    CreateFramebuffers();
+    // the renderer's camera and level of detail selection depend on the render extent
+    srRenderer.SetExtent(exRenderExtent.width, exRenderExtent.height);
+}
+
+
+// Retire the render targets, the framebuffers, and the render pass and pipeline.
+void GfxAPIVulkan::RetireRenderTargets() {
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    // retire the image views for depth, multisampled color and scaled color
+    const VkImageView vkhOldDepthView = vkhDeptImageView;
+    const VkImageView vkhOldColorView = vkhColorImageView;
+    const VkImageView vkhOldScaledView = vkhScaledImageView;
+    dqRetired.Retire([vkhDevice, vkhOldDepthView, vkhOldColorView, vkhOldScaledView]() {
+        vkDestroyImageView(vkhDevice, vkhOldDepthView, nullptr);
+        if (vkhOldColorView != VK_NULL_HANDLE) {
+            vkDestroyImageView(vkhDevice, vkhOldColorView, nullptr);
+        }
+        if (vkhOldScaledView != VK_NULL_HANDLE) {
+            vkDestroyImageView(vkhDevice, vkhOldScaledView, nullptr);
+        }
+    });
+    vkhDeptImageView = VK_NULL_HANDLE;
+    vkhColorImageView = VK_NULL_HANDLE;
+    vkhScaledImageView = VK_NULL_HANDLE;
+    // retire the depth buffer and the other transient attachments with their memory - the new ones get a new allocation
+    tapAttachments.Retire(dqRetired);
+
+    // retire the framebuffers
+    RetireFramebuffers();
+
+    // retire the pipelines - their handles stay valid until the frames that may use them completed, and the new
+    // pipelines get new ones
+    for (PipelineHandle phPipeline : aphPipelines) {
+        dqRetired.Retire(phPipeline);
+    }
+    // retire the pipeline layout, the render pass, and the one continuing it after the occlusion test
+    const VkPipelineLayout vkhOldPipelineLayout = vkhPipelineLayout;
+    const VkRenderPass vkhOldRenderPass = vkhRenderPass;
+    const VkRenderPass vkhOldLoadRenderPass = vkhLoadRenderPass;
+    dqRetired.Retire([vkhDevice, vkhOldPipelineLayout, vkhOldRenderPass, vkhOldLoadRenderPass]() {
+        vkDestroyPipelineLayout(vkhDevice, vkhOldPipelineLayout, nullptr);
+        vkDestroyRenderPass(vkhDevice, vkhOldRenderPass, nullptr);
+        if (vkhOldLoadRenderPass != VK_NULL_HANDLE) {
+            vkDestroyRenderPass(vkhDevice, vkhOldLoadRenderPass, nullptr);
+        }
+    });
+    vkhLoadRenderPass = VK_NULL_HANDLE;
+}
+
+
+// Retire the swap chain and everything using it.
+void GfxAPIVulkan::RetireSwapChain() {
+    // retire the render targets and everything using them
+    RetireRenderTargets();
+    // the command buffers
+    RetireCommandBuffers();
+    // the image views
+    RetireImageViews();
+    // and the swap chain
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    const VkSwapchainKHR vkhOldSwapChain = vkhSwapChain;
+    dqRetired.Retire([vkhDevice, vkhOldSwapChain]() { vkDestroySwapchainKHR(vkhDevice, vkhOldSwapChain, nullptr); });
+    vkhSwapChain = VK_NULL_HANDLE;
+}
+
+
+// Create a swap chain from the current one, which is retired.
+void GfxAPIVulkan::CreateSwapChainFromCurrent() {
+    // the presentation engine hands over from the old swap chain, which may still be presenting submitted frames
+    const VkSwapchainKHR vkhOldSwapChain = vkhSwapChain;
+    CreateSwapChain(vkhOldSwapChain);
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    dqRetired.Retire([vkhDevice, vkhOldSwapChain]() { vkDestroySwapchainKHR(vkhDevice, vkhOldSwapChain, nullptr); });
 }
 
 // Initialize the GfxAPIVulkan window.
@@ -262,8 +424,8 @@ void GfxAPIVulkan::CreateInstance() {
     appInfo.pEngineName = "No Enging";
     // version of the engine
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    // version of the Vulkan API to use
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // version of the Vulkan API to use - 1.2 has timeline semaphores in the core
+    appInfo.apiVersion = VK_API_VERSION_1_2;
 
 
     // create the info about which extensions and validators we want to use
@@ -356,7 +518,7 @@ void GfxAPIVulkan::GetRequiredDeviceExtensions(std::vector<const char*> &astrReq
 
 
 // Check if all required device extensions are supported
-void GfxAPIVulkan::CheckDeviceExtensionSupport(const VkPhysicalDevice &device, const std::vector<const char*> &astrRequiredExtensions) const {
+bool GfxAPIVulkan::CheckDeviceExtensionSupport(const VkPhysicalDevice &device, const std::vector<const char*> &astrRequiredExtensions) const {
     // get the number of supported extensions
     uint32_t ctExtensions = 0;
     vkEnumerateDeviceExtensionProperties(device,nullptr, &ctExtensions, nullptr);
@@ -377,11 +539,12 @@ void GfxAPIVulkan::CheckDeviceExtensionSupport(const VkPhysicalDevice &device, c
                 break;
             }
         }
-        // if the extension was not found, throw an exception
+        // if the extension was not found, the device can't be used
         if (!bFound) {
-            throw std::runtime_error("Not all required extensions are supported");
+            return false;
         }
     }
+    return true;
 }
 
 // Set up the validation layers.
@@ -485,58 +648,119 @@ void GfxAPIVulkan::SelectPhysicalDevice() {
     std::vector<VkPhysicalDevice> aPhysicalDevices(ctDevices);
     vkEnumeratePhysicalDevices(vkhAPIInstance, &ctDevices, aPhysicalDevices.data());
 
-    // find the first physical device that fits the needs
-    for (const VkPhysicalDevice &device : aPhysicalDevices) {
-        if (IsDeviceSuitable(device)) {
-            vkhPhysicalDevice = device;
-            break;
+    // an explicit choice in the options overrides the scoring
+    const int32_t iForcedDevice = Options::Get().GetPhysicalDeviceIndex();
+    const std::string &strForcedName = Options::Get().GetPhysicalDeviceName();
+
+    // score all devices, remembering the best suitable one and the one matching the override
+    vkhPhysicalDevice = VK_NULL_HANDLE;
+    int64_t iBestScore = -1;
+    int32_t iBestDevice = -1;
+    int32_t iMatchedDevice = -1;
+    for (uint32_t iDevice = 0; iDevice < ctDevices; iDevice++) {
+        const VkPhysicalDevice &device = aPhysicalDevices[iDevice];
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+        std::cout << "Physical device " << iDevice << ": " << deviceProperties.deviceName << std::endl;
+
+        // the first device matching the override by index or by a part of its name is the one to use
+        const bool bMatchesIndex = iForcedDevice >= 0 && iForcedDevice == static_cast<int32_t>(iDevice);
+        const bool bMatchesName = !strForcedName.empty() && std::string(deviceProperties.deviceName).find(strForcedName) != std::string::npos;
+        if (iMatchedDevice < 0 && (bMatchesIndex || bMatchesName)) {
+            iMatchedDevice = iDevice;
+        }
+
+        // devices that can't run the application get no score
+        if (!IsDeviceSuitable(device)) {
+            continue;
+        }
+        const int64_t iScore = ScoreDevice(device);
+        std::cout << "    score " << iScore << std::endl;
+        if (iScore > iBestScore) {
+            iBestScore = iScore;
+            iBestDevice = iDevice;
         }
     }
 
+    // if an override was given, it must match a suitable device
+    int32_t iSelectedDevice = iBestDevice;
+    if (iForcedDevice >= 0 || !strForcedName.empty()) {
+        if (iMatchedDevice < 0) {
+            throw std::runtime_error("No physical device matches the one requested in the options");
+        }
+        if (!IsDeviceSuitable(aPhysicalDevices[iMatchedDevice])) {
+            throw std::runtime_error("The physical device requested in the options is not suitable");
+        }
+        iSelectedDevice = iMatchedDevice;
+    }
+
     // if no suitable physical device was found, throw
-    if (vkhPhysicalDevice == VK_NULL_HANDLE) {
+    if (iSelectedDevice < 0) {
         throw std::runtime_error("No suitable physical device found");
     }
+    std::cout << "Selected physical device " << iSelectedDevice
+        << (iSelectedDevice == iMatchedDevice ? " (requested in the options)" : " (highest score)") << std::endl;
+
+    // the queue families and swap chain support of the last device scored are in the members, so query them again
+    vkhPhysicalDevice = aPhysicalDevices[iSelectedDevice];
+    FindQueueFamilies(vkhPhysicalDevice);
+    QuerySwapChainSupport(vkhPhysicalDevice);
 }
 
 
-// Does the device support all required features?
+// Does the device support all required features? Logs the reason a device is rejected.
 bool GfxAPIVulkan::IsDeviceSuitable(const VkPhysicalDevice &device) {
-    // get the data for properties of this device
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    // get the data about supported features
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-    // the device must support anisotropy
-    if (!deviceFeatures.samplerAnisotropy) {
-        return false;
-    }
-
-    // NOTE: This is only an example of device property and feature selection, the real implementation would be more elaborate
-    // and would probably select the best device available
-    // the GfxAPIVulkan requires a discrete GPU and geometry shader support
-    if (deviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU || !deviceFeatures.geometryShader) {
-        return false;
-    }
-
     // find indices of queue families needed to support all application's features.
     FindQueueFamilies(device);
     // if the queue families don't support all reqired features, the app can't work
     if (!IsQueueFamiliesSuitable()) {
+        std::cout << "    rejected: no graphics or presentation queue" << std::endl;
         return false;
     }
 
-    // before trying to create the instance, check if all required extensions are supported
+    // check if all required extensions are supported
     std::vector<const char*> astrRequiredExtensions;
     GetRequiredDeviceExtensions(astrRequiredExtensions);
-    CheckDeviceExtensionSupport(device, astrRequiredExtensions);
+    if (!CheckDeviceExtensionSupport(device, astrRequiredExtensions)) {
+        std::cout << "    rejected: missing required device extensions" << std::endl;
+        return false;
+    }
 
     // get swap chain feature information
     QuerySwapChainSupport(device);
     // if the surface doesn't support any formats or present modes, the device isn't suitable
     if (afmtFormats.empty() || apmPresentModes.empty()) {
+        std::cout << "    rejected: no surface formats or present modes" << std::endl;
+        return false;
+    }
+
+    // the device must be able to render depth in one of the formats the renderer uses
+    bool bDepthFormat = false;
+    for (VkFormat fmtFormat : afmtDepthFormats) {
+        VkFormatProperties propsFormat;
+        vkGetPhysicalDeviceFormatProperties(device, fmtFormat, &propsFormat);
+        bDepthFormat |= (propsFormat.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
+    }
+    if (!bDepthFormat) {
+        std::cout << "    rejected: no supported depth format" << std::endl;
+        return false;
+    }
+
+    // queue work is synchronized with timeline semaphores, which need Vulkan 1.2
+    VkPhysicalDeviceProperties propsDevice;
+    vkGetPhysicalDeviceProperties(device, &propsDevice);
+    if (propsDevice.apiVersion < VK_API_VERSION_1_2) {
+        std::cout << "    rejected: no Vulkan 1.2" << std::endl;
+        return false;
+    }
+    VkPhysicalDeviceVulkan12Features featVulkan12 = {};
+    featVulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 featDevice = {};
+    featDevice.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    featDevice.pNext = &featVulkan12;
+    vkGetPhysicalDeviceFeatures2(device, &featDevice);
+    if (featVulkan12.timelineSemaphore != VK_TRUE) {
+        std::cout << "    rejected: no timeline semaphores" << std::endl;
         return false;
     }
 
@@ -544,8 +768,71 @@ bool GfxAPIVulkan::IsDeviceSuitable(const VkPhysicalDevice &device) {
 }
 
 
+// Score a suitable device, higher is better. Logs what the score is based on.
+int64_t GfxAPIVulkan::ScoreDevice(const VkPhysicalDevice &device) const {
+    // get the data for properties of this device
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    // get the data about supported features
+    VkPhysicalDeviceFeatures deviceFeatures;
+    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+    // get the memory heaps
+    VkPhysicalDeviceMemoryProperties propsMemory;
+    vkGetPhysicalDeviceMemoryProperties(device, &propsMemory);
+
+    // the device type matters most - a dedicated GPU is faster than a shared one, which is faster than a software rasterizer
+    int64_t iTypeRank = 0;
+    const char *strType = "other";
+    switch (deviceProperties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   iTypeRank = 4; strType = "discrete GPU"; break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: iTypeRank = 3; strType = "integrated GPU"; break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    iTypeRank = 2; strType = "virtual GPU"; break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:            iTypeRank = 1; strType = "CPU"; break;
+    default: break;
+    }
+
+    // then the optional features and formats the renderer makes use of
+    int64_t iFeatureRank = 0;
+    // one indirect call per object instead of one per meshlet
+    if (deviceFeatures.multiDrawIndirect) {
+        iFeatureRank += 2;
+    }
+    // sharper textures at oblique angles
+    if (deviceFeatures.samplerAnisotropy) {
+        iFeatureRank += 1;
+    }
+    // depth without an unused stencil component
+    VkFormatProperties propsDepthFormat;
+    vkGetPhysicalDeviceFormatProperties(device, VK_FORMAT_D32_SFLOAT, &propsDepthFormat);
+    if (propsDepthFormat.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+        iFeatureRank += 1;
+    }
+
+    // and last, the size of the largest device local heap, which tells cards of the same kind apart
+    VkDeviceSize ctDeviceLocalSize = 0;
+    for (uint32_t iHeap = 0; iHeap < propsMemory.memoryHeapCount; iHeap++) {
+        if (propsMemory.memoryHeaps[iHeap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            ctDeviceLocalSize = std::max(ctDeviceLocalSize, propsMemory.memoryHeaps[iHeap].size);
+        }
+    }
+    const int64_t ctDeviceLocalMB = static_cast<int64_t>(ctDeviceLocalSize >> 20);
+
+    std::cout << "    " << strType << ", " << ctDeviceLocalMB << " MB device local"
+        << (deviceFeatures.multiDrawIndirect ? ", multi-draw indirect" : "")
+        << (deviceFeatures.samplerAnisotropy ? ", anisotropic filtering" : "")
+        << ((propsDepthFormat.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) ? ", D32 depth" : "") << std::endl;
+
+    // rank by type, then by features, then by memory size - the memory size in MB stays well below 2^32
+    return (iTypeRank << 40) | (iFeatureRank << 32) | std::min<int64_t>(ctDeviceLocalMB, 0xFFFFFFFF);
+}
+
+
 // Find indices of queue families needed to support all application's features.
 void GfxAPIVulkan::FindQueueFamilies(const VkPhysicalDevice &device) {
+    // the indices found for a previously examined device don't apply
+    iGraphicsQueueFamily = -1;
+    iPresentationQueueFamily = -1;
+
     // enumerate the available queue families
     uint32_t ctQueueFamilies = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(device, &ctQueueFamilies, nullptr);
@@ -557,7 +844,7 @@ void GfxAPIVulkan::FindQueueFamilies(const VkPhysicalDevice &device) {
     for (uint32_t iQueueFamily = 0; iQueueFamily < ctQueueFamilies; iQueueFamily++) {
         const auto &qfQueueFamily = aQueueFamilies[iQueueFamily];
         // if this is the first queue family that supports graphics commands, store its index
-        if (iGraphicsQueueFamily < 0 && qfQueueFamily.queueCount > 0 && (qfQueueFamily.queueFlags | VK_QUEUE_GRAPHICS_BIT)) {
+        if (iGraphicsQueueFamily < 0 && qfQueueFamily.queueCount > 0 && (qfQueueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
             iGraphicsQueueFamily = iQueueFamily;
         }
 
@@ -574,7 +861,7 @@ void GfxAPIVulkan::FindQueueFamilies(const VkPhysicalDevice &device) {
 
 // Do the queue families support all required features?
 bool GfxAPIVulkan::IsQueueFamiliesSuitable() const {
-    if (iGraphicsQueueFamily < 0) {
+    if (iGraphicsQueueFamily < 0 || iPresentationQueueFamily < 0) {
         return false;
     }
     return true;
@@ -601,14 +888,19 @@ void GfxAPIVulkan::QuerySwapChainSupport(const VkPhysicalDevice &device) {
 
 
 // Create the swap chain to use for presenting images.
-void GfxAPIVulkan::CreateSwapChain() {
+void GfxAPIVulkan::CreateSwapChain(VkSwapchainKHR vkhOldSwapChain) {
     // select swap chain format, present mode and extent to use
     SelectSwapChainFormat();
     SelectSwapChainPresentMode();
     SelectSwapChainExtent();
 
-    // select the number of images in the swap chain queue - one more than minimum, for tripple buffering
-    uint32_t ctImages = capsSurface.minImageCount + 1;
+    // select the number of images in the swap chain queue - as requested, or one more than minimum, for tripple buffering
+    uint32_t ctImages = Options::Get().GetSwapChainImageCount();
+    if (ctImages == 0) {
+        ctImages = capsSurface.minImageCount + 1;
+    }
+    // the surface needs at least its minimum
+    ctImages = std::max(ctImages, capsSurface.minImageCount);
     // maxImageCount of 0 indicates unlimited max images (limited by available memory)
     // if the number of images is limited to below the desired number, clamp to maximum
     if (capsSurface.maxImageCount > 0 && ctImages > capsSurface.maxImageCount) {
@@ -632,8 +924,9 @@ void GfxAPIVulkan::CreateSwapChain() {
 
     // image has only one layer (more is used for stereoscopic 3D)
     infoSwapChain.imageArrayLayers = 1;
-    // this specifies that this image will be rendered to directly
-    infoSwapChain.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // this specifies that this image will be rendered to directly - or, with a resolution scale, that the rendered
+    // image is scaled to it, if the surface allows it
+    infoSwapChain.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (capsSurface.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 
     // prepare queue familiy indices to be given to Vulkan
     uint32_t aQueueFamilyIndices[] = { (uint32_t)iGraphicsQueueFamily, (uint32_t)iPresentationQueueFamily };
@@ -662,10 +955,9 @@ void GfxAPIVulkan::CreateSwapChain() {
     // the image should be presented as opaque, no alpha blending
     infoSwapChain.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
-    // no old swapchain
-    // in some cases (e.g. window is resized) the swap chain must be recreated. Then, the handle to the old swap chain
-    // must be set. 
-    infoSwapChain.oldSwapchain = VK_NULL_HANDLE;
+    // in some cases (e.g. the present mode changes) the swap chain must be recreated. Then, the handle to the old swap
+    // chain is set, so that the presentation engine can hand over to the new one
+    infoSwapChain.oldSwapchain = vkhOldSwapChain;
 
     // create the swap chain
     if (vkCreateSwapchainKHR(vkhLogicalDevice, &infoSwapChain, nullptr, &vkhSwapChain) != VK_SUCCESS) {
@@ -705,6 +997,22 @@ void GfxAPIVulkan::SelectSwapChainFormat() {
 
 // Select the presentation mode to use.
 void GfxAPIVulkan::SelectSwapChainPresentMode() {
+    // if a present mode was requested and the surface supports it, use it
+    const PresentMode pmRequested = Options::Get().GetPresentMode();
+    if (pmRequested != PresentMode::PRESENT_MODE_AUTO) {
+        VkPresentModeKHR pmRequestedMode = VK_PRESENT_MODE_FIFO_KHR;
+        if (pmRequested == PresentMode::PRESENT_MODE_MAILBOX) {
+            pmRequestedMode = VK_PRESENT_MODE_MAILBOX_KHR;
+        } else if (pmRequested == PresentMode::PRESENT_MODE_IMMEDIATE) {
+            pmRequestedMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        if (std::find(apmPresentModes.begin(), apmPresentModes.end(), pmRequestedMode) != apmPresentModes.end()) {
+            pmSurfacePresentMode = pmRequestedMode;
+            return;
+        }
+        std::cout << "Requested present mode is not supported, selecting one automatically" << std::endl;
+    }
+
     // default to immediate presentation mode
     pmSurfacePresentMode = VK_PRESENT_MODE_FIFO_KHR;
 
@@ -751,12 +1059,17 @@ void GfxAPIVulkan::CreateImageViews() {
 }
 
 
-// Destroy the image views.
-void GfxAPIVulkan::DestroyImageViews() {
-    // for each swap chain image, create the view
-    for (VkImageView &imgvView : avkhImageViews) {
-        vkDestroyImageView(vkhLogicalDevice, imgvView, nullptr);
-    }
+// Retire the image views.
+void GfxAPIVulkan::RetireImageViews() {
+    // the views are destroyed once the frames rendering to them completed
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    std::vector<VkImageView> avkhOldViews;
+    avkhOldViews.swap(avkhImageViews);
+    dqRetired.Retire([vkhDevice, avkhOldViews]() {
+        for (VkImageView imgvView : avkhOldViews) {
+            vkDestroyImageView(vkhDevice, imgvView, nullptr);
+        }
+    });
 }
 
 
@@ -790,11 +1103,27 @@ void GfxAPIVulkan::CreateLogicalDevice() {
     // list the needed device features
     // NOTE: not specifying any for now, will revisit later
     VkPhysicalDeviceFeatures deviceFeatures = {};
-    // request texture sampling anisotropy
-    deviceFeatures.samplerAnisotropy = VK_TRUE;
+    VkPhysicalDeviceFeatures featSupported;
+    vkGetPhysicalDeviceFeatures(vkhPhysicalDevice, &featSupported);
+    // request texture sampling anisotropy when available - software devices may not have it
+    bSamplerAnisotropy = featSupported.samplerAnisotropy == VK_TRUE;
+    deviceFeatures.samplerAnisotropy = featSupported.samplerAnisotropy;
+
+    // use multi-draw indirect when available, it lets culling output be drawn with one call per object
+    bMultiDrawIndirect = featSupported.multiDrawIndirect == VK_TRUE;
+    deviceFeatures.multiDrawIndirect = featSupported.multiDrawIndirect;
+
+    // count fragment shader invocations when available, they decide whether the depth pre-pass pays off
+    bPipelineStatistics = featSupported.pipelineStatisticsQuery == VK_TRUE;
+    deviceFeatures.pipelineStatisticsQuery = featSupported.pipelineStatisticsQuery;
 
     // set required features
     infoLogicalDevice.pEnabledFeatures = &deviceFeatures;
+    // and timeline semaphores, which all suitable devices have
+    VkPhysicalDeviceVulkan12Features featVulkan12 = {};
+    featVulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    featVulkan12.timelineSemaphore = VK_TRUE;
+    infoLogicalDevice.pNext = &featVulkan12;
 
     // enable the required extensions
     std::vector<const char*> astrRequiredExtensions;
@@ -872,20 +1201,31 @@ std::vector<char> GfxAPIVulkan::LoadShader(const std::string &filename) {
 
 // Create the render pass.
 void GfxAPIVulkan::CreateRenderPass() {
+    // the main pass clears the attachments
+    vkhRenderPass = BuildRenderPass(false);
+    // with occlusion culling, the objects found visible by the test are drawn over its results in a second pass
+    vkhLoadRenderPass = bOcclusionCulling ? BuildRenderPass(true) : VK_NULL_HANDLE;
+}
+
+
+// Create a render pass that clears the attachments, or one that loads what an earlier pass rendered to them.
+VkRenderPass GfxAPIVulkan::BuildRenderPass(bool bLoadContents) {
+    // with multisampling, the scene is rendered to a multisampled color target that is resolved to the swap chain image
+    const bool bMultisampled = flgSamples != VK_SAMPLE_COUNT_1_BIT;
+
 	// describe the attachment used for the color target
 	VkAttachmentDescription descColorAttachment = {};
 	// color format is the same as the one in the swap chain
 	descColorAttachment.format = fmtSurfaceFormat.format;
-	// no multisampling, use one sample
-	descColorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	// the buffer should be cleared to a constant at the start
-	descColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	// rendered contents need to be stored so that thay can be used afterwards
-	descColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	// the initial layout of the image is not important
-	descColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	// final layout needs to be presented in the swap chain
-	descColorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// use the selected number of samples
+	descColorAttachment.samples = flgSamples;
+	// the buffer should be cleared to a constant at the start, unless the pass continues an earlier one
+	descColorAttachment.loadOp = bLoadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	// rendered contents need to be stored so that thay can be used afterwards - unless they are resolved within the pass
+	descColorAttachment.storeOp = bMultisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	// the frame graph transitions the image to the attachment layout before the pass, and for presenting after it
+	descColorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	descColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     // describe the attachment reference
     VkAttachmentReference refColorAttachment = {};
@@ -898,15 +1238,15 @@ void GfxAPIVulkan::CreateRenderPass() {
     VkAttachmentDescription descDepthAttachment = {};
     // find the format used for depth
     descDepthAttachment.format = FindDepthFormat();
-    // no multisampling, use one sample
-    descDepthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    // the buffer should be cleared to a constant at the start
-    descDepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    // don't care about storing after the pass is rendered
-    descDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    // the initial layout of the image is not important
-    descDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    // final layout is the depth buffer
+    // depth needs as many samples as color
+    descDepthAttachment.samples = flgSamples;
+    // the buffer should be cleared to a constant at the start, unless the pass continues an earlier one
+    descDepthAttachment.loadOp = bLoadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // with occlusion culling, the first pass' depth is needed for the depth pyramid and the second pass, otherwise
+    // there is no need to store it after the pass is rendered
+    descDepthAttachment.storeOp = bOcclusionCulling && !bLoadContents ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // the frame graph keeps the image in the depth attachment layout
+    descDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     descDepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     
     // describe the attachment reference
@@ -916,6 +1256,27 @@ void GfxAPIVulkan::CreateRenderPass() {
     // the attachment will function as a color buffer
     refDepthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+    // describe the attachment the multisampled color is resolved to - the swap chain image
+    VkAttachmentDescription descResolveAttachment = {};
+    descResolveAttachment.format = fmtSurfaceFormat.format;
+    descResolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    // every pixel is written by the resolve, so the previous contents don't matter
+    descResolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    descResolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    descResolveAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    descResolveAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // describe the attachment reference
+    VkAttachmentReference refResolveAttachment = {};
+    refResolveAttachment.attachment = 2;
+    refResolveAttachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // describe the depth pre-pass subpass - it only writes depth, and stays empty when the pre-pass isn't used
+    VkSubpassDescription descDepthSubPass = {};
+    descDepthSubPass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    descDepthSubPass.colorAttachmentCount = 0;
+    descDepthSubPass.pDepthStencilAttachment = &refDepthAttachment;
+
 	// describe the subpass needed
 	VkSubpassDescription descSubPass = {};
 	// this is a graphics subpass, not a compute one
@@ -925,41 +1286,42 @@ void GfxAPIVulkan::CreateRenderPass() {
 	descSubPass.pColorAttachments = &refColorAttachment;
     // bind the depth attachment
     descSubPass.pDepthStencilAttachment = &refDepthAttachment;
-
-    // describe the subpass dependency - making sure that the subpass doesn't begin before an buffer is available
-    VkSubpassDependency infDependency = {};
-    // the subpass waited on is the implicit subpass that usually happens at the start of the pipeline
-    infDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    // the subpass needs to wait until the swap chain is finished reading from the buffer (presenting the previous frame)
-    infDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    infDependency.srcAccessMask = 0;
-    // the dependant subpass is the apps subpass
-    infDependency.dstSubpass = 0;
-    // the operations that should wait are reading and writing of the color buffer
-    infDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    infDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    // resolve the multisampled color at the end of the subpass, while it is still in tile memory on tiled GPUs
+    descSubPass.pResolveAttachments = bMultisampled ? &refResolveAttachment : nullptr;
+
+    // the main subpass tests against the depth the pre-pass wrote - per region, so tiled GPUs keep depth in tile memory
+    VkSubpassDependency depDepthPrepass = {};
+    depDepthPrepass.srcSubpass = 0;
+    depDepthPrepass.dstSubpass = 1;
+    depDepthPrepass.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    depDepthPrepass.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    depDepthPrepass.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depDepthPrepass.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depDepthPrepass.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
     // description of the render pass to create
 	VkRenderPassCreateInfo infoRenderPass = {};
 	infoRenderPass.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    // bind the subpass
-    infoRenderPass.subpassCount = 1;
-    infoRenderPass.pSubpasses = &descSubPass;
-    // bind the dependency
-    infoRenderPass.dependencyCount = 0;
-    infoRenderPass.pDependencies = &infDependency;
-
-    // create the array of attachments
-    std::array<VkAttachmentDescription, 2> ainfoAttachments = { descColorAttachment, descDepthAttachment };
+    // bind the subpasses - the depth pre-pass, then the one shading the scene
+    std::array<VkSubpassDescription, 2> adescSubPasses = { descDepthSubPass, descSubPass };
+    infoRenderPass.subpassCount = static_cast<uint32_t>(adescSubPasses.size());
+    infoRenderPass.pSubpasses = adescSubPasses.data();
+    // only the dependency between the subpasses - the frame graph records the barriers around the pass
+    infoRenderPass.dependencyCount = 1;
+    infoRenderPass.pDependencies = &depDepthPrepass;
+
+    // create the array of attachments, the resolve attachment is only used with multisampling
+    std::array<VkAttachmentDescription, 3> ainfoAttachments = { descColorAttachment, descDepthAttachment, descResolveAttachment };
 	// bind the color attachment
-	infoRenderPass.attachmentCount = static_cast<uint32_t>(ainfoAttachments.size());
+	infoRenderPass.attachmentCount = bMultisampled ? 3 : 2;
 	infoRenderPass.pAttachments = ainfoAttachments.data();
 
 	// finally, create the render pass
-	if (vkCreateRenderPass(vkhLogicalDevice, &infoRenderPass, nullptr, &vkhRenderPass) != VK_SUCCESS) {
+    VkRenderPass vkhPass;
+	if (vkCreateRenderPass(vkhLogicalDevice, &infoRenderPass, nullptr, &vkhPass) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create the render pass");
 	}
-
+    return vkhPass;
 }
 
 
@@ -1038,11 +1400,11 @@ void GfxAPIVulkan::CreateGraphicsPipeline() {
 	VkPipelineVertexInputStateCreateInfo infoVertexInput = {};
 	infoVertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	// bind the binding descriptions
-    auto descBinding = Vertex::GetBindingDescription();
+    auto descBinding = VertexLayout<Vertex>::GetBindingDescription();
 	infoVertexInput.vertexBindingDescriptionCount = 1;
 	infoVertexInput.pVertexBindingDescriptions = &descBinding;
 	// bind the vertex attributes
-    auto adescAttributes = Vertex::GetAttributeDescriptions();
+    auto adescAttributes = VertexLayout<Vertex>::GetAttributeDescriptions();
 	infoVertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(adescAttributes.size());
 	infoVertexInput.pVertexAttributeDescriptions = adescAttributes.data();
 
@@ -1060,8 +1422,8 @@ void GfxAPIVulkan::CreateGraphicsPipeline() {
 	// viweport coves the full screen
 	vpViewport.x = 0.0f;
 	vpViewport.y = 0.0f;
-	vpViewport.width = (float) exExtent.width;
-	vpViewport.height = (float) exExtent.height;
+	vpViewport.width = (float) exRenderExtent.width;
+	vpViewport.height = (float) exRenderExtent.height;
 	// full range of depths
 	vpViewport.minDepth = 0.0f;
 	vpViewport.maxDepth = 1.0f;
@@ -1069,7 +1431,7 @@ void GfxAPIVulkan::CreateGraphicsPipeline() {
 	// set up the scissor to also cover the full screen
 	VkRect2D rectScissor = {};
 	rectScissor.offset = { 0, 0 };
-	rectScissor.extent = exExtent;
+	rectScissor.extent = exRenderExtent;
 
 	// describe the viewport state for the pipeline
 	VkPipelineViewportStateCreateInfo infoViewportState = {};
@@ -1107,11 +1469,12 @@ void GfxAPIVulkan::CreateGraphicsPipeline() {
 	// describe the multisampling configuration
 	VkPipelineMultisampleStateCreateInfo infoMultisampling = {};
 	infoMultisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	// multisampling is disabled
+	// shade once per pixel, coverage and depth are tested per sample
 	infoMultisampling.sampleShadingEnable = VK_FALSE;
+	// rasterize with the sample count of the render targets
+	infoMultisampling.rasterizationSamples = flgSamples;
 	// set the rest of multisampling values to the simplest
 	// NOTE: they are not described in the tutorial, so no comments for them at this point
-	infoMultisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 	infoMultisampling.minSampleShading = 1.0f;
 	infoMultisampling.pSampleMask = nullptr;
 	infoMultisampling.alphaToCoverageEnable = VK_FALSE;
@@ -1155,9 +1518,17 @@ void GfxAPIVulkan::CreateGraphicsPipeline() {
     // bind the descriptor set layout
 	infoPipelineLayout.setLayoutCount = 1;
 	infoPipelineLayout.pSetLayouts = &vkhDescriptorSetLayout;
-    // not using push constants at the moment
-	infoPipelineLayout.pushConstantRangeCount = 0;
-	infoPipelineLayout.pPushConstantRanges = 0;
+
+    // describe the push constant range holding the per-draw data
+    VkPushConstantRange infoPushConstantRange = {};
+    // per-draw data is only read by the vertex shader
+    infoPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    // the block starts at the beginning and covers the whole per-draw struct
+    infoPushConstantRange.offset = 0;
+    infoPushConstantRange.size = sizeof(DrawConstants);
+    // bind the push constant range
+	infoPipelineLayout.pushConstantRangeCount = 1;
+	infoPipelineLayout.pPushConstantRanges = &infoPushConstantRange;
 
 	// create the pipeline layout
 	if (vkCreatePipelineLayout(vkhLogicalDevice, &infoPipelineLayout, nullptr, &vkhPipelineLayout) != VK_SUCCESS) {
@@ -1198,19 +1569,57 @@ void GfxAPIVulkan::CreateGraphicsPipeline() {
     infoGraphicsPipeline.pDynamicState = nullptr;
     // set the pipeline layout
     infoGraphicsPipeline.layout = vkhPipelineLayout;
-    // set up the render pass
+    // set up the render pass - the scene is shaded in the subpass after the depth pre-pass
     infoGraphicsPipeline.renderPass = vkhRenderPass;
-    infoGraphicsPipeline.subpass = 0;
+    infoGraphicsPipeline.subpass = 1;
     // this pipeline doesn't derive from another pipeline (could be done as an optimization)
     infoGraphicsPipeline.basePipelineHandle = VK_NULL_HANDLE;
     infoGraphicsPipeline.basePipelineIndex = -1;
 
-    // create the graphics pipeline
-    if (vkCreateGraphicsPipelines(vkhLogicalDevice, VK_NULL_HANDLE, 1, &infoGraphicsPipeline, nullptr, &vkhPipeline) != VK_SUCCESS) {
+    // after the depth pre-pass, depth is final - only the fragments that wrote it are shaded, and it isn't written again
+    VkPipelineDepthStencilStateCreateInfo infoDepthEqualState = infoPipelineDepthStencilState;
+    infoDepthEqualState.depthWriteEnable = VK_FALSE;
+    infoDepthEqualState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    VkGraphicsPipelineCreateInfo infoDepthEqualPipeline = infoGraphicsPipeline;
+    infoDepthEqualPipeline.pDepthStencilState = &infoDepthEqualState;
+
+    // the depth pre-pass only runs the vertex shader, on the position-only stream
+    VkShaderModule modDepthVert = CreateShaderModule("d:/Work/VulcanTutorial/Shaders/depth_vert.spv");
+    VkPipelineShaderStageCreateInfo infoShaderStageDepthVert = infoShaderStageVert;
+    infoShaderStageDepthVert.module = modDepthVert;
+
+    VkPipelineVertexInputStateCreateInfo infoPositionInput = infoVertexInput;
+    auto descPositionBinding = VertexLayout<VertexPosition>::GetBindingDescription();
+    infoPositionInput.vertexBindingDescriptionCount = 1;
+    infoPositionInput.pVertexBindingDescriptions = &descPositionBinding;
+    auto adescPositionAttributes = VertexLayout<VertexPosition>::GetAttributeDescriptions();
+    infoPositionInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(adescPositionAttributes.size());
+    infoPositionInput.pVertexAttributeDescriptions = adescPositionAttributes.data();
+
+    // the pre-pass subpass has no color attachments
+    VkPipelineColorBlendStateCreateInfo infoDepthOnlyBlendState = infoColorBlendState;
+    infoDepthOnlyBlendState.attachmentCount = 0;
+    infoDepthOnlyBlendState.pAttachments = nullptr;
+
+    VkGraphicsPipelineCreateInfo infoDepthPrepassPipeline = infoGraphicsPipeline;
+    infoDepthPrepassPipeline.stageCount = 1;
+    infoDepthPrepassPipeline.pStages = &infoShaderStageDepthVert;
+    infoDepthPrepassPipeline.pVertexInputState = &infoPositionInput;
+    infoDepthPrepassPipeline.pColorBlendState = &infoDepthOnlyBlendState;
+    infoDepthPrepassPipeline.subpass = 0;
+
+    // create the graphics pipelines, all at once
+    std::array<VkGraphicsPipelineCreateInfo, 3> ainfoPipelines = { infoGraphicsPipeline, infoDepthEqualPipeline, infoDepthPrepassPipeline };
+    std::array<VkPipeline, 3> avkhPipelines;
+    if (vkCreateGraphicsPipelines(vkhLogicalDevice, VK_NULL_HANDLE, static_cast<uint32_t>(ainfoPipelines.size()), ainfoPipelines.data(), nullptr, avkhPipelines.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create the graphics pipeline");
     }
+    aphPipelines[iMainPipeline] = ppPipelines.Add(avkhPipelines[0], VK_PIPELINE_BIND_POINT_GRAPHICS);
+    aphPipelines[iDepthEqualPipeline] = ppPipelines.Add(avkhPipelines[1], VK_PIPELINE_BIND_POINT_GRAPHICS);
+    aphPipelines[iDepthPrepassPipeline] = ppPipelines.Add(avkhPipelines[2], VK_PIPELINE_BIND_POINT_GRAPHICS);
 
     // destroy shader modules - they are a part of the graphics pipeline
+    vkDestroyShaderModule(vkhLogicalDevice, modDepthVert, nullptr);
     vkDestroyShaderModule(vkhLogicalDevice, modFrag, nullptr);
     vkDestroyShaderModule(vkhLogicalDevice, modVert, nullptr);
 }
@@ -1226,24 +1635,31 @@ void GfxAPIVulkan::CreateFramebuffers() {
     infoFramebuffer.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
     // bind the render pass
     infoFramebuffer.renderPass = vkhRenderPass;
-    // set the extends for the frame buffer
-    infoFramebuffer.width = exExtent.width;
-    infoFramebuffer.height = exExtent.height;
+    // set the extends for the frame buffer - the scene is rendered at the render extent
+    infoFramebuffer.width = exRenderExtent.width;
+    infoFramebuffer.height = exRenderExtent.height;
     // only one layer
     infoFramebuffer.layers = 1;
 
     // create a frame buffer for each image view
     for (int iImageView = 0; iImageView < avkhImageViews.size(); iImageView++) {
-        // create the image view attachment
-        std::array<VkImageView, 2> avkhAttachments = {
-            avkhImageViews[iImageView],
+        // the scene ends up in the swap chain image, or in the scaled color image that is scaled to it afterwards
+        const VkImageView vkhTargetView = vkhScaledImageView != VK_NULL_HANDLE ? vkhScaledImageView : avkhImageViews[iImageView];
+        // create the image view attachment - with multisampling, the target is the resolve target and the
+        // multisampled color image is rendered to
+        std::array<VkImageView, 3> avkhAttachments = {
+            vkhTargetView,
             vkhDeptImageView,
+            VK_NULL_HANDLE,
         };
+        if (flgSamples != VK_SAMPLE_COUNT_1_BIT) {
+            avkhAttachments = { vkhColorImageView, vkhDeptImageView, vkhTargetView };
+        }
 
         // bind the image view to the framebuffer
         infoFramebuffer.pAttachments = avkhAttachments.data();
-        // there will only be one image view
-        infoFramebuffer.attachmentCount = static_cast<uint32_t>(avkhAttachments.size());
+        // the resolve target is only used with multisampling
+        infoFramebuffer.attachmentCount = flgSamples != VK_SAMPLE_COUNT_1_BIT ? 3 : 2;
 
         // create the framebuffer
         if (vkCreateFramebuffer(vkhLogicalDevice, &infoFramebuffer, nullptr, &avkhFramebuffers[iImageView]) != VK_SUCCESS) {
@@ -1252,11 +1668,16 @@ void GfxAPIVulkan::CreateFramebuffers() {
     }
 }
 
-// Destroy the framebuffers.
-void GfxAPIVulkan::DestroyFramebuffers() {
-    for (VkFramebuffer vkhFramebuffer : avkhFramebuffers) {
-        vkDestroyFramebuffer(vkhLogicalDevice, vkhFramebuffer, nullptr);
-    }
+// Retire the framebuffers.
+void GfxAPIVulkan::RetireFramebuffers() {
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    std::vector<VkFramebuffer> avkhOldFramebuffers;
+    avkhOldFramebuffers.swap(avkhFramebuffers);
+    dqRetired.Retire([vkhDevice, avkhOldFramebuffers]() {
+        for (VkFramebuffer vkhFramebuffer : avkhOldFramebuffers) {
+            vkDestroyFramebuffer(vkhDevice, vkhFramebuffer, nullptr);
+        }
+    });
 }
 
 
@@ -1267,8 +1688,8 @@ void GfxAPIVulkan::CreateCommandPool() {
     infoCommandPool.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     // bind the graphics queue family to the command pool
     infoCommandPool.queueFamilyIndex = iGraphicsQueueFamily;
-    // clear all flags
-    infoCommandPool.flags = 0;
+    // command buffers are re-recorded every frame, so they need to be individually resettable
+    infoCommandPool.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     // create the command pool
     if (vkCreateCommandPool(vkhLogicalDevice, &infoCommandPool, nullptr, &vkhCommandPool) != VK_SUCCESS) {
@@ -1298,16 +1719,143 @@ void GfxAPIVulkan::CreateCommandBuffers() {
 }
 
 
-// Record the command buffers - NOTE: this is for the simple drawing from the tutorial.
-void GfxAPIVulkan::RecordCommandBuffers() {
-    //  describe how the command buffers will be used
+// Retire the command buffers.
+void GfxAPIVulkan::RetireCommandBuffers() {
+    // a command buffer is freed once the frame it was submitted with completed - the pool is only touched on the render
+    // thread, or while it is idle
+    if (avkhCommandBuffers.empty()) {
+        return;
+    }
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    const VkCommandPool vkhPool = vkhCommandPool;
+    std::vector<VkCommandBuffer> avkhOldCommandBuffers;
+    avkhOldCommandBuffers.swap(avkhCommandBuffers);
+    dqRetired.Retire([vkhDevice, vkhPool, avkhOldCommandBuffers]() {
+        vkFreeCommandBuffers(vkhDevice, vkhPool, static_cast<uint32_t>(avkhOldCommandBuffers.size()), avkhOldCommandBuffers.data());
+    });
+}
+
+
+// Record the command buffer for a swap chain image. Done every frame, the renderer builds the draws through a VulkanCommandSink.
+void GfxAPIVulkan::RecordCommandBuffer(uint32_t iImage, FrameArena &faFrame) {
+    //  describe how the command buffer will be used
     VkCommandBufferBeginInfo infoCommandBufferBegin = {};
     infoCommandBufferBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    // it is possible that the command buffer will be resubmitted before the prebious submission has finished executing
-    infoCommandBufferBegin.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    // the buffer is re-recorded before each submission
+    infoCommandBufferBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     // primary command buffers don't inherit from anything
     infoCommandBufferBegin.pInheritanceInfo = nullptr;
 
+    // begin the command buffer - this implicitly resets whatever was recorded in the previous use
+    VkCommandBuffer &vkhCommandBuffer = avkhCommandBuffers[iImage];
+    vkBeginCommandBuffer(vkhCommandBuffer, &infoCommandBufferBegin);
+
+    // mark the start of the frame's GPU work
+    if (flgTimestampMask != 0) {
+        vkCmdResetQueryPool(vkhCommandBuffer, vkhTimestampQueryPool, 0, 2);
+        vkCmdWriteTimestamp(vkhCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vkhTimestampQueryPool, 0);
+    }
+
+    // record the frame's passes, with the barriers between them
+    BuildFrameGraph(iImage, faFrame);
+    rgFrameGraph.Execute(vkhCommandBuffer);
+
+    // and its end, once all commands have finished
+    if (flgTimestampMask != 0) {
+        vkCmdWriteTimestamp(vkhCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkhTimestampQueryPool, 1);
+    }
+
+    // end the command buffer
+    if (vkEndCommandBuffer(vkhCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer");
+    }
+}
+
+
+// Declare the frame's passes and the images they use to the frame graph, and compile it.
+void GfxAPIVulkan::BuildFrameGraph(uint32_t iImage, FrameArena &faFrame) {
+    rgFrameGraph.Reset(faFrame.GetArena());
+
+    // import the images - the swap chain image is the frame's result, and is presented afterwards
+    const uint32_t iColorTarget = rgFrameGraph.ImportImage(avkhImages[iImage], VK_IMAGE_ASPECT_COLOR_BIT, isSwapChainImage);
+    rgFrameGraph.MarkOutput(iColorTarget, RenderGraph::IMAGE_USAGE_PRESENT);
+    const uint32_t iDepthTarget = rgFrameGraph.ImportTransientImage(vkhDepthImageData, flgDepthAspect);
+    // with multisampling, the scene is rendered to the multisampled target and resolved to the swap chain image
+    const bool bMultisampled = flgSamples != VK_SAMPLE_COUNT_1_BIT;
+    const uint32_t iMultisampledTarget = bMultisampled ? rgFrameGraph.ImportTransientImage(vkhColorImageData, VK_IMAGE_ASPECT_COLOR_BIT) : 0;
+    const uint32_t iTexture = rgFrameGraph.ImportImage(ipImages.GetImage(ihTexture), VK_IMAGE_ASPECT_COLOR_BIT, isTextureImage);
+    // with a resolution scale, the scene is rendered to the scaled target, which is then scaled to the swap chain image
+    const bool bScaled = vkhScaledImageData != VK_NULL_HANDLE;
+    const uint32_t iScaledTarget = bScaled ? rgFrameGraph.ImportTransientImage(vkhScaledImageData, VK_IMAGE_ASPECT_COLOR_BIT) : 0;
+    const uint32_t iSceneTarget = bScaled ? iScaledTarget : iColorTarget;
+
+    // the main pass draws the scene through the renderer - with occlusion culling, the objects visible in the last frame
+    const uint32_t iMainPass = rgFrameGraph.AddPass("Main", [this, iImage](VkCommandBuffer vkhCommandBuffer) {
+        // count the fragments the pass shades, to measure overdraw
+        if (bPipelineStatistics) {
+            vkCmdResetQueryPool(vkhCommandBuffer, vkhStatisticsQueryPool, 0, bOcclusionCulling ? 2 : 1);
+            vkCmdBeginQuery(vkhCommandBuffer, vkhStatisticsQueryPool, 0, 0);
+        }
+        VulkanCommandSink csSink(*this, iImage, false);
+        srRenderer.RecordFrame(csSink, false);
+        if (bPipelineStatistics) {
+            vkCmdEndQuery(vkhCommandBuffer, vkhStatisticsQueryPool, 0);
+        }
+    });
+    rgFrameGraph.WriteImage(iMainPass, iSceneTarget, RenderGraph::IMAGE_USAGE_COLOR_ATTACHMENT);
+    if (bMultisampled) {
+        rgFrameGraph.WriteImage(iMainPass, iMultisampledTarget, RenderGraph::IMAGE_USAGE_COLOR_ATTACHMENT);
+    }
+    rgFrameGraph.WriteImage(iMainPass, iDepthTarget, RenderGraph::IMAGE_USAGE_DEPTH_ATTACHMENT);
+    rgFrameGraph.ReadImage(iMainPass, iTexture, RenderGraph::IMAGE_USAGE_SHADER_READ);
+
+    if (bOcclusionCulling) {
+        // build the depth pyramid from the main pass' depth and test all objects against it - the results are the
+        // indirect commands and the visibility, which the graph doesn't track, so the pass must not be culled
+        const uint32_t iHiZPass = rgFrameGraph.AddPass("HiZ", [this](VkCommandBuffer vkhCommandBuffer) {
+            ocOcclusion.Record(vkhCommandBuffer, puboUniforms->tViewProjection);
+        });
+        rgFrameGraph.ReadImage(iHiZPass, iDepthTarget, RenderGraph::IMAGE_USAGE_COMPUTE_READ);
+        rgFrameGraph.KeepPass(iHiZPass);
+
+        // draw the objects that weren't visible in the last frame - the test emptied the commands of the hidden ones
+        const uint32_t iMainLatePass = rgFrameGraph.AddPass("MainLate", [this, iImage](VkCommandBuffer vkhCommandBuffer) {
+            if (bPipelineStatistics) {
+                vkCmdBeginQuery(vkhCommandBuffer, vkhStatisticsQueryPool, 1, 0);
+            }
+            VulkanCommandSink csSink(*this, iImage, true);
+            srRenderer.RecordFrame(csSink, true);
+            if (bPipelineStatistics) {
+                vkCmdEndQuery(vkhCommandBuffer, vkhStatisticsQueryPool, 1);
+            }
+        });
+        rgFrameGraph.WriteImage(iMainLatePass, iSceneTarget, RenderGraph::IMAGE_USAGE_COLOR_ATTACHMENT);
+        rgFrameGraph.WriteImage(iMainLatePass, iDepthTarget, RenderGraph::IMAGE_USAGE_DEPTH_ATTACHMENT);
+        rgFrameGraph.ReadImage(iMainLatePass, iTexture, RenderGraph::IMAGE_USAGE_SHADER_READ);
+    }
+
+    if (bScaled) {
+        // scale the rendered image to the whole swap chain image, filtered
+        const uint32_t iUpscalePass = rgFrameGraph.AddPass("Upscale", [this, iImage](VkCommandBuffer vkhCommandBuffer) {
+            VkImageBlit blitScale = {};
+            blitScale.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            blitScale.srcOffsets[1] = { static_cast<int32_t>(exRenderExtent.width), static_cast<int32_t>(exRenderExtent.height), 1 };
+            blitScale.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            blitScale.dstOffsets[1] = { static_cast<int32_t>(exExtent.width), static_cast<int32_t>(exExtent.height), 1 };
+            vkCmdBlitImage(vkhCommandBuffer, vkhScaledImageData, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, avkhImages[iImage], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blitScale, VK_FILTER_LINEAR);
+        });
+        rgFrameGraph.ReadImage(iUpscalePass, iScaledTarget, RenderGraph::IMAGE_USAGE_TRANSFER_SOURCE);
+        rgFrameGraph.WriteImage(iUpscalePass, iColorTarget, RenderGraph::IMAGE_USAGE_TRANSFER_DESTINATION);
+    }
+
+    // schedule the barriers
+    rgFrameGraph.Compile();
+}
+
+
+// Begin the main render pass, clearing color and depth - or after the occlusion test, keeping them.
+void GfxAPIVulkan::VulkanCommandSink::BeginRenderPass() {
     // define the fraembuffer clear color as black
     std::array<VkClearValue, 2> acolClearColors = {};
     acolClearColors[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
@@ -1316,52 +1864,179 @@ void GfxAPIVulkan::RecordCommandBuffers() {
     // describe how the render pass will be used
     VkRenderPassBeginInfo infoRenderPassBegin = {};
     infoRenderPassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    // bind the render pass definition
-    infoRenderPassBegin.renderPass = vkhRenderPass;
+    // bind the render pass definition - the late draws continue the main pass' rendering
+    infoRenderPassBegin.renderPass = _bLatePhase ? _gfxVulkan.vkhLoadRenderPass : _gfxVulkan.vkhRenderPass;
+    // bind the frame buffer to the render pass
+    infoRenderPassBegin.framebuffer = _gfxVulkan.avkhFramebuffers[_iImage];
     // set the render area
     infoRenderPassBegin.renderArea.offset = { 0,0 };
-    infoRenderPassBegin.renderArea.extent = exExtent;
+    infoRenderPassBegin.renderArea.extent = _gfxVulkan.exRenderExtent;
     // set the clear color
     infoRenderPassBegin.clearValueCount = static_cast<uint32_t>(acolClearColors.size());
     infoRenderPassBegin.pClearValues = acolClearColors.data();
 
-    // record the same commands in all buffers
-    for (int iCommandBuffer = 0; iCommandBuffer < avkhCommandBuffers.size(); iCommandBuffer++) {
-        VkCommandBuffer &vkhCommandBuffer = avkhCommandBuffers[iCommandBuffer];
-        // begin the command buffer
-        vkBeginCommandBuffer(vkhCommandBuffer, &infoCommandBufferBegin);
+    // issue (record) the command to begin the render pass, with the command executed from the primary buffer
+    vkCmdBeginRenderPass(_vkhCommandBuffer, &infoRenderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-        // bind the frame buffer to the render pass
-        infoRenderPassBegin.framebuffer = avkhFramebuffers[iCommandBuffer];
 
-        // issue (record) the command to begin the render pass, with the command executed from the primary buffer
-        vkCmdBeginRenderPass(vkhCommandBuffer, &infoRenderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-        // issue the command to bind the graphics pipeline
-        vkCmdBindPipeline(vkhCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkhPipeline);
+// Move from the depth pre-pass subpass to the subpass that shades the scene.
+void GfxAPIVulkan::VulkanCommandSink::NextSubpass() {
+    vkCmdNextSubpass(_vkhCommandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-        // bind the vertex buffer
-        VkBuffer avkhBuffers[] = { vkhVertexBuffer };
-        VkDeviceSize actOffsets[] = { 0 };
-        vkCmdBindVertexBuffers(vkhCommandBuffer, 0, 1, avkhBuffers, actOffsets);
-        // bind the index buffer
-        vkCmdBindIndexBuffer(vkhCommandBuffer, vkhIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-        // bind the descriptor sets
-        vkCmdBindDescriptorSets(vkhCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkhPipelineLayout, 0, 1, &vkhDescriptorSet, 0, nullptr);
+// End the main render pass.
+void GfxAPIVulkan::VulkanCommandSink::EndRenderPass() {
+    // issue the command to end the render pass
+    vkCmdEndRenderPass(_vkhCommandBuffer);
+}
+
+
+// Bind a graphics pipeline. The pipeline id picks its handle, and the handle its slot in the pool.
+void GfxAPIVulkan::VulkanCommandSink::BindPipeline(uint32_t iPipeline) {
+    assert(iPipeline < ctRendererPipelines);
+    const PipelineHandle phPipeline = _gfxVulkan.aphPipelines[iPipeline];
+    // issue the command to bind the graphics pipeline
+    vkCmdBindPipeline(_vkhCommandBuffer, _gfxVulkan.ppPipelines.GetBindPoint(phPipeline), _gfxVulkan.ppPipelines.GetPipeline(phPipeline));
+}
+
+
+// Bind the vertex and index buffers of a mesh. There is only the model's mesh so far, with all attributes or positions only.
+void GfxAPIVulkan::VulkanCommandSink::BindMeshBuffers(uint32_t iMesh) {
+    assert(iMesh < ctRendererMeshes);
+    // bind the vertex buffer - the position stream has the same vertex order, so the indices and draws are shared
+    VkBuffer avkhBuffers[] = { _gfxVulkan.bpBuffers.GetBuffer(_gfxVulkan.abhMeshVertexBuffers[iMesh]) };
+    VkDeviceSize actOffsets[] = { 0 };
+    vkCmdBindVertexBuffers(_vkhCommandBuffer, 0, 1, avkhBuffers, actOffsets);
+    // bind the index buffer
+    vkCmdBindIndexBuffer(_vkhCommandBuffer, _gfxVulkan.bpBuffers.GetBuffer(_gfxVulkan.bhIndexBuffer), 0, VK_INDEX_TYPE_UINT32);
+}
+
+
+// Bind a descriptor set holding per-frame data. There is only the frame's set so far.
+void GfxAPIVulkan::VulkanCommandSink::BindDescriptorSet(uint32_t iDescriptorSet) {
+    assert(iDescriptorSet == iFrameDescriptorSet);
+    vkCmdBindDescriptorSets(_vkhCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _gfxVulkan.vkhPipelineLayout, 0, 1, &_gfxVulkan.vkhDescriptorSet, 0, nullptr);
+}
+
 
-        // issue the draw command to draw index buffers
-        vkCmdDrawIndexed(vkhCommandBuffer, static_cast<uint32_t>(aiIndices.size()), 1, 0, 0, 0);
+// Set the per-draw constants.
+void GfxAPIVulkan::VulkanCommandSink::PushConstants(const void *pData, uint32_t ctSize) {
+    // the data is stored in the command buffer, so no memory writes or descriptor binds are needed
+    vkCmdPushConstants(_vkhCommandBuffer, _gfxVulkan.vkhPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, ctSize, pData);
+}
 
-        // issue the command to end the render pass
-        vkCmdEndRenderPass(vkhCommandBuffer);
 
-        // end the command buffer
-        if (vkEndCommandBuffer(vkhCommandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to record command buffer");
+// Issue a range of draw commands from the frame's indirect buffer.
+void GfxAPIVulkan::VulkanCommandSink::DrawIndexedIndirect(uint32_t iFirstCommand, uint32_t ctCommands) {
+    // issue all the draws with one call if the device allows it, otherwise one call per command
+    const VkDeviceSize slFirstCommand = iFirstCommand * sizeof(VkDrawIndexedIndirectCommand);
+    const VkBuffer vkhIndirectBuffer = _gfxVulkan.bpBuffers.GetBuffer(_gfxVulkan.bhIndirectBuffer);
+    if (_gfxVulkan.bMultiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(_vkhCommandBuffer, vkhIndirectBuffer, slFirstCommand, ctCommands, sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+        for (uint32_t iCommand = 0; iCommand < ctCommands; iCommand++) {
+            vkCmdDrawIndexedIndirect(_vkhCommandBuffer, vkhIndirectBuffer, slFirstCommand + iCommand * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
         }
     }
 }
 
+// Create the query pool used to measure the GPU time of a frame.
+void GfxAPIVulkan::CreateTimestampQueries() {
+    // the graphics queue reports how many bits of its timestamps are valid, if any
+    uint32_t ctQueueFamilies = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vkhPhysicalDevice, &ctQueueFamilies, nullptr);
+    std::vector<VkQueueFamilyProperties> aQueueFamilies(ctQueueFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(vkhPhysicalDevice, &ctQueueFamilies, aQueueFamilies.data());
+    const uint32_t ctValidBits = aQueueFamilies[iGraphicsQueueFamily].timestampValidBits;
+    flgTimestampMask = ctValidBits >= 64 ? ~0ull : (1ull << ctValidBits) - 1;
+
+    // the tick length converts timestamps to time
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkhPhysicalDevice, &deviceProperties);
+    fTimestampPeriod = deviceProperties.limits.timestampPeriod;
+
+    // one timestamp at the start of the frame and one at the end
+    VkQueryPoolCreateInfo infoQueryPool = {};
+    infoQueryPool.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    infoQueryPool.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    infoQueryPool.queryCount = 2;
+    if (vkCreateQueryPool(vkhLogicalDevice, &infoQueryPool, nullptr, &vkhTimestampQueryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the timestamp query pool");
+    }
+}
+
+
+// Get the GPU time of the last frame, in seconds, or a negative value if the device can't measure it.
+double GfxAPIVulkan::GetGpuFrameTime() {
+    if (flgTimestampMask == 0) {
+        return -1.0;
+    }
+    // the frame has finished, so the results are available without waiting
+    uint64_t aullTimestamps[2];
+    if (vkGetQueryPoolResults(vkhLogicalDevice, vkhTimestampQueryPool, 0, 2, sizeof(aullTimestamps), aullTimestamps, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return -1.0;
+    }
+    // the counter may wrap around within its valid bits
+    const uint64_t ctTicks = (aullTimestamps[1] - aullTimestamps[0]) & flgTimestampMask;
+    return ctTicks * fTimestampPeriod * 1e-9;
+}
+
+
+// Create the query pool used to count the fragment shader invocations of a frame.
+void GfxAPIVulkan::CreateStatisticsQueries() {
+    vkhStatisticsQueryPool = VK_NULL_HANDLE;
+    if (!bPipelineStatistics) {
+        return;
+    }
+
+    // one query around the main pass and one around its continuation after the occlusion test, counting only the
+    // fragment shader invocations
+    VkQueryPoolCreateInfo infoQueryPool = {};
+    infoQueryPool.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    infoQueryPool.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    infoQueryPool.queryCount = 2;
+    infoQueryPool.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    if (vkCreateQueryPool(vkhLogicalDevice, &infoQueryPool, nullptr, &vkhStatisticsQueryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the pipeline statistics query pool");
+    }
+}
+
+
+// Get the fragment shader invocations of the last frame, or a negative value if the device can't count them.
+int64_t GfxAPIVulkan::GetFragmentInvocations() {
+    if (!bPipelineStatistics) {
+        return -1;
+    }
+    // the frame has finished, so the results are available without waiting - the late pass has its own query
+    const uint32_t ctQueries = bOcclusionCulling ? 2 : 1;
+    uint64_t actInvocations[2] = {};
+    if (vkGetQueryPoolResults(vkhLogicalDevice, vkhStatisticsQueryPool, 0, ctQueries, sizeof(actInvocations), actInvocations, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return -1;
+    }
+    return static_cast<int64_t>(actInvocations[0] + actInvocations[1]);
+}
+
+
+// Create the compute pipelines of occlusion culling.
+void GfxAPIVulkan::InitializeOcclusionCulling() {
+    // load the shaders building the depth pyramid and testing the objects
+    VkShaderModule modHiZ = CreateShaderModule("d:/Work/VulcanTutorial/Shaders/hiz_comp.spv");
+    VkShaderModule modOcclusion = CreateShaderModule("d:/Work/VulcanTutorial/Shaders/occlusion_comp.spv");
+    ocOcclusion.Initialize(vkhPhysicalDevice, vkhLogicalDevice, modHiZ, modOcclusion);
+    // the pipelines are created, the modules are no longer needed
+    vkDestroyShaderModule(vkhLogicalDevice, modHiZ, nullptr);
+    vkDestroyShaderModule(vkhLogicalDevice, modOcclusion, nullptr);
+
+    // nothing culled yet
+    ctTotalOccluded = 0;
+    ctOcclusionFrames = 0;
+}
+
+
 // Create semaphores for syncing buffer and renderer access.
 void GfxAPIVulkan::CreateSemaphores() {
     
@@ -1383,18 +2058,114 @@ void GfxAPIVulkan::DestroySemaphores() {
 }
 
 
-// Create resources needed for depth testing.
-void GfxAPIVulkan::CreateDepthResources() {
+// Select the number of samples per pixel.
+void GfxAPIVulkan::SelectSampleCount() {
+    // the render targets are used as color and depth attachments, so both need to support the count
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkhPhysicalDevice, &deviceProperties);
+    const VkSampleCountFlags flgSupported = deviceProperties.limits.framebufferColorSampleCounts & deviceProperties.limits.framebufferDepthSampleCounts;
+
+    // use the highest supported count that doesn't exceed the requested one - the flags are equal to the counts
+    const uint32_t ctRequested = Options::Get().GetMsaaSampleCount();
+    flgSamples = VK_SAMPLE_COUNT_1_BIT;
+    for (uint32_t ctSamples = VK_SAMPLE_COUNT_64_BIT; ctSamples > 1; ctSamples >>= 1) {
+        if (ctSamples <= ctRequested && (flgSupported & ctSamples)) {
+            flgSamples = static_cast<VkSampleCountFlagBits>(ctSamples);
+            break;
+        }
+    }
+    if (flgSamples != ctRequested) {
+        std::cout << "MSAA: " << ctRequested << " samples requested, " << flgSamples << " used" << std::endl;
+    }
+
+    // the depth pyramid is built from single sampled depth
+    bOcclusionCulling = Options::Get().ShouldUseOcclusionCulling() && flgSamples == VK_SAMPLE_COUNT_1_BIT;
+    if (Options::Get().ShouldUseOcclusionCulling() && !bOcclusionCulling) {
+        std::cout << "Occlusion culling: not used with multisampling" << std::endl;
+    }
+}
+
+
+// Select the extent the scene is rendered at.
+void GfxAPIVulkan::SelectRenderExtent() {
+    // scale the swap chain extent, keeping at least a pixel and staying within what framebuffers support
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkhPhysicalDevice, &deviceProperties);
+    const float fScale = std::max(Options::Get().GetResolutionScale(), 0.0f);
+    exRenderExtent.width = std::max(1u, static_cast<uint32_t>(std::min(exExtent.width * fScale + 0.5f, static_cast<float>(deviceProperties.limits.maxFramebufferWidth))));
+    exRenderExtent.height = std::max(1u, static_cast<uint32_t>(std::min(exExtent.height * fScale + 0.5f, static_cast<float>(deviceProperties.limits.maxFramebufferHeight))));
+    if (exRenderExtent.width == exExtent.width && exRenderExtent.height == exExtent.height) {
+        return;
+    }
+
+    // the rendered image is scaled to the swap chain image with a filtered blit, which both have to support
+    VkFormatProperties propsFormat;
+    vkGetPhysicalDeviceFormatProperties(vkhPhysicalDevice, fmtSurfaceFormat.format, &propsFormat);
+    const VkFormatFeatureFlags flgBlitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (!(capsSurface.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) || (propsFormat.optimalTilingFeatures & flgBlitFeatures) != flgBlitFeatures) {
+        std::cout << "Resolution scale: not used, the swap chain images can't be scaled to" << std::endl;
+        exRenderExtent = exExtent;
+        return;
+    }
+    std::cout << "Resolution scale: rendering at " << exRenderExtent.width << "x" << exRenderExtent.height << ", scaled to " << exExtent.width << "x" << exExtent.height << std::endl;
+}
+
+
+// Create the attachments that only live within a frame.
+void GfxAPIVulkan::CreateAttachments() {
     // get the depth format to use
     VkFormat fmtDepth = FindDepthFormat();
 
-    // create the depth image
-    CreateImage(exExtent.width, exExtent.height, fmtDepth, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkhDepthImageData, vkhDepthImageMemory);
+    // create the depth image - it is cleared at the start of the main pass and not needed after it, so it is transient;
+    // with occlusion culling, the depth pyramid is built from it and the late draws continue it, so it is sampled too
+    const VkImageUsageFlags flgDepthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (bOcclusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+    const VkImageCreateInfo infoDepthImage = DescribeImage(exRenderExtent.width, exRenderExtent.height, fmtDepth, VK_IMAGE_TILING_OPTIMAL, flgDepthUsage, flgSamples);
+    const uint32_t iDepthAttachment = tapAttachments.AddAttachment(infoDepthImage, FRAME_PASS_MAIN, bOcclusionCulling ? FRAME_PASS_MAIN_LATE : FRAME_PASS_MAIN);
+    // the multisampled color image is resolved within the main pass, so it is transient too
+    uint32_t iColorAttachment = 0;
+    if (flgSamples != VK_SAMPLE_COUNT_1_BIT) {
+        const VkImageCreateInfo infoColorImage = DescribeImage(exRenderExtent.width, exRenderExtent.height, fmtSurfaceFormat.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, flgSamples);
+        iColorAttachment = tapAttachments.AddAttachment(infoColorImage, FRAME_PASS_MAIN, FRAME_PASS_MAIN);
+    }
+    // when rendering at a different extent than the swap chain's, the scene is rendered or resolved to a single sampled
+    // color image, which is scaled to the swap chain image at the end of the frame
+    const bool bScaled = exRenderExtent.width != exExtent.width || exRenderExtent.height != exExtent.height;
+    uint32_t iScaledAttachment = 0;
+    if (bScaled) {
+        const VkImageCreateInfo infoScaledImage = DescribeImage(exRenderExtent.width, exRenderExtent.height, fmtSurfaceFormat.format, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        iScaledAttachment = tapAttachments.AddAttachment(infoScaledImage, FRAME_PASS_MAIN, FRAME_PASS_UPSCALE);
+    }
+    // place the attachments in memory
+    tapAttachments.Allocate();
+
+    vkhDepthImageData = tapAttachments.GetImage(iDepthAttachment);
     // create the image view for depth
     vkhDeptImageView = CreateImageView(vkhDepthImageData, fmtDepth, VK_IMAGE_ASPECT_DEPTH_BIT);
+    // the depth pyramid is sized for the depth buffer
+    if (bOcclusionCulling) {
+        ocOcclusion.SetDepthBuffer(vkhDeptImageView, exRenderExtent, dqRetired);
+    }
+    // and for multisampled color
+    vkhColorImageData = VK_NULL_HANDLE;
+    vkhColorImageView = VK_NULL_HANDLE;
+    if (flgSamples != VK_SAMPLE_COUNT_1_BIT) {
+        vkhColorImageData = tapAttachments.GetImage(iColorAttachment);
+        vkhColorImageView = CreateImageView(vkhColorImageData, fmtSurfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+    // and for scaled color
+    vkhScaledImageData = VK_NULL_HANDLE;
+    vkhScaledImageView = VK_NULL_HANDLE;
+    if (bScaled) {
+        vkhScaledImageData = tapAttachments.GetImage(iScaledAttachment);
+        vkhScaledImageView = CreateImageView(vkhScaledImageData, fmtSurfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
 
-    // transition the layout to one suitable for depth attachment
-    TransitionImageLayout(vkhDepthImageData, fmtDepth, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    // barriers need to cover the stencil too, if the format has it
+    flgDepthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (FormatHasStencilComponent(fmtDepth)) {
+        flgDepthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
 }
 
 
@@ -1428,23 +2199,23 @@ void GfxAPIVulkan::CreateTextureImage() {
     // release texture memory
     stbi_image_free(imgRawData);
 
-    // create the image
-    CreateImage(dimWidth, dimHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkhImageData, vkhImageMemory);
-    // prepare the image to receive data from the staging buffer
-    TransitionImageLayout(vkhImageData, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    // copy data from the staging buffer to the image
-    CoypBufferToImage(vkhStagingBuffer, vkhImageData, dimWidth, dimHeight);
-
-    // destroy the staging buffer
-    vkDestroyBuffer(vkhLogicalDevice, vkhStagingBuffer, nullptr);
-    // free buffer memory
-    vkFreeMemory(vkhLogicalDevice, vkhStagingMemory, nullptr);
+    // create the image, and hand it to the image pool
+    VkImage vkhImage;
+    VkDeviceMemory vkhImageMemory;
+    CreateImage(dimWidth, dimHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkhImage, vkhImageMemory);
+    ihTexture = ipImages.Add(vkhImage, vkhImageMemory, VK_FORMAT_R8G8B8A8_UNORM);
+    // queue the copy from the staging buffer, with the transitions around it
+    ubUploads.CopyBufferToImage(vkhStagingBuffer, vkhImage, dimWidth, dimHeight);
+    ubUploads.ReleaseAfterSubmit(vkhStagingBuffer, vkhStagingMemory);
+    // the upload leaves the image ready for sampling, and is waited for before the first frame
+    isTextureImage = RenderGraph::GetIdleState(RenderGraph::IMAGE_USAGE_SHADER_READ);
 }
 
 
 // Create a view for the texture.
 void GfxAPIVulkan::CreateTextureImageVeiw() {
-    vkhImageView = CreateImageView(vkhImageData, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+    // the pool destroys the view with the image
+    ipImages.SetView(ihTexture, CreateImageView(ipImages.GetImage(ihTexture), ipImages.GetFormat(ihTexture), VK_IMAGE_ASPECT_COLOR_BIT));
 }
 
 
@@ -1460,9 +2231,12 @@ void GfxAPIVulkan::CreateImageSampler() {
     infoSampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     infoSampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     infoSampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    // set anisotyopy to 16x
-    infoSampler.anisotropyEnable = VK_TRUE;
-    infoSampler.maxAnisotropy = 16;
+    // set anisotyopy as requested in the options, or as much as the device supports
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkhPhysicalDevice, &deviceProperties);
+    const float fMaxAnisotropy = std::min(Options::Get().GetMaxAnisotropy(), deviceProperties.limits.maxSamplerAnisotropy);
+    infoSampler.anisotropyEnable = bSamplerAnisotropy && fMaxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+    infoSampler.maxAnisotropy = infoSampler.anisotropyEnable ? fMaxAnisotropy : 1.0f;
     // if sampling out of bounds, return black - only valid for clamp to border mode
     infoSampler.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     // for UV coordinates, use [0,1) range - uses [0, texture_size) if TRUE
@@ -1483,9 +2257,39 @@ void GfxAPIVulkan::CreateImageSampler() {
 }
 
 
+// Recreate the texture sampler with the current filtering options, and point the descriptor set at it.
+void GfxAPIVulkan::RecreateImageSampler() {
+    // the renderer was flushed, and each frame waits for its ticket on the graphics timeline before the next one starts,
+    // so the descriptor set is no longer in use and can be rewritten - the old sampler only has to outlive the frames
+    // submitted so far, it is retired without waiting
+    const VkSampler vkhOldSampler = vkhImageSampler;
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    dqRetired.Retire([vkhDevice, vkhOldSampler]() { vkDestroySampler(vkhDevice, vkhOldSampler, nullptr); });
+    CreateImageSampler();
+
+    // rewrite the image sampler descriptor, the uniform buffer descriptor stays
+    VkDescriptorImageInfo infoImage = {};
+    infoImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    infoImage.imageView = ipImages.GetView(ihTexture);
+    infoImage.sampler = vkhImageSampler;
+
+    VkWriteDescriptorSet infoUpdateDescriptorSet = {};
+    infoUpdateDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    infoUpdateDescriptorSet.dstSet = vkhDescriptorSet;
+    infoUpdateDescriptorSet.dstBinding = 1;
+    infoUpdateDescriptorSet.dstArrayElement = 0;
+    infoUpdateDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    infoUpdateDescriptorSet.descriptorCount = 1;
+    infoUpdateDescriptorSet.pImageInfo = &infoImage;
+    vkUpdateDescriptorSets(vkhLogicalDevice, 1, &infoUpdateDescriptorSet, 0, nullptr);
+}
+
+
 // Find the format to use for depth.
 VkFormat GfxAPIVulkan::FindDepthFormat() {
-    VkFormat fmtFormat = FindSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    // occlusion culling reads depth in a compute shader
+    const VkFormatFeatureFlags flgFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (bOcclusionCulling ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0);
+    VkFormat fmtFormat = FindSupportedFormat(afmtDepthFormats, VK_IMAGE_TILING_OPTIMAL, flgFeatures);
     return fmtFormat;
 }
 
@@ -1545,8 +2349,8 @@ VkImageView GfxAPIVulkan::CreateImageView(VkImage vkhImage, VkFormat fmtFormat,
     return vkhView;
 }
 
-// Create an image.
-void GfxAPIVulkan::CreateImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat fmtFormat, VkImageTiling imtTiling, VkImageUsageFlags flagUsage, VkMemoryPropertyFlags flagMemoryProperties, VkImage &vkhImage, VkDeviceMemory &vkhMemory) {
+// Describe a 2D image with no mipmaps or layers.
+VkImageCreateInfo GfxAPIVulkan::DescribeImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat fmtFormat, VkImageTiling imtTiling, VkImageUsageFlags flagUsage, VkSampleCountFlagBits flgSamples) {
     // describe the image
     VkImageCreateInfo infoImage = {};
     infoImage.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1570,10 +2374,18 @@ void GfxAPIVulkan::CreateImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat f
     infoImage.usage = flagUsage;
     // it will be used by only one queue family (graphics)
     infoImage.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    // no multisampling
-    infoImage.samples = VK_SAMPLE_COUNT_1_BIT;
+    // set the number of samples per pixel
+    infoImage.samples = flgSamples;
     // default flags
     infoImage.flags = 0;
+    return infoImage;
+}
+
+
+// Create an image.
+void GfxAPIVulkan::CreateImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat fmtFormat, VkImageTiling imtTiling, VkImageUsageFlags flagUsage, VkMemoryPropertyFlags flagMemoryProperties, VkImage &vkhImage, VkDeviceMemory &vkhMemory) {
+    // describe the image
+    const VkImageCreateInfo infoImage = DescribeImage(dimWidth, dimHeight, fmtFormat, imtTiling, flagUsage, VK_SAMPLE_COUNT_1_BIT);
 
     // create the image
     if (vkCreateImage(vkhLogicalDevice, &infoImage, nullptr, &vkhImage) != VK_SUCCESS) {
@@ -1602,156 +2414,19 @@ void GfxAPIVulkan::CreateImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat f
 }
 
 
-// Change image layout to what is needed for rendering.
-void GfxAPIVulkan::TransitionImageLayout(VkImage vkhImage, VkFormat fmtFormat, VkImageLayout imlOldLayout, VkImageLayout imlNewLayout) {
-    // begin recording a one time command buffer
-    VkCommandBuffer vkhCommandBuffer = BeginOneTimeCommand();
-
-    // use an image memory barrier to transition the image
-    VkImageMemoryBarrier infoImageMemoryBarrier = {};
-    infoImageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    // set source and destination layouts
-    infoImageMemoryBarrier.oldLayout = imlOldLayout;
-    infoImageMemoryBarrier.newLayout = imlNewLayout;
-    // not transferring queue family ownership, so queue indices don't matter
-    infoImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    infoImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    // set the image
-    infoImageMemoryBarrier.image = vkhImage;
-    // not a 3D image, so only one layer
-    infoImageMemoryBarrier.subresourceRange.layerCount = 1;
-    infoImageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-    // no mipmaps either
-    infoImageMemoryBarrier.subresourceRange.levelCount = 1;
-    infoImageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-    
-    // if transitioning a depth buffer
-    if (imlNewLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        // mark that it in the aspect mask
-        infoImageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        // if the format has a stencil component, set the stencil aspect bit
-        if (FormatHasStencilComponent(fmtFormat)) {
-            infoImageMemoryBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-        }
-    // else, it's a texture
-    } else {
-        infoImageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    }
-
-    // if transfering from an undefined layout to transfer destination 
-    VkPipelineStageFlags flagSourceStage;
-    VkPipelineStageFlags flagDestinationStage;
-    if (imlOldLayout == VK_IMAGE_LAYOUT_UNDEFINED && imlNewLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        // no need to wait on anything
-        infoImageMemoryBarrier.srcAccessMask = 0;
-        infoImageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        // start at the earliest pipeline stage there is
-        flagSourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        flagDestinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    // else, if transitioning to prepare for reads from the shader
-    } else if (imlOldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && imlNewLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        // need to wait for any transfer to finish
-        infoImageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        infoImageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        // start at the transfer stage
-        flagSourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        flagDestinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    // else, if transitioning to prepare the depth and stencil buffer
-    } else if (imlOldLayout == VK_IMAGE_LAYOUT_UNDEFINED && imlNewLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        // no need to wait on anything
-        infoImageMemoryBarrier.srcAccessMask = 0;
-        infoImageMemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        // start at the earliest pipeline stage there is
-        flagSourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        flagDestinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    // else, if any other kind of transition
-    } else {
-        throw std::runtime_error("Unsupported image layout transition.");
-    }
-
-    // record a pipeline barrier command to the buffer
-    vkCmdPipelineBarrier(vkhCommandBuffer, flagSourceStage, flagDestinationStage, 0, 0, nullptr, 0, nullptr, 1, &infoImageMemoryBarrier);
-
-    // finish recording and submit the buffer
-    EndOneTimeCommand(vkhCommandBuffer);
-}
-
-
-// Copy a buffer to the image.
-void GfxAPIVulkan::CoypBufferToImage(VkBuffer vkhBuffer, VkImage vkhImage, uint32_t dimWidth, uint32_t dimHeight) {
-    // begin recording a one time command buffer
-    VkCommandBuffer vkhCommandBuffer = BeginOneTimeCommand();
-
-    // prepare the copy command
-    VkBufferImageCopy infoCopyCommand = {};
-    // copyign the whole buffer
-    infoCopyCommand.bufferOffset = 0;
-    // this specifies that pixels are tightly packed
-    infoCopyCommand.bufferImageHeight = 0;
-    infoCopyCommand.bufferRowLength = 0;
-
-    // this is a color image
-    infoCopyCommand.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    // not a 3D image, so only one layer
-    infoCopyCommand.imageSubresource.layerCount = 1;
-    infoCopyCommand.imageSubresource.baseArrayLayer = 0;
-    // no mipmaps either
-    infoCopyCommand.imageSubresource.mipLevel = 0;
-
-    // copy the entire image
-    infoCopyCommand.imageOffset = { 0, 0, 0 };
-    infoCopyCommand.imageExtent = { dimWidth, dimHeight, 1 };
-
-    // record the command to copy the buffer to the image
-    vkCmdCopyBufferToImage(vkhCommandBuffer, vkhBuffer, vkhImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &infoCopyCommand);
-    // finish recording and submit the buffer
-    EndOneTimeCommand(vkhCommandBuffer);
-}
-
-
 // Load the example model.
-void GfxAPIVulkan::LoadModel() {
-    // vertex attributes - position, normal, uv, color
-    tinyobj::attrib_t vatrVertexAttributes;
-    // object's meshes, named
-    std::vector<tinyobj::shape_t> ameshMeshes;
-    // materials used by the object
-    std::vector<tinyobj::material_t> amatMaterials;
-    // error string will be stored here, if any
-    std::string strError;
-
-    // load the model from the object file
-    if (!tinyobj::LoadObj(&vatrVertexAttributes, &ameshMeshes, &amatMaterials, &strError, "d:/Work/VulcanTutorial/Shaders/sphere.obj")) {
-        throw std::runtime_error("Failed to load the model:  " + strError);
-    }
-
-    // combine all meshes into a single vertex and index buffer
-    // go through all vertices in all meshes in the model
-    for (const auto &meshMesh : ameshMeshes) {
-        for (const auto iVertex : meshMesh.mesh.indices) {
-            // read vertex attributes
-            Vertex vVertex = {};
-            // read the position
-            vVertex.vecPosition = {
-                vatrVertexAttributes.vertices[iVertex.vertex_index * 3 + 0],
-                vatrVertexAttributes.vertices[iVertex.vertex_index * 3 + 1],
-                vatrVertexAttributes.vertices[iVertex.vertex_index * 3 + 2],
-            };
-            // read the UV coordinaets
-            vVertex.vecTexCoords = {
-                vatrVertexAttributes.texcoords[iVertex.texcoord_index * 2 + 0],
-                1.0f - vatrVertexAttributes.texcoords[iVertex.texcoord_index * 2 + 1],
-            };
-            // use constant color, white
-            vVertex.colColor = { 1.0f, 1.0f, 1.0f };
-
-            // store vertex and its index
-            avVertices.push_back(vVertex);
-            aiIndices.push_back(static_cast<uint32_t>(aiIndices.size()));
-        }
+void GfxAPIVulkan::LoadModel(uint32_t ctObjects) {
+    // the renderer loads the model for the scene's objects
+    srRenderer.Initialize(ctObjects);
+
+    // copy the vertex and index data for uploading
+    const CookedMesh &meshModel = srRenderer.GetModel();
+    avVertices = meshModel.avVertices;
+    aiIndices = meshModel.aiIndices;
+    // split the positions into their own stream
+    avPositions.resize(avVertices.size());
+    for (size_t iVertex = 0; iVertex < avVertices.size(); iVertex++) {
+        avPositions[iVertex].vecPosition = avVertices[iVertex].vecPosition;
     }
 }
 
@@ -1775,15 +2450,42 @@ void GfxAPIVulkan::CreateVertexBuffers() {
     vkUnmapMemory(vkhLogicalDevice, vkhStagingMemory);
 
     // create the vertex buffer - it is located in device memory and is a memory transfer destination
+    VkBuffer vkhVertexBuffer;
+    VkDeviceMemory vkhVertexBufferMemory;
     CreateBuffer(ctBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkhVertexBuffer, vkhVertexBufferMemory);
+    abhMeshVertexBuffers[iModelMesh] = bpBuffers.Add(vkhVertexBuffer, vkhVertexBufferMemory, ctBufferSize, nullptr);
+
+    // queue the copy of the staging buffer contents to the vertex buffer
+    ubUploads.CopyBuffer(vkhStagingBuffer, vkhVertexBuffer, ctBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    ubUploads.ReleaseAfterSubmit(vkhStagingBuffer, vkhStagingMemory);
+}
 
-    // copy staging buffer contents to the vertex buffer
-    CopyBuffer(vkhStagingBuffer, vkhVertexBuffer, ctBufferSize);
 
-    // destroy the staging buffer
-    vkDestroyBuffer(vkhLogicalDevice, vkhStagingBuffer, nullptr);
-    // free buffer memory
-    vkFreeMemory(vkhLogicalDevice, vkhStagingMemory, nullptr);
+// Create the buffer holding the position-only vertex stream.
+void GfxAPIVulkan::CreatePositionBuffer() {
+    // get the position buffer size
+    VkDeviceSize ctBufferSize = sizeof(avPositions[0]) * avPositions.size();
+
+    // create a staging buffer - it is a source in a memory transfer operation, and is located on the host
+    VkBuffer vkhStagingBuffer;
+    VkDeviceMemory vkhStagingMemory;
+    CreateBuffer(ctBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkhStagingBuffer, vkhStagingMemory);
+
+    // copy the positions to the staging buffer
+    void *pMappedMemory;
+    vkMapMemory(vkhLogicalDevice, vkhStagingMemory, 0, ctBufferSize, 0, &pMappedMemory);
+    memcpy(pMappedMemory, avPositions.data(), ctBufferSize);
+    vkUnmapMemory(vkhLogicalDevice, vkhStagingMemory);
+
+    // create the position buffer - it is located in device memory and is a memory transfer destination
+    VkBuffer vkhPositionBuffer;
+    VkDeviceMemory vkhPositionBufferMemory;
+    CreateBuffer(ctBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkhPositionBuffer, vkhPositionBufferMemory);
+    abhMeshVertexBuffers[iModelMeshPositions] = bpBuffers.Add(vkhPositionBuffer, vkhPositionBufferMemory, ctBufferSize, nullptr);
+
+    // queue the copy of the staging buffer contents to the position buffer
+    ubUploads.CopyBuffer(vkhStagingBuffer, vkhPositionBuffer, ctBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    ubUploads.ReleaseAfterSubmit(vkhStagingBuffer, vkhStagingMemory);
 }
 
 
@@ -1806,15 +2508,14 @@ void GfxAPIVulkan::CreateIndexBuffers() {
     vkUnmapMemory(vkhLogicalDevice, vkhStagingMemory);
 
     // create the index buffer - it is located in device memory and is a memory transfer destination
+    VkBuffer vkhIndexBuffer;
+    VkDeviceMemory vkhIndexBufferMemory;
     CreateBuffer(ctBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkhIndexBuffer, vkhIndexBufferMemory);
+    bhIndexBuffer = bpBuffers.Add(vkhIndexBuffer, vkhIndexBufferMemory, ctBufferSize, nullptr);
 
-    // copy staging buffer contents to the index buffer
-    CopyBuffer(vkhStagingBuffer, vkhIndexBuffer, ctBufferSize);
-
-    // destroy the staging buffer
-    vkDestroyBuffer(vkhLogicalDevice, vkhStagingBuffer, nullptr);
-    // free buffer memory
-    vkFreeMemory(vkhLogicalDevice, vkhStagingMemory, nullptr);
+    // queue the copy of the staging buffer contents to the index buffer
+    ubUploads.CopyBuffer(vkhStagingBuffer, vkhIndexBuffer, ctBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    ubUploads.ReleaseAfterSubmit(vkhStagingBuffer, vkhStagingMemory);
 }
 
 // Create uniform buffer.
@@ -1822,7 +2523,31 @@ void GfxAPIVulkan::CreateUniformBuffers() {
     // get the uniform buffer size
     VkDeviceSize ctBufferSize = sizeof(UniformBufferObject);
     // create the uniform buffer
+    VkBuffer vkhUniformBuffer;
+    VkDeviceMemory vkhUniformBufferMemory;
     CreateBuffer(ctBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkhUniformBuffer, vkhUniformBufferMemory);
+    // keep the buffer mapped for its whole lifetime, the renderer writes the frame constants into it every frame
+    void *pMappedMemory;
+    vkMapMemory(vkhLogicalDevice, vkhUniformBufferMemory, 0, ctBufferSize, 0, &pMappedMemory);
+    // the pool releases the mapping when it destroys the buffer
+    bhUniformBuffer = bpBuffers.Add(vkhUniformBuffer, vkhUniformBufferMemory, ctBufferSize, pMappedMemory);
+    puboUniforms = static_cast<UniformBufferObject*>(pMappedMemory);
+}
+
+// Create the indirect buffer that culling writes draw commands to.
+void GfxAPIVulkan::CreateIndirectBuffer() {
+    // the renderer knows how many commands a frame can produce at most
+    VkDeviceSize ctBufferSize = sizeof(VkDrawIndexedIndirectCommand) * srRenderer.GetMaxIndirectCommands();
+    // create the indirect buffer - the CPU writes it every frame, so it is host visible
+    // the occlusion test empties the commands of hidden objects, so it is a storage buffer too
+    VkBuffer vkhIndirectBuffer;
+    VkDeviceMemory vkhIndirectBufferMemory;
+    CreateBuffer(ctBufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkhIndirectBuffer, vkhIndirectBufferMemory);
+    // keep the buffer mapped for its whole lifetime
+    void *pMappedMemory;
+    vkMapMemory(vkhLogicalDevice, vkhIndirectBufferMemory, 0, ctBufferSize, 0, &pMappedMemory);
+    bhIndirectBuffer = bpBuffers.Add(vkhIndirectBuffer, vkhIndirectBufferMemory, ctBufferSize, pMappedMemory);
+    adicIndirectCommands = static_cast<VkDrawIndexedIndirectCommand*>(pMappedMemory);
 }
 
 
@@ -1877,7 +2602,7 @@ void GfxAPIVulkan::CreateDescriptorSet() {
     // use a descriptor to describe the uniform buffer
     VkDescriptorBufferInfo infoUniformBuffer = {};
     // bind the uniform buffer
-    infoUniformBuffer.buffer = vkhUniformBuffer;
+    infoUniformBuffer.buffer = bpBuffers.GetBuffer(bhUniformBuffer);
     // start at the beggining
     infoUniformBuffer.offset = 0;
     // size is equal to the buffer object's
@@ -1888,7 +2613,7 @@ void GfxAPIVulkan::CreateDescriptorSet() {
     // set the image layout to optimal for reading from a fragment shader
     infoImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     // set the image view and sampler
-    infoImage.imageView = vkhImageView;
+    infoImage.imageView = ipImages.GetView(ihTexture);
     infoImage.sampler = vkhImageSampler;
 
     // describe how to update the descriptor sets
@@ -1968,22 +2693,17 @@ void GfxAPIVulkan::CreateBuffer(VkDeviceSize ctSize, VkBufferUsageFlags flgBuffe
 }
 
 
-// Copy memory from one buffer to the other.
-void GfxAPIVulkan::CopyBuffer(VkBuffer vkhSourceBuffer, VkBuffer vkhDestinationBuffer, VkDeviceSize ctSize) {
-    // begin recording a one time command buffer
+// Submit all queued resource uploads in one command buffer, without waiting for them.
+void GfxAPIVulkan::SubmitUploads() {
+    if (ubUploads.IsEmpty()) {
+        return;
+    }
+    // record and submit the whole batch, the frames wait for its ticket on the GPU
     VkCommandBuffer vkhCommandBuffer = BeginOneTimeCommand();
-
-    // create the copy command - copies start from beggining, size is the size specified in the input arguments
-    VkBufferCopy cmdCopy = {};
-    cmdCopy.srcOffset = 0;
-    cmdCopy.dstOffset = 0;
-    cmdCopy.size = ctSize;
-
-    // run the copy command
-    vkCmdCopyBuffer(vkhCommandBuffer, vkhSourceBuffer, vkhDestinationBuffer, 1, &cmdCopy);
-
-    // finish recording and submit the buffer
-    EndOneTimeCommand(vkhCommandBuffer);
+    ubUploads.Record(vkhCommandBuffer);
+    iUploadTicket = EndOneTimeCommand(vkhCommandBuffer);
+    // the staging buffers are released once the copies completed
+    ubUploads.Release(dqRetired);
 }
 
 
@@ -2016,25 +2736,22 @@ VkCommandBuffer GfxAPIVulkan::BeginOneTimeCommand() {
 }
 
 
-// Finish one time command recording.
-void GfxAPIVulkan::EndOneTimeCommand(VkCommandBuffer vkhCommandBuffer) {
+// Finish one time command recording and submit it.
+uint64_t GfxAPIVulkan::EndOneTimeCommand(VkCommandBuffer vkhCommandBuffer) {
     // stop recording the buffer
     vkEndCommandBuffer(vkhCommandBuffer);
 
-    // prepare the command buffer submit info for the copy operation
-    VkSubmitInfo infoSubmitCopy = {};
-    infoSubmitCopy.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    // set the buffer to execute
-    infoSubmitCopy.commandBufferCount = 1;
-    infoSubmitCopy.pCommandBuffers = &vkhCommandBuffer;
-
-    // submit the queue for execution
-    vkQueueSubmit(vkhGraphicsQueue, 1, &infoSubmitCopy, VK_NULL_HANDLE);
-    // wait for the commands to finish
-    vkQueueWaitIdle(vkhGraphicsQueue);
+    // submit the buffer for execution, nothing to wait for
+    QueueSubmission qsSubmission;
+    qsSubmission.avkhCommandBuffers = &vkhCommandBuffer;
+    qsSubmission.ctCommandBuffers = 1;
+    const uint64_t iTicket = qtGraphics.Submit(qsSubmission);
 
-    // clean up the command buffer
-    vkFreeCommandBuffers(vkhLogicalDevice, vkhCommandPool, 1, &vkhCommandBuffer);
+    // clean up the command buffer once it executed, instead of waiting for the queue
+    const VkDevice vkhDevice = vkhLogicalDevice;
+    const VkCommandPool vkhPool = vkhCommandPool;
+    dqRetired.Retire([vkhDevice, vkhPool, vkhCommandBuffer]() { vkFreeCommandBuffers(vkhDevice, vkhPool, 1, &vkhCommandBuffer); });
+    return iTicket;
 }
 
 
@@ -2062,44 +2779,168 @@ uint32_t GfxAPIVulkan::FindMemoryType(uint32_t flgTypeFilter, VkMemoryPropertyFl
 void GfxAPIVulkan::OnWindowResized(GLFWwindow* window, uint32_t width, uint32_t height) {
     // have the window update its dimensions
     _wndWindow->UpdateDimensions();
-    // swap chain needs to be recreated to be able to render again
-    InitializeSwapChain();
-}
-
-// Update the uniform buffer - MVP matrices.
-// The tutorial implementation rotates the object 90 degrees per second.
-void GfxAPIVulkan::UpdateUniformBuffer() {
-    // get the start time in milliseconds, once the first time this function is executed
-    static auto tmStartTime = std::chrono::high_resolution_clock::now();
-
-    // get the current time
-    auto tmCurrentTime = std::chrono::high_resolution_clock::now();
-    float tmElapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(tmCurrentTime - tmStartTime).count() / 1000.f;
-
-    // genetate the matrices
-    UniformBufferObject uboUniforms = {};
-    // calculate the model transform
-    uboUniforms.tModel = glm::rotate(glm::mat4(1.0f), tmElapsedTime * glm::radians(-45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    // calculate the view transform
-    uboUniforms.tView = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    // calculate the prijection transform
-    uboUniforms.tProjection = glm::perspective(glm::radians(45.0f), exExtent.width / (float) exExtent.height, 0.1f, 10.0f);
-    // correct for the difference between OpenGL and Vulkan regarding the direction of the Y clip coordinate axis
-    uboUniforms.tProjection[1][1] *= -1;
-
-    // to copy the uniform buffer values to GPU memory, it first needs to be mapped to CPU
-    void *pMappedMemory;
-    vkMapMemory(vkhLogicalDevice, vkhUniformBufferMemory, 0, sizeof(UniformBufferObject), 0, &pMappedMemory);
-    // copy the buffer to mapped memory
-    memcpy(pMappedMemory, &uboUniforms, sizeof(UniformBufferObject));
-    // unmap memory, let the GPU take over
-    vkUnmapMemory(vkhLogicalDevice, vkhUniformBufferMemory);
+    // swap chain needs to be recreated to be able to render again - the render thread does it before its next frame,
+    // so that the events don't wait for the GPU
+    bSwapChainOutdated = true;
+}
+
+
+// Called when options change. Rebuilds only the objects the changed options affect.
+// Runs on the main thread, while the render thread is idle - the options are only reloaded after a flush.
+void GfxAPIVulkan::OnOptionsChanged(uint32_t flgChanged) {
+    // present mode and image count only affect the swap chain and the objects that refer to its images
+    if (flgChanged & OPTION_CHANGE_SWAP_CHAIN) {
+        ReplaceSwapChain();
+    }
+    // filtering only affects the sampler
+    if (flgChanged & OPTION_CHANGE_SAMPLER) {
+        RecreateImageSampler();
+    }
+    // multisampling and the resolution scale affect the render targets, and the render pass and pipeline that use them
+    if (flgChanged & OPTION_CHANGE_RENDER_TARGETS) {
+        RecreateRenderTargets();
+    }
+    // the pacer starts over at the new rate
+    if (flgChanged & OPTION_CHANGE_FRAME_PACING) {
+        fpPacer.Initialize(Options::Get().GetTargetFrameRate());
+    }
+    // the depth pre-pass is decided anew
+    if (flgChanged & OPTION_CHANGE_DEPTH_PREPASS) {
+        dpsDepthPrepass.Initialize(Options::Get().GetDepthPrepassMode(), Options::Get().GetDepthPrepassOverdraw());
+    }
+}
+
+// Start the render thread.
+void GfxAPIVulkan::StartRenderThread() {
+    bStopRenderThread = false;
+    ctPushedFrames = 0;
+    ctRenderedFrames = 0;
+    epRenderError = nullptr;
+    bSwapChainOutdated = false;
+    tmNextFrameStart = FramePacer::Clock::now();
+    thrRenderThread = std::thread(&GfxAPIVulkan::RenderThread, this);
+}
+
+
+// Stop the render thread, once it rendered the frames handed to it.
+void GfxAPIVulkan::StopRenderThread() {
+    if (!thrRenderThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtxRenderThread);
+        bStopRenderThread = true;
+    }
+    cvPacketPushed.notify_one();
+    thrRenderThread.join();
+}
+
+
+// Body of the render thread - renders the packets the main thread pushes, until it is stopped.
+void GfxAPIVulkan::RenderThread() {
+    try {
+        for (;;) {
+            // sleep until the main thread hands over a frame, and stop only once all handed over frames are rendered
+            {
+                std::unique_lock<std::mutex> lock(mtxRenderThread);
+                cvPacketPushed.wait(lock, [this] { return bStopRenderThread || qFramePackets.Front() != nullptr; });
+                if (qFramePackets.Front() == nullptr) {
+                    return;
+                }
+            }
+
+            // the packet stays in the queue while it's rendered, the main thread fills the other one meanwhile
+            RenderFrame(*qFramePackets.Front());
+            qFramePackets.Pop();
+
+            {
+                std::lock_guard<std::mutex> lock(mtxRenderThread);
+                ctRenderedFrames++;
+            }
+            cvFrameRendered.notify_all();
+        }
+    } catch (...) {
+        // errors can't leave the thread, the main thread throws them the next time it hands over a frame or waits
+        std::lock_guard<std::mutex> lock(mtxRenderThread);
+        epRenderError = std::current_exception();
+    }
+    cvFrameRendered.notify_all();
+}
+
+
+// Throw the error the render thread stopped on, if any, on the main thread.
+void GfxAPIVulkan::RethrowRenderError() {
+    std::exception_ptr epError;
+    {
+        std::lock_guard<std::mutex> lock(mtxRenderThread);
+        std::swap(epError, epRenderError);
+    }
+    if (epError) {
+        std::rethrow_exception(epError);
+    }
 }
 
-// Render a frame.
-void GfxAPIVulkan::Render() {
-    // update model, view and perspective matrices
-    UpdateUniformBuffer();
+
+// Write a frame's packet and hand it to the render thread.
+void GfxAPIVulkan::Render(const SceneSimulation &ssScene, float fInterpolation) {
+    RethrowRenderError();
+
+    // a slow GPU frame must not hold up the events - if the render thread is still busy with the earlier frames, wait
+    // only briefly for it, then drop this frame so that the main loop goes back to processing events
+    FramePacket *pfpPacket = qFramePackets.BeginPush();
+    if (pfpPacket == nullptr) {
+        {
+            std::unique_lock<std::mutex> lock(mtxRenderThread);
+            cvFrameRendered.wait_for(lock, tmMaxPacketWait, [this] { return !qFramePackets.IsFull() || epRenderError; });
+        }
+        pfpPacket = qFramePackets.BeginPush();
+        if (pfpPacket == nullptr) {
+            // what the dropped frame would have shown still needs showing
+            _wndWindow->RequestRedraw();
+            return;
+        }
+    }
+
+    // write the scene's state to the packet
+    ssScene.WriteFramePacket(fInterpolation, *pfpPacket);
+    pfpPacket->tmFrameStart = tmNextFrameStart;
+
+    // publish the packet under the lock, so that the render thread can't miss the wake-up between looking at the
+    // queue and going to sleep
+    {
+        std::lock_guard<std::mutex> lock(mtxRenderThread);
+        qFramePackets.EndPush();
+    }
+    ctPushedFrames++;
+    cvPacketPushed.notify_one();
+}
+
+
+// Wait until the render thread rendered all frames handed to it.
+void GfxAPIVulkan::Flush() {
+    {
+        std::unique_lock<std::mutex> lock(mtxRenderThread);
+        cvFrameRendered.wait(lock, [this] { return ctRenderedFrames == ctPushedFrames || epRenderError; });
+    }
+    RethrowRenderError();
+}
+
+
+// Render a frame from a packet, on the render thread.
+void GfxAPIVulkan::RenderFrame(const FramePacket &fpPacket) {
+    // the window was resized since the last frame
+    if (bSwapChainOutdated.exchange(false)) {
+        InitializeSwapChain();
+    }
+
+    // take the next frame arena - the frame that last used it completed before it ended, and the frame after it,
+    // which may still refer to its memory, is finished too
+    FrameArena &faFrame = afaFrameArenas[iFrameArena];
+    iFrameArena = (iFrameArena + 1) % ctFrameArenaSlots;
+    faFrame.Reset();
+
+    // run the frame logic - the frame constants, draw commands and occlusion candidates go straight to the mapped buffers
+    srRenderer.PrepareFrame(fpPacket, *puboUniforms, adicIndirectCommands, bOcclusionCulling ? ocOcclusion.GetCandidates() : nullptr, faFrame);
 
     // obtain a target image from the swap chain
     // setting max uint64 as the timeout (in nanoseconds) disables the timeout
@@ -2111,39 +2952,40 @@ void GfxAPIVulkan::Render() {
     if (statusResult == VK_ERROR_OUT_OF_DATE_KHR) {
         // setup the swap chain for the current surface
         InitializeSwapChain();
+        // the image wasn't acquired, so there is nothing to render into this frame - render it again with the new one
+        _wndWindow->RequestRedraw();
+        return;
     // else, if the operation failed with no way to recover
     } else if (statusResult != VK_SUCCESS && statusResult != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("Failed to acquire swap chain image");
     }
     // note that we consider suboptimal surface as success - this is something that could be handled better/differently by, for example, recreating the swap chain
+    // the presentation engine may still be reading the image, the frame graph makes the first pass wait for it
+    isSwapChainImage = RenderGraph::GetAcquiredState();
 
-    // describe how the queue will be submitted and synchronized
-    VkSubmitInfo infSubmit = {};
-    infSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    // bind the image semaphore that the queue has to wait on before it starts executing
-    VkSemaphore asyncWait[] = { vkhImageAvailableSemaphore };
-    infSubmit.waitSemaphoreCount = 1;
-    infSubmit.pWaitSemaphores = asyncWait;
-
-    // at what stage of the pipeline should the queue wait for the semaphore
-    // this sets the stage to the fragment program, making it possible for the vertex program to run before waiting
-    VkPipelineStageFlags aflgWaitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    infSubmit.pWaitDstStageMask = aflgWaitStages;
+    // record the commands for this frame, including the per-draw push constants, with or without the depth pre-pass
+    const bool bDepthPrepass = dpsDepthPrepass.ShouldUsePrepass();
+    srRenderer.SetDepthPrepass(bDepthPrepass);
+    RecordCommandBuffer(iImage, faFrame);
 
+    // describe how the queue will be submitted and synchronized
+    QueueSubmission qsFrame;
     // bind the command buffer
-    infSubmit.commandBufferCount = 1;
-    infSubmit.pCommandBuffers = &avkhCommandBuffers[iImage];
-
-    // set the semaphores that will be signalled when the command buffers are executed
-    VkSemaphore asyncSignal[] = { vkhRenderSemaphore };
-    infSubmit.signalSemaphoreCount = 1;
-    infSubmit.pSignalSemaphores = asyncSignal;
-
-    // submit the command buffers to the queue
-    if (vkQueueSubmit(vkhGraphicsQueue, 1, &infSubmit, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit draw command buffer");
-    }
+    qsFrame.avkhCommandBuffers = &avkhCommandBuffers[iImage];
+    qsFrame.ctCommandBuffers = 1;
+    // the image semaphore that the queue has to wait on, at the stage that writes the image
+    // this makes it possible for the vertex program to run before waiting
+    qsFrame.vkhAcquireSemaphore = vkhImageAvailableSemaphore;
+    qsFrame.flgAcquireStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    // the semaphore presentation waits for
+    qsFrame.vkhPresentSemaphore = vkhRenderSemaphore;
+    // the uploaded resources are read from vertex input on - the wait is skipped once the uploads completed
+    qsFrame.WaitFor(qtGraphics, iUploadTicket, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    // submit the command buffers to the queue, the frame completed once the timeline reached its value
+    const uint64_t iFrameTicket = qtGraphics.Submit(qsFrame);
+    // the CPU work of the frame is done
+    const FramePacer::Clock::time_point tmCpuEnd = FramePacer::Clock::now();
 
     // describe how to present the image
     VkPresentInfoKHR infPresent = {};
@@ -2151,7 +2993,7 @@ void GfxAPIVulkan::Render() {
 
     // presentation should wait for the render semaphore to be signalled
     infPresent.waitSemaphoreCount = 1;
-    infPresent.pWaitSemaphores = asyncSignal;
+    infPresent.pWaitSemaphores = &vkhRenderSemaphore;
 
     // what images to present to which swap chains
     VkSwapchainKHR aswcChains[] = { vkhSwapChain };
@@ -2168,15 +3010,48 @@ void GfxAPIVulkan::Render() {
 
     // if presentation failed because the swap chain has become incompatible with the surface
     if (statusResult == VK_ERROR_OUT_OF_DATE_KHR) {
-        // setup the swap chain for the current surface
-        InitializeSwapChain();
+        // setup the swap chain for the current surface before the next frame - this one is still executing, and the
+        // descriptor sets are only rewritten between frames
+        bSwapChainOutdated = true;
+        _wndWindow->RequestRedraw();
     // else, if the operation failed with no way to recover
     } else if (statusResult != VK_SUCCESS && statusResult != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("Failed to present swap chain image");
     }
     // note that we consider suboptimal surface as success - this is something that could be handled better/differently by, for example, recreating the swap chain
 
-    // wait for the device to finish rendering
+    // wait for the frame's commands to complete - only this frame's, not the whole device
     // not needed in a proper application where there are other things to do while the grahics card and thread to their thing
-    vkDeviceWaitIdle(vkhLogicalDevice);
+    qtGraphics.Wait(iFrameTicket);
+    // no work uses the objects retired up to now anymore
+    dqRetired.Collect();
+    // the frame is finished, let the pacer know how long the GPU took
+    const double tmGpuFrameTime = GetGpuFrameTime();
+    fpPacer.EndFrame(fpPacket.tmFrameStart, tmCpuEnd, tmGpuFrameTime);
+    // and track it per sample count, to compare the cost of multisampling
+    if (tmGpuFrameTime >= 0.0) {
+        SampleCountCost &sccCost = dicSampleCountCosts[flgSamples];
+        sccCost.tmTotalGpu += tmGpuFrameTime;
+        sccCost.ctFrames++;
+    }
+    // count the fragments it shaded, with or without the pre-pass
+    dpsDepthPrepass.EndFrame(bDepthPrepass, GetFragmentInvocations());
+    // the occlusion test decides which objects the next frame draws first, and counts the culled ones
+    if (bOcclusionCulling) {
+        srRenderer.ApplyOcclusionResults(ocOcclusion.GetVisibility());
+        ctTotalOccluded += srRenderer.GetOcclusionStatistics().ctOccluded;
+        ctOcclusionFrames++;
+    }
+}
+
+
+// Wait until the next frame should start, as the frame pacer decides.
+void GfxAPIVulkan::WaitForNextFrame() {
+    tmNextFrameStart = fpPacer.WaitForFrameStart();
+}
+
+
+// Restart frame pacing after the application slept.
+void GfxAPIVulkan::ResumeAfterIdle() {
+    fpPacer.Resume();
 }
@@ -1,80 +1,71 @@
 #pragma once
 #include "../GfxAPI/GfxAPI.h"
+#include "../Renderer/SceneRenderer.h"
+#include "../Renderer/SceneSimulation.h"
+#include "../Renderer/SpscQueue.h"
+#include "../Renderer/FramePacer.h"
+#include "../Renderer/DepthPrepassSelector.h"
+#include "RenderGraph.h"
+#include "OcclusionCuller.h"
+#include "TransientAttachmentPool.h"
+#include "UploadBatch.h"
+#include "ResourcePools.h"
+#include "QueueTimeline.h"
+#include "DeletionQueue.h"
 #include <vulkan/vulkan.h>
+#include <thread>
+#include <condition_variable>
 
 struct GLFWwindow;
 
-// Implementation of Vulkan graphics API.
+// Implementation of Vulkan graphics API. The main thread processes window messages and simulates the scene, and hands
+// each frame to a render thread as a packet, through a lock-free queue. The render thread owns the Vulkan objects
+// while it runs - the main thread only changes them once it flushed the renderer.
 class GfxAPIVulkan : public GfxAPI {
 private:
-    // NOTE: refactor this
-    struct Vertex {
-        glm::vec3 vecPosition;
-        glm::vec3 colColor;
-        glm::vec2 vecTexCoords;
-
-        // Describe to the Vulkan API how to handle Vertex data.
-        static VkVertexInputBindingDescription GetBindingDescription() {
-            // describe the layout of a vertex
-            VkVertexInputBindingDescription descVertexInputBinding = {};
-            // index of the binding in the array of bindings
-            descVertexInputBinding.binding = 0;
-            // number of bytes from the start of one entry to the next
-            descVertexInputBinding.stride = sizeof(Vertex);
-            // move to next data entry after each vertex (could be instance)
-            descVertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-            return descVertexInputBinding;
-        };
-
-        // Describe each individual vertex attribute.
-        static std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions() {
-            std::array<VkVertexInputAttributeDescription, 3> adescAttributes = {};
-            // set up the description of the vertex position
-            // data comes from the binding 0 (set up above)
-            adescAttributes[0].binding = 0;
-            // data goes to the location 0 (specified in the vertex shader)
-            adescAttributes[0].location = 0;
-            // data is two 32bit floats (screen x, y)
-            adescAttributes[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-            // offset of this attribute from the start of the data block
-            adescAttributes[0].offset = offsetof(Vertex, vecPosition);
-
-            // set up the description of the vertex color
-            // data comes from the binding 0 (set up above)
-            adescAttributes[1].binding = 0;
-            // data goes to the location 0 (specified in the vertex shader)
-            adescAttributes[1].location = 1;
-            // data is three 32bit floats (red, green, blue)
-            adescAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-            // offset of this attribute from the start of the data block
-            adescAttributes[1].offset = offsetof(Vertex, colColor);
-
-            // set up the description of the texture coordinates
-            // data comes from the binding 0 (set up above)
-            adescAttributes[2].binding = 0;
-            // data goes to the location 0 (specified in the vertex shader)
-            adescAttributes[2].location = 2;
-            // data is three 32bit floats (red, green, blue)
-            adescAttributes[2].format = VK_FORMAT_R32G32_SFLOAT;
-            // offset of this attribute from the start of the data block
-            adescAttributes[2].offset = offsetof(Vertex, vecTexCoords);
-
-            return adescAttributes;
-        };
-    };
+    // Vertex layout used for all meshes - 16 bit normalized positions, texture coordinates and octahedral normals.
+    typedef VertexQuantized Vertex;
     std::vector<Vertex> avVertices;
+    // Positions of the vertices, for the depth pre-pass.
+    std::vector<VertexPosition> avPositions;
     std::vector<uint32_t> aiIndices;
 
 private:
-    // Uniform buffer description.
-    struct UniformBufferObject {
-        // Model transform.
-        glm::mat4 tModel;
-        // View transform.
-        glm::mat4 tView;
-        // Projection transform.
-        glm::mat4 tProjection;
+    // Passes of the frame graph, in the order they are declared. Used to declare the lifetimes of transient attachments.
+    enum FramePass {
+        FRAME_PASS_MAIN,
+        // builds the depth pyramid and tests the objects against it, with occlusion culling
+        FRAME_PASS_HIZ,
+        // draws the objects found visible that weren't drawn in the main pass, with occlusion culling
+        FRAME_PASS_MAIN_LATE,
+        // scales the rendered image to the swap chain image, with a resolution scale
+        FRAME_PASS_UPSCALE,
+    };
+
+    // Translates the renderer's commands to a Vulkan command buffer.
+    class VulkanCommandSink : public CommandSink {
+    public:
+        VulkanCommandSink(GfxAPIVulkan &gfxVulkan, uint32_t iImage, bool bLatePhase) : _gfxVulkan(gfxVulkan), _iImage(iImage), _bLatePhase(bLatePhase),
+            _vkhCommandBuffer(gfxVulkan.avkhCommandBuffers[iImage]) {};
+
+        virtual void BeginRenderPass();
+        virtual void NextSubpass();
+        virtual void EndRenderPass();
+        virtual void BindPipeline(uint32_t iPipeline);
+        virtual void BindMeshBuffers(uint32_t iMesh);
+        virtual void BindDescriptorSet(uint32_t iDescriptorSet);
+        virtual void PushConstants(const void *pData, uint32_t ctSize);
+        virtual void DrawIndexedIndirect(uint32_t iFirstCommand, uint32_t ctCommands);
+
+    private:
+        // API that owns the objects the commands refer to.
+        GfxAPIVulkan &_gfxVulkan;
+        // Swap chain image being rendered to.
+        uint32_t _iImage;
+        // Are the draws after the occlusion test, continuing the main pass' color and depth?
+        bool _bLatePhase;
+        // Command buffer being recorded.
+        VkCommandBuffer _vkhCommandBuffer;
     };
 
 public:
@@ -87,20 +78,35 @@ private:
 
 public:
     // Initialize the API. Returns true if successfull.
-    virtual bool Initialize(uint32_t dimWidth, uint32_t dimHeight);
+    virtual bool Initialize(uint32_t dimWidth, uint32_t dimHeight, const SceneSimulation &ssScene);
     // Destroy the API. Returns true if successfull.
     virtual bool Destroy();
 
-    // Render a frame.
-    virtual void Render(); 
+    // Wait until the next frame should start, as the frame pacer decides.
+    virtual void WaitForNextFrame();
+    // Restart frame pacing after the application slept.
+    virtual void ResumeAfterIdle();
+    // Write a frame's packet and hand it to the render thread.
+    virtual void Render(const SceneSimulation &ssScene, float fInterpolation);
+    // Wait until the render thread rendered all frames handed to it.
+    virtual void Flush();
 
 private:
     // Called when the application's window is resized.
     void OnWindowResized(GLFWwindow* window, uint32_t width, uint32_t height);
-
-    // Update the uniform buffer - MVP matrices.
-    // The tutorial implementation rotates the object 90 degrees per second.
-    void UpdateUniformBuffer();
+    // Called when options change. Rebuilds only the objects the changed options affect.
+    void OnOptionsChanged(uint32_t flgChanged);
+
+    // Start the render thread.
+    void StartRenderThread();
+    // Stop the render thread, once it rendered the frames handed to it.
+    void StopRenderThread();
+    // Body of the render thread - renders the packets the main thread pushes, until it is stopped.
+    void RenderThread();
+    // Render a frame from a packet, on the render thread.
+    void RenderFrame(const FramePacket &fpPacket);
+    // Throw the error the render thread stopped on, if any, on the main thread.
+    void RethrowRenderError();
 
 private:
     // Initialize the application window.
@@ -108,10 +114,17 @@ private:
     // Create the Vulkan instance.
     void CreateInstance();
 
-    // Initialize swap chain. Called on first initialization, but also on window resize.
+    // Rebuild the swap chain and everything depending on it for the surface's current size. Called on window resize.
     void InitializeSwapChain();
-    // Destroy the swap chain.
-    void DestroySwapChain();
+    // Retire the swap chain and everything using it, to be destroyed once the frames submitted so far completed.
+    void RetireSwapChain();
+    // Create a swap chain from the current one, which is retired.
+    void CreateSwapChainFromCurrent();
+    // Recreate the render targets and the objects that depend on their sample count and extent - the render pass, the
+    // pipeline and the framebuffers. The swap chain stays.
+    void RecreateRenderTargets();
+    // Retire the render targets, the framebuffers, and the render pass and pipeline.
+    void RetireRenderTargets();
 
     // Get the Vulkan instance extensions required for the applciation to work.
     void GetRequiredInstanceExtensions(std::vector<const char*> &astrRequiredExtensions) const;
@@ -120,7 +133,7 @@ private:
     // Get the Vulkan device extensions required for the applciation to work.
     void GetRequiredDeviceExtensions(std::vector<const char*> &astrRequiredExtensions) const;
     // Check if all required device extensions are supported.
-    void CheckDeviceExtensionSupport(const VkPhysicalDevice &device, const std::vector<const char*> &astrRequiredExtensions) const;
+    bool CheckDeviceExtensionSupport(const VkPhysicalDevice &device, const std::vector<const char*> &astrRequiredExtensions) const;
 
     // NOTE: In the Vulkan SDK, Config directory, there is a vk_layer_settings.txt file that explains how to configure the validation layers.
     // Set up the validation layers.
@@ -135,10 +148,14 @@ private:
     // Create the surface to present render buffers to.
     void CreateSurface();
 
-    // Select the physical device (graphics card) to render on.
+    // Select the physical device (graphics card) to render on. Picks the suitable device with the highest score, unless
+    // the options request a specific one by index or name.
     void SelectPhysicalDevice();
-    // Does the device support all required features?
+    // Does the device support all required features? Logs the reason a device is rejected.
     bool IsDeviceSuitable(const VkPhysicalDevice &vkdevDevice);
+    // Score a suitable device, higher is better. Devices are ranked by type, then by the optional features and formats
+    // they support, then by the size of their device local memory. Logs what the score is based on.
+    int64_t ScoreDevice(const VkPhysicalDevice &vkdevDevice) const;
 
     // Find indices of queue families needed to support all application's features.
     void FindQueueFamilies(const VkPhysicalDevice &device);
@@ -147,8 +164,11 @@ private:
 
     // Collect information about swap chain feature support.
     void QuerySwapChainSupport(const VkPhysicalDevice &device);
-    // Create the swap chain to use for presenting images.
-    void CreateSwapChain();
+    // Create the swap chain to use for presenting images. The old swap chain, if any, hands its images over to the new one.
+    void CreateSwapChain(VkSwapchainKHR vkhOldSwapChain);
+    // Replace the swap chain with one using the current present mode and image count. Only the objects that refer to
+    // the swap chain images are recreated, unless the surface's extent changed too.
+    void ReplaceSwapChain();
     // Select the swap chain format to use.
     void SelectSwapChainFormat();
     // Select the presentation mode to use.
@@ -161,16 +181,18 @@ private:
 
     // Create the image views needed to acces swap chain images.
     void CreateImageViews();
-    // Destroy the image views.
-    void DestroyImageViews();
+    // Retire the image views.
+    void RetireImageViews();
 
     // Load shaders and create shader modules.
     VkShaderModule CreateShaderModule(const std::string &strFilename);
     // Load shader bytecode from a file.
     std::vector<char> LoadShader(const std::string &filename);
 
-    // Create the render pass.
+    // Create the render pass, and with occlusion culling, the one that continues it after the occlusion test.
 	void CreateRenderPass();
+    // Create a render pass that clears the attachments, or one that loads what an earlier pass rendered to them.
+    VkRenderPass BuildRenderPass(bool bLoadContents);
     // Create descriptor sets - used to bind uniforms to shaders.
     void CreateDescriptorSetLayout();
 	// Create the graphics pipeline.
@@ -178,24 +200,46 @@ private:
 
     // Create the framebuffers.
     void CreateFramebuffers();
-    // Destroy the framebuffers.
-    void DestroyFramebuffers();
+    // Retire the framebuffers.
+    void RetireFramebuffers();
 
     // Create the command pool.
     void CreateCommandPool();
     // Create the command buffers.
     void CreateCommandBuffers();
-
-    // Record the command buffers - NOTE: this is for the simple drawing from the tutorial.
-    void RecordCommandBuffers();
-
-    // Create semaphores for syncing buffer and renderer access.
+    // Retire the command buffers.
+    void RetireCommandBuffers();
+
+    // Record the command buffer for a swap chain image. Done every frame, the renderer builds the draws through a VulkanCommandSink.
+    void RecordCommandBuffer(uint32_t iImage, FrameArena &faFrame);
+    // Declare the frame's passes and the images they use to the frame graph, and compile it.
+    void BuildFrameGraph(uint32_t iImage, FrameArena &faFrame);
+
+    // Create the query pool used to measure the GPU time of a frame.
+    void CreateTimestampQueries();
+    // Get the GPU time of the last frame, in seconds, or a negative value if the device can't measure it.
+    double GetGpuFrameTime();
+    // Create the query pool used to count the fragment shader invocations of a frame.
+    void CreateStatisticsQueries();
+    // Get the fragment shader invocations of the last frame, or a negative value if the device can't count them.
+    int64_t GetFragmentInvocations();
+    // Create the compute pipelines of occlusion culling.
+    void InitializeOcclusionCulling();
+
+    // Create semaphores for syncing buffer and renderer access, and the fence that signals a frame completed.
     void CreateSemaphores();
-    // Delete the semaphores.
+    // Delete the semaphores and the fence.
     void DestroySemaphores();
 
-    // Create resources needed for depth testing.
-    void CreateDepthResources();
+    // Select the number of samples per pixel - the requested count, lowered to one the device supports for both color
+    // and depth attachments. Also decides on occlusion culling, which only works with single sampled depth.
+    void SelectSampleCount();
+    // Select the extent the scene is rendered at - the swap chain extent scaled by the requested resolution scale, if the
+    // device can scale the rendered image to the swap chain image.
+    void SelectRenderExtent();
+    // Create the attachments that only live within a frame - the depth buffer, the multisampled color target when
+    // multisampling is on, and the scaled color target when rendering at a different extent than the swap chain's.
+    void CreateAttachments();
 
     // Create a texture.
     void CreateTextureImage();
@@ -203,6 +247,8 @@ private:
     void CreateTextureImageVeiw();
     // Create a sampler for the texture.
     void CreateImageSampler();
+    // Recreate the texture sampler with the current filtering options, and point the descriptor set at it.
+    void RecreateImageSampler();
 
     // Find the format to use for depth.
     VkFormat FindDepthFormat();
@@ -213,22 +259,24 @@ private:
 
     // Create an image view
     VkImageView CreateImageView(VkImage vkhImage, VkFormat fmtFormat, VkImageAspectFlags flagImageAspect);
+    // Describe a 2D image with no mipmaps or layers.
+    VkImageCreateInfo DescribeImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat fmtFormat, VkImageTiling imtTiling, VkImageUsageFlags flagUsage, VkSampleCountFlagBits flgSamples);
     // Create an image.
     void CreateImage(uint32_t dimWidth, uint32_t dimHeight, VkFormat fmtFormat, VkImageTiling imtTiling, VkImageUsageFlags flagUsage, VkMemoryPropertyFlags flagMemoryProperties, VkImage &vkhImage, VkDeviceMemory &vkhMemory);
-    // Change image layout to what is needed for rendering.
-    void TransitionImageLayout(VkImage vkhImage, VkFormat fmtFormat, VkImageLayout imlOldLayout, VkImageLayout imlNewLayout);
-    // Copy a buffer to the image.
-    void CoypBufferToImage(VkBuffer vkhBuffer, VkImage vkhImage, uint32_t dimWidth, uint32_t dimHeight);
 
-    // Load the example model.
-    void LoadModel();
+    // Load the example model, for the given number of objects.
+    void LoadModel(uint32_t ctObjects);
 
     // Create vertex buffer.
     void CreateVertexBuffers();
+    // Create the buffer holding the position-only vertex stream.
+    void CreatePositionBuffer();
     // Create index buffer.
     void CreateIndexBuffers();
     // Create uniform buffer.
     void CreateUniformBuffers();
+    // Create the indirect buffer that culling writes draw commands to.
+    void CreateIndirectBuffer();
 
     // Create the descriptor pool.
     void CreateDescriptorPool();
@@ -240,12 +288,12 @@ private:
 
     // Create a buffer - vertex, transfer, index...
     void CreateBuffer(VkDeviceSize ctSize, VkBufferUsageFlags flgBufferUsage, VkMemoryPropertyFlags flagMemoryProperties, VkBuffer &vkhBuffer, VkDeviceMemory &vkhMemory);
-    // Copy memory from one buffer to the other.
-    void CopyBuffer(VkBuffer vkhSourceBuffer, VkBuffer vkhDestinationBuffer, VkDeviceSize ctSize);
+    // Submit all queued resource uploads in one command buffer, without waiting for them - frames wait for their ticket.
+    void SubmitUploads();
     // Start one time command recording.
     VkCommandBuffer BeginOneTimeCommand();
-    // Finish one time command recording.
-    void EndOneTimeCommand(VkCommandBuffer vkhCommandBuffer);
+    // Finish one time command recording and submit it. Returns the timeline value the commands completed at.
+    uint64_t EndOneTimeCommand(VkCommandBuffer vkhCommandBuffer);
 
 private:
     // Handle to the vulkan instance.
@@ -273,6 +321,8 @@ private:
     VkPresentModeKHR pmSurfacePresentMode;
     // Extent (resolution) selected for the swap chain.
     VkExtent2D exExtent;
+    // Extent the scene is rendered at - the swap chain extent, scaled by the resolution scale.
+    VkExtent2D exRenderExtent;
 
     // Handle to the debug callback.
     VkDebugReportCallbackEXT vkhValidationCallback;
@@ -293,14 +343,18 @@ private:
 
 	// Render pass applied to render objects.
 	VkRenderPass vkhRenderPass;
+    // Render pass drawing the objects after the occlusion test, over what the first one rendered. Null without
+    // occlusion culling.
+    VkRenderPass vkhLoadRenderPass;
 	
     // Descriptor set layout for uniform buffers.
     VkDescriptorSetLayout vkhDescriptorSetLayout;
 
     // Layout of the graphics pipeline.
 	VkPipelineLayout vkhPipelineLayout;
-    // Graphics pipeline.
-    VkPipeline vkhPipeline;
+    // Graphics pipelines, by the renderer's pipeline ids - the main one, the one used after the depth pre-pass that
+    // tests for equal depth without writing it, and the depth-only one of the pre-pass.
+    std::array<PipelineHandle, ctRendererPipelines> aphPipelines;
 
     // Framebuffers used to draw.
     std::vector<VkFramebuffer> avkhFramebuffers;
@@ -314,41 +368,142 @@ private:
     VkSemaphore vkhImageAvailableSemaphore;
     // Semaphore used to sync presentation.
     VkSemaphore vkhRenderSemaphore;
-
-    // Vertex buffer holding the shape's vertices.
-    VkBuffer vkhVertexBuffer;
-    // Memory used by the vertex buffer.
-    VkDeviceMemory vkhVertexBufferMemory;
-
-    // Image holding the texture data.
-    VkImage vkhImageData;
-    // Memory used by the Image buffer.
-    VkDeviceMemory vkhImageMemory;
-    // Image view describing how to access the image.
-    VkImageView vkhImageView;
+    // Timeline of the graphics queue - frames and uploads are submitted through it, and waited for by its values.
+    QueueTimeline qtGraphics;
+    // Timeline value of the last resource uploads, the frames that use the resources wait for it.
+    uint64_t iUploadTicket;
+
+    // Buffers, images and pipelines, addressed by handles. Resources that live for more than a frame go here.
+    BufferPool bpBuffers;
+    ImagePool ipImages;
+    PipelinePool ppPipelines;
+    // Resources and objects that were replaced, destroyed once the work that may use them completed.
+    DeletionQueue dqRetired;
+
+    // Vertex buffers, by the renderer's mesh ids - the one holding the shape's vertices, and the one holding only
+    // their positions.
+    std::array<BufferHandle, ctRendererMeshes> abhMeshVertexBuffers;
+
+    // Image holding the texture data, with its memory and the view describing how to access it.
+    ImageHandle ihTexture;
     // Sampler used in the fragment shader to read from the texture.
     VkSampler vkhImageSampler;
 
-    // Depth image that fragment depth will be written to and tested with.
+    // Copies and layout transitions queued by resource creation, submitted together.
+    UploadBatch ubUploads;
+
+    // Attachments that only live within a frame, sharing aliased memory.
+    TransientAttachmentPool tapAttachments;
+    // Depth image that fragment depth will be written to and tested with. Owned by the transient attachment pool.
     VkImage vkhDepthImageData;
-    // Memory used by the Depth image buffer.
-    VkDeviceMemory vkhDepthImageMemory;
     // Depth image view describing how to access the Depth image.
     VkImageView vkhDeptImageView;
+    // Multisampled color image the scene is rendered to before it is resolved to the swap chain image. Owned by the
+    // transient attachment pool, null without multisampling.
+    VkImage vkhColorImageData;
+    // Color image view describing how to access the multisampled color image.
+    VkImageView vkhColorImageView;
+    // Color image the scene is rendered or resolved to when the render extent differs from the swap chain's, and which
+    // is then scaled to the swap chain image. Owned by the transient attachment pool, null without a resolution scale.
+    VkImage vkhScaledImageData;
+    // Color image view describing how to access the scaled color image.
+    VkImageView vkhScaledImageView;
+    // Number of samples per pixel of the render targets.
+    VkSampleCountFlagBits flgSamples;
 
     // Index buffer holding the order of vertices in triangles.
-    VkBuffer vkhIndexBuffer;
-    // Memory used by the index buffer.
-    VkDeviceMemory vkhIndexBufferMemory;
+    BufferHandle bhIndexBuffer;
 
-    // Uniform buffer holding the order of vertices in triangles.
-    VkBuffer vkhUniformBuffer;
-    // Memory used by the uniform buffer.
-    VkDeviceMemory vkhUniformBufferMemory;
+    // Uniform buffer holding the frame constants.
+    BufferHandle bhUniformBuffer;
 
     // Descriptor pool used to allocate descriptor sets.
     VkDescriptorPool vkhDescriptorPool;
     // Descriptor set that will hold the uniform buffer.
     VkDescriptorSet vkhDescriptorSet;
+
+    // Mapped contents of the uniform buffer. It stays mapped, the renderer writes the frame constants into it.
+    UniformBufferObject *puboUniforms;
+
+    // API independent part of rendering - culling and draw list, on the render thread.
+    SceneRenderer srRenderer;
+
+    // Frames the main thread prepared, waiting for the render thread. Two, so that the main thread prepares the next
+    // frame while the render thread renders one.
+    SpscQueue<FramePacket, 2> qFramePackets;
+    // Thread that renders the frames.
+    std::thread thrRenderThread;
+    // Guards waking up the threads, the count of rendered frames and the render error - the queue needs no lock.
+    std::mutex mtxRenderThread;
+    // Signalled when a packet is pushed or the render thread should stop, and when a frame was rendered.
+    std::condition_variable cvPacketPushed;
+    std::condition_variable cvFrameRendered;
+    // Should the render thread stop, once it rendered the queued frames?
+    bool bStopRenderThread;
+    // Frames pushed by the main thread, and rendered by the render thread.
+    uint64_t ctPushedFrames;
+    uint64_t ctRenderedFrames;
+    // Error the render thread stopped on, to be thrown on the main thread.
+    std::exception_ptr epRenderError;
+    // Start of the frame the main thread prepares next, as the pacer decided.
+    FramePacer::Clock::time_point tmNextFrameStart;
+    // Did the window change size, so that the render thread has to recreate the swap chain before its next frame?
+    std::atomic<bool> bSwapChainOutdated;
+
+    // Transient memory of the frames, used in turn, and the one the next frame uses.
+    std::array<FrameArena, ctFrameArenaSlots> afaFrameArenas;
+    uint32_t iFrameArena;
+    // Schedules the barriers and layout transitions between the frame's passes.
+    RenderGraph rgFrameGraph;
+    // Synchronization states of the images the frame graph uses.
+    RenderGraph::ImageState isSwapChainImage;
+    RenderGraph::ImageState isTextureImage;
+    // Aspects of the depth image - depth, and stencil if the format has it.
+    VkImageAspectFlags flgDepthAspect;
+
+    // Indirect buffer holding the draw commands of the visible meshlets. It stays mapped, culling writes into it
+    // every frame.
+    BufferHandle bhIndirectBuffer;
+    // Mapped contents of the indirect buffer.
+    VkDrawIndexedIndirectCommand *adicIndirectCommands;
+    // Can one indirect draw call issue multiple draws?
+    bool bMultiDrawIndirect;
+    // Is anisotropic texture filtering enabled?
+    bool bSamplerAnisotropy;
+
+    // Decides when frames start, and measures their latency.
+    FramePacer fpPacer;
+    // Timestamps written at the start and end of a frame's commands.
+    VkQueryPool vkhTimestampQueryPool;
+    // Nanoseconds per timestamp tick.
+    float fTimestampPeriod;
+    // Valid bits of the graphics queue's timestamps, zero if it can't write them.
+    uint64_t flgTimestampMask;
+    // Counts the fragment shader invocations of the main pass.
+    VkQueryPool vkhStatisticsQueryPool;
+    // Can the device count pipeline statistics?
+    bool bPipelineStatistics;
+
+    // Decides whether the scene is rendered with a depth pre-pass.
+    DepthPrepassSelector dpsDepthPrepass;
+
+    // Tests the objects against a depth pyramid on the GPU.
+    OcclusionCuller ocOcclusion;
+    // Is occlusion culling used with the current render targets?
+    bool bOcclusionCulling;
+    // Objects culled by the occlusion test, over the frames rendered with it.
+    uint64_t ctTotalOccluded;
+    uint64_t ctOcclusionFrames;
+
+    // Id of the listener for option changes.
+    uint32_t iOptionsListener;
+
+    // GPU time of the frames rendered with a sample count.
+    struct SampleCountCost {
+        double tmTotalGpu;
+        uint32_t ctFrames;
+    };
+    // GPU time per sample count, to compare the cost of multisampling settings.
+    std::map<uint32_t, SampleCountCost> dicSampleCountCosts;
 };
 
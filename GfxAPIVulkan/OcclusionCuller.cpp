@@ -0,0 +1,366 @@
+#include "../PrecompiledHeader.h"
+#include "OcclusionCuller.h"
+
+// Largest size of the pyramid's first level along either axis. Fewer texels make the pyramid cheaper to build, and
+// the test only ever reads 2x2 texels, so the resolution matters little.
+static const uint32_t dimMaxFirstLevel = 256;
+// Threads per workgroup of the build shader along each axis, and of the test shader.
+static const uint32_t ctBuildGroupSize = 8;
+static const uint32_t ctTestGroupSize = 64;
+// Bindings of the descriptor set, as declared in the shaders.
+static const uint32_t iDepthBinding = 0;
+static const uint32_t iPyramidBinding = 1;
+static const uint32_t iCandidateBinding = 2;
+static const uint32_t iCommandBinding = 3;
+static const uint32_t iVisibilityBinding = 4;
+
+
+// Set the device, and create the compute pipelines that build the pyramid and test the objects.
+void OcclusionCuller::Initialize(VkPhysicalDevice vkhPhysicalDevice, VkDevice vkhLogicalDevice, VkShaderModule modBuild, VkShaderModule modTest) {
+    _vkhPhysicalDevice = vkhPhysicalDevice;
+    _vkhLogicalDevice = vkhLogicalDevice;
+
+    // depth is read texel by texel, so the sampler doesn't filter
+    VkSamplerCreateInfo infoSampler = {};
+    infoSampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    infoSampler.magFilter = VK_FILTER_NEAREST;
+    infoSampler.minFilter = VK_FILTER_NEAREST;
+    infoSampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    infoSampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    infoSampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    infoSampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    infoSampler.maxLod = 0.0f;
+    if (vkCreateSampler(_vkhLogicalDevice, &infoSampler, nullptr, &_vkhDepthSampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the occlusion depth sampler");
+    }
+
+    CreateDescriptorSet();
+    CreatePipelines(modBuild, modTest);
+}
+
+
+// Destroy the pipelines and buffers.
+void OcclusionCuller::Destroy() {
+    DestroyPyramid();
+
+    // release the mappings and the buffers of the objects
+    if (_vkhCandidateBuffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(_vkhLogicalDevice, _vkhCandidateMemory);
+        vkDestroyBuffer(_vkhLogicalDevice, _vkhCandidateBuffer, nullptr);
+        vkFreeMemory(_vkhLogicalDevice, _vkhCandidateMemory, nullptr);
+        vkUnmapMemory(_vkhLogicalDevice, _vkhVisibilityMemory);
+        vkDestroyBuffer(_vkhLogicalDevice, _vkhVisibilityBuffer, nullptr);
+        vkFreeMemory(_vkhLogicalDevice, _vkhVisibilityMemory, nullptr);
+    }
+
+    // destroy the pipelines and the objects they use
+    vkDestroyPipeline(_vkhLogicalDevice, _vkhBuildPipeline, nullptr);
+    vkDestroyPipeline(_vkhLogicalDevice, _vkhTestPipeline, nullptr);
+    vkDestroyPipelineLayout(_vkhLogicalDevice, _vkhPipelineLayout, nullptr);
+    vkDestroyDescriptorPool(_vkhLogicalDevice, _vkhDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(_vkhLogicalDevice, _vkhDescriptorSetLayout, nullptr);
+    vkDestroySampler(_vkhLogicalDevice, _vkhDepthSampler, nullptr);
+}
+
+
+// Create the descriptor set layout, pool and set shared by both shaders.
+void OcclusionCuller::CreateDescriptorSet() {
+    // the depth buffer is sampled, everything else is a storage buffer
+    std::array<VkDescriptorSetLayoutBinding, 5> ainfoBindings = {};
+    const uint32_t aiBindings[] = { iDepthBinding, iPyramidBinding, iCandidateBinding, iCommandBinding, iVisibilityBinding };
+    for (size_t iBinding = 0; iBinding < ainfoBindings.size(); iBinding++) {
+        ainfoBindings[iBinding].binding = aiBindings[iBinding];
+        ainfoBindings[iBinding].descriptorType = aiBindings[iBinding] == iDepthBinding ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        ainfoBindings[iBinding].descriptorCount = 1;
+        ainfoBindings[iBinding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    // create the layout
+    VkDescriptorSetLayoutCreateInfo infoDescriptorSetLayout = {};
+    infoDescriptorSetLayout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    infoDescriptorSetLayout.bindingCount = static_cast<uint32_t>(ainfoBindings.size());
+    infoDescriptorSetLayout.pBindings = ainfoBindings.data();
+    if (vkCreateDescriptorSetLayout(_vkhLogicalDevice, &infoDescriptorSetLayout, nullptr, &_vkhDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create the occlusion descriptor set layout");
+    }
+
+    // a pool for exactly the one set
+    std::array<VkDescriptorPoolSize, 2> ainfoPoolSizes = {};
+    ainfoPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    ainfoPoolSizes[0].descriptorCount = 1;
+    ainfoPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    ainfoPoolSizes[1].descriptorCount = 4;
+    VkDescriptorPoolCreateInfo infoDescriptorPool = {};
+    infoDescriptorPool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    infoDescriptorPool.poolSizeCount = static_cast<uint32_t>(ainfoPoolSizes.size());
+    infoDescriptorPool.pPoolSizes = ainfoPoolSizes.data();
+    infoDescriptorPool.maxSets = 1;
+    if (vkCreateDescriptorPool(_vkhLogicalDevice, &infoDescriptorPool, nullptr, &_vkhDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the occlusion descriptor pool");
+    }
+
+    // allocate the set - its bindings are written as the resources are created
+    VkDescriptorSetAllocateInfo infoDescriptorSetAllocation = {};
+    infoDescriptorSetAllocation.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    infoDescriptorSetAllocation.descriptorPool = _vkhDescriptorPool;
+    infoDescriptorSetAllocation.descriptorSetCount = 1;
+    infoDescriptorSetAllocation.pSetLayouts = &_vkhDescriptorSetLayout;
+    if (vkAllocateDescriptorSets(_vkhLogicalDevice, &infoDescriptorSetAllocation, &_vkhDescriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to allocate the occlusion descriptor set");
+    }
+}
+
+
+// Create the compute pipelines.
+void OcclusionCuller::CreatePipelines(VkShaderModule modBuild, VkShaderModule modTest) {
+    // both shaders take their constants as push constants, the range covers the larger of them
+    VkPushConstantRange rngConstants = {};
+    rngConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    rngConstants.offset = 0;
+    rngConstants.size = static_cast<uint32_t>(std::max(sizeof(HiZBuildConstants), sizeof(OcclusionTestConstants)));
+
+    VkPipelineLayoutCreateInfo infoPipelineLayout = {};
+    infoPipelineLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    infoPipelineLayout.setLayoutCount = 1;
+    infoPipelineLayout.pSetLayouts = &_vkhDescriptorSetLayout;
+    infoPipelineLayout.pushConstantRangeCount = 1;
+    infoPipelineLayout.pPushConstantRanges = &rngConstants;
+    if (vkCreatePipelineLayout(_vkhLogicalDevice, &infoPipelineLayout, nullptr, &_vkhPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the occlusion pipeline layout");
+    }
+
+    // describe both pipelines, and create them with one call
+    std::array<VkComputePipelineCreateInfo, 2> ainfoPipelines = {};
+    const VkShaderModule amodShaders[] = { modBuild, modTest };
+    for (size_t iPipeline = 0; iPipeline < ainfoPipelines.size(); iPipeline++) {
+        ainfoPipelines[iPipeline].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        ainfoPipelines[iPipeline].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        ainfoPipelines[iPipeline].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        ainfoPipelines[iPipeline].stage.module = amodShaders[iPipeline];
+        ainfoPipelines[iPipeline].stage.pName = "main";
+        ainfoPipelines[iPipeline].layout = _vkhPipelineLayout;
+    }
+    std::array<VkPipeline, 2> avkhPipelines;
+    if (vkCreateComputePipelines(_vkhLogicalDevice, VK_NULL_HANDLE, static_cast<uint32_t>(ainfoPipelines.size()), ainfoPipelines.data(), nullptr, avkhPipelines.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the occlusion pipelines");
+    }
+    _vkhBuildPipeline = avkhPipelines[0];
+    _vkhTestPipeline = avkhPipelines[1];
+}
+
+
+// Create the buffers for the objects' bounds and visibility.
+void OcclusionCuller::SetObjects(uint32_t ctObjects, VkBuffer vkhIndirectBuffer, VkDeviceSize ctIndirectSize) {
+    _ctObjects = ctObjects;
+
+    // the renderer writes the bounds every frame, and the visibility is read back after it - both stay mapped
+    const VkMemoryPropertyFlags flgHostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkDeviceSize ctCandidateSize = sizeof(OcclusionCandidate) * ctObjects;
+    CreateBuffer(ctCandidateSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, flgHostMemory, _vkhCandidateBuffer, _vkhCandidateMemory);
+    void *pMappedMemory;
+    vkMapMemory(_vkhLogicalDevice, _vkhCandidateMemory, 0, ctCandidateSize, 0, &pMappedMemory);
+    _aocCandidates = static_cast<OcclusionCandidate*>(pMappedMemory);
+
+    const VkDeviceSize ctVisibilitySize = sizeof(uint32_t) * ctObjects;
+    CreateBuffer(ctVisibilitySize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, flgHostMemory, _vkhVisibilityBuffer, _vkhVisibilityMemory);
+    vkMapMemory(_vkhLogicalDevice, _vkhVisibilityMemory, 0, ctVisibilitySize, 0, &pMappedMemory);
+    _abVisible = static_cast<uint32_t*>(pMappedMemory);
+    // until the first test, everything counts as visible
+    std::fill(_abVisible, _abVisible + ctObjects, 1u);
+
+    WriteBufferDescriptor(iCandidateBinding, _vkhCandidateBuffer, ctCandidateSize);
+    WriteBufferDescriptor(iCommandBinding, vkhIndirectBuffer, ctIndirectSize);
+    WriteBufferDescriptor(iVisibilityBinding, _vkhVisibilityBuffer, ctVisibilitySize);
+}
+
+
+// Create the pyramid for a depth buffer.
+void OcclusionCuller::SetDepthBuffer(VkImageView vkhDepthView, VkExtent2D exExtent, DeletionQueue &dqRetired) {
+    // the frames submitted so far may still build the old pyramid, so it is destroyed once they completed
+    if (_vkhPyramidBuffer != VK_NULL_HANDLE) {
+        const VkDevice vkhDevice = _vkhLogicalDevice;
+        const VkBuffer vkhOldBuffer = _vkhPyramidBuffer;
+        const VkDeviceMemory vkhOldMemory = _vkhPyramidMemory;
+        dqRetired.Retire([vkhDevice, vkhOldBuffer, vkhOldMemory]() {
+            vkDestroyBuffer(vkhDevice, vkhOldBuffer, nullptr);
+            vkFreeMemory(vkhDevice, vkhOldMemory, nullptr);
+        });
+        _vkhPyramidBuffer = VK_NULL_HANDLE;
+        _vkhPyramidMemory = VK_NULL_HANDLE;
+    }
+    _aplLevels.clear();
+    _exExtent = exExtent;
+
+    // the first level reduces the depth buffer by a power of two, small enough to fit the size limit
+    _ctFootprint = 1;
+    while ((std::max(exExtent.width, exExtent.height) + _ctFootprint - 1) / _ctFootprint > dimMaxFirstLevel) {
+        _ctFootprint *= 2;
+    }
+    // each further level halves the previous one, rounding up so that no texel is lost, down to a single texel
+    PyramidLevel plLevel = {};
+    plLevel.dimWidth = (exExtent.width + _ctFootprint - 1) / _ctFootprint;
+    plLevel.dimHeight = (exExtent.height + _ctFootprint - 1) / _ctFootprint;
+    plLevel.iOffset = 0;
+    _aplLevels.push_back(plLevel);
+    while (plLevel.dimWidth > 1 || plLevel.dimHeight > 1) {
+        plLevel.iOffset += plLevel.dimWidth * plLevel.dimHeight;
+        plLevel.dimWidth = (plLevel.dimWidth + 1) / 2;
+        plLevel.dimHeight = (plLevel.dimHeight + 1) / 2;
+        _aplLevels.push_back(plLevel);
+    }
+
+    // all levels go in one buffer that only the GPU accesses
+    const VkDeviceSize ctPyramidSize = sizeof(float) * (plLevel.iOffset + plLevel.dimWidth * plLevel.dimHeight);
+    CreateBuffer(ctPyramidSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vkhPyramidBuffer, _vkhPyramidMemory);
+    WriteBufferDescriptor(iPyramidBinding, _vkhPyramidBuffer, ctPyramidSize);
+
+    // point the build shader at the depth buffer, which it reads after the early draws
+    VkDescriptorImageInfo infoImage = {};
+    infoImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    infoImage.imageView = vkhDepthView;
+    infoImage.sampler = _vkhDepthSampler;
+    VkWriteDescriptorSet infoWrite = {};
+    infoWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    infoWrite.dstSet = _vkhDescriptorSet;
+    infoWrite.dstBinding = iDepthBinding;
+    infoWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    infoWrite.descriptorCount = 1;
+    infoWrite.pImageInfo = &infoImage;
+    vkUpdateDescriptorSets(_vkhLogicalDevice, 1, &infoWrite, 0, nullptr);
+}
+
+
+// Destroy the pyramid buffer, if there is one.
+void OcclusionCuller::DestroyPyramid() {
+    if (_vkhPyramidBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(_vkhLogicalDevice, _vkhPyramidBuffer, nullptr);
+        vkFreeMemory(_vkhLogicalDevice, _vkhPyramidMemory, nullptr);
+        _vkhPyramidBuffer = VK_NULL_HANDLE;
+        _vkhPyramidMemory = VK_NULL_HANDLE;
+    }
+    _aplLevels.clear();
+}
+
+
+// Point a binding of the descriptor set at a storage buffer.
+void OcclusionCuller::WriteBufferDescriptor(uint32_t iBinding, VkBuffer vkhBuffer, VkDeviceSize ctSize) {
+    VkDescriptorBufferInfo infoBuffer = {};
+    infoBuffer.buffer = vkhBuffer;
+    infoBuffer.offset = 0;
+    infoBuffer.range = ctSize;
+
+    VkWriteDescriptorSet infoWrite = {};
+    infoWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    infoWrite.dstSet = _vkhDescriptorSet;
+    infoWrite.dstBinding = iBinding;
+    infoWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    infoWrite.descriptorCount = 1;
+    infoWrite.pBufferInfo = &infoBuffer;
+    vkUpdateDescriptorSets(_vkhLogicalDevice, 1, &infoWrite, 0, nullptr);
+}
+
+
+// Record building the pyramid and testing the objects.
+void OcclusionCuller::Record(VkCommandBuffer vkhCommandBuffer, const glm::mat4 &tViewProjection) {
+    assert(_vkhPyramidBuffer != VK_NULL_HANDLE && _vkhCandidateBuffer != VK_NULL_HANDLE);
+
+    // the early draws read the indirect commands that the test rewrites
+    vkCmdPipelineBarrier(vkhCommandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+    vkCmdBindDescriptorSets(vkhCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _vkhPipelineLayout, 0, 1, &_vkhDescriptorSet, 0, nullptr);
+
+    // each level of the pyramid must be complete before the next one reads it
+    VkBufferMemoryBarrier infoLevelBarrier = {};
+    infoLevelBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    infoLevelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    infoLevelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    infoLevelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    infoLevelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    infoLevelBarrier.buffer = _vkhPyramidBuffer;
+    infoLevelBarrier.offset = 0;
+    infoLevelBarrier.size = VK_WHOLE_SIZE;
+
+    // build the levels, the first one from the depth buffer
+    vkCmdBindPipeline(vkhCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _vkhBuildPipeline);
+    for (size_t iLevel = 0; iLevel < _aplLevels.size(); iLevel++) {
+        const PyramidLevel &plTarget = _aplLevels[iLevel];
+        HiZBuildConstants hbcBuild = {};
+        hbcBuild.dimTargetWidth = plTarget.dimWidth;
+        hbcBuild.dimTargetHeight = plTarget.dimHeight;
+        hbcBuild.iTargetOffset = plTarget.iOffset;
+        if (iLevel == 0) {
+            hbcBuild.dimSourceWidth = _exExtent.width;
+            hbcBuild.dimSourceHeight = _exExtent.height;
+            hbcBuild.ctFootprint = _ctFootprint;
+            hbcBuild.bFromDepth = 1;
+        } else {
+            const PyramidLevel &plSource = _aplLevels[iLevel - 1];
+            hbcBuild.dimSourceWidth = plSource.dimWidth;
+            hbcBuild.dimSourceHeight = plSource.dimHeight;
+            hbcBuild.iSourceOffset = plSource.iOffset;
+            hbcBuild.ctFootprint = 2;
+            hbcBuild.bFromDepth = 0;
+        }
+        vkCmdPushConstants(vkhCommandBuffer, _vkhPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(hbcBuild), &hbcBuild);
+        vkCmdDispatch(vkhCommandBuffer, (plTarget.dimWidth + ctBuildGroupSize - 1) / ctBuildGroupSize, (plTarget.dimHeight + ctBuildGroupSize - 1) / ctBuildGroupSize, 1);
+        vkCmdPipelineBarrier(vkhCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &infoLevelBarrier, 0, nullptr);
+    }
+
+    // test the objects against the finished pyramid
+    OcclusionTestConstants otcTest = {};
+    otcTest.tViewProjection = tViewProjection;
+    otcTest.vecViewport = glm::vec2(static_cast<float>(_exExtent.width), static_cast<float>(_exExtent.height));
+    otcTest.dimLevelWidth = _aplLevels[0].dimWidth;
+    otcTest.dimLevelHeight = _aplLevels[0].dimHeight;
+    otcTest.ctLevels = static_cast<uint32_t>(_aplLevels.size());
+    otcTest.ctFootprint = _ctFootprint;
+    otcTest.ctObjects = _ctObjects;
+    vkCmdBindPipeline(vkhCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _vkhTestPipeline);
+    vkCmdPushConstants(vkhCommandBuffer, _vkhPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(otcTest), &otcTest);
+    vkCmdDispatch(vkhCommandBuffer, (_ctObjects + ctTestGroupSize - 1) / ctTestGroupSize, 1, 1);
+
+    // the late draws read the emptied commands, and the host reads the visibility once the frame is done
+    VkMemoryBarrier infoResultBarrier = {};
+    infoResultBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    infoResultBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    infoResultBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(vkhCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &infoResultBarrier, 0, nullptr, 0, nullptr);
+}
+
+
+// Create a buffer and bind memory with the given properties to it.
+void OcclusionCuller::CreateBuffer(VkDeviceSize ctSize, VkBufferUsageFlags flgUsage, VkMemoryPropertyFlags flgProperties, VkBuffer &vkhBuffer, VkDeviceMemory &vkhMemory) {
+    VkBufferCreateInfo infoBuffer = {};
+    infoBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    infoBuffer.size = ctSize;
+    infoBuffer.usage = flgUsage;
+    infoBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(_vkhLogicalDevice, &infoBuffer, nullptr, &vkhBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create an occlusion culling buffer");
+    }
+
+    VkMemoryRequirements propsMemoryRequirements = {};
+    vkGetBufferMemoryRequirements(_vkhLogicalDevice, vkhBuffer, &propsMemoryRequirements);
+    VkMemoryAllocateInfo infoMemory = {};
+    infoMemory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    infoMemory.allocationSize = propsMemoryRequirements.size;
+    infoMemory.memoryTypeIndex = FindMemoryType(propsMemoryRequirements.memoryTypeBits, flgProperties);
+    if (vkAllocateMemory(_vkhLogicalDevice, &infoMemory, nullptr, &vkhMemory) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to allocate memory for an occlusion culling buffer");
+    }
+    vkBindBufferMemory(_vkhLogicalDevice, vkhBuffer, vkhMemory, 0);
+}
+
+
+// Find a memory type among the allowed ones, with the given properties.
+uint32_t OcclusionCuller::FindMemoryType(uint32_t flgTypeFilter, VkMemoryPropertyFlags flgProperties) const {
+    VkPhysicalDeviceMemoryProperties propsDeviceMemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(_vkhPhysicalDevice, &propsDeviceMemoryProperties);
+
+    for (uint32_t iMemoryType = 0; iMemoryType < propsDeviceMemoryProperties.memoryTypeCount; iMemoryType++) {
+        if ((flgTypeFilter & (1 << iMemoryType)) && (propsDeviceMemoryProperties.memoryTypes[iMemoryType].propertyFlags & flgProperties) == flgProperties) {
+            return iMemoryType;
+        }
+    }
+    throw std::runtime_error("Unable to find a memory type for occlusion culling");
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "../Renderer/SceneRenderer.h"
+#include "DeletionQueue.h"
+#include <vulkan/vulkan.h>
+
+// GPU occlusion culling against a hierarchical depth pyramid. A compute pass reduces the depth buffer to a pyramid
+// whose texels hold the farthest depth of the area they cover, then tests each object's bounding sphere against the
+// level at which the sphere covers at most 2x2 texels. The renderer draws the objects visible in the last frame
+// first, the pyramid is built from their depth, and the other objects are drawn after the test, which empties the
+// draw commands of the hidden ones. The visibility of all objects is read back to split the next frame's objects.
+class OcclusionCuller {
+public:
+    OcclusionCuller() : _vkhPhysicalDevice(VK_NULL_HANDLE), _vkhLogicalDevice(VK_NULL_HANDLE), _vkhDepthSampler(VK_NULL_HANDLE),
+        _vkhDescriptorSetLayout(VK_NULL_HANDLE), _vkhDescriptorPool(VK_NULL_HANDLE), _vkhDescriptorSet(VK_NULL_HANDLE),
+        _vkhPipelineLayout(VK_NULL_HANDLE), _vkhBuildPipeline(VK_NULL_HANDLE), _vkhTestPipeline(VK_NULL_HANDLE),
+        _vkhPyramidBuffer(VK_NULL_HANDLE), _vkhPyramidMemory(VK_NULL_HANDLE), _ctFootprint(0),
+        _vkhCandidateBuffer(VK_NULL_HANDLE), _vkhCandidateMemory(VK_NULL_HANDLE), _aocCandidates(nullptr),
+        _vkhVisibilityBuffer(VK_NULL_HANDLE), _vkhVisibilityMemory(VK_NULL_HANDLE), _abVisible(nullptr), _ctObjects(0) {
+        _exExtent = {};
+    };
+    ~OcclusionCuller() {};
+
+    // Set the device, and create the compute pipelines that build the pyramid and test the objects.
+    void Initialize(VkPhysicalDevice vkhPhysicalDevice, VkDevice vkhLogicalDevice, VkShaderModule modBuild, VkShaderModule modTest);
+    // Destroy the pipelines and buffers.
+    void Destroy();
+
+    // Create the buffers for the objects' bounds and visibility. The test empties commands in the indirect buffer,
+    // which needs storage buffer usage.
+    void SetObjects(uint32_t ctObjects, VkBuffer vkhIndirectBuffer, VkDeviceSize ctIndirectSize);
+    // Create the pyramid for a depth buffer, which must be single sampled. Called whenever the depth buffer is recreated,
+    // the old pyramid is retired to dqRetired.
+    void SetDepthBuffer(VkImageView vkhDepthView, VkExtent2D exExtent, DeletionQueue &dqRetired);
+
+    // Get the memory the renderer writes the objects' bounds and draw ranges to, one candidate per object.
+    OcclusionCandidate *GetCandidates() const { return _aocCandidates; }
+    // Get the visibility of each object in the last test, non-zero if it is visible. Valid once the frame executed.
+    const uint32_t *GetVisibility() const { return _abVisible; }
+
+    // Record building the pyramid and testing the objects. The depth buffer must be in the shader read-only layout,
+    // and the early draws done with their indirect commands. Afterwards, the commands are ready for indirect draws
+    // and the visibility for reading on the host.
+    void Record(VkCommandBuffer vkhCommandBuffer, const glm::mat4 &tViewProjection);
+
+private:
+    // A level of the pyramid.
+    struct PyramidLevel {
+        uint32_t dimWidth;
+        uint32_t dimHeight;
+        // Offset of the level's first texel in the pyramid buffer.
+        uint32_t iOffset;
+    };
+
+    // Constants of the pyramid build shader, matching its push constant block.
+    struct HiZBuildConstants {
+        uint32_t dimSourceWidth;
+        uint32_t dimSourceHeight;
+        uint32_t dimTargetWidth;
+        uint32_t dimTargetHeight;
+        uint32_t iSourceOffset;
+        uint32_t iTargetOffset;
+        uint32_t ctFootprint;
+        uint32_t bFromDepth;
+    };
+
+    // Constants of the occlusion test shader, matching its push constant block.
+    struct OcclusionTestConstants {
+        glm::mat4 tViewProjection;
+        glm::vec2 vecViewport;
+        uint32_t dimLevelWidth;
+        uint32_t dimLevelHeight;
+        uint32_t ctLevels;
+        uint32_t ctFootprint;
+        uint32_t ctObjects;
+    };
+
+    // Create the descriptor set layout, pool and set shared by both shaders.
+    void CreateDescriptorSet();
+    // Create the compute pipelines.
+    void CreatePipelines(VkShaderModule modBuild, VkShaderModule modTest);
+    // Point a binding of the descriptor set at a storage buffer.
+    void WriteBufferDescriptor(uint32_t iBinding, VkBuffer vkhBuffer, VkDeviceSize ctSize);
+    // Destroy the pyramid buffer, if there is one.
+    void DestroyPyramid();
+
+    // Create a buffer and bind memory with the given properties to it.
+    void CreateBuffer(VkDeviceSize ctSize, VkBufferUsageFlags flgUsage, VkMemoryPropertyFlags flgProperties, VkBuffer &vkhBuffer, VkDeviceMemory &vkhMemory);
+    // Find a memory type among the allowed ones, with the given properties.
+    uint32_t FindMemoryType(uint32_t flgTypeFilter, VkMemoryPropertyFlags flgProperties) const;
+
+private:
+    VkPhysicalDevice _vkhPhysicalDevice;
+    VkDevice _vkhLogicalDevice;
+
+    // Sampler for reading depth texels, unfiltered.
+    VkSampler _vkhDepthSampler;
+    // Bindings of both shaders - depth buffer, pyramid, candidates, indirect commands and visibility.
+    VkDescriptorSetLayout _vkhDescriptorSetLayout;
+    VkDescriptorPool _vkhDescriptorPool;
+    VkDescriptorSet _vkhDescriptorSet;
+    // Pipeline layout shared by both pipelines, with room for the larger of their constants.
+    VkPipelineLayout _vkhPipelineLayout;
+    // Pipeline building a level of the pyramid, and the one testing the objects.
+    VkPipeline _vkhBuildPipeline;
+    VkPipeline _vkhTestPipeline;
+
+    // Levels of the pyramid, all in one device local buffer.
+    std::vector<PyramidLevel> _aplLevels;
+    VkBuffer _vkhPyramidBuffer;
+    VkDeviceMemory _vkhPyramidMemory;
+    // Size of the depth buffer, and its pixels per texel of the first level along each axis.
+    VkExtent2D _exExtent;
+    uint32_t _ctFootprint;
+
+    // Objects' bounds, written by the renderer through a persistent mapping.
+    VkBuffer _vkhCandidateBuffer;
+    VkDeviceMemory _vkhCandidateMemory;
+    OcclusionCandidate *_aocCandidates;
+    // Objects' visibility, read back through a persistent mapping.
+    VkBuffer _vkhVisibilityBuffer;
+    VkDeviceMemory _vkhVisibilityMemory;
+    uint32_t *_abVisible;
+    // Number of objects tested.
+    uint32_t _ctObjects;
+};
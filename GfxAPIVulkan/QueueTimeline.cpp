@@ -0,0 +1,148 @@
+#include "../PrecompiledHeader.h"
+#include "QueueTimeline.h"
+
+
+// Wait for a point on a timeline before the given stages.
+void QueueSubmission::WaitFor(QueueTimeline &qtTimeline, uint64_t iValue, VkPipelineStageFlags flgStages) {
+    // completed work needs no wait, which also covers the zero value of no work at all
+    if (qtTimeline.IsCompleted(iValue)) {
+        return;
+    }
+    if (ctTimelineWaits == ctMaxTimelineWaits) {
+        throw std::runtime_error("Too many timeline waits in one submission");
+    }
+    atwTimelineWaits[ctTimelineWaits++] = { qtTimeline.GetSemaphore(), iValue, flgStages };
+}
+
+
+// Create the timeline of a queue, starting at zero.
+void QueueTimeline::Initialize(VkDevice vkhLogicalDevice, VkQueue vkhQueue) {
+    _vkhLogicalDevice = vkhLogicalDevice;
+    _vkhQueue = vkhQueue;
+    _iSubmittedValue = 0;
+    _iCompletedValue = 0;
+
+    // a timeline semaphore is a binary semaphore's create info extended with its type
+    VkSemaphoreTypeCreateInfo infoSemaphoreType = {};
+    infoSemaphoreType.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    infoSemaphoreType.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    infoSemaphoreType.initialValue = 0;
+
+    VkSemaphoreCreateInfo infoSemaphore = {};
+    infoSemaphore.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    infoSemaphore.pNext = &infoSemaphoreType;
+    if (vkCreateSemaphore(_vkhLogicalDevice, &infoSemaphore, nullptr, &_vkhTimeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create a queue timeline");
+    }
+}
+
+
+// Destroy the timeline.
+void QueueTimeline::Destroy() {
+    vkDestroySemaphore(_vkhLogicalDevice, _vkhTimeline, nullptr);
+    _vkhTimeline = VK_NULL_HANDLE;
+}
+
+
+// Submit work to the queue.
+uint64_t QueueTimeline::Submit(const QueueSubmission &qsSubmission) {
+    std::lock_guard<std::mutex> lock(_mtxSubmit);
+    const uint64_t iValue = _iSubmittedValue.load(std::memory_order_relaxed) + 1;
+
+    // the timeline waits, then the swap chain image - the values of binary semaphores are ignored
+    std::array<VkSemaphore, QueueSubmission::ctMaxTimelineWaits + 1> avkhWaits;
+    std::array<uint64_t, QueueSubmission::ctMaxTimelineWaits + 1> aiWaitValues;
+    std::array<VkPipelineStageFlags, QueueSubmission::ctMaxTimelineWaits + 1> aflgWaitStages;
+    uint32_t ctWaits = 0;
+    for (uint32_t iWait = 0; iWait < qsSubmission.ctTimelineWaits; iWait++) {
+        const TimelineWait &twWait = qsSubmission.atwTimelineWaits[iWait];
+        avkhWaits[ctWaits] = twWait.vkhTimeline;
+        aiWaitValues[ctWaits] = twWait.iValue;
+        aflgWaitStages[ctWaits] = twWait.flgStages;
+        ctWaits++;
+    }
+    if (qsSubmission.vkhAcquireSemaphore != VK_NULL_HANDLE) {
+        avkhWaits[ctWaits] = qsSubmission.vkhAcquireSemaphore;
+        aiWaitValues[ctWaits] = 0;
+        aflgWaitStages[ctWaits] = qsSubmission.flgAcquireStages;
+        ctWaits++;
+    }
+
+    // this queue's timeline, then presentation
+    std::array<VkSemaphore, 2> avkhSignals = { _vkhTimeline, qsSubmission.vkhPresentSemaphore };
+    std::array<uint64_t, 2> aiSignalValues = { iValue, 0 };
+    const uint32_t ctSignals = qsSubmission.vkhPresentSemaphore != VK_NULL_HANDLE ? 2 : 1;
+
+    VkTimelineSemaphoreSubmitInfo infoTimelineSubmit = {};
+    infoTimelineSubmit.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    infoTimelineSubmit.waitSemaphoreValueCount = ctWaits;
+    infoTimelineSubmit.pWaitSemaphoreValues = aiWaitValues.data();
+    infoTimelineSubmit.signalSemaphoreValueCount = ctSignals;
+    infoTimelineSubmit.pSignalSemaphoreValues = aiSignalValues.data();
+
+    VkSubmitInfo infoSubmit = {};
+    infoSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    infoSubmit.pNext = &infoTimelineSubmit;
+    infoSubmit.waitSemaphoreCount = ctWaits;
+    infoSubmit.pWaitSemaphores = avkhWaits.data();
+    infoSubmit.pWaitDstStageMask = aflgWaitStages.data();
+    infoSubmit.commandBufferCount = qsSubmission.ctCommandBuffers;
+    infoSubmit.pCommandBuffers = qsSubmission.avkhCommandBuffers;
+    infoSubmit.signalSemaphoreCount = ctSignals;
+    infoSubmit.pSignalSemaphores = avkhSignals.data();
+
+    if (vkQueueSubmit(_vkhQueue, 1, &infoSubmit, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit to a queue");
+    }
+    // the value is only published once the work that signals it was submitted, so waiting for it can't hang
+    _iSubmittedValue.store(iValue, std::memory_order_release);
+    return iValue;
+}
+
+
+// Get the value the GPU reached.
+uint64_t QueueTimeline::GetCompletedValue() {
+    uint64_t iValue = 0;
+    if (vkGetSemaphoreCounterValue(_vkhLogicalDevice, _vkhTimeline, &iValue) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to query a queue timeline");
+    }
+    NoteCompleted(iValue);
+    return _iCompletedValue.load(std::memory_order_relaxed);
+}
+
+
+// Has the work up to a value completed?
+bool QueueTimeline::IsCompleted(uint64_t iValue) {
+    // the cached value answers without asking the device, for values that are long done
+    return iValue <= _iCompletedValue.load(std::memory_order_relaxed) || iValue <= GetCompletedValue();
+}
+
+
+// Wait on the host until the work up to a value completed.
+void QueueTimeline::Wait(uint64_t iValue) {
+    if (iValue <= _iCompletedValue.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (iValue > GetSubmittedValue()) {
+        throw std::runtime_error("Waiting for work that was never submitted");
+    }
+
+    VkSemaphoreWaitInfo infoWait = {};
+    infoWait.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    infoWait.semaphoreCount = 1;
+    infoWait.pSemaphores = &_vkhTimeline;
+    infoWait.pValues = &iValue;
+    if (vkWaitSemaphores(_vkhLogicalDevice, &infoWait, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to wait for a queue timeline");
+    }
+    NoteCompleted(iValue);
+}
+
+
+// Remember that the GPU reached a value.
+void QueueTimeline::NoteCompleted(uint64_t iValue) {
+    // keep the highest value seen, other threads may have seen a higher one in the meantime
+    uint64_t iCompleted = _iCompletedValue.load(std::memory_order_relaxed);
+    while (iCompleted < iValue && !_iCompletedValue.compare_exchange_weak(iCompleted, iValue, std::memory_order_relaxed)) {
+    }
+}
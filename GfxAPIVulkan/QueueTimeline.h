@@ -0,0 +1,87 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <mutex>
+
+class QueueTimeline;
+
+// Wait of a submission for a point on a timeline, before the given stages.
+struct TimelineWait {
+    VkSemaphore vkhTimeline;
+    uint64_t iValue;
+    VkPipelineStageFlags flgStages;
+};
+
+// Work to submit to a queue, and what it waits for. Dependencies on other work - on this queue, or on another queue
+// for transfer or compute - are points on their timelines. Binary semaphores are only for the swap chain: the one the
+// acquired image signals, and the one presentation waits for.
+struct QueueSubmission {
+    QueueSubmission() : avkhCommandBuffers(nullptr), ctCommandBuffers(0), ctTimelineWaits(0),
+        vkhAcquireSemaphore(VK_NULL_HANDLE), flgAcquireStages(0), vkhPresentSemaphore(VK_NULL_HANDLE) {};
+
+    // Most timeline points a submission waits for.
+    static const uint32_t ctMaxTimelineWaits = 4;
+
+    // Wait for a point on a timeline before the given stages. Points that already completed are skipped.
+    void WaitFor(QueueTimeline &qtTimeline, uint64_t iValue, VkPipelineStageFlags flgStages);
+
+    // Command buffers to execute.
+    const VkCommandBuffer *avkhCommandBuffers;
+    uint32_t ctCommandBuffers;
+    // Timeline points to wait for.
+    std::array<TimelineWait, ctMaxTimelineWaits> atwTimelineWaits;
+    uint32_t ctTimelineWaits;
+    // Semaphore signalled when the swap chain image was acquired, and the stages that wait for it. Null if the work
+    // doesn't render to the swap chain.
+    VkSemaphore vkhAcquireSemaphore;
+    VkPipelineStageFlags flgAcquireStages;
+    // Semaphore to signal for presentation, null if the work isn't presented.
+    VkSemaphore vkhPresentSemaphore;
+};
+
+
+// Progress of the GPU on a queue, as a timeline semaphore. Each submission to the queue signals the next value of the
+// timeline, so a value is a ticket for everything submitted up to it - a frame, an upload - and the work has completed
+// once the timeline reached it. Waiting for a ticket on the host, checking it without waiting, and making work on
+// another queue wait for it all use the same value, so one counter replaces per-frame fences and idle waits.
+class QueueTimeline {
+public:
+    QueueTimeline() : _vkhLogicalDevice(VK_NULL_HANDLE), _vkhQueue(VK_NULL_HANDLE), _vkhTimeline(VK_NULL_HANDLE),
+        _iSubmittedValue(0), _iCompletedValue(0) {};
+    ~QueueTimeline() {};
+
+    // Create the timeline of a queue, starting at zero.
+    void Initialize(VkDevice vkhLogicalDevice, VkQueue vkhQueue);
+    // Destroy the timeline. Only once its work completed.
+    void Destroy();
+
+    // Submit work to the queue. Returns the value the timeline reaches once it completed.
+    uint64_t Submit(const QueueSubmission &qsSubmission);
+
+    // Get the value of the last submitted work.
+    uint64_t GetSubmittedValue() const { return _iSubmittedValue.load(std::memory_order_acquire); }
+    // Get the value the GPU reached - all work up to it completed.
+    uint64_t GetCompletedValue();
+    // Has the work up to a value completed?
+    bool IsCompleted(uint64_t iValue);
+    // Wait on the host until the work up to a value completed.
+    void Wait(uint64_t iValue);
+
+    // Get the timeline semaphore, for waiting on it from another queue.
+    VkSemaphore GetSemaphore() const { return _vkhTimeline; }
+
+private:
+    // Remember that the GPU reached a value.
+    void NoteCompleted(uint64_t iValue);
+
+private:
+    VkDevice _vkhLogicalDevice;
+    VkQueue _vkhQueue;
+    VkSemaphore _vkhTimeline;
+    // Value of the last submitted work.
+    std::atomic<uint64_t> _iSubmittedValue;
+    // Highest value the GPU was seen to reach, so that completed values aren't queried again.
+    std::atomic<uint64_t> _iCompletedValue;
+    // Guards submitting - the queue must not be used by two threads at once.
+    std::mutex _mtxSubmit;
+};
@@ -0,0 +1,306 @@
+#include "../PrecompiledHeader.h"
+#include "RenderGraph.h"
+
+// Accesses that write memory. Only these need to be made available to later accesses.
+static const VkAccessFlags flgWriteAccesses = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+// Get the state of an image that was just created, with undefined contents.
+RenderGraph::ImageState RenderGraph::GetUndefinedState() {
+    // nothing accessed the image yet, so there is nothing to wait for
+    return { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0 };
+}
+
+
+// Get the state of a swap chain image that was just acquired.
+RenderGraph::ImageState RenderGraph::GetAcquiredState() {
+    // the contents are cleared by the frame anyway, so they can be treated as undefined; the presentation engine may
+    // still be reading the image until the acquire semaphore is signaled, which is waited on at color output
+    return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0 };
+}
+
+
+// Get the state of an image after it was written in a certain way, outside of the graph.
+RenderGraph::ImageState RenderGraph::GetWrittenState(ImageUsage usUsage) {
+    const UsageInfo uiUsage = GetUsageInfo(usUsage);
+    return { uiUsage.imlLayout, uiUsage.flgStages, uiUsage.flgAccess & flgWriteAccesses, 0 };
+}
+
+
+// Get the state of an image in the layout of a usage, with all earlier accesses already finished.
+RenderGraph::ImageState RenderGraph::GetIdleState(ImageUsage usUsage) {
+    return { GetUsageInfo(usUsage).imlLayout, 0, 0, 0 };
+}
+
+
+// Get the layout, stages and accesses of an image usage.
+RenderGraph::UsageInfo RenderGraph::GetUsageInfo(ImageUsage usUsage) {
+    switch (usUsage) {
+    case IMAGE_USAGE_COLOR_ATTACHMENT:
+        return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+    case IMAGE_USAGE_DEPTH_ATTACHMENT:
+        // depth is tested before and written after the fragment shader
+        return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+    case IMAGE_USAGE_SHADER_READ:
+        return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+    case IMAGE_USAGE_COMPUTE_READ:
+        return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+    case IMAGE_USAGE_TRANSFER_SOURCE:
+        return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+    case IMAGE_USAGE_TRANSFER_DESTINATION:
+        return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+    case IMAGE_USAGE_PRESENT:
+        // presentation is synchronized with semaphores, the barrier only needs to change the layout
+        return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0 };
+    }
+    throw std::runtime_error("Unknown render graph image usage");
+}
+
+
+// Forget the passes and images of the previous frame.
+void RenderGraph::Reset(LinearArena &arFrame) {
+    // the arrays keep their memory for the next frame, only the per-pass ones come from the frame's arena
+    _parFrame = &arFrame;
+    _agiImages.clear();
+    _agpPasses.clear();
+    _agbBarriers.clear();
+    _aisFinalStates.clear();
+    _gsStatistics = {};
+}
+
+
+// Import an image for use in this frame.
+uint32_t RenderGraph::ImportImage(VkImage vkhImage, VkImageAspectFlags flgAspect, ImageState &isState) {
+    GraphImage giImage = {};
+    giImage.vkhImage = vkhImage;
+    giImage.flgAspect = flgAspect;
+    giImage.isInitialState = isState;
+    giImage.pisState = &isState;
+    giImage.bOutput = false;
+    _agiImages.push_back(giImage);
+    return static_cast<uint32_t>(_agiImages.size() - 1);
+}
+
+
+// Import a transient attachment.
+uint32_t RenderGraph::ImportTransientImage(VkImage vkhImage, VkImageAspectFlags flgAspect) {
+    GraphImage giImage = {};
+    giImage.vkhImage = vkhImage;
+    giImage.flgAspect = flgAspect;
+    // the contents are undefined, and whatever used the memory before - this or an aliased attachment, in this or
+    // the previous frame - was an attachment or the source of a copy, so waiting for all those stages covers it
+    giImage.isInitialState.imlLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    giImage.isInitialState.flgWriteStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+        | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    giImage.isInitialState.flgWriteAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    giImage.isInitialState.flgReadStages = 0;
+    // the state isn't kept between frames
+    giImage.pisState = nullptr;
+    giImage.bOutput = false;
+    _agiImages.push_back(giImage);
+    return static_cast<uint32_t>(_agiImages.size() - 1);
+}
+
+
+// Mark an image as a result of the frame, in the given final usage.
+void RenderGraph::MarkOutput(uint32_t iImage, ImageUsage usFinalUsage) {
+    _agiImages[iImage].bOutput = true;
+    _agiImages[iImage].usFinalUsage = usFinalUsage;
+}
+
+
+// Declare a pass.
+uint32_t RenderGraph::AddPass(const std::string &strName, const std::function<void(VkCommandBuffer)> &fnRecord) {
+    GraphPass gpPass = { strName, fnRecord, ArenaVector<ImageAccess>(*_parFrame), false, false };
+    _agpPasses.push_back(std::move(gpPass));
+    return static_cast<uint32_t>(_agpPasses.size() - 1);
+}
+
+
+// Declare that a pass reads an image.
+void RenderGraph::ReadImage(uint32_t iPass, uint32_t iImage, ImageUsage usUsage) {
+    _agpPasses[iPass].aiaAccesses.push_back({ iImage, usUsage, false });
+}
+
+
+// Declare that a pass writes an image.
+void RenderGraph::WriteImage(uint32_t iPass, uint32_t iImage, ImageUsage usUsage) {
+    _agpPasses[iPass].aiaAccesses.push_back({ iImage, usUsage, true });
+}
+
+
+// Never cull a pass.
+void RenderGraph::KeepPass(uint32_t iPass) {
+    _agpPasses[iPass].bKeep = true;
+}
+
+
+// Mark the passes that contribute to the outputs.
+void RenderGraph::CullPasses() {
+    // images whose contents are still needed by a later pass or after the frame
+    ArenaVector<bool> abNeeded(_agiImages.size(), false, *_parFrame);
+    for (size_t iImage = 0; iImage < _agiImages.size(); iImage++) {
+        abNeeded[iImage] = _agiImages[iImage].bOutput;
+    }
+
+    // walk backwards, so that each pass knows whether anything after it needs its results
+    for (size_t iPass = _agpPasses.size(); iPass-- > 0;) {
+        GraphPass &gpPass = _agpPasses[iPass];
+        // the pass is needed if it writes a needed image, or its results are used outside of the graph
+        gpPass.bAlive = gpPass.bKeep;
+        for (const ImageAccess &iaAccess : gpPass.aiaAccesses) {
+            if (iaAccess.bWrite && abNeeded[iaAccess.iImage]) {
+                gpPass.bAlive = true;
+            }
+        }
+        if (!gpPass.bAlive) {
+            _gsStatistics.ctCulledPasses++;
+            continue;
+        }
+        // the images the pass reads are needed from the earlier passes
+        for (const ImageAccess &iaAccess : gpPass.aiaAccesses) {
+            if (!iaAccess.bWrite) {
+                abNeeded[iaAccess.iImage] = true;
+            }
+        }
+    }
+}
+
+
+// Add an image access to a barrier, if the image's current state requires one, and advance the state.
+void RenderGraph::AddImageTransition(uint32_t iImage, ImageUsage usUsage, bool bWrite, ImageState &isState, GraphBarrier &gbBarrier) {
+    const UsageInfo uiUsage = GetUsageInfo(usUsage);
+    const bool bLayoutChange = isState.imlLayout != uiUsage.imlLayout;
+
+    // find what the access has to wait for
+    VkPipelineStageFlags flgWaitStages;
+    if (bWrite || bLayoutChange) {
+        // writes, including layout transitions, wait for all earlier accesses to finish
+        flgWaitStages = isState.flgWriteStages | isState.flgReadStages;
+    } else if (isState.flgWriteStages != 0) {
+        // reads wait for the last write or layout transition, unless an earlier read in the same stages already did;
+        // after a transition done for a read, the stages of that read are what a read from other stages chains to
+        flgWaitStages = ((uiUsage.flgStages & ~isState.flgReadStages) != 0) ? isState.flgWriteStages : 0;
+    } else {
+        // reads of an image that wasn't written don't need to wait for anything
+        flgWaitStages = 0;
+    }
+
+    // a barrier is needed if there is something to wait for, or the layout changes
+    if (flgWaitStages != 0 || bLayoutChange) {
+        // describe the transition
+        VkImageMemoryBarrier infoImageBarrier = {};
+        infoImageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        // make the last write available, and visible to this access
+        infoImageBarrier.srcAccessMask = isState.flgWriteAccess;
+        infoImageBarrier.dstAccessMask = uiUsage.flgAccess;
+        // transition from the layout the image is currently in
+        infoImageBarrier.oldLayout = isState.imlLayout;
+        infoImageBarrier.newLayout = uiUsage.imlLayout;
+        // not transferring queue family ownership
+        infoImageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        infoImageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        // the whole image - no mipmaps or layers
+        infoImageBarrier.image = _agiImages[iImage].vkhImage;
+        infoImageBarrier.subresourceRange.aspectMask = _agiImages[iImage].flgAspect;
+        infoImageBarrier.subresourceRange.baseMipLevel = 0;
+        infoImageBarrier.subresourceRange.levelCount = 1;
+        infoImageBarrier.subresourceRange.baseArrayLayer = 0;
+        infoImageBarrier.subresourceRange.layerCount = 1;
+
+        // merge it into the pass' barrier
+        gbBarrier.ainfoImageBarriers.push_back(infoImageBarrier);
+        gbBarrier.flgSourceStages |= flgWaitStages;
+        gbBarrier.flgDestinationStages |= uiUsage.flgStages;
+    }
+
+    // advance the state
+    isState.imlLayout = uiUsage.imlLayout;
+    if (bWrite) {
+        // the new write is what later accesses wait for
+        isState.flgWriteStages = uiUsage.flgStages;
+        isState.flgWriteAccess = uiUsage.flgAccess & flgWriteAccesses;
+        isState.flgReadStages = 0;
+    } else if (bLayoutChange) {
+        // the transition was made visible to this read only, other readers have to wait for its stages
+        isState.flgWriteStages = uiUsage.flgStages;
+        isState.flgWriteAccess = 0;
+        isState.flgReadStages = uiUsage.flgStages;
+    } else {
+        isState.flgReadStages |= uiUsage.flgStages;
+    }
+}
+
+
+// Cull unused passes and compute the barriers in front of each remaining pass.
+void RenderGraph::Compile() {
+    _gsStatistics.ctPasses = static_cast<uint32_t>(_agpPasses.size());
+    CullPasses();
+
+    // simulate the image states through the frame, starting from the imported ones
+    _aisFinalStates.resize(_agiImages.size());
+    for (size_t iImage = 0; iImage < _agiImages.size(); iImage++) {
+        _aisFinalStates[iImage] = _agiImages[iImage].isInitialState;
+    }
+
+    // one barrier in front of each pass, holding all the transitions it needs
+    for (uint32_t iPass = 0; iPass < _agpPasses.size(); iPass++) {
+        const GraphPass &gpPass = _agpPasses[iPass];
+        if (!gpPass.bAlive) {
+            continue;
+        }
+        GraphBarrier gbBarrier = { iPass, 0, 0, ArenaVector<VkImageMemoryBarrier>(*_parFrame) };
+        for (const ImageAccess &iaAccess : gpPass.aiaAccesses) {
+            AddImageTransition(iaAccess.iImage, iaAccess.usUsage, iaAccess.bWrite, _aisFinalStates[iaAccess.iImage], gbBarrier);
+        }
+        if (!gbBarrier.ainfoImageBarriers.empty()) {
+            _agbBarriers.push_back(std::move(gbBarrier));
+        }
+    }
+
+    // and one at the end, bringing the outputs to their final usage
+    GraphBarrier gbFinalBarrier = { static_cast<uint32_t>(_agpPasses.size()), 0, 0, ArenaVector<VkImageMemoryBarrier>(*_parFrame) };
+    for (uint32_t iImage = 0; iImage < _agiImages.size(); iImage++) {
+        if (_agiImages[iImage].bOutput) {
+            AddImageTransition(iImage, _agiImages[iImage].usFinalUsage, false, _aisFinalStates[iImage], gbFinalBarrier);
+        }
+    }
+    if (!gbFinalBarrier.ainfoImageBarriers.empty()) {
+        _agbBarriers.push_back(std::move(gbFinalBarrier));
+    }
+
+    // count the synchronization
+    _gsStatistics.ctBarrierCommands = static_cast<uint32_t>(_agbBarriers.size());
+    for (const GraphBarrier &gbBarrier : _agbBarriers) {
+        _gsStatistics.ctImageBarriers += static_cast<uint32_t>(gbBarrier.ainfoImageBarriers.size());
+    }
+}
+
+
+// Record the compiled frame to a command buffer and update the states of the imported images.
+void RenderGraph::Execute(VkCommandBuffer vkhCommandBuffer, PFN_vkCmdPipelineBarrier pfnPipelineBarrier) {
+    size_t iBarrier = 0;
+    for (uint32_t iPass = 0; iPass <= _agpPasses.size(); iPass++) {
+        // record the barrier in front of the pass
+        if (iBarrier < _agbBarriers.size() && _agbBarriers[iBarrier].iPass == iPass) {
+            const GraphBarrier &gbBarrier = _agbBarriers[iBarrier];
+            // an image that wasn't used before doesn't wait for anything, which must be expressed as the top of the pipe
+            const VkPipelineStageFlags flgSourceStages = gbBarrier.flgSourceStages != 0 ? gbBarrier.flgSourceStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            pfnPipelineBarrier(vkhCommandBuffer, flgSourceStages, gbBarrier.flgDestinationStages, 0, 0, nullptr, 0, nullptr,
+                static_cast<uint32_t>(gbBarrier.ainfoImageBarriers.size()), gbBarrier.ainfoImageBarriers.data());
+            iBarrier++;
+        }
+        // record the pass itself
+        if (iPass < _agpPasses.size() && _agpPasses[iPass].bAlive) {
+            _agpPasses[iPass].fnRecord(vkhCommandBuffer);
+        }
+    }
+
+    // the images are now in the states the frame leaves them in
+    for (size_t iImage = 0; iImage < _agiImages.size(); iImage++) {
+        if (_agiImages[iImage].pisState != nullptr) {
+            *_agiImages[iImage].pisState = _aisFinalStates[iImage];
+        }
+    }
+}
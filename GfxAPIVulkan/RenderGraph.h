@@ -0,0 +1,157 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <functional>
+#include "../Memory/FrameArena.h"
+
+// Frame graph that schedules synchronization between render passes. Each frame, the images used in the frame are
+// imported and the passes are declared together with the images they read and write. The graph then culls passes
+// whose results are never used, and records the remaining ones in order, each preceded by a single pipeline barrier
+// that holds all the layout transitions and memory dependencies the pass needs. Passes that only read an image
+// don't wait on each other, and images already in the right state get no barrier at all.
+class RenderGraph {
+public:
+    // Ways a pass can use an image. Each maps to a layout, the pipeline stages and the memory accesses involved.
+    enum ImageUsage {
+        IMAGE_USAGE_COLOR_ATTACHMENT,
+        IMAGE_USAGE_DEPTH_ATTACHMENT,
+        IMAGE_USAGE_SHADER_READ,
+        IMAGE_USAGE_COMPUTE_READ,
+        IMAGE_USAGE_TRANSFER_SOURCE,
+        IMAGE_USAGE_TRANSFER_DESTINATION,
+        IMAGE_USAGE_PRESENT,
+    };
+
+    // Synchronization state of an image between frames. Owned by whoever owns the image, the graph updates it.
+    struct ImageState {
+        // Current layout of the image.
+        VkImageLayout imlLayout;
+        // Stages and accesses of the last write, which later reads and writes have to wait for. After a layout transition
+        // for a read, the stages are those of the read and there are no accesses left to make available.
+        VkPipelineStageFlags flgWriteStages;
+        VkAccessFlags flgWriteAccess;
+        // Stages that read the image since the last write. They already see the write, and the next write has to wait for them.
+        VkPipelineStageFlags flgReadStages;
+    };
+
+    // Counters for the last compiled frame.
+    struct GraphStatistics {
+        // Passes declared and passes culled because nothing used their results.
+        uint32_t ctPasses;
+        uint32_t ctCulledPasses;
+        // Pipeline barrier commands recorded, and image barriers in them.
+        uint32_t ctBarrierCommands;
+        uint32_t ctImageBarriers;
+    };
+
+public:
+    RenderGraph() : _parFrame(nullptr) {};
+    ~RenderGraph() {};
+
+    // Get the state of an image that was just created, with undefined contents.
+    static ImageState GetUndefinedState();
+    // Get the state of a swap chain image that was just acquired. The contents are undefined, and writing must wait for
+    // the stage the acquire semaphore is waited on.
+    static ImageState GetAcquiredState();
+    // Get the state of an image after it was written in a certain way, outside of the graph.
+    static ImageState GetWrittenState(ImageUsage usUsage);
+    // Get the state of an image in the layout of a usage, with all earlier accesses already finished.
+    static ImageState GetIdleState(ImageUsage usUsage);
+
+    // Forget the passes and images of the previous frame. The accesses and barriers of the new frame are allocated from
+    // arFrame, which must stay until the next reset.
+    void Reset(LinearArena &arFrame);
+    // Import an image for use in this frame. The state is read now and updated when the frame is executed.
+    uint32_t ImportImage(VkImage vkhImage, VkImageAspectFlags flgAspect, ImageState &isState);
+    // Import a transient attachment. Its contents are discarded at the start of the frame, and its first use waits
+    // for any attachment use or copy from it before, since the memory may be aliased with other transient attachments.
+    uint32_t ImportTransientImage(VkImage vkhImage, VkImageAspectFlags flgAspect);
+    // Mark an image as a result of the frame, in the given final usage. Passes leading to it are never culled.
+    void MarkOutput(uint32_t iImage, ImageUsage usFinalUsage);
+
+    // Declare a pass. The function records the pass' commands.
+    uint32_t AddPass(const std::string &strName, const std::function<void(VkCommandBuffer)> &fnRecord);
+    // Declare that a pass reads an image.
+    void ReadImage(uint32_t iPass, uint32_t iImage, ImageUsage usUsage);
+    // Declare that a pass writes an image.
+    void WriteImage(uint32_t iPass, uint32_t iImage, ImageUsage usUsage);
+    // Never cull a pass, for passes whose results aren't images the graph tracks - like buffers read by later passes.
+    void KeepPass(uint32_t iPass);
+
+    // Cull unused passes and compute the barriers in front of each remaining pass.
+    void Compile();
+    // Record the compiled frame to a command buffer and update the states of the imported images. The barriers are
+    // recorded through pfnPipelineBarrier, which the Null API replaces, as it has no command buffers.
+    void Execute(VkCommandBuffer vkhCommandBuffer, PFN_vkCmdPipelineBarrier pfnPipelineBarrier = vkCmdPipelineBarrier);
+
+    // Get the counters for the last compiled frame.
+    const GraphStatistics &GetStatistics() const { return _gsStatistics; }
+
+private:
+    // An image imported into the frame.
+    struct GraphImage {
+        VkImage vkhImage;
+        VkImageAspectFlags flgAspect;
+        // State at the start of the frame.
+        ImageState isInitialState;
+        // State owned by the caller, updated after execution. Null for transient images.
+        ImageState *pisState;
+        // Is the image a result of the frame, and how is it used afterwards?
+        bool bOutput;
+        ImageUsage usFinalUsage;
+    };
+
+    // Layout, stages and accesses of an image usage.
+    struct UsageInfo {
+        VkImageLayout imlLayout;
+        VkPipelineStageFlags flgStages;
+        VkAccessFlags flgAccess;
+    };
+    // Get the layout, stages and accesses of an image usage.
+    static UsageInfo GetUsageInfo(ImageUsage usUsage);
+
+    // Use of an image by a pass.
+    struct ImageAccess {
+        uint32_t iImage;
+        ImageUsage usUsage;
+        bool bWrite;
+    };
+
+    // A declared pass.
+    struct GraphPass {
+        std::string strName;
+        std::function<void(VkCommandBuffer)> fnRecord;
+        ArenaVector<ImageAccess> aiaAccesses;
+        // Must the pass be kept even if it writes no needed image?
+        bool bKeep;
+        // Was the pass kept by culling?
+        bool bAlive;
+    };
+
+    // Barrier recorded in front of a pass, or at the end of the frame.
+    struct GraphBarrier {
+        // Pass the barrier precedes, or the number of passes for the final barrier.
+        uint32_t iPass;
+        VkPipelineStageFlags flgSourceStages;
+        VkPipelineStageFlags flgDestinationStages;
+        ArenaVector<VkImageMemoryBarrier> ainfoImageBarriers;
+    };
+
+    // Add an image access to a barrier, if the image's current state requires one, and advance the state.
+    void AddImageTransition(uint32_t iImage, ImageUsage usUsage, bool bWrite, ImageState &isState, GraphBarrier &gbBarrier);
+    // Mark the passes that contribute to the outputs.
+    void CullPasses();
+
+private:
+    // Memory of the frame's per-pass arrays.
+    LinearArena *_parFrame;
+    // Images imported into this frame.
+    std::vector<GraphImage> _agiImages;
+    // Passes, in declaration order.
+    std::vector<GraphPass> _agpPasses;
+    // Barriers of the compiled frame, in recording order.
+    std::vector<GraphBarrier> _agbBarriers;
+    // States the images will be in after the compiled frame executes.
+    std::vector<ImageState> _aisFinalStates;
+    // Counters for the last compiled frame.
+    GraphStatistics _gsStatistics;
+};
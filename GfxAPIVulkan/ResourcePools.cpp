@@ -0,0 +1,213 @@
+#include "../PrecompiledHeader.h"
+#include "ResourcePools.h"
+
+// Generations wrap around within the bits above the slot.
+static const uint32_t ctGenerations = 1u << (32 - HandleAllocator::ctSlotBits);
+
+
+// Set the number of slots, all of them free.
+void HandleAllocator::Initialize(uint32_t ctSlots) {
+    if (ctSlots == 0 || ctSlots > ctMaxSlots) {
+        throw std::runtime_error("Resource pool size out of range");
+    }
+    _ctSlots = ctSlots;
+    _aulSlotHandles.reset(new std::atomic<uint32_t>[ctSlots]);
+    _aiGenerations.assign(ctSlots, 1);
+    // the first slots are allocated first, so that the used part of the arrays stays dense
+    _aiFreeSlots.resize(ctSlots);
+    for (uint32_t iSlot = 0; iSlot < ctSlots; iSlot++) {
+        _aulSlotHandles[iSlot].store(0, std::memory_order_relaxed);
+        _aiFreeSlots[iSlot] = ctSlots - 1 - iSlot;
+    }
+}
+
+
+// Allocate a free slot, returning its handle.
+uint32_t HandleAllocator::Allocate() {
+    std::lock_guard<std::mutex> lock(_mtxSlots);
+    if (_aiFreeSlots.empty()) {
+        throw std::runtime_error("Resource pool is full");
+    }
+    const uint32_t iSlot = _aiFreeSlots.back();
+    _aiFreeSlots.pop_back();
+    const uint32_t ulHandle = (_aiGenerations[iSlot] << ctSlotBits) | iSlot;
+    _aulSlotHandles[iSlot].store(ulHandle, std::memory_order_release);
+    return ulHandle;
+}
+
+
+// Free the slot of a handle.
+void HandleAllocator::Free(uint32_t ulHandle) {
+    std::lock_guard<std::mutex> lock(_mtxSlots);
+    if (!IsValid(ulHandle)) {
+        throw std::runtime_error("Freeing a stale resource handle");
+    }
+    const uint32_t iSlot = GetSlot(ulHandle);
+    _aulSlotHandles[iSlot].store(0, std::memory_order_release);
+    // the next allocation of the slot gets a new generation, skipping zero so that no handle is null
+    _aiGenerations[iSlot] = (_aiGenerations[iSlot] + 1) % ctGenerations;
+    if (_aiGenerations[iSlot] == 0) {
+        _aiGenerations[iSlot] = 1;
+    }
+    _aiFreeSlots.push_back(iSlot);
+}
+
+
+// Set the device the buffers are on, and the most buffers the pool holds.
+void BufferPool::Initialize(VkDevice vkhLogicalDevice, uint32_t ctBuffers) {
+    _vkhLogicalDevice = vkhLogicalDevice;
+    _haHandles.Initialize(ctBuffers);
+    _avkhBuffers.assign(ctBuffers, VK_NULL_HANDLE);
+    _avkhMemory.assign(ctBuffers, VK_NULL_HANDLE);
+    _actSizes.assign(ctBuffers, 0);
+    _apMapped.assign(ctBuffers, nullptr);
+}
+
+
+// Destroy the buffers still in the pool.
+void BufferPool::DestroyAll() {
+    for (uint32_t iSlot = 0; iSlot < _haHandles.GetSlotCount(); iSlot++) {
+        const uint32_t ulHandle = _haHandles.GetSlotHandle(iSlot);
+        if (ulHandle != 0) {
+            Destroy(BufferHandle(ulHandle));
+        }
+    }
+}
+
+
+// Take over a buffer and its memory.
+BufferHandle BufferPool::Add(VkBuffer vkhBuffer, VkDeviceMemory vkhMemory, VkDeviceSize ctSize, void *pMapped) {
+    // the slot is only written before its handle is handed out, readers only get to it through the handle
+    const uint32_t ulHandle = _haHandles.Allocate();
+    const uint32_t iSlot = HandleAllocator::GetSlot(ulHandle);
+    _avkhBuffers[iSlot] = vkhBuffer;
+    _avkhMemory[iSlot] = vkhMemory;
+    _actSizes[iSlot] = ctSize;
+    _apMapped[iSlot] = pMapped;
+    return BufferHandle(ulHandle);
+}
+
+
+// Destroy a buffer and release its memory.
+void BufferPool::Destroy(BufferHandle bhBuffer) {
+    if (!IsValid(bhBuffer)) {
+        throw std::runtime_error("Destroying a buffer through a stale handle");
+    }
+    // take the objects out of the slot before freeing it - once it is free, another thread may reuse it, and if two
+    // threads destroy the same buffer, only the first one gets past freeing the slot
+    const uint32_t iSlot = HandleAllocator::GetSlot(bhBuffer.GetValue());
+    const VkBuffer vkhBuffer = _avkhBuffers[iSlot];
+    const VkDeviceMemory vkhMemory = _avkhMemory[iSlot];
+    const bool bMapped = _apMapped[iSlot] != nullptr;
+    _haHandles.Free(bhBuffer.GetValue());
+
+    // release the mapping first, if the buffer stayed mapped
+    if (bMapped) {
+        vkUnmapMemory(_vkhLogicalDevice, vkhMemory);
+    }
+    vkDestroyBuffer(_vkhLogicalDevice, vkhBuffer, nullptr);
+    vkFreeMemory(_vkhLogicalDevice, vkhMemory, nullptr);
+}
+
+
+// Set the device the images are on, and the most images the pool holds.
+void ImagePool::Initialize(VkDevice vkhLogicalDevice, uint32_t ctImages) {
+    _vkhLogicalDevice = vkhLogicalDevice;
+    _haHandles.Initialize(ctImages);
+    _avkhImages.assign(ctImages, VK_NULL_HANDLE);
+    _avkhMemory.assign(ctImages, VK_NULL_HANDLE);
+    _avkhViews.assign(ctImages, VK_NULL_HANDLE);
+    _afmtFormats.assign(ctImages, VK_FORMAT_UNDEFINED);
+}
+
+
+// Destroy the images still in the pool.
+void ImagePool::DestroyAll() {
+    for (uint32_t iSlot = 0; iSlot < _haHandles.GetSlotCount(); iSlot++) {
+        const uint32_t ulHandle = _haHandles.GetSlotHandle(iSlot);
+        if (ulHandle != 0) {
+            Destroy(ImageHandle(ulHandle));
+        }
+    }
+}
+
+
+// Take over an image and its memory.
+ImageHandle ImagePool::Add(VkImage vkhImage, VkDeviceMemory vkhMemory, VkFormat fmtFormat) {
+    const uint32_t ulHandle = _haHandles.Allocate();
+    const uint32_t iSlot = HandleAllocator::GetSlot(ulHandle);
+    _avkhImages[iSlot] = vkhImage;
+    _avkhMemory[iSlot] = vkhMemory;
+    _avkhViews[iSlot] = VK_NULL_HANDLE;
+    _afmtFormats[iSlot] = fmtFormat;
+    return ImageHandle(ulHandle);
+}
+
+
+// Set the view of an image.
+void ImagePool::SetView(ImageHandle ihImage, VkImageView vkhView) {
+    _avkhViews[GetSlot(ihImage)] = vkhView;
+}
+
+
+// Destroy an image, its view, and release its memory.
+void ImagePool::Destroy(ImageHandle ihImage) {
+    if (!IsValid(ihImage)) {
+        throw std::runtime_error("Destroying an image through a stale handle");
+    }
+    // take the objects out of the slot before freeing it, like the buffer pool
+    const uint32_t iSlot = HandleAllocator::GetSlot(ihImage.GetValue());
+    const VkImage vkhImage = _avkhImages[iSlot];
+    const VkDeviceMemory vkhMemory = _avkhMemory[iSlot];
+    const VkImageView vkhView = _avkhViews[iSlot];
+    _haHandles.Free(ihImage.GetValue());
+
+    // the view refers to the image, so it goes first
+    if (vkhView != VK_NULL_HANDLE) {
+        vkDestroyImageView(_vkhLogicalDevice, vkhView, nullptr);
+    }
+    vkDestroyImage(_vkhLogicalDevice, vkhImage, nullptr);
+    vkFreeMemory(_vkhLogicalDevice, vkhMemory, nullptr);
+}
+
+
+// Set the device the pipelines are on, and the most pipelines the pool holds.
+void PipelinePool::Initialize(VkDevice vkhLogicalDevice, uint32_t ctPipelines) {
+    _vkhLogicalDevice = vkhLogicalDevice;
+    _haHandles.Initialize(ctPipelines);
+    _avkhPipelines.assign(ctPipelines, VK_NULL_HANDLE);
+    _abpBindPoints.assign(ctPipelines, VK_PIPELINE_BIND_POINT_GRAPHICS);
+}
+
+
+// Destroy the pipelines still in the pool.
+void PipelinePool::DestroyAll() {
+    for (uint32_t iSlot = 0; iSlot < _haHandles.GetSlotCount(); iSlot++) {
+        const uint32_t ulHandle = _haHandles.GetSlotHandle(iSlot);
+        if (ulHandle != 0) {
+            Destroy(PipelineHandle(ulHandle));
+        }
+    }
+}
+
+
+// Take over a pipeline.
+PipelineHandle PipelinePool::Add(VkPipeline vkhPipeline, VkPipelineBindPoint bpBindPoint) {
+    const uint32_t ulHandle = _haHandles.Allocate();
+    const uint32_t iSlot = HandleAllocator::GetSlot(ulHandle);
+    _avkhPipelines[iSlot] = vkhPipeline;
+    _abpBindPoints[iSlot] = bpBindPoint;
+    return PipelineHandle(ulHandle);
+}
+
+
+// Destroy a pipeline.
+void PipelinePool::Destroy(PipelineHandle phPipeline) {
+    if (!IsValid(phPipeline)) {
+        throw std::runtime_error("Destroying a pipeline through a stale handle");
+    }
+    // take the pipeline out of the slot before freeing it, like the buffer pool
+    const VkPipeline vkhPipeline = _avkhPipelines[HandleAllocator::GetSlot(phPipeline.GetValue())];
+    _haHandles.Free(phPipeline.GetValue());
+    vkDestroyPipeline(_vkhLogicalDevice, vkhPipeline, nullptr);
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <mutex>
+
+// Typed 32-bit handle to a resource in a pool. The low bits are the resource's slot in the pool, the high bits the
+// generation of the slot - slots are reused, and each reuse gets a new generation, so a handle kept after its
+// resource was destroyed no longer matches the slot and is detected as stale. The Tag only keeps handles to different
+// kinds of resources apart. Zero is the null handle, no resource ever gets it.
+template<typename Tag>
+class ResourceHandle {
+public:
+    ResourceHandle() : _ulValue(0) {};
+    explicit ResourceHandle(uint32_t ulValue) : _ulValue(ulValue) {};
+
+    // Get the raw value of the handle.
+    uint32_t GetValue() const { return _ulValue; }
+    // Is this the null handle?
+    bool IsNull() const { return _ulValue == 0; }
+
+    bool operator==(const ResourceHandle &hOther) const { return _ulValue == hOther._ulValue; }
+    bool operator!=(const ResourceHandle &hOther) const { return _ulValue != hOther._ulValue; }
+
+private:
+    uint32_t _ulValue;
+};
+
+struct BufferTag;
+struct ImageTag;
+struct PipelineTag;
+typedef ResourceHandle<BufferTag> BufferHandle;
+typedef ResourceHandle<ImageTag> ImageHandle;
+typedef ResourceHandle<PipelineTag> PipelineHandle;
+
+
+// Hands out the slots of a pool with a fixed number of them, as handles. Free slots are kept in a list, so allocating
+// and freeing take constant time, under a lock so that any thread may do it. Checking a handle takes no lock - each
+// slot holds the handle it was last allocated as, or zero while it is free.
+class HandleAllocator {
+public:
+    HandleAllocator() : _ctSlots(0) {};
+    ~HandleAllocator() {};
+
+    // Bits of a handle holding the slot, the rest hold the generation.
+    static const uint32_t ctSlotBits = 20;
+    // Most slots a pool can have.
+    static const uint32_t ctMaxSlots = 1u << ctSlotBits;
+
+    // Set the number of slots, all of them free.
+    void Initialize(uint32_t ctSlots);
+
+    // Allocate a free slot, returning its handle. Throws if all slots are taken.
+    uint32_t Allocate();
+    // Free the slot of a handle. Throws if the handle is stale.
+    void Free(uint32_t ulHandle);
+
+    // Does the handle refer to a slot that is allocated as it?
+    bool IsValid(uint32_t ulHandle) const {
+        const uint32_t iSlot = GetSlot(ulHandle);
+        return ulHandle != 0 && iSlot < _ctSlots && _aulSlotHandles[iSlot].load(std::memory_order_acquire) == ulHandle;
+    }
+    // Get the handle a slot is allocated as, or zero if it is free.
+    uint32_t GetSlotHandle(uint32_t iSlot) const { return _aulSlotHandles[iSlot].load(std::memory_order_acquire); }
+    // Get the number of slots.
+    uint32_t GetSlotCount() const { return _ctSlots; }
+    // Get the slot of a handle.
+    static uint32_t GetSlot(uint32_t ulHandle) { return ulHandle & (ctMaxSlots - 1); }
+
+private:
+    uint32_t _ctSlots;
+    // Handle each slot is allocated as, zero if it is free.
+    std::unique_ptr<std::atomic<uint32_t>[]> _aulSlotHandles;
+    // Generation the next allocation of each slot gets.
+    std::vector<uint32_t> _aiGenerations;
+    // Free slots, the next one to allocate last.
+    std::vector<uint32_t> _aiFreeSlots;
+    // Guards the generations and the free slots.
+    std::mutex _mtxSlots;
+};
+
+
+// Buffers addressed by handles. Each property of the buffers is kept in its own array, indexed by the slot, so
+// getting a buffer from its handle is a single array read. The arrays never grow, so resources may be added on one
+// thread while another one reads them.
+class BufferPool {
+public:
+    BufferPool() : _vkhLogicalDevice(VK_NULL_HANDLE) {};
+    ~BufferPool() {};
+
+    // Set the device the buffers are on, and the most buffers the pool holds.
+    void Initialize(VkDevice vkhLogicalDevice, uint32_t ctBuffers);
+    // Destroy the buffers still in the pool.
+    void DestroyAll();
+
+    // Take over a buffer and its memory, with the memory's mapping if it stays mapped. Returns the buffer's handle.
+    BufferHandle Add(VkBuffer vkhBuffer, VkDeviceMemory vkhMemory, VkDeviceSize ctSize, void *pMapped);
+    // Destroy a buffer and release its memory. Throws if the handle is stale.
+    void Destroy(BufferHandle bhBuffer);
+
+    // Does the handle refer to a buffer in the pool?
+    bool IsValid(BufferHandle bhBuffer) const { return _haHandles.IsValid(bhBuffer.GetValue()); }
+    // Get the properties of a buffer.
+    VkBuffer GetBuffer(BufferHandle bhBuffer) const { return _avkhBuffers[GetSlot(bhBuffer)]; }
+    VkDeviceMemory GetMemory(BufferHandle bhBuffer) const { return _avkhMemory[GetSlot(bhBuffer)]; }
+    VkDeviceSize GetSize(BufferHandle bhBuffer) const { return _actSizes[GetSlot(bhBuffer)]; }
+    void *GetMapped(BufferHandle bhBuffer) const { return _apMapped[GetSlot(bhBuffer)]; }
+
+private:
+    // Get the slot of a handle, which must be valid.
+    uint32_t GetSlot(BufferHandle bhBuffer) const {
+        assert(IsValid(bhBuffer));
+        return HandleAllocator::GetSlot(bhBuffer.GetValue());
+    }
+
+private:
+    VkDevice _vkhLogicalDevice;
+    HandleAllocator _haHandles;
+    std::vector<VkBuffer> _avkhBuffers;
+    std::vector<VkDeviceMemory> _avkhMemory;
+    std::vector<VkDeviceSize> _actSizes;
+    // Mapping of the buffer's memory, null if it isn't mapped.
+    std::vector<void *> _apMapped;
+};
+
+
+// Images addressed by handles, each property in its own array like in the buffer pool.
+class ImagePool {
+public:
+    ImagePool() : _vkhLogicalDevice(VK_NULL_HANDLE) {};
+    ~ImagePool() {};
+
+    // Set the device the images are on, and the most images the pool holds.
+    void Initialize(VkDevice vkhLogicalDevice, uint32_t ctImages);
+    // Destroy the images still in the pool.
+    void DestroyAll();
+
+    // Take over an image and its memory. Returns the image's handle. The view is set once it is created.
+    ImageHandle Add(VkImage vkhImage, VkDeviceMemory vkhMemory, VkFormat fmtFormat);
+    // Set the view of an image, which the pool then destroys with it.
+    void SetView(ImageHandle ihImage, VkImageView vkhView);
+    // Destroy an image, its view, and release its memory. Throws if the handle is stale.
+    void Destroy(ImageHandle ihImage);
+
+    // Does the handle refer to an image in the pool?
+    bool IsValid(ImageHandle ihImage) const { return _haHandles.IsValid(ihImage.GetValue()); }
+    // Get the properties of an image.
+    VkImage GetImage(ImageHandle ihImage) const { return _avkhImages[GetSlot(ihImage)]; }
+    VkImageView GetView(ImageHandle ihImage) const { return _avkhViews[GetSlot(ihImage)]; }
+    VkFormat GetFormat(ImageHandle ihImage) const { return _afmtFormats[GetSlot(ihImage)]; }
+
+private:
+    // Get the slot of a handle, which must be valid.
+    uint32_t GetSlot(ImageHandle ihImage) const {
+        assert(IsValid(ihImage));
+        return HandleAllocator::GetSlot(ihImage.GetValue());
+    }
+
+private:
+    VkDevice _vkhLogicalDevice;
+    HandleAllocator _haHandles;
+    std::vector<VkImage> _avkhImages;
+    std::vector<VkDeviceMemory> _avkhMemory;
+    std::vector<VkImageView> _avkhViews;
+    std::vector<VkFormat> _afmtFormats;
+};
+
+
+// Pipelines addressed by handles, each property in its own array like in the buffer pool.
+class PipelinePool {
+public:
+    PipelinePool() : _vkhLogicalDevice(VK_NULL_HANDLE) {};
+    ~PipelinePool() {};
+
+    // Set the device the pipelines are on, and the most pipelines the pool holds.
+    void Initialize(VkDevice vkhLogicalDevice, uint32_t ctPipelines);
+    // Destroy the pipelines still in the pool.
+    void DestroyAll();
+
+    // Take over a pipeline. Returns its handle.
+    PipelineHandle Add(VkPipeline vkhPipeline, VkPipelineBindPoint bpBindPoint);
+    // Destroy a pipeline. Throws if the handle is stale.
+    void Destroy(PipelineHandle phPipeline);
+
+    // Does the handle refer to a pipeline in the pool?
+    bool IsValid(PipelineHandle phPipeline) const { return _haHandles.IsValid(phPipeline.GetValue()); }
+    // Get the properties of a pipeline.
+    VkPipeline GetPipeline(PipelineHandle phPipeline) const { return _avkhPipelines[GetSlot(phPipeline)]; }
+    VkPipelineBindPoint GetBindPoint(PipelineHandle phPipeline) const { return _abpBindPoints[GetSlot(phPipeline)]; }
+
+private:
+    // Get the slot of a handle, which must be valid.
+    uint32_t GetSlot(PipelineHandle phPipeline) const {
+        assert(IsValid(phPipeline));
+        return HandleAllocator::GetSlot(phPipeline.GetValue());
+    }
+
+private:
+    VkDevice _vkhLogicalDevice;
+    HandleAllocator _haHandles;
+    std::vector<VkPipeline> _avkhPipelines;
+    std::vector<VkPipelineBindPoint> _abpBindPoints;
+};
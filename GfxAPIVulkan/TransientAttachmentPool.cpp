@@ -0,0 +1,157 @@
+#include "../PrecompiledHeader.h"
+#include "TransientAttachmentPool.h"
+#include "DeletionQueue.h"
+
+// Usages an image may have and still be created as transient.
+static const VkImageUsageFlags flgAttachmentUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+
+// Set the device the attachments are created on.
+void TransientAttachmentPool::Initialize(VkPhysicalDevice vkhPhysicalDevice, VkDevice vkhLogicalDevice) {
+    _vkhPhysicalDevice = vkhPhysicalDevice;
+    _vkhLogicalDevice = vkhLogicalDevice;
+}
+
+
+// Retire all the attachments and the pool's memory.
+void TransientAttachmentPool::Retire(DeletionQueue &dqRetired) {
+    // the frames in flight may still render to the images, so the memory is never reused in place
+    std::vector<VkImage> avkhImages;
+    for (const Attachment &aAttachment : _aaAttachments) {
+        avkhImages.push_back(aAttachment.vkhImage);
+    }
+    const VkDevice vkhDevice = _vkhLogicalDevice;
+    const VkDeviceMemory vkhMemory = _vkhMemory;
+    dqRetired.Retire([vkhDevice, avkhImages, vkhMemory]() {
+        for (VkImage vkhImage : avkhImages) {
+            vkDestroyImage(vkhDevice, vkhImage, nullptr);
+        }
+        if (vkhMemory != VK_NULL_HANDLE) {
+            vkFreeMemory(vkhDevice, vkhMemory, nullptr);
+        }
+    });
+
+    _aaAttachments.clear();
+    _vkhMemory = VK_NULL_HANDLE;
+    _ctAllocationSize = 0;
+}
+
+
+// Find a memory type among the allowed ones, with the given properties. Returns false if there is none.
+bool TransientAttachmentPool::FindMemoryType(uint32_t flgTypeFilter, VkMemoryPropertyFlags flgProperties, uint32_t &iMemoryType) const {
+    VkPhysicalDeviceMemoryProperties propsDeviceMemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(_vkhPhysicalDevice, &propsDeviceMemoryProperties);
+
+    for (iMemoryType = 0; iMemoryType < propsDeviceMemoryProperties.memoryTypeCount; iMemoryType++) {
+        if ((flgTypeFilter & (1 << iMemoryType)) && (propsDeviceMemoryProperties.memoryTypes[iMemoryType].propertyFlags & flgProperties) == flgProperties) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Declare an attachment used by the passes from iFirstPass to iLastPass, inclusive.
+uint32_t TransientAttachmentPool::AddAttachment(const VkImageCreateInfo &infoImage, uint32_t iFirstPass, uint32_t iLastPass) {
+    VkImageCreateInfo infoTransientImage = infoImage;
+    // images that are only ever attachments can be transient, if the device has lazily allocated memory to put them in
+    uint32_t iLazyMemoryType;
+    if ((infoImage.usage & ~flgAttachmentUsages) == 0 && FindMemoryType(~0u, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, iLazyMemoryType)) {
+        infoTransientImage.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+
+    // create the image, the memory is bound once all attachments are known
+    Attachment aAttachment = {};
+    if (vkCreateImage(_vkhLogicalDevice, &infoTransientImage, nullptr, &aAttachment.vkhImage) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create a transient attachment");
+    }
+    vkGetImageMemoryRequirements(_vkhLogicalDevice, aAttachment.vkhImage, &aAttachment.propsMemoryRequirements);
+    aAttachment.iFirstPass = iFirstPass;
+    aAttachment.iLastPass = iLastPass;
+
+    _aaAttachments.push_back(aAttachment);
+    return static_cast<uint32_t>(_aaAttachments.size() - 1);
+}
+
+
+// Place the declared attachments in memory, allocate it and bind the images.
+void TransientAttachmentPool::Allocate() {
+    if (_aaAttachments.empty()) {
+        return;
+    }
+
+    // place the largest attachments first, they are the hardest to fit in the gaps
+    std::vector<uint32_t> aiOrder(_aaAttachments.size());
+    for (uint32_t iAttachment = 0; iAttachment < aiOrder.size(); iAttachment++) {
+        aiOrder[iAttachment] = iAttachment;
+    }
+    std::sort(aiOrder.begin(), aiOrder.end(), [this](uint32_t iFirst, uint32_t iSecond) {
+        return _aaAttachments[iFirst].propsMemoryRequirements.size > _aaAttachments[iSecond].propsMemoryRequirements.size;
+    });
+
+    // all attachments share one allocation, so they need a memory type they all allow
+    uint32_t flgMemoryTypes = ~0u;
+    VkDeviceSize ctDedicatedSize = 0;
+    _ctAllocationSize = 0;
+    for (size_t iPlaced = 0; iPlaced < aiOrder.size(); iPlaced++) {
+        Attachment &aAttachment = _aaAttachments[aiOrder[iPlaced]];
+        const VkMemoryRequirements &propsRequirements = aAttachment.propsMemoryRequirements;
+        flgMemoryTypes &= propsRequirements.memoryTypeBits;
+        ctDedicatedSize += propsRequirements.size;
+
+        // find the lowest offset that doesn't overlap any placed attachment whose passes overlap this one's
+        VkDeviceSize slOffset = 0;
+        bool bMoved = true;
+        while (bMoved) {
+            bMoved = false;
+            // align the candidate offset
+            slOffset = (slOffset + propsRequirements.alignment - 1) / propsRequirements.alignment * propsRequirements.alignment;
+            for (size_t iOther = 0; iOther < iPlaced; iOther++) {
+                const Attachment &aOther = _aaAttachments[aiOrder[iOther]];
+                // attachments used by disjoint ranges of passes may share memory
+                if (aOther.iLastPass < aAttachment.iFirstPass || aAttachment.iLastPass < aOther.iFirstPass) {
+                    continue;
+                }
+                // if the memory ranges overlap, try right after the other attachment
+                const VkDeviceSize slOtherEnd = aOther.slOffset + aOther.propsMemoryRequirements.size;
+                if (slOffset < slOtherEnd && aOther.slOffset < slOffset + propsRequirements.size) {
+                    slOffset = slOtherEnd;
+                    bMoved = true;
+                }
+            }
+        }
+        aAttachment.slOffset = slOffset;
+        _ctAllocationSize = std::max(_ctAllocationSize, slOffset + propsRequirements.size);
+    }
+
+    // prefer lazily allocated memory, fall back to regular device memory
+    uint32_t iMemoryType;
+    _bLazilyAllocated = FindMemoryType(flgMemoryTypes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, iMemoryType);
+    if (!_bLazilyAllocated && !FindMemoryType(flgMemoryTypes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, iMemoryType)) {
+        throw std::runtime_error("Transient attachments have no common memory type");
+    }
+
+    // allocate the memory
+    VkMemoryAllocateInfo infoMemory = {};
+    infoMemory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    infoMemory.allocationSize = _ctAllocationSize;
+    infoMemory.memoryTypeIndex = iMemoryType;
+    if (vkAllocateMemory(_vkhLogicalDevice, &infoMemory, nullptr, &_vkhMemory) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to allocate memory for transient attachments");
+    }
+
+    // bind the images at their offsets
+    for (const Attachment &aAttachment : _aaAttachments) {
+        vkBindImageMemory(_vkhLogicalDevice, aAttachment.vkhImage, _vkhMemory, aAttachment.slOffset);
+    }
+
+    // report how much memory aliasing saved compared to giving each attachment its own allocation - only attachments
+    // whose passes don't overlap alias, which the current passes never produce, so there is usually nothing to report
+    if (_ctAllocationSize == ctDedicatedSize) {
+        return;
+    }
+    std::cout << "Transient attachments: " << _aaAttachments.size() << " images, "
+        << ctDedicatedSize << " bytes dedicated, " << _ctAllocationSize << " bytes aliased, "
+        << ctDedicatedSize - _ctAllocationSize << " bytes saved"
+        << (_bLazilyAllocated ? " (lazily allocated)" : "") << std::endl;
+}
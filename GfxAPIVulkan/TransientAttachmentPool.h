@@ -0,0 +1,57 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+class DeletionQueue;
+
+// Memory pool for attachments whose contents only live within a frame - depth buffers, multisampled targets and other
+// intermediate render targets. Each attachment is declared with the range of frame graph passes that use it, and
+// attachments whose ranges don't overlap are placed at the same offset in a single allocation. Where the device
+// supports it, the attachments are created as transient and the memory is lazily allocated, so that tiled GPUs can
+// keep them in on-chip memory and never back them with real memory at all.
+class TransientAttachmentPool {
+public:
+    TransientAttachmentPool() : _vkhLogicalDevice(VK_NULL_HANDLE), _vkhMemory(VK_NULL_HANDLE), _ctAllocationSize(0), _bLazilyAllocated(false) {};
+    ~TransientAttachmentPool() {};
+
+    // Set the device the attachments are created on.
+    void Initialize(VkPhysicalDevice vkhPhysicalDevice, VkDevice vkhLogicalDevice);
+    // Retire all the attachments and the pool's memory, so that they are destroyed once the frames submitted so far
+    // completed. The pool is empty afterwards, and the next attachments get a new allocation.
+    void Retire(DeletionQueue &dqRetired);
+
+    // Declare an attachment used by the passes from iFirstPass to iLastPass, inclusive. Creates the image, but
+    // doesn't bind any memory to it. Returns the attachment's index.
+    uint32_t AddAttachment(const VkImageCreateInfo &infoImage, uint32_t iFirstPass, uint32_t iLastPass);
+    // Place the declared attachments in memory, allocate it and bind the images. Reports how much memory aliasing saved,
+    // if it saved any.
+    void Allocate();
+
+    // Get the image of an attachment.
+    VkImage GetImage(uint32_t iAttachment) const { return _aaAttachments[iAttachment].vkhImage; }
+
+private:
+    // An attachment in the pool.
+    struct Attachment {
+        VkImage vkhImage;
+        // Range of passes that use the attachment.
+        uint32_t iFirstPass;
+        uint32_t iLastPass;
+        // Memory requirements and the offset the attachment was placed at.
+        VkMemoryRequirements propsMemoryRequirements;
+        VkDeviceSize slOffset;
+    };
+
+    // Find a memory type among the allowed ones, with the given properties. Returns false if there is none.
+    bool FindMemoryType(uint32_t flgTypeFilter, VkMemoryPropertyFlags flgProperties, uint32_t &iMemoryType) const;
+
+private:
+    VkPhysicalDevice _vkhPhysicalDevice;
+    VkDevice _vkhLogicalDevice;
+    // Attachments in the pool.
+    std::vector<Attachment> _aaAttachments;
+    // Memory shared by all attachments.
+    VkDeviceMemory _vkhMemory;
+    VkDeviceSize _ctAllocationSize;
+    // Is the memory lazily allocated, i.e. only committed if the attachments ever leave on-chip memory?
+    bool _bLazilyAllocated;
+};
@@ -0,0 +1,157 @@
+#include "../PrecompiledHeader.h"
+#include "UploadBatch.h"
+#include "DeletionQueue.h"
+
+
+// Add an image barrier between the given stages.
+void BarrierBatch::AddImageBarrier(VkPipelineStageFlags flgSourceStages, VkPipelineStageFlags flgDestinationStages, const VkImageMemoryBarrier &infoBarrier) {
+    _mapBarriers[std::make_pair(flgSourceStages, flgDestinationStages)].ainfoImageBarriers.push_back(infoBarrier);
+}
+
+
+// Add a buffer barrier between the given stages.
+void BarrierBatch::AddBufferBarrier(VkPipelineStageFlags flgSourceStages, VkPipelineStageFlags flgDestinationStages, const VkBufferMemoryBarrier &infoBarrier) {
+    _mapBarriers[std::make_pair(flgSourceStages, flgDestinationStages)].ainfoBufferBarriers.push_back(infoBarrier);
+}
+
+
+// Record the collected barriers and forget them. Returns the number of pipeline barrier commands recorded.
+uint32_t BarrierBatch::Flush(VkCommandBuffer vkhCommandBuffer) {
+    uint32_t ctCommands = 0;
+    for (const auto &pairStageBarriers : _mapBarriers) {
+        const StageBarriers &sbBarriers = pairStageBarriers.second;
+        // all barriers between the same stages go into one command
+        vkCmdPipelineBarrier(vkhCommandBuffer, pairStageBarriers.first.first, pairStageBarriers.first.second, 0, 0, nullptr,
+            static_cast<uint32_t>(sbBarriers.ainfoBufferBarriers.size()), sbBarriers.ainfoBufferBarriers.data(),
+            static_cast<uint32_t>(sbBarriers.ainfoImageBarriers.size()), sbBarriers.ainfoImageBarriers.data());
+        ctCommands++;
+    }
+    _mapBarriers.clear();
+    return ctCommands;
+}
+
+
+// Set the device that owns the staging buffers.
+void UploadBatch::Initialize(VkDevice vkhLogicalDevice) {
+    _vkhLogicalDevice = vkhLogicalDevice;
+}
+
+
+// Copy a staging buffer to a buffer, which is then used in the given stages and accesses.
+void UploadBatch::CopyBuffer(VkBuffer vkhSourceBuffer, VkBuffer vkhDestinationBuffer, VkDeviceSize ctSize, VkPipelineStageFlags flgDestinationStages, VkAccessFlags flgDestinationAccess) {
+    // copy the whole buffer
+    Copy cpCopy = {};
+    cpCopy.vkhSourceBuffer = vkhSourceBuffer;
+    cpCopy.vkhDestinationBuffer = vkhDestinationBuffer;
+    cpCopy.infoBufferCopy.srcOffset = 0;
+    cpCopy.infoBufferCopy.dstOffset = 0;
+    cpCopy.infoBufferCopy.size = ctSize;
+    _aCopies.push_back(cpCopy);
+    _ctBytes += ctSize;
+
+    // the buffer is new, so nothing needs to happen before the copy; after it, the copied data must be visible to its users
+    VkBufferMemoryBarrier infoBarrier = {};
+    infoBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    infoBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    infoBarrier.dstAccessMask = flgDestinationAccess;
+    infoBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    infoBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    infoBarrier.buffer = vkhDestinationBuffer;
+    infoBarrier.offset = 0;
+    infoBarrier.size = VK_WHOLE_SIZE;
+    _bbAfterCopies.AddBufferBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, flgDestinationStages, infoBarrier);
+}
+
+
+// Copy a staging buffer to the whole of a 2D color image, which is then sampled in the fragment shader.
+void UploadBatch::CopyBufferToImage(VkBuffer vkhSourceBuffer, VkImage vkhImage, uint32_t dimWidth, uint32_t dimHeight) {
+    // prepare the copy command
+    Copy cpCopy = {};
+    cpCopy.vkhSourceBuffer = vkhSourceBuffer;
+    cpCopy.vkhDestinationImage = vkhImage;
+    // copying the whole buffer, pixels are tightly packed
+    cpCopy.infoImageCopy.bufferOffset = 0;
+    cpCopy.infoImageCopy.bufferRowLength = 0;
+    cpCopy.infoImageCopy.bufferImageHeight = 0;
+    // this is a color image, with one layer and no mipmaps
+    cpCopy.infoImageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    cpCopy.infoImageCopy.imageSubresource.mipLevel = 0;
+    cpCopy.infoImageCopy.imageSubresource.baseArrayLayer = 0;
+    cpCopy.infoImageCopy.imageSubresource.layerCount = 1;
+    // copy the entire image
+    cpCopy.infoImageCopy.imageOffset = { 0, 0, 0 };
+    cpCopy.infoImageCopy.imageExtent = { dimWidth, dimHeight, 1 };
+    _aCopies.push_back(cpCopy);
+    _ctBytes += VkDeviceSize(dimWidth) * dimHeight * 4;
+
+    // describe the transitions of the whole image
+    VkImageMemoryBarrier infoBarrier = {};
+    infoBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    infoBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    infoBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    infoBarrier.image = vkhImage;
+    infoBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    infoBarrier.subresourceRange.baseMipLevel = 0;
+    infoBarrier.subresourceRange.levelCount = 1;
+    infoBarrier.subresourceRange.baseArrayLayer = 0;
+    infoBarrier.subresourceRange.layerCount = 1;
+
+    // before the copy, the new image is transitioned to the transfer layout - no need to wait on anything
+    infoBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    infoBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    infoBarrier.srcAccessMask = 0;
+    infoBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    _bbBeforeCopies.AddImageBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, infoBarrier);
+
+    // after the copy, it is transitioned for reading in the shader
+    infoBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    infoBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    infoBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    infoBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    _bbAfterCopies.AddImageBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, infoBarrier);
+}
+
+
+// Release a staging buffer once the batch has executed.
+void UploadBatch::ReleaseAfterSubmit(VkBuffer vkhBuffer, VkDeviceMemory vkhMemory) {
+    _aStagingBuffers.push_back(std::make_pair(vkhBuffer, vkhMemory));
+}
+
+
+// Record the batch: transitions to the transfer layout, then all the copies, then transitions to the final usages.
+void UploadBatch::Record(VkCommandBuffer vkhCommandBuffer) {
+    // prepare all destinations at once
+    const uint32_t ctBarriersBefore = _bbBeforeCopies.Flush(vkhCommandBuffer);
+
+    // the copies don't depend on each other, so no barriers are needed between them
+    for (const Copy &cpCopy : _aCopies) {
+        if (cpCopy.vkhDestinationImage != VK_NULL_HANDLE) {
+            vkCmdCopyBufferToImage(vkhCommandBuffer, cpCopy.vkhSourceBuffer, cpCopy.vkhDestinationImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &cpCopy.infoImageCopy);
+        } else {
+            vkCmdCopyBuffer(vkhCommandBuffer, cpCopy.vkhSourceBuffer, cpCopy.vkhDestinationBuffer, 1, &cpCopy.infoBufferCopy);
+        }
+    }
+
+    // make all copied data visible to its users at once
+    const uint32_t ctBarriersAfter = _bbAfterCopies.Flush(vkhCommandBuffer);
+
+    std::cout << "Uploaded " << _ctBytes << " bytes with " << _aCopies.size() << " copies and "
+        << ctBarriersBefore + ctBarriersAfter << " barrier commands" << std::endl;
+}
+
+
+// Retire the staging buffers of the submitted batch, and start a new batch.
+void UploadBatch::Release(DeletionQueue &dqRetired) {
+    const VkDevice vkhDevice = _vkhLogicalDevice;
+    for (const auto &pairStaging : _aStagingBuffers) {
+        dqRetired.Retire([vkhDevice, pairStaging]() {
+            // destroy the staging buffer
+            vkDestroyBuffer(vkhDevice, pairStaging.first, nullptr);
+            // free buffer memory
+            vkFreeMemory(vkhDevice, pairStaging.second, nullptr);
+        });
+    }
+    _aStagingBuffers.clear();
+    _aCopies.clear();
+    _ctBytes = 0;
+}
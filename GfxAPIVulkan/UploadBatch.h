@@ -0,0 +1,78 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+class DeletionQueue;
+
+// Collects image and buffer barriers and records them with one pipeline barrier command per pair of source and
+// destination stages, instead of one command per resource.
+class BarrierBatch {
+public:
+    BarrierBatch() {};
+    ~BarrierBatch() {};
+
+    // Add an image barrier between the given stages.
+    void AddImageBarrier(VkPipelineStageFlags flgSourceStages, VkPipelineStageFlags flgDestinationStages, const VkImageMemoryBarrier &infoBarrier);
+    // Add a buffer barrier between the given stages.
+    void AddBufferBarrier(VkPipelineStageFlags flgSourceStages, VkPipelineStageFlags flgDestinationStages, const VkBufferMemoryBarrier &infoBarrier);
+    // Record the collected barriers and forget them. Returns the number of pipeline barrier commands recorded.
+    uint32_t Flush(VkCommandBuffer vkhCommandBuffer);
+
+private:
+    // Barriers between one pair of stages.
+    struct StageBarriers {
+        std::vector<VkImageMemoryBarrier> ainfoImageBarriers;
+        std::vector<VkBufferMemoryBarrier> ainfoBufferBarriers;
+    };
+    // Barriers, by source and destination stages.
+    std::map<std::pair<VkPipelineStageFlags, VkPipelineStageFlags>, StageBarriers> _mapBarriers;
+};
+
+
+// Batch of resource uploads recorded into a single command buffer. Resource creation queues its copies and layout
+// transitions here, and all of them are submitted together without waiting - the submit returns a ticket on the
+// graphics timeline, and the first frame's submission waits for it on the GPU at the stages that read the resources,
+// so the host never stalls on uploads. Staging buffers are retired, and released once the batch has executed.
+class UploadBatch {
+public:
+    UploadBatch() : _vkhLogicalDevice(VK_NULL_HANDLE), _ctBytes(0) {};
+    ~UploadBatch() {};
+
+    // Set the device that owns the staging buffers.
+    void Initialize(VkDevice vkhLogicalDevice);
+
+    // Copy a staging buffer to a buffer, which is then used in the given stages and accesses.
+    void CopyBuffer(VkBuffer vkhSourceBuffer, VkBuffer vkhDestinationBuffer, VkDeviceSize ctSize, VkPipelineStageFlags flgDestinationStages, VkAccessFlags flgDestinationAccess);
+    // Copy a staging buffer to the whole of a 2D color image, which is then sampled in the fragment shader.
+    void CopyBufferToImage(VkBuffer vkhSourceBuffer, VkImage vkhImage, uint32_t dimWidth, uint32_t dimHeight);
+    // Release a staging buffer once the batch has executed.
+    void ReleaseAfterSubmit(VkBuffer vkhBuffer, VkDeviceMemory vkhMemory);
+
+    // Is there anything to record?
+    bool IsEmpty() const { return _aCopies.empty(); }
+    // Record the batch: transitions to the transfer layout, then all the copies, then transitions to the final usages.
+    void Record(VkCommandBuffer vkhCommandBuffer);
+    // Retire the staging buffers of the submitted batch, so they are released once it executed, and start a new batch.
+    void Release(DeletionQueue &dqRetired);
+
+private:
+    // A queued copy.
+    struct Copy {
+        VkBuffer vkhSourceBuffer;
+        // Either a buffer or an image destination.
+        VkBuffer vkhDestinationBuffer;
+        VkImage vkhDestinationImage;
+        VkBufferCopy infoBufferCopy;
+        VkBufferImageCopy infoImageCopy;
+    };
+
+    VkDevice _vkhLogicalDevice;
+    // Barriers recorded before and after the copies.
+    BarrierBatch _bbBeforeCopies;
+    BarrierBatch _bbAfterCopies;
+    // Copies, in the order they were queued.
+    std::vector<Copy> _aCopies;
+    // Staging buffers and their memory, released after execution.
+    std::vector<std::pair<VkBuffer, VkDeviceMemory>> _aStagingBuffers;
+    // Bytes uploaded by the batch.
+    VkDeviceSize _ctBytes;
+};
@@ -0,0 +1,84 @@
+#include "../PrecompiledHeader.h"
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include "../Mesh/MeshletCulling.h"
+
+// Number of objects culled per run, and objects per parallel-for range.
+static const uint32_t ctBenchmarkObjects = 1 << 18;
+static const uint32_t ctObjectsPerRange = 1024;
+// Runs per thread count - the fastest one is reported, which is the least disturbed by the rest of the system.
+static const uint32_t ctBenchmarkRuns = 20;
+
+
+// Cull a range of objects - rotate each about its own axis, move it to its position, and test its bounding sphere.
+// Returns the number of visible objects.
+static uint32_t CullObjectRange(const std::vector<glm::vec4> &avecObjects, const CullingFrustum &cfFrustum, uint32_t iBegin, uint32_t iEnd) {
+    uint32_t ctVisible = 0;
+    for (uint32_t iObject = iBegin; iObject < iEnd; iObject++) {
+        const glm::vec4 &vecObject = avecObjects[iObject];
+        // the objects spin at different speeds, so that each needs its own transform
+        const glm::mat4 tRotation = glm::rotate(glm::mat4(1.0f), vecObject.w, glm::vec3(0.0f, 0.0f, 1.0f));
+        const glm::mat4 tWorld = glm::translate(glm::mat4(1.0f), glm::vec3(vecObject)) * tRotation;
+        const glm::vec3 vecCenter = glm::vec3(tWorld * glm::vec4(0.5f, 0.0f, 0.0f, 1.0f));
+        if (IsSphereInFrustum(cfFrustum, vecCenter, 1.0f)) {
+            ctVisible++;
+        }
+    }
+    return ctVisible;
+}
+
+
+// Measure how the job system scales.
+void RunJobBenchmark() {
+    // objects scattered on a plane in front of the camera, with some outside its view
+    std::vector<glm::vec4> avecObjects(ctBenchmarkObjects);
+    uint32_t ulSeed = 1;
+    auto fnRandom = [&ulSeed]() {
+        ulSeed = ulSeed * 1664525u + 1013904223u;
+        return (ulSeed >> 8) / float(1 << 24);
+    };
+    for (glm::vec4 &vecObject : avecObjects) {
+        vecObject = glm::vec4(fnRandom() * 200.0f - 100.0f, fnRandom() * 200.0f - 100.0f, 0.0f, fnRandom() * 6.28f);
+    }
+    const glm::mat4 tView = glm::lookAt(glm::vec3(0.0f, -120.0f, 60.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    const glm::mat4 tProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+    CullingFrustum cfFrustum;
+    ExtractFrustumPlanes(tProjection * tView, cfFrustum);
+
+    // visible objects per range, each written by one job only
+    const uint32_t ctRanges = (ctBenchmarkObjects + ctObjectsPerRange - 1) / ctObjectsPerRange;
+    std::vector<uint32_t> actVisible(ctRanges);
+
+    const uint32_t ctMaxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    double tmSingleThread = 0.0;
+    std::cout << "Job system benchmark, " << ctBenchmarkObjects << " objects culled in ranges of " << ctObjectsPerRange << ":" << std::endl;
+    for (uint32_t ctThreads = 1; ctThreads <= ctMaxThreads; ctThreads++) {
+        JobSystem::Initialize(ctThreads);
+
+        // the first run warms up the caches and the threads, and isn't measured
+        double tmBest = std::numeric_limits<double>::max();
+        uint32_t ctTotalVisible = 0;
+        for (uint32_t iRun = 0; iRun <= ctBenchmarkRuns; iRun++) {
+            const auto tmStart = std::chrono::high_resolution_clock::now();
+            JobSystem::ParallelFor(ctBenchmarkObjects, ctObjectsPerRange, [&](uint32_t iBegin, uint32_t iEnd) {
+                actVisible[iBegin / ctObjectsPerRange] = CullObjectRange(avecObjects, cfFrustum, iBegin, iEnd);
+            });
+            const double tmRun = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tmStart).count();
+            if (iRun > 0) {
+                tmBest = std::min(tmBest, tmRun);
+            }
+            ctTotalVisible = 0;
+            for (uint32_t ctRangeVisible : actVisible) {
+                ctTotalVisible += ctRangeVisible;
+            }
+        }
+        JobSystem::Shutdown();
+
+        if (ctThreads == 1) {
+            tmSingleThread = tmBest;
+        }
+        const double fSpeedup = tmSingleThread / tmBest;
+        std::cout << "  " << ctThreads << " threads: " << tmBest * 1000.0 << " ms, speedup " << fSpeedup << ", efficiency "
+            << fSpeedup / ctThreads * 100.0 << "%, " << ctTotalVisible << " visible" << std::endl;
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Measure how the job system scales, with one thread up to one per hardware thread. The workload is culling a large
+// number of moving objects against a camera frustum, split into parallel-for ranges like the renderer's culling.
+// Prints the time per run, the speedup over one thread, and the efficiency - the speedup per thread.
+void RunJobBenchmark();
@@ -0,0 +1,306 @@
+#include "../PrecompiledHeader.h"
+#include "JobSystem.h"
+
+// Index of the worker running on the calling thread, or -1 for threads that aren't workers.
+static thread_local int32_t iCurrentWorker = -1;
+// Room for jobs in a queue when the first one is queued.
+static const uint32_t ctMinQueueCapacity = 64;
+
+
+// Are all jobs of the group finished?
+bool JobCounter::IsDone() {
+    std::lock_guard<std::mutex> lock(_mtxState);
+    return _ctPending == 0;
+}
+
+
+// Start the workers for the given number of threads running jobs.
+void JobSystem::Initialize(uint32_t ctThreads) {
+    JobSystem &jsJobs = GetInstance();
+    assert(jsJobs._ajqQueues.empty());
+
+    // the thread waiting for the jobs is one of the threads running them
+    if (ctThreads == 0) {
+        ctThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    const uint32_t ctWorkers = ctThreads - 1;
+
+    // a queue per worker, and the shared one last
+    for (uint32_t iQueue = 0; iQueue <= ctWorkers; iQueue++) {
+        jsJobs._ajqQueues.push_back(std::make_unique<JobQueue>());
+    }
+    jsJobs._idMainThread = std::this_thread::get_id();
+    jsJobs._bStop = false;
+    for (uint32_t iWorker = 0; iWorker < ctWorkers; iWorker++) {
+        jsJobs._athrWorkers.push_back(std::thread(&JobSystem::WorkerLoop, &jsJobs, iWorker));
+    }
+}
+
+
+// Stop the workers.
+void JobSystem::Shutdown() {
+    JobSystem &jsJobs = GetInstance();
+    assert(jsJobs._ctQueuedJobs == 0);
+
+    {
+        std::lock_guard<std::mutex> lock(jsJobs._mtxSleep);
+        jsJobs._bStop = true;
+    }
+    jsJobs._cvWork.notify_all();
+    for (std::thread &thrWorker : jsJobs._athrWorkers) {
+        thrWorker.join();
+    }
+    jsJobs._athrWorkers.clear();
+    jsJobs._ajqQueues.clear();
+}
+
+
+// Get the number of worker threads.
+uint32_t JobSystem::GetWorkerCount() {
+    return static_cast<uint32_t>(GetInstance()._athrWorkers.size());
+}
+
+
+// Get the index of the worker running on the calling thread.
+int32_t JobSystem::GetCurrentWorker() {
+    return iCurrentWorker;
+}
+
+
+// Submit a job whose work is set up.
+void JobSystem::SubmitJob(Job &jobJob, JobCounter *pjcDependency) {
+    JobSystem &jsJobs = GetInstance();
+    assert(!jsJobs._ajqQueues.empty());
+
+    // the counter is incremented right away, so that waiting for it also waits for jobs held back by a dependency
+    if (jobJob.pjcSignal != nullptr) {
+        std::lock_guard<std::mutex> lock(jobJob.pjcSignal->_mtxState);
+        jobJob.pjcSignal->_ctPending++;
+    }
+
+    // a job whose dependency isn't done waits on the dependency's counter, which schedules it when it reaches zero -
+    // checked under the counter's lock, so that it can't reach zero in between
+    if (pjcDependency != nullptr) {
+        std::lock_guard<std::mutex> lock(pjcDependency->_mtxState);
+        if (pjcDependency->_ctPending > 0) {
+            pjcDependency->_ajobWaiting.push_back(std::move(jobJob));
+            return;
+        }
+    }
+    jsJobs.Schedule(std::move(jobJob));
+}
+
+
+// Wait until all jobs of a counter are finished, running jobs meanwhile.
+void JobSystem::Wait(JobCounter &jcCounter) {
+    JobSystem &jsJobs = GetInstance();
+    // help with the jobs instead of sleeping - the jobs the counter waits for may be in the queues
+    while (!jcCounter.IsDone()) {
+        if (!jsJobs.TryRunJob()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+// Run fnBody on ranges of the items, spread over all threads, and wait for them.
+void JobSystem::ParallelFor(uint32_t ctItems, uint32_t ctGrain, const std::function<void(uint32_t, uint32_t)> &fnBody) {
+    assert(ctGrain > 0);
+    if (ctItems == 0) {
+        return;
+    }
+
+    // the other ranges go to the queues, the first one is run here right away
+    JobCounter jcRanges;
+    for (uint32_t iBegin = ctGrain; iBegin < ctItems; iBegin += ctGrain) {
+        const uint32_t iEnd = std::min(iBegin + ctGrain, ctItems);
+        Submit([&fnBody, iBegin, iEnd]() { fnBody(iBegin, iEnd); }, &jcRanges);
+    }
+    fnBody(0, std::min(ctGrain, ctItems));
+    Wait(jcRanges);
+}
+
+
+// Run the jobs submitted for the main thread.
+void JobSystem::RunMainThreadJobs() {
+    JobSystem &jsJobs = GetInstance();
+    assert(std::this_thread::get_id() == jsJobs._idMainThread);
+
+    // only the jobs queued so far, the jobs may submit new ones
+    uint32_t ctJobs;
+    {
+        std::lock_guard<std::mutex> lock(jsJobs._jqMainThread.mtxJobs);
+        ctJobs = jsJobs._jqMainThread.ctJobs;
+    }
+    for (uint32_t iJob = 0; iJob < ctJobs; iJob++) {
+        Job jobJob;
+        {
+            std::lock_guard<std::mutex> lock(jsJobs._jqMainThread.mtxJobs);
+            if (jsJobs._jqMainThread.IsEmpty()) {
+                return;
+            }
+            jobJob = jsJobs._jqMainThread.PopFront();
+        }
+        jsJobs.RunJob(jobJob);
+    }
+}
+
+
+// Body of a worker thread - runs jobs, and sleeps while there are none.
+void JobSystem::WorkerLoop(uint32_t iWorker) {
+    iCurrentWorker = static_cast<int32_t>(iWorker);
+
+    for (;;) {
+        if (TryRunJob()) {
+            continue;
+        }
+        // sleep until a job is queued - the count is raised before the sleep lock is taken to wake a worker, so a job
+        // queued while this worker is about to sleep is seen by the check
+        std::unique_lock<std::mutex> lock(_mtxSleep);
+        _ctSleeping++;
+        _cvWork.wait(lock, [this] { return _bStop || _ctQueuedJobs.load() > 0; });
+        _ctSleeping--;
+        if (_bStop) {
+            return;
+        }
+    }
+}
+
+
+// Queue a job whose dependency is done, and wake a worker for it.
+void JobSystem::Schedule(Job &&jobJob) {
+    // jobs for the main thread wait until it runs them, workers don't see them
+    if (jobJob.jaAffinity == JOB_AFFINITY_MAIN_THREAD) {
+        std::lock_guard<std::mutex> lock(_jqMainThread.mtxJobs);
+        _jqMainThread.PushBack(std::move(jobJob));
+        return;
+    }
+
+    // workers queue their own jobs, which they will likely run themselves, other threads queue to the shared queue
+    JobQueue &jqQueue = iCurrentWorker >= 0 ? *_ajqQueues[iCurrentWorker] : *_ajqQueues.back();
+    {
+        // counted under the queue's lock, before the job can be taken - a taker uncounting it first would wrap the count
+        // around, and keep the workers from sleeping
+        std::lock_guard<std::mutex> lock(jqQueue.mtxJobs);
+        _ctQueuedJobs++;
+        jqQueue.PushBack(std::move(jobJob));
+    }
+
+    // wake a worker, if any is sleeping
+    std::lock_guard<std::mutex> lock(_mtxSleep);
+    if (_ctSleeping > 0) {
+        _cvWork.notify_one();
+    }
+}
+
+
+// Take a job and run it. Returns false if there was none.
+bool JobSystem::TryRunJob() {
+    Job jobJob;
+    // the main thread also runs the jobs only it can run
+    if (std::this_thread::get_id() == _idMainThread) {
+        std::unique_lock<std::mutex> lock(_jqMainThread.mtxJobs);
+        if (!_jqMainThread.IsEmpty()) {
+            jobJob = _jqMainThread.PopFront();
+            lock.unlock();
+            RunJob(jobJob);
+            return true;
+        }
+    }
+
+    if (!TakeJob(jobJob)) {
+        return false;
+    }
+    _ctQueuedJobs--;
+    RunJob(jobJob);
+    return true;
+}
+
+
+// Take a job from the calling thread's queue, or steal one from another queue.
+bool JobSystem::TakeJob(Job &jobJob) {
+    const uint32_t ctQueues = static_cast<uint32_t>(_ajqQueues.size());
+    // workers start with their own queue, at the back, where the most recently queued and cache-warm jobs are
+    const uint32_t iOwnQueue = iCurrentWorker >= 0 ? static_cast<uint32_t>(iCurrentWorker) : ctQueues - 1;
+    {
+        JobQueue &jqQueue = *_ajqQueues[iOwnQueue];
+        std::lock_guard<std::mutex> lock(jqQueue.mtxJobs);
+        if (!jqQueue.IsEmpty()) {
+            jobJob = jqQueue.PopBack();
+            return true;
+        }
+    }
+
+    // then steal from the others, at the front, where the oldest and usually largest pieces of work are - starting
+    // next to the own queue, so that the thieves spread over the queues
+    for (uint32_t iOffset = 1; iOffset < ctQueues; iOffset++) {
+        JobQueue &jqQueue = *_ajqQueues[(iOwnQueue + iOffset) % ctQueues];
+        std::lock_guard<std::mutex> lock(jqQueue.mtxJobs);
+        if (!jqQueue.IsEmpty()) {
+            jobJob = jqQueue.PopFront();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Run a job and signal its counter.
+void JobSystem::RunJob(Job &jobJob) {
+    jobJob.pfnRun(jobJob.aubPayload);
+    if (jobJob.pjcSignal != nullptr) {
+        Signal(*jobJob.pjcSignal);
+    }
+}
+
+
+// Count a finished job of a counter, and release the jobs that waited for it once all are finished.
+void JobSystem::Signal(JobCounter &jcCounter) {
+    // the released jobs are scheduled outside the counter's lock - once it's released, a waiter may destroy the counter
+    std::vector<Job> ajobReleased;
+    {
+        std::lock_guard<std::mutex> lock(jcCounter._mtxState);
+        assert(jcCounter._ctPending > 0);
+        jcCounter._ctPending--;
+        if (jcCounter._ctPending == 0) {
+            ajobReleased.swap(jcCounter._ajobWaiting);
+        }
+    }
+    for (Job &jobJob : ajobReleased) {
+        Schedule(std::move(jobJob));
+    }
+}
+
+
+// Add a job at the back of the queue.
+void JobSystem::JobQueue::PushBack(Job &&jobJob) {
+    // a full ring doubles, with the jobs moved to the start of the new one in order
+    if (ctJobs == ajobJobs.size()) {
+        std::vector<Job> ajobGrown(std::max(static_cast<uint32_t>(ajobJobs.size()) * 2, ctMinQueueCapacity));
+        for (uint32_t iJob = 0; iJob < ctJobs; iJob++) {
+            ajobGrown[iJob] = std::move(ajobJobs[(iFront + iJob) % ajobJobs.size()]);
+        }
+        ajobJobs.swap(ajobGrown);
+        iFront = 0;
+    }
+    ajobJobs[(iFront + ctJobs) % ajobJobs.size()] = std::move(jobJob);
+    ctJobs++;
+}
+
+
+// Take the job at the back of the queue.
+Job JobSystem::JobQueue::PopBack() {
+    assert(ctJobs > 0);
+    ctJobs--;
+    return std::move(ajobJobs[(iFront + ctJobs) % ajobJobs.size()]);
+}
+
+
+// Take the job at the front of the queue.
+Job JobSystem::JobQueue::PopFront() {
+    assert(ctJobs > 0);
+    Job jobJob = std::move(ajobJobs[iFront]);
+    iFront = static_cast<uint32_t>((iFront + 1) % ajobJobs.size());
+    ctJobs--;
+    return jobJob;
+}
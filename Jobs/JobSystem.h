@@ -0,0 +1,180 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <type_traits>
+#include <new>
+
+// Which threads may run a job.
+enum JobAffinity {
+    // any worker, or a thread waiting for jobs to finish
+    JOB_AFFINITY_ANY = 0,
+    // only the main thread, for work like GLFW calls that other threads must not do
+    JOB_AFFINITY_MAIN_THREAD = 1,
+};
+
+class JobCounter;
+
+// A unit of work submitted to the job system. The work is a callable kept in place in the job, so that submitting
+// and queueing jobs doesn't touch the heap - it must fit the payload and be copyable as plain bytes, like lambdas that
+// capture pointers, references and small values.
+struct Job {
+    // Size of the largest callable a job can hold.
+    static const size_t slMaxPayload = 48;
+
+    // Calls the callable in the payload.
+    void (*pfnRun)(void *pvPayload);
+    // Counter to signal when the work is done, or nullptr.
+    JobCounter *pjcSignal;
+    JobAffinity jaAffinity;
+    // The callable.
+    alignas(std::max_align_t) uint8_t aubPayload[slMaxPayload];
+};
+
+// Counts the unfinished jobs of a group. Jobs signal the counter they were submitted with when they finish, and jobs
+// that depend on a counter only start once it reaches zero. Must outlive the jobs that signal it or depend on it.
+class JobCounter {
+public:
+    JobCounter() : _ctPending(0) {};
+    ~JobCounter() {};
+
+    // Forbid copying, jobs refer to the counter.
+    JobCounter(JobCounter const &) = delete;
+    void operator = (JobCounter const &) = delete;
+
+    // Are all jobs of the group finished?
+    bool IsDone();
+
+private:
+    friend class JobSystem;
+
+    // Guards the count and the waiting jobs. Waiters check the count under it too, so that the counter isn't
+    // destroyed while the last job is still signalling it.
+    std::mutex _mtxState;
+    // Jobs submitted with the counter that didn't finish yet.
+    uint32_t _ctPending;
+    // Jobs that wait for the counter to reach zero.
+    std::vector<Job> _ajobWaiting;
+};
+
+// Work-stealing job scheduler. A worker thread per core, less the main thread, each with its own queue - workers
+// push and pop their jobs at the back of it, so that they keep working on data that is still in their cache, and take
+// jobs from the front of the other queues when theirs is empty. Threads that aren't workers, like the main and the
+// render thread, push to a shared queue, and run jobs themselves while they wait for a counter. Jobs that must run on
+// the main thread are kept apart, until the main thread runs them.
+class JobSystem {
+public:
+    // Start the workers for the given number of threads running jobs, or with zero, one per hardware thread. There is
+    // one worker less, since the thread that waits for jobs runs them too - with one thread, there are no workers.
+    // Must be called on the main thread.
+    static void Initialize(uint32_t ctThreads);
+    // Stop the workers. All submitted jobs must be finished.
+    static void Shutdown();
+
+    // Get the number of worker threads.
+    static uint32_t GetWorkerCount();
+    // Get the index of the worker running on the calling thread, or -1 on threads that aren't workers.
+    static int32_t GetCurrentWorker();
+
+    // Submit a job. The job increments pjcSignal, if given, until it finishes, and doesn't start before pjcDependency,
+    // if given, reaches zero. fnJob is copied into the job, see Job for what it may hold.
+    template<typename Function>
+    static void Submit(const Function &fnJob, JobCounter *pjcSignal, JobCounter *pjcDependency = nullptr,
+        JobAffinity jaAffinity = JOB_AFFINITY_ANY);
+    // Wait until all jobs of a counter are finished, running jobs meanwhile.
+    static void Wait(JobCounter &jcCounter);
+    // Run fnBody on ranges of at most ctGrain of the items [0, ctItems), spread over all threads, and wait for them.
+    // The calling thread runs one of the ranges.
+    static void ParallelFor(uint32_t ctItems, uint32_t ctGrain, const std::function<void(uint32_t, uint32_t)> &fnBody);
+
+    // Run the jobs submitted for the main thread. Called by the main loop.
+    static void RunMainThreadJobs();
+
+private:
+    JobSystem() : _ctQueuedJobs(0), _ctSleeping(0), _bStop(false) {};
+    ~JobSystem() {};
+
+    // The singleton instance.
+    static JobSystem &GetInstance() {
+        static JobSystem jsJobs;
+        return jsJobs;
+    }
+
+    // Jobs of a worker, or the ones pushed by threads that aren't workers. A ring buffer that only grows, so that
+    // queueing jobs doesn't touch the heap once it's large enough. Guarded by its mutex.
+    struct JobQueue {
+        JobQueue() : iFront(0), ctJobs(0) {};
+
+        // Add a job at the back.
+        void PushBack(Job &&jobJob);
+        // Take the job at the back, or at the front. The queue must not be empty.
+        Job PopBack();
+        Job PopFront();
+        // Are there no jobs?
+        bool IsEmpty() const { return ctJobs == 0; }
+
+        std::mutex mtxJobs;
+        // Ring of the jobs, starting at iFront.
+        std::vector<Job> ajobJobs;
+        uint32_t iFront;
+        uint32_t ctJobs;
+    };
+
+    // Call the callable of type Function in a job's payload.
+    template<typename Function>
+    static void RunPayload(void *pvPayload) { (*static_cast<Function *>(pvPayload))(); }
+    // Submit a job whose work is set up.
+    static void SubmitJob(Job &jobJob, JobCounter *pjcDependency);
+
+    // Body of a worker thread - runs jobs, and sleeps while there are none.
+    void WorkerLoop(uint32_t iWorker);
+    // Queue a job whose dependency is done, and wake a worker for it.
+    void Schedule(Job &&jobJob);
+    // Take a job and run it. Returns false if there was none.
+    bool TryRunJob();
+    // Take a job from the calling thread's queue, or steal one from another queue.
+    bool TakeJob(Job &jobJob);
+    // Run a job and signal its counter.
+    void RunJob(Job &jobJob);
+    // Count a finished job of a counter, and release the jobs that waited for it once all are finished.
+    void Signal(JobCounter &jcCounter);
+
+private:
+    // Queue of each worker, and last the shared one of the other threads.
+    std::vector<std::unique_ptr<JobQueue>> _ajqQueues;
+    // Jobs that must run on the main thread.
+    JobQueue _jqMainThread;
+    // Worker threads.
+    std::vector<std::thread> _athrWorkers;
+    // Id of the main thread.
+    std::thread::id _idMainThread;
+
+    // Jobs in the queues that workers can run, for deciding whether to sleep.
+    std::atomic<uint32_t> _ctQueuedJobs;
+    // Guards sleeping and waking up the workers.
+    std::mutex _mtxSleep;
+    std::condition_variable _cvWork;
+    // Number of sleeping workers, and should they stop?
+    uint32_t _ctSleeping;
+    bool _bStop;
+};
+
+
+// Submit a job.
+template<typename Function>
+void JobSystem::Submit(const Function &fnJob, JobCounter *pjcSignal, JobCounter *pjcDependency, JobAffinity jaAffinity) {
+    // jobs are moved between the queues as plain bytes, and never destroyed
+    static_assert(sizeof(Function) <= Job::slMaxPayload, "the job's callable doesn't fit the payload");
+    static_assert(alignof(Function) <= alignof(std::max_align_t), "the job's callable is over-aligned");
+    static_assert(std::is_trivially_copy_constructible<Function>::value && std::is_trivially_destructible<Function>::value,
+        "the job's callable must be copyable as plain bytes");
+
+    Job jobJob;
+    jobJob.pfnRun = &RunPayload<Function>;
+    jobJob.pjcSignal = pjcSignal;
+    jobJob.jaAffinity = jaAffinity;
+    new (jobJob.aubPayload) Function(fnJob);
+    SubmitJob(jobJob, pjcDependency);
+}
@@ -0,0 +1,154 @@
+#include "../PrecompiledHeader.h"
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+// Allocations made so far. Counting is relaxed - the count is only read between frames, long after it changed.
+static std::atomic<uint64_t> ctHeapAllocations(0);
+
+
+// Get the number of heap allocations made through operator new.
+uint64_t GetHeapAllocationCount() {
+    return ctHeapAllocations.load(std::memory_order_relaxed);
+}
+
+
+// Allocate from the heap and count the allocation. Returns nullptr if there is no memory.
+static void *AllocateCounted(size_t ulSize) {
+    ctHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    // zero sized allocations must still return distinct pointers
+    return std::malloc(ulSize > 0 ? ulSize : 1);
+}
+
+
+// Replacements of the global allocation functions, which all allocate through AllocateCounted.
+void *operator new(size_t ulSize) {
+    void *pMemory = AllocateCounted(ulSize);
+    if (pMemory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pMemory;
+}
+
+void *operator new[](size_t ulSize) {
+    return operator new(ulSize);
+}
+
+void *operator new(size_t ulSize, const std::nothrow_t &) noexcept {
+    return AllocateCounted(ulSize);
+}
+
+void *operator new[](size_t ulSize, const std::nothrow_t &) noexcept {
+    return AllocateCounted(ulSize);
+}
+
+void operator delete(void *pMemory) noexcept {
+    std::free(pMemory);
+}
+
+void operator delete[](void *pMemory) noexcept {
+    std::free(pMemory);
+}
+
+void operator delete(void *pMemory, size_t) noexcept {
+    std::free(pMemory);
+}
+
+void operator delete[](void *pMemory, size_t) noexcept {
+    std::free(pMemory);
+}
+
+void operator delete(void *pMemory, const std::nothrow_t &) noexcept {
+    std::free(pMemory);
+}
+
+void operator delete[](void *pMemory, const std::nothrow_t &) noexcept {
+    std::free(pMemory);
+}
+
+
+// Over-aligned types are allocated through separate functions, which must be replaced as well to be counted.
+#ifdef __cpp_aligned_new
+// Allocate aligned memory from the heap and count the allocation. Returns nullptr if there is no memory.
+static void *AllocateCountedAligned(size_t ulSize, std::align_val_t ulAlignment) {
+    ctHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t ulAlign = static_cast<size_t>(ulAlignment);
+#ifdef _MSC_VER
+    return _aligned_malloc(ulSize > 0 ? ulSize : 1, ulAlign);
+#else
+    // the size must be a nonzero multiple of the alignment
+    const size_t ulAlignedSize = (std::max<size_t>(ulSize, 1) + ulAlign - 1) / ulAlign * ulAlign;
+    return std::aligned_alloc(ulAlign, ulAlignedSize);
+#endif
+}
+
+
+// Free memory allocated by AllocateCountedAligned.
+static void FreeAligned(void *pMemory) {
+#ifdef _MSC_VER
+    _aligned_free(pMemory);
+#else
+    std::free(pMemory);
+#endif
+}
+
+
+void *operator new(size_t ulSize, std::align_val_t ulAlignment) {
+    void *pMemory = AllocateCountedAligned(ulSize, ulAlignment);
+    if (pMemory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pMemory;
+}
+
+void *operator new[](size_t ulSize, std::align_val_t ulAlignment) {
+    return operator new(ulSize, ulAlignment);
+}
+
+void *operator new(size_t ulSize, std::align_val_t ulAlignment, const std::nothrow_t &) noexcept {
+    return AllocateCountedAligned(ulSize, ulAlignment);
+}
+
+void *operator new[](size_t ulSize, std::align_val_t ulAlignment, const std::nothrow_t &) noexcept {
+    return AllocateCountedAligned(ulSize, ulAlignment);
+}
+
+void operator delete(void *pMemory, std::align_val_t) noexcept {
+    FreeAligned(pMemory);
+}
+
+void operator delete[](void *pMemory, std::align_val_t) noexcept {
+    FreeAligned(pMemory);
+}
+
+void operator delete(void *pMemory, size_t, std::align_val_t) noexcept {
+    FreeAligned(pMemory);
+}
+
+void operator delete[](void *pMemory, size_t, std::align_val_t) noexcept {
+    FreeAligned(pMemory);
+}
+
+void operator delete(void *pMemory, std::align_val_t, const std::nothrow_t &) noexcept {
+    FreeAligned(pMemory);
+}
+
+void operator delete[](void *pMemory, std::align_val_t, const std::nothrow_t &) noexcept {
+    FreeAligned(pMemory);
+}
+#endif // __cpp_aligned_new
+
+#else
+
+// Get the number of heap allocations made through operator new. They aren't counted in this build.
+uint64_t GetHeapAllocationCount() {
+    return 0;
+}
+
+#endif // COUNT_HEAP_ALLOCATIONS
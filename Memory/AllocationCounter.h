@@ -0,0 +1,13 @@
+#pragma once
+
+// Heap allocations are only counted in builds that define COUNT_HEAP_ALLOCATIONS, like the benchmark builds. The global
+// operator new is then replaced to count them, so that benchmarks can check that steady state frames don't allocate.
+#ifdef COUNT_HEAP_ALLOCATIONS
+static const bool bHeapAllocationsCounted = true;
+#else
+static const bool bHeapAllocationsCounted = false;
+#endif
+
+// Get the number of heap allocations made through operator new since the program started, on all threads. Always zero
+// in builds that don't count them.
+uint64_t GetHeapAllocationCount();
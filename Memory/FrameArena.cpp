@@ -0,0 +1,99 @@
+#include "../PrecompiledHeader.h"
+#include "FrameArena.h"
+#include "../Jobs/JobSystem.h"
+
+// Size of the first block of an arena.
+static const size_t ctMinBlockBytes = 64 * 1024;
+
+
+// Allocate memory with the given alignment.
+void *LinearArena::Allocate(size_t ulSize, size_t ulAlignment) {
+    assert(ulAlignment > 0 && (ulAlignment & (ulAlignment - 1)) == 0);
+
+    // align the offset in the current block, and take the next block if it doesn't fit
+    size_t ulStart = 0;
+    for (;;) {
+        if (_iBlock < _ablBlocks.size()) {
+            const uintptr_t ulBase = reinterpret_cast<uintptr_t>(_ablBlocks[_iBlock].aubMemory.get());
+            ulStart = ((ulBase + _ulOffset + ulAlignment - 1) & ~(uintptr_t(ulAlignment) - 1)) - ulBase;
+            if (ulStart + ulSize <= _ablBlocks[_iBlock].ulSize) {
+                break;
+            }
+        }
+        // blocks after the current one are only there until the next reset merges them, so a new one goes last
+        if (_iBlock + 1 < _ablBlocks.size()) {
+            _iBlock++;
+            _ulOffset = 0;
+            continue;
+        }
+        AddBlock(ulSize, ulAlignment);
+    }
+
+    _ulOffset = ulStart + ulSize;
+    _ulUsed += ulSize;
+    _ulPeak = std::max(_ulPeak, _ulUsed);
+    return _ablBlocks[_iBlock].aubMemory.get() + ulStart;
+}
+
+
+// Free all allocations.
+void LinearArena::Reset() {
+    // merge the blocks into one that holds everything they did, so that the next time it all fits in one block
+    if (_ablBlocks.size() > 1) {
+        size_t ulTotal = 0;
+        for (const ArenaBlock &abBlock : _ablBlocks) {
+            ulTotal += abBlock.ulSize;
+        }
+        _ablBlocks.clear();
+        ArenaBlock abBlock;
+        abBlock.aubMemory.reset(new uint8_t[ulTotal]);
+        abBlock.ulSize = ulTotal;
+        _ablBlocks.push_back(std::move(abBlock));
+    }
+    _iBlock = 0;
+    _ulOffset = 0;
+    _ulUsed = 0;
+}
+
+
+// Add a block with room for at least ulSize bytes at the given alignment.
+void LinearArena::AddBlock(size_t ulSize, size_t ulAlignment) {
+    // the blocks double, so that a growing arena needs few of them
+    size_t ulBlockSize = _ablBlocks.empty() ? ctMinBlockBytes : _ablBlocks.back().ulSize * 2;
+    ulBlockSize = std::max(ulBlockSize, ulSize + ulAlignment);
+    ArenaBlock abBlock;
+    abBlock.aubMemory.reset(new uint8_t[ulBlockSize]);
+    abBlock.ulSize = ulBlockSize;
+    _ablBlocks.push_back(std::move(abBlock));
+    _iBlock = static_cast<uint32_t>(_ablBlocks.size() - 1);
+    _ulOffset = 0;
+}
+
+
+// Create the sub-arenas of the job system's workers.
+void FrameArena::Initialize() {
+    _aparWorkers.clear();
+    for (uint32_t iWorker = 0; iWorker < JobSystem::GetWorkerCount(); iWorker++) {
+        _aparWorkers.push_back(std::make_unique<LinearArena>());
+    }
+}
+
+
+// Free all allocations of the frame.
+void FrameArena::Reset() {
+    _arMain.Reset();
+    for (std::unique_ptr<LinearArena> &parWorker : _aparWorkers) {
+        parWorker->Reset();
+    }
+}
+
+
+// Get the arena of the calling thread.
+LinearArena &FrameArena::GetThreadArena() {
+    const int32_t iWorker = JobSystem::GetCurrentWorker();
+    if (iWorker < 0) {
+        return _arMain;
+    }
+    assert(static_cast<uint32_t>(iWorker) < _aparWorkers.size());
+    return *_aparWorkers[iWorker];
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// Bump allocator for memory that lives until a known point, like the end of a frame. Allocating moves an offset
+// forward, freeing single allocations does nothing, and resetting frees everything at once. The memory is kept in
+// blocks, a new one is added when the current one is full - after a reset they are merged into one block of their
+// total size, so that once the arena grew to what a frame needs, it doesn't touch the heap anymore.
+// Not thread safe - each thread allocates from its own arena.
+class LinearArena {
+public:
+    LinearArena() : _iBlock(0), _ulOffset(0), _ulUsed(0), _ulPeak(0) {};
+    ~LinearArena() {};
+
+    // Forbid copying, allocations point into the arena.
+    LinearArena(LinearArena const &) = delete;
+    void operator = (LinearArena const &) = delete;
+
+    // Allocate memory with the given alignment, which must be a power of two.
+    void *Allocate(size_t ulSize, size_t ulAlignment);
+    // Free all allocations.
+    void Reset();
+
+    // Get the bytes allocated since the last reset, and the most allocated between two resets.
+    size_t GetUsedBytes() const { return _ulUsed; }
+    size_t GetPeakBytes() const { return _ulPeak; }
+
+private:
+    // A block of memory allocations are taken from.
+    struct ArenaBlock {
+        std::unique_ptr<uint8_t[]> aubMemory;
+        size_t ulSize;
+    };
+    // Add a block with room for at least ulSize bytes at the given alignment, and make it the current one.
+    void AddBlock(size_t ulSize, size_t ulAlignment);
+
+private:
+    // Blocks, in the order they were added.
+    std::vector<ArenaBlock> _ablBlocks;
+    // Block allocations are taken from, and the offset of its free part.
+    uint32_t _iBlock;
+    size_t _ulOffset;
+    // Bytes allocated since the last reset, and the most between two resets.
+    size_t _ulUsed;
+    size_t _ulPeak;
+};
+
+// Number of frame arenas used in turn. A frame's transient data may still be referenced while the next frame is
+// built - like the frame graph's passes, which are only dropped when the next frame declares its own - so an arena
+// is only reset when the frame after the one that used it finished too.
+const uint32_t ctFrameArenaSlots = 2;
+
+// Transient memory of a frame in flight - draw lists, barrier arrays and other data that lives until the frame is
+// finished. Reset wholesale once the GPU finished the frame. The thread that builds the frame allocates from the main
+// arena, job workers from their own sub-arenas, so that jobs allocate without locking.
+class FrameArena {
+public:
+    FrameArena() {};
+    ~FrameArena() {};
+
+    // Create the sub-arenas of the job system's workers. The job system must be running.
+    void Initialize();
+    // Free all allocations of the frame, in all sub-arenas. No thread may allocate from the arena meanwhile.
+    void Reset();
+
+    // Get the arena of the calling thread - the worker's sub-arena on job workers, the main arena on other threads.
+    // Only the thread building the frame may use the main arena.
+    LinearArena &GetThreadArena();
+    // Get the main arena.
+    LinearArena &GetArena() { return _arMain; }
+
+private:
+    // Arena of the thread building the frame.
+    LinearArena _arMain;
+    // Arena of each job worker, separately allocated so that workers don't share cache lines.
+    std::vector<std::unique_ptr<LinearArena>> _aparWorkers;
+};
+
+// Allocator that lets standard containers take their memory from an arena. Deallocating does nothing - the memory is
+// freed when the arena is reset, so the containers must not be used after that, not even destroyed if their elements
+// have destructors that read them.
+template<typename Item>
+class ArenaAllocator {
+public:
+    typedef Item value_type;
+    // a container moved into another one keeps its memory, so it keeps its arena too
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator(LinearArena &arArena) : _parArena(&arArena) {};
+    template<typename Other>
+    ArenaAllocator(const ArenaAllocator<Other> &aaOther) : _parArena(aaOther.GetArena()) {};
+
+    // Allocate memory for ctItems items.
+    Item *allocate(size_t ctItems) { return static_cast<Item *>(_parArena->Allocate(ctItems * sizeof(Item), alignof(Item))); }
+    // Deallocate memory - it is freed together with the arena.
+    void deallocate(Item *, size_t) {};
+
+    // Get the arena the memory is taken from.
+    LinearArena *GetArena() const { return _parArena; }
+
+private:
+    LinearArena *_parArena;
+};
+
+// Allocators are equal if they take memory from the same arena.
+template<typename First, typename Second>
+bool operator == (const ArenaAllocator<First> &aaFirst, const ArenaAllocator<Second> &aaSecond) { return aaFirst.GetArena() == aaSecond.GetArena(); }
+template<typename First, typename Second>
+bool operator != (const ArenaAllocator<First> &aaFirst, const ArenaAllocator<Second> &aaSecond) { return aaFirst.GetArena() != aaSecond.GetArena(); }
+
+// Vector taking its memory from an arena.
+template<typename Item>
+using ArenaVector = std::vector<Item, ArenaAllocator<Item>>;
@@ -0,0 +1,269 @@
+#include "../PrecompiledHeader.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include <sys/stat.h>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "../ThirdParty/tiny_obj_loader.h"
+
+// Identifies cooked mesh files.
+static const uint32_t ulMeshCacheMagic = 0x4853454d; // 'MESH'
+// Version of the cooked mesh format. Increase whenever the format or the cooking process changes, to force a recook.
+static const uint32_t ulMeshCacheVersion = 4;
+
+// Header at the start of each cooked mesh file.
+struct MeshCacheHeader {
+    uint32_t ulMagic;
+    uint32_t ulVersion;
+    // Size and modification time of the source file, the cooked file is up to date if both match.
+    uint64_t ullSourceSize;
+    int64_t llSourceModified;
+    // Hash of the source file contents, compared when the size or the time don't match - the cooked file is stale if
+    // it doesn't match either.
+    uint64_t ullSourceHash;
+};
+
+
+// Get the size and modification time of a file. Returns false if it doesn't exist.
+static bool GetFileStamp(const std::string &strPath, uint64_t &ullSize, int64_t &llModified) {
+    struct stat statFile;
+    if (stat(strPath.c_str(), &statFile) != 0) {
+        return false;
+    }
+    ullSize = static_cast<uint64_t>(statFile.st_size);
+    llModified = static_cast<int64_t>(statFile.st_mtime);
+    return true;
+}
+
+
+// Read an entire file into memory. Returns false if the file can't be opened.
+static bool ReadFileContents(const std::string &strPath, std::vector<char> &achContents) {
+    std::ifstream fsFile(strPath, std::ios::ate | std::ios::binary);
+    if (!fsFile.is_open()) {
+        return false;
+    }
+    // get the file size and read the whole file
+    const size_t ctFileSize = static_cast<size_t>(fsFile.tellg());
+    achContents.resize(ctFileSize);
+    fsFile.seekg(0);
+    fsFile.read(achContents.data(), ctFileSize);
+    return !fsFile.fail();
+}
+
+
+// Hash a block of memory with 64 bit FNV-1a.
+static uint64_t HashContents(const std::vector<char> &achContents) {
+    uint64_t ullHash = 14695981039346656037ull;
+    for (const char chByte : achContents) {
+        ullHash = (ullHash ^ static_cast<uint8_t>(chByte)) * 1099511628211ull;
+    }
+    return ullHash;
+}
+
+
+// Write a plain value to a binary stream.
+template<typename TValue>
+static void WriteValue(std::ofstream &fsFile, const TValue &tValue) {
+    fsFile.write(reinterpret_cast<const char*>(&tValue), sizeof(TValue));
+}
+
+// Write an array, prefixed with its element count, to a binary stream.
+template<typename TElement>
+static void WriteArray(std::ofstream &fsFile, const std::vector<TElement> &atElements) {
+    WriteValue(fsFile, static_cast<uint32_t>(atElements.size()));
+    fsFile.write(reinterpret_cast<const char*>(atElements.data()), atElements.size() * sizeof(TElement));
+}
+
+// Read a plain value from a binary stream.
+template<typename TValue>
+static bool ReadValue(std::ifstream &fsFile, TValue &tValue) {
+    fsFile.read(reinterpret_cast<char*>(&tValue), sizeof(TValue));
+    return !fsFile.fail();
+}
+
+// Read an array, prefixed with its element count, from a binary stream.
+template<typename TElement>
+static bool ReadArray(std::ifstream &fsFile, std::vector<TElement> &atElements) {
+    uint32_t ctElements = 0;
+    if (!ReadValue(fsFile, ctElements)) {
+        return false;
+    }
+    // a damaged count must not resize the array past what the rest of the file can hold
+    const std::streampos spElements = fsFile.tellg();
+    fsFile.seekg(0, std::ios::end);
+    const std::streamoff soRemaining = fsFile.tellg() - spElements;
+    fsFile.seekg(spElements);
+    if (fsFile.fail() || soRemaining < 0 || static_cast<uint64_t>(soRemaining) / sizeof(TElement) < ctElements) {
+        return false;
+    }
+    atElements.resize(ctElements);
+    fsFile.read(reinterpret_cast<char*>(atElements.data()), atElements.size() * sizeof(TElement));
+    return !fsFile.fail();
+}
+
+
+// Get the path of the cached file for a source file.
+std::string GetMeshCachePath(const std::string &strSourcePath) {
+    return strSourcePath + ".mesh";
+}
+
+
+// Load the full precision triangle list from an OBJ file. All meshes in the file are combined into one.
+static void LoadSourceMesh(const std::string &strSourcePath, std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices) {
+    // vertex attributes - position, normal, uv, color
+    tinyobj::attrib_t vatrVertexAttributes;
+    // object's meshes, named
+    std::vector<tinyobj::shape_t> ameshMeshes;
+    // materials used by the object
+    std::vector<tinyobj::material_t> amatMaterials;
+    // error string will be stored here, if any
+    std::string strError;
+
+    // load the model from the object file
+    if (!tinyobj::LoadObj(&vatrVertexAttributes, &ameshMeshes, &amatMaterials, &strError, strSourcePath.c_str())) {
+        throw std::runtime_error("Failed to load the model:  " + strError);
+    }
+
+    // go through all vertices in all meshes in the model
+    for (const auto &meshMesh : ameshMeshes) {
+        for (const auto iVertex : meshMesh.mesh.indices) {
+            // read vertex attributes
+            VertexSource vVertex = {};
+            // read the position
+            vVertex.vecPosition = {
+                vatrVertexAttributes.vertices[iVertex.vertex_index * 3 + 0],
+                vatrVertexAttributes.vertices[iVertex.vertex_index * 3 + 1],
+                vatrVertexAttributes.vertices[iVertex.vertex_index * 3 + 2],
+            };
+            // read the UV coordinaets
+            vVertex.vecTexCoords = {
+                vatrVertexAttributes.texcoords[iVertex.texcoord_index * 2 + 0],
+                1.0f - vatrVertexAttributes.texcoords[iVertex.texcoord_index * 2 + 1],
+            };
+            // read the normal, if the model has normals
+            if (iVertex.normal_index >= 0) {
+                vVertex.vecNormal = {
+                    vatrVertexAttributes.normals[iVertex.normal_index * 3 + 0],
+                    vatrVertexAttributes.normals[iVertex.normal_index * 3 + 1],
+                    vatrVertexAttributes.normals[iVertex.normal_index * 3 + 2],
+                };
+            }
+            // use constant color, white
+            vVertex.colColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+            // store the vertex and its index, duplicates are merged by the optimizer
+            aiIndices.push_back(static_cast<uint32_t>(avVertices.size()));
+            avVertices.push_back(vVertex);
+        }
+    }
+}
+
+
+// Load a mesh from its source OBJ file and run all the processing on it.
+CookedMesh CookMesh(const std::string &strSourcePath) {
+    std::vector<VertexSource> avSourceVertices;
+    std::vector<uint32_t> aiIndices;
+    LoadSourceMesh(strSourcePath, avSourceVertices, aiIndices);
+
+    // optimize the mesh in full precision, and report how much the vertex cache efficiency improved
+    const MeshOptimizationStatistics mosStatistics = OptimizeMesh(avSourceVertices, aiIndices);
+    std::cout << "Cooked mesh " << strSourcePath << ":  "
+        << mosStatistics.ctTriangles << " triangles, "
+        << mosStatistics.ctVerticesBefore << " -> " << mosStatistics.ctVerticesAfter << " vertices, "
+        << mosStatistics.ctClusters << " clusters, "
+        << "ACMR " << mosStatistics.vcsBefore.fACMR << " -> " << mosStatistics.vcsAfter.fACMR << ", "
+        << "ATVR " << mosStatistics.vcsBefore.fATVR << " -> " << mosStatistics.vcsAfter.fATVR << std::endl;
+
+    // generate the simplified levels of detail, they all reference the same vertices
+    CookedMesh meshCooked;
+    GenerateMeshLods(avSourceVertices, aiIndices, meshCooked.aiIndices, meshCooked.almLods);
+    // report the triangles of each level, with its error in object space units
+    std::cout << "Generated " << meshCooked.almLods.size() << " levels of detail, triangles (error):";
+    for (const MeshLod &mlLod : meshCooked.almLods) {
+        std::cout << " " << mlLod.ctIndices / 3 << " (" << mlLod.fError << ")";
+    }
+    std::cout << std::endl;
+
+    // split each level into meshlets for culling
+    for (MeshLod &mlLod : meshCooked.almLods) {
+        mlLod.iFirstMeshlet = static_cast<uint32_t>(meshCooked.amsMeshlets.size());
+        BuildMeshlets(avSourceVertices, meshCooked.aiIndices, mlLod.iFirstIndex, mlLod.ctIndices, meshCooked.amsMeshlets);
+        mlLod.ctMeshlets = static_cast<uint32_t>(meshCooked.amsMeshlets.size()) - mlLod.iFirstMeshlet;
+    }
+    std::cout << "Built " << meshCooked.amsMeshlets.size() << " meshlets" << std::endl;
+
+    // quantize the vertices to the compact GPU layout
+    meshCooked.vqQuantization = ComputeVertexQuantization(avSourceVertices);
+    QuantizeVertices(avSourceVertices, meshCooked.vqQuantization, meshCooked.avVertices);
+    return meshCooked;
+}
+
+
+// Load a mesh through the cache, cooking it first if the cached file is missing or out of date.
+CookedMesh LoadCookedMesh(const std::string &strSourcePath) {
+    // the header the cooked file should have, the hash is only filled in once the source had to be read
+    MeshCacheHeader mchSource = { ulMeshCacheMagic, ulMeshCacheVersion, 0, 0, 0 };
+    if (!GetFileStamp(strSourcePath, mchSource.ullSourceSize, mchSource.llSourceModified)) {
+        throw std::runtime_error("Failed to open mesh source:  " + strSourcePath);
+    }
+    bool bHashed = false;
+    const std::string strCachePath = GetMeshCachePath(strSourcePath);
+
+    // try the cooked file first
+    {
+        std::ifstream fsCache(strCachePath, std::ios::binary);
+        MeshCacheHeader mchHeader = {};
+        if (fsCache.is_open() && ReadValue(fsCache, mchHeader) && mchHeader.ulMagic == ulMeshCacheMagic && mchHeader.ulVersion == ulMeshCacheVersion) {
+            // an unchanged size and time are trusted, otherwise the source may have only been touched or copied, so
+            // its contents decide
+            bool bUpToDate = mchHeader.ullSourceSize == mchSource.ullSourceSize && mchHeader.llSourceModified == mchSource.llSourceModified;
+            if (!bUpToDate) {
+                std::vector<char> achSource;
+                if (!ReadFileContents(strSourcePath, achSource)) {
+                    throw std::runtime_error("Failed to open mesh source:  " + strSourcePath);
+                }
+                mchSource.ullSourceHash = HashContents(achSource);
+                bHashed = true;
+                bUpToDate = mchHeader.ullSourceHash == mchSource.ullSourceHash;
+            }
+
+            CookedMesh meshCooked;
+            if (bUpToDate && ReadValue(fsCache, meshCooked.vqQuantization) && ReadArray(fsCache, meshCooked.avVertices) && ReadArray(fsCache, meshCooked.aiIndices)
+                && ReadArray(fsCache, meshCooked.almLods) && ReadArray(fsCache, meshCooked.amsMeshlets)) {
+                // a source whose contents didn't change gets its new stamp, so that the next run doesn't hash it again
+                if (bHashed) {
+                    fsCache.close();
+                    std::fstream fsStamp(strCachePath, std::ios::binary | std::ios::in | std::ios::out);
+                    fsStamp.write(reinterpret_cast<const char*>(&mchSource), sizeof(MeshCacheHeader));
+                }
+                return meshCooked;
+            }
+        }
+    }
+
+    // the cooked file is missing, stale or damaged, so cook the mesh again
+    CookedMesh meshCooked = CookMesh(strSourcePath);
+    if (!bHashed) {
+        std::vector<char> achSource;
+        if (!ReadFileContents(strSourcePath, achSource)) {
+            throw std::runtime_error("Failed to open mesh source:  " + strSourcePath);
+        }
+        mchSource.ullSourceHash = HashContents(achSource);
+    }
+
+    // store the result for the next run; failing to do so only costs time, so it's not an error
+    std::ofstream fsCache(strCachePath, std::ios::binary | std::ios::trunc);
+    if (fsCache.is_open()) {
+        WriteValue(fsCache, mchSource);
+        WriteValue(fsCache, meshCooked.vqQuantization);
+        WriteArray(fsCache, meshCooked.avVertices);
+        WriteArray(fsCache, meshCooked.aiIndices);
+        WriteArray(fsCache, meshCooked.almLods);
+        WriteArray(fsCache, meshCooked.amsMeshlets);
+    }
+    if (!fsCache.is_open() || fsCache.fail()) {
+        std::cerr << "Failed to write mesh cache:  " << strCachePath << std::endl;
+    }
+
+    return meshCooked;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "VertexFormats.h"
+#include "MeshLod.h"
+#include "Meshlets.h"
+
+// Cache of cooked meshes. Source OBJ files are loaded, optimized and quantized once, and the result is stored in a
+// binary file next to the source. Later runs load the cooked file directly, as long as the source didn't change.
+
+// Mesh in the form it's uploaded to the GPU.
+struct CookedMesh {
+    // Parameters needed to restore the quantized vertex attributes.
+    VertexQuantization vqQuantization;
+    // Quantized vertices, in the order they are first used by the index buffer.
+    std::vector<VertexQuantized> avVertices;
+    // Triangle lists of all levels of detail, each ordered for the post-transform cache.
+    std::vector<uint32_t> aiIndices;
+    // Levels of detail, as ranges in the index buffer, from the most to the least detailed.
+    std::vector<MeshLod> almLods;
+    // Meshlets of all levels of detail, each level's meshlets are a range in this array.
+    std::vector<Meshlet> amsMeshlets;
+};
+
+// Load a mesh through the cache, cooking it first if the cached file is missing or out of date.
+CookedMesh LoadCookedMesh(const std::string &strSourcePath);
+// Load a mesh from its source OBJ file and run all the processing on it.
+CookedMesh CookMesh(const std::string &strSourcePath);
+// Get the path of the cached file for a source file.
+std::string GetMeshCachePath(const std::string &strSourcePath);
@@ -0,0 +1,65 @@
+#include "../PrecompiledHeader.h"
+#include "MeshLod.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+// Maximum number of levels in the chain, including the full detail one.
+static const uint32_t ctMaxLods = 8;
+// Each level targets this fraction of the previous level's triangles.
+static const float fLodReduction = 0.5f;
+// The chain ends when a level can't get below this fraction of the previous one.
+static const float fMinLodProgress = 0.9f;
+// Levels are not simplified below this number of triangles.
+static const size_t ctMinLodTriangles = 16;
+// Largest error allowed for any level, relative to the mesh extent.
+static const float fMaxLodError = 0.25f;
+
+
+// Generate a chain of simplified levels from the full detail index buffer.
+void GenerateMeshLods(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, std::vector<uint32_t> &aiLodIndices, std::vector<MeshLod> &almLods) {
+    // the full detail level is stored unchanged - the meshlets of the levels are filled in when they are split
+    almLods.push_back({ static_cast<uint32_t>(aiLodIndices.size()), static_cast<uint32_t>(aiIndices.size()), 0.0f, 0, 0 });
+    aiLodIndices.insert(aiLodIndices.end(), aiIndices.begin(), aiIndices.end());
+
+    // each level is simplified from the previous one, so the errors add up
+    std::vector<uint32_t> aiPrevious(aiIndices);
+    float fPreviousError = 0.0f;
+    while (almLods.size() < ctMaxLods && aiPrevious.size() / 3 > ctMinLodTriangles) {
+        const size_t ctTargetIndices = std::max(size_t(aiPrevious.size() * fLodReduction) / 3, ctMinLodTriangles) * 3;
+        float fLevelError = 0.0f;
+        std::vector<uint32_t> aiLevel = SimplifyMesh(avVertices, aiPrevious, ctTargetIndices, fMaxLodError, fLevelError);
+
+        // stop when simplification stalls - borders, seams or the error limit keep the mesh from getting simpler
+        if (aiLevel.size() > aiPrevious.size() * fMinLodProgress) {
+            break;
+        }
+
+        // simplification scrambles the triangle order, restore cache locality
+        std::vector<uint32_t> aiClusterStarts;
+        OptimizeVertexCache(aiLevel, avVertices.size(), aiClusterStarts);
+
+        fPreviousError += fLevelError;
+        almLods.push_back({ static_cast<uint32_t>(aiLodIndices.size()), static_cast<uint32_t>(aiLevel.size()), fPreviousError, 0, 0 });
+        aiLodIndices.insert(aiLodIndices.end(), aiLevel.begin(), aiLevel.end());
+        aiPrevious.swap(aiLevel);
+    }
+}
+
+
+// Pick the least detailed level whose error, projected to the screen, stays below fMaxPixelError.
+uint32_t SelectMeshLod(const std::vector<MeshLod> &almLods, float fObjectScale, float fDistance, float fProjectionScale, float fMaxPixelError) {
+    // inside or very close to the object, always use full detail
+    if (fDistance <= 0.0f) {
+        return 0;
+    }
+    // levels are ordered by increasing error, take the last one that is still good enough
+    const float fPixelsPerUnit = fObjectScale * fProjectionScale / fDistance;
+    uint32_t iLod = 0;
+    for (uint32_t iLevel = 1; iLevel < almLods.size(); iLevel++) {
+        if (almLods[iLevel].fError * fPixelsPerUnit > fMaxPixelError) {
+            break;
+        }
+        iLod = iLevel;
+    }
+    return iLod;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "VertexFormats.h"
+
+// Levels of detail of a mesh. All levels share the vertex buffer, and their index ranges are stored one after
+// another in the same index buffer, from the most to the least detailed.
+
+// One level of detail - a range in the mesh's index buffer.
+struct MeshLod {
+    // First index of the level in the index buffer.
+    uint32_t iFirstIndex;
+    // Number of indices in the level.
+    uint32_t ctIndices;
+    // Largest distance of the simplified surface from the original one, in object space units.
+    float fError;
+    // First meshlet of the level in the mesh's meshlet array.
+    uint32_t iFirstMeshlet;
+    // Number of meshlets the level is split into.
+    uint32_t ctMeshlets;
+};
+
+// Generate a chain of simplified levels from the full detail index buffer. The indices of all levels, including the
+// full detail one, are appended to aiLodIndices, and the levels are appended to almLods.
+void GenerateMeshLods(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, std::vector<uint32_t> &aiLodIndices, std::vector<MeshLod> &almLods);
+
+// Pick the least detailed level whose error, projected to the screen, stays below fMaxPixelError.
+// fProjectionScale converts a size at unit distance to pixels - viewport height / (2 * tan(fov / 2)).
+uint32_t SelectMeshLod(const std::vector<MeshLod> &almLods, float fObjectScale, float fDistance, float fProjectionScale, float fMaxPixelError);
@@ -0,0 +1,357 @@
+#include "../PrecompiledHeader.h"
+#include "MeshOptimizer.h"
+
+#include <unordered_map>
+#include <cstring>
+
+
+// Simulate a FIFO post-transform vertex cache over an indexed triangle list.
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t> &aiIndices, size_t ctVertices, uint32_t ctCacheSize) {
+    VertexCacheStatistics vcsStatistics = {};
+    // time when each vertex entered the cache, counted in cache misses; 0 means never
+    std::vector<uint32_t> aiTimestamps(ctVertices, 0);
+    uint32_t ctUniqueVertices = 0;
+
+    for (const uint32_t iVertex : aiIndices) {
+        // a vertex is in the cache if less than ctCacheSize vertices were inserted after it
+        const bool bCached = aiTimestamps[iVertex] != 0 && vcsStatistics.ctVerticesTransformed - aiTimestamps[iVertex] < ctCacheSize;
+        if (!bCached) {
+            // count the vertex the first time it's used
+            if (aiTimestamps[iVertex] == 0) {
+                ctUniqueVertices++;
+            }
+            // transform the vertex and push it into the cache
+            vcsStatistics.ctVerticesTransformed++;
+            aiTimestamps[iVertex] = vcsStatistics.ctVerticesTransformed;
+        }
+    }
+
+    // calculate the ratios, if there's anything to calculate them for
+    const size_t ctTriangles = aiIndices.size() / 3;
+    vcsStatistics.fACMR = ctTriangles > 0 ? float(vcsStatistics.ctVerticesTransformed) / ctTriangles : 0.0f;
+    vcsStatistics.fATVR = ctUniqueVertices > 0 ? float(vcsStatistics.ctVerticesTransformed) / ctUniqueVertices : 0.0f;
+    return vcsStatistics;
+}
+
+
+// Hashes a vertex by its bytes, so that only bitwise identical vertices are merged.
+struct VertexSourceHasher {
+    size_t operator()(const VertexSource &vVertex) const {
+        // FNV-1a over the raw bytes
+        const uint8_t *pubBytes = reinterpret_cast<const uint8_t*>(&vVertex);
+        uint32_t ulHash = 2166136261u;
+        for (size_t iByte = 0; iByte < sizeof(VertexSource); iByte++) {
+            ulHash = (ulHash ^ pubBytes[iByte]) * 16777619u;
+        }
+        return ulHash;
+    }
+};
+
+// Compares vertices by their bytes.
+struct VertexSourceEqual {
+    bool operator()(const VertexSource &vFirst, const VertexSource &vSecond) const {
+        return memcmp(&vFirst, &vSecond, sizeof(VertexSource)) == 0;
+    }
+};
+
+
+// Merge bitwise identical vertices and rewrite the index buffer to reference the merged ones.
+void WeldVertices(std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices) {
+    // index of the first occurrence of each unique vertex
+    std::unordered_map<VertexSource, uint32_t, VertexSourceHasher, VertexSourceEqual> mapUniqueVertices;
+    mapUniqueVertices.reserve(avVertices.size());
+    std::vector<VertexSource> avUniqueVertices;
+    avUniqueVertices.reserve(avVertices.size());
+
+    for (uint32_t &iVertex : aiIndices) {
+        const VertexSource &vVertex = avVertices[iVertex];
+        // add the vertex if it wasn't seen before
+        auto itUnique = mapUniqueVertices.find(vVertex);
+        if (itUnique == mapUniqueVertices.end()) {
+            itUnique = mapUniqueVertices.emplace(vVertex, static_cast<uint32_t>(avUniqueVertices.size())).first;
+            avUniqueVertices.push_back(vVertex);
+        }
+        // point the index to the unique copy
+        iVertex = itUnique->second;
+    }
+
+    avVertices.swap(avUniqueVertices);
+}
+
+
+// Reorder triangles for vertex cache locality, using the Tipsify algorithm (Sander, Nehab, Barczak 2007).
+void OptimizeVertexCache(std::vector<uint32_t> &aiIndices, size_t ctVertices, std::vector<uint32_t> &aiClusterStarts, uint32_t ctCacheSize) {
+    aiClusterStarts.clear();
+    const size_t ctTriangles = aiIndices.size() / 3;
+    if (ctTriangles == 0) {
+        return;
+    }
+
+    // build vertex to triangle adjacency, in compressed form - triangles of vertex v are at [aiAdjacencyOffsets[v], aiAdjacencyOffsets[v + 1])
+    std::vector<uint32_t> aiAdjacencyOffsets(ctVertices + 1, 0);
+    for (const uint32_t iVertex : aiIndices) {
+        aiAdjacencyOffsets[iVertex + 1]++;
+    }
+    for (size_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+        aiAdjacencyOffsets[iVertex + 1] += aiAdjacencyOffsets[iVertex];
+    }
+    std::vector<uint32_t> aiAdjacentTriangles(aiIndices.size());
+    std::vector<uint32_t> aiFill(aiAdjacencyOffsets.begin(), aiAdjacencyOffsets.end() - 1);
+    for (size_t iIndex = 0; iIndex < aiIndices.size(); iIndex++) {
+        aiAdjacentTriangles[aiFill[aiIndices[iIndex]]++] = static_cast<uint32_t>(iIndex / 3);
+    }
+
+    // number of triangles not yet emitted, for each vertex
+    std::vector<uint32_t> actLiveTriangles(ctVertices);
+    for (size_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+        actLiveTriangles[iVertex] = aiAdjacencyOffsets[iVertex + 1] - aiAdjacencyOffsets[iVertex];
+    }
+    // time when each vertex entered the cache
+    std::vector<uint32_t> aiCacheTimes(ctVertices, 0);
+    // whether each triangle was already emitted
+    std::vector<bool> abEmitted(ctTriangles, false);
+    // recently used vertices, to restart from when the fanning vertex runs out of triangles
+    std::vector<uint32_t> aiDeadEnds;
+    // candidates for the next fanning vertex
+    std::vector<uint32_t> aiCandidates;
+
+    std::vector<uint32_t> aiOutput;
+    aiOutput.reserve(aiIndices.size());
+
+    // current time, starts past the cache size so no vertex is considered cached
+    uint32_t tmTime = ctCacheSize + 1;
+    // cursor for finding the next vertex with live triangles when all dead ends are exhausted
+    uint32_t iCursor = 0;
+    // start fanning from the first vertex
+    int64_t iFanning = aiIndices[0];
+    aiClusterStarts.push_back(0);
+
+    while (iFanning >= 0) {
+        aiCandidates.clear();
+
+        // emit all the remaining triangles around the fanning vertex
+        for (uint32_t iAdjacent = aiAdjacencyOffsets[iFanning]; iAdjacent < aiAdjacencyOffsets[iFanning + 1]; iAdjacent++) {
+            const uint32_t iTriangle = aiAdjacentTriangles[iAdjacent];
+            if (abEmitted[iTriangle]) {
+                continue;
+            }
+            for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+                const uint32_t iVertex = aiIndices[iTriangle * 3 + iCorner];
+                aiOutput.push_back(iVertex);
+                aiDeadEnds.push_back(iVertex);
+                aiCandidates.push_back(iVertex);
+                actLiveTriangles[iVertex]--;
+                // if the vertex is not in the cache, it gets transformed and enters it
+                if (tmTime - aiCacheTimes[iVertex] > ctCacheSize) {
+                    aiCacheTimes[iVertex] = tmTime;
+                    tmTime++;
+                }
+            }
+            abEmitted[iTriangle] = true;
+        }
+
+        // pick the candidate that will still be in the cache after its remaining triangles are emitted, preferring the oldest one
+        int64_t iNext = -1;
+        int64_t iBestPriority = -1;
+        for (const uint32_t iCandidate : aiCandidates) {
+            if (actLiveTriangles[iCandidate] == 0) {
+                continue;
+            }
+            int64_t iPriority = 0;
+            if (tmTime - aiCacheTimes[iCandidate] + 2 * actLiveTriangles[iCandidate] <= ctCacheSize) {
+                iPriority = tmTime - aiCacheTimes[iCandidate];
+            }
+            if (iPriority > iBestPriority) {
+                iBestPriority = iPriority;
+                iNext = iCandidate;
+            }
+        }
+
+        // if none of the candidates has live triangles, we're at a dead end
+        if (iNext < 0) {
+            // try the recently used vertices first
+            while (!aiDeadEnds.empty() && iNext < 0) {
+                const uint32_t iDeadEnd = aiDeadEnds.back();
+                aiDeadEnds.pop_back();
+                if (actLiveTriangles[iDeadEnd] > 0) {
+                    iNext = iDeadEnd;
+                }
+            }
+            // otherwise continue with the next vertex in the input order that still has live triangles
+            while (iNext < 0 && iCursor < ctVertices) {
+                if (actLiveTriangles[iCursor] > 0) {
+                    iNext = iCursor;
+                }
+                iCursor++;
+            }
+            // restarting from an arbitrary vertex effectively flushes the cache, so it's a cluster boundary
+            if (iNext >= 0 && aiOutput.size() < aiIndices.size()) {
+                aiClusterStarts.push_back(static_cast<uint32_t>(aiOutput.size()));
+            }
+        }
+
+        iFanning = iNext;
+    }
+
+    aiIndices.swap(aiOutput);
+}
+
+
+// Reorder clusters of triangles so that the outward facing ones are drawn first.
+uint32_t OptimizeOverdraw(std::vector<uint32_t> &aiIndices, const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiClusterStarts, float fThreshold, uint32_t ctCacheSize) {
+    const size_t ctIndices = aiIndices.size();
+    if (ctIndices == 0) {
+        return 0;
+    }
+
+    // split the hard clusters further while the cache efficiency of the pieces stays close to the whole cluster
+    std::vector<uint32_t> aiSoftStarts;
+    // cache simulation shared by all clusters - advancing the miss counter by the cache size flushes the cache
+    std::vector<uint32_t> aiTimestamps(avVertices.size(), 0);
+    uint32_t ctMisses = 0;
+    auto SimulateTriangle = [&](uint32_t iIndex) {
+        uint32_t ctTriangleMisses = 0;
+        for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+            const uint32_t iVertex = aiIndices[iIndex + iCorner];
+            if (aiTimestamps[iVertex] == 0 || ctMisses - aiTimestamps[iVertex] >= ctCacheSize) {
+                ctMisses++;
+                ctTriangleMisses++;
+                aiTimestamps[iVertex] = ctMisses;
+            }
+        }
+        return ctTriangleMisses;
+    };
+
+    for (size_t iCluster = 0; iCluster < aiClusterStarts.size(); iCluster++) {
+        const uint32_t iStart = aiClusterStarts[iCluster];
+        const uint32_t iEnd = iCluster + 1 < aiClusterStarts.size() ? aiClusterStarts[iCluster + 1] : static_cast<uint32_t>(ctIndices);
+
+        // cache efficiency of the entire cluster, starting with a cold cache
+        ctMisses += ctCacheSize;
+        uint32_t ctClusterMisses = 0;
+        for (uint32_t iIndex = iStart; iIndex < iEnd; iIndex += 3) {
+            ctClusterMisses += SimulateTriangle(iIndex);
+        }
+        const float fClusterACMR = float(ctClusterMisses) / ((iEnd - iStart) / 3);
+
+        // walk the triangles with a cold cache again, and split whenever the piece is as efficient as the whole
+        aiSoftStarts.push_back(iStart);
+        ctMisses += ctCacheSize;
+        uint32_t ctPieceMisses = 0;
+        uint32_t ctPieceTriangles = 0;
+        for (uint32_t iIndex = iStart; iIndex < iEnd; iIndex += 3) {
+            ctPieceMisses += SimulateTriangle(iIndex);
+            ctPieceTriangles++;
+
+            // start a new piece, with a cold cache, if this one is good enough
+            if (iIndex + 3 < iEnd && float(ctPieceMisses) / ctPieceTriangles <= fThreshold * fClusterACMR) {
+                aiSoftStarts.push_back(iIndex + 3);
+                ctMisses += ctCacheSize;
+                ctPieceMisses = 0;
+                ctPieceTriangles = 0;
+            }
+        }
+    }
+    const size_t ctClusters = aiSoftStarts.size();
+
+    // the mesh centroid, for deciding which way the clusters face
+    glm::vec3 vecMeshCentroid(0.0f);
+    for (const uint32_t iVertex : aiIndices) {
+        vecMeshCentroid += avVertices[iVertex].vecPosition;
+    }
+    vecMeshCentroid /= float(ctIndices);
+
+    // sort key for each cluster - how much it faces away from the mesh centroid
+    std::vector<float> afSortKeys(ctClusters);
+    for (size_t iCluster = 0; iCluster < ctClusters; iCluster++) {
+        const uint32_t iStart = aiSoftStarts[iCluster];
+        const uint32_t iEnd = iCluster + 1 < ctClusters ? aiSoftStarts[iCluster + 1] : static_cast<uint32_t>(ctIndices);
+
+        // area weighted centroid and normal of the cluster
+        glm::vec3 vecCentroid(0.0f);
+        glm::vec3 vecNormal(0.0f);
+        float fArea = 0.0f;
+        for (uint32_t iIndex = iStart; iIndex < iEnd; iIndex += 3) {
+            const glm::vec3 &vecA = avVertices[aiIndices[iIndex + 0]].vecPosition;
+            const glm::vec3 &vecB = avVertices[aiIndices[iIndex + 1]].vecPosition;
+            const glm::vec3 &vecC = avVertices[aiIndices[iIndex + 2]].vecPosition;
+            const glm::vec3 vecCross = glm::cross(vecB - vecA, vecC - vecA);
+            const float fTriangleArea = glm::length(vecCross);
+            vecCentroid += (vecA + vecB + vecC) * (fTriangleArea / 3.0f);
+            vecNormal += vecCross;
+            fArea += fTriangleArea;
+        }
+        if (fArea > 0.0f) {
+            vecCentroid /= fArea;
+        }
+        const float fNormalLength = glm::length(vecNormal);
+        if (fNormalLength > 0.0f) {
+            vecNormal /= fNormalLength;
+        }
+        afSortKeys[iCluster] = glm::dot(vecCentroid - vecMeshCentroid, vecNormal);
+    }
+
+    // draw the clusters facing outwards first, they are most likely to occlude the others
+    std::vector<uint32_t> aiClusterOrder(ctClusters);
+    for (uint32_t iCluster = 0; iCluster < ctClusters; iCluster++) {
+        aiClusterOrder[iCluster] = iCluster;
+    }
+    std::stable_sort(aiClusterOrder.begin(), aiClusterOrder.end(), [&afSortKeys](uint32_t iFirst, uint32_t iSecond) {
+        return afSortKeys[iFirst] > afSortKeys[iSecond];
+    });
+
+    // emit the clusters in the sorted order
+    std::vector<uint32_t> aiOutput;
+    aiOutput.reserve(ctIndices);
+    for (const uint32_t iCluster : aiClusterOrder) {
+        const uint32_t iStart = aiSoftStarts[iCluster];
+        const uint32_t iEnd = iCluster + 1 < ctClusters ? aiSoftStarts[iCluster + 1] : static_cast<uint32_t>(ctIndices);
+        aiOutput.insert(aiOutput.end(), aiIndices.begin() + iStart, aiIndices.begin() + iEnd);
+    }
+    aiIndices.swap(aiOutput);
+
+    return static_cast<uint32_t>(ctClusters);
+}
+
+
+// Reorder vertices in the order of their first use in the index buffer.
+void OptimizeVertexFetch(std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices) {
+    // new location of each vertex, assigned on first use
+    const uint32_t iUnassigned = ~0u;
+    std::vector<uint32_t> aiRemap(avVertices.size(), iUnassigned);
+    std::vector<VertexSource> avRemapped;
+    avRemapped.reserve(avVertices.size());
+
+    for (uint32_t &iVertex : aiIndices) {
+        if (aiRemap[iVertex] == iUnassigned) {
+            aiRemap[iVertex] = static_cast<uint32_t>(avRemapped.size());
+            avRemapped.push_back(avVertices[iVertex]);
+        }
+        iVertex = aiRemap[iVertex];
+    }
+
+    // vertices that are never referenced are dropped
+    avVertices.swap(avRemapped);
+}
+
+
+// Run all the optimizations on a mesh, in order.
+MeshOptimizationStatistics OptimizeMesh(std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices) {
+    MeshOptimizationStatistics mosStatistics = {};
+    mosStatistics.ctVerticesBefore = static_cast<uint32_t>(avVertices.size());
+    mosStatistics.ctTriangles = static_cast<uint32_t>(aiIndices.size() / 3);
+
+    // merge duplicates first, the cache can't help if the same vertex has multiple indices
+    WeldVertices(avVertices, aiIndices);
+    mosStatistics.ctVerticesAfter = static_cast<uint32_t>(avVertices.size());
+    mosStatistics.vcsBefore = AnalyzeVertexCache(aiIndices, avVertices.size());
+
+    // reorder the triangles for the cache, then the clusters for overdraw, and the vertices for fetching
+    std::vector<uint32_t> aiClusterStarts;
+    OptimizeVertexCache(aiIndices, avVertices.size(), aiClusterStarts);
+    mosStatistics.ctClusters = OptimizeOverdraw(aiIndices, avVertices, aiClusterStarts);
+    OptimizeVertexFetch(avVertices, aiIndices);
+
+    mosStatistics.vcsAfter = AnalyzeVertexCache(aiIndices, avVertices.size());
+    return mosStatistics;
+}
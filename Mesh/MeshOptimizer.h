@@ -0,0 +1,51 @@
+#pragma once
+#include "VertexFormats.h"
+
+// Mesh optimization pass, run when a mesh is cooked into the asset cache. Reorders triangles for post-transform
+// vertex cache locality (Tipsify), then reorders clusters of triangles to reduce overdraw, and finally remaps
+// vertices so the vertex fetch reads them sequentially.
+
+// Size of the simulated post-transform vertex cache (FIFO). Matches the typical size on current hardware.
+const uint32_t ctDefaultVertexCacheSize = 16;
+
+// Result of simulating a vertex cache over an index buffer.
+struct VertexCacheStatistics {
+    // Number of vertices that missed the cache and had to be transformed.
+    uint32_t ctVerticesTransformed;
+    // Average cache miss ratio - transformed vertices per triangle. 0.5 is the ideal for a large regular grid, 3 the worst.
+    float fACMR;
+    // Average transform to vertex ratio - transformed vertices per unique vertex. 1 is the ideal.
+    float fATVR;
+};
+
+// Statistics gathered while optimizing a mesh.
+struct MeshOptimizationStatistics {
+    // Number of vertices before and after welding duplicates.
+    uint32_t ctVerticesBefore;
+    uint32_t ctVerticesAfter;
+    // Number of triangles in the mesh.
+    uint32_t ctTriangles;
+    // Number of clusters the triangles were split into for overdraw ordering.
+    uint32_t ctClusters;
+    // Vertex cache efficiency of the original triangle order.
+    VertexCacheStatistics vcsBefore;
+    // Vertex cache efficiency of the optimized triangle order.
+    VertexCacheStatistics vcsAfter;
+};
+
+// Simulate a FIFO post-transform vertex cache over an indexed triangle list.
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t> &aiIndices, size_t ctVertices, uint32_t ctCacheSize = ctDefaultVertexCacheSize);
+
+// Merge bitwise identical vertices and rewrite the index buffer to reference the merged ones.
+void WeldVertices(std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices);
+// Reorder triangles for vertex cache locality. Fills the offsets (in indices) where the cache was flushed,
+// which are natural boundaries for reordering clusters without hurting cache efficiency.
+void OptimizeVertexCache(std::vector<uint32_t> &aiIndices, size_t ctVertices, std::vector<uint32_t> &aiClusterStarts, uint32_t ctCacheSize = ctDefaultVertexCacheSize);
+// Reorder clusters of triangles so that the outward facing ones are drawn first. Clusters are split further while
+// their cache miss ratio stays within fThreshold of the original. Returns the number of clusters.
+uint32_t OptimizeOverdraw(std::vector<uint32_t> &aiIndices, const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiClusterStarts, float fThreshold = 1.05f, uint32_t ctCacheSize = ctDefaultVertexCacheSize);
+// Reorder vertices in the order of their first use in the index buffer.
+void OptimizeVertexFetch(std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices);
+
+// Run all the optimizations on a mesh, in order.
+MeshOptimizationStatistics OptimizeMesh(std::vector<VertexSource> &avVertices, std::vector<uint32_t> &aiIndices);
@@ -0,0 +1,423 @@
+#include "../PrecompiledHeader.h"
+#include "MeshSimplifier.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+
+// Kinds of vertices, they decide which collapses are allowed.
+enum VertexKind {
+    // Interior vertex, can collapse onto any neighbour.
+    VERTEX_KIND_MANIFOLD,
+    // Vertex on an open border, can only collapse along the border.
+    VERTEX_KIND_BORDER,
+    // Vertex on an attribute seam (two vertices share the position), both sides collapse along the seam together.
+    VERTEX_KIND_SEAM,
+    // Vertex that can't be moved - corners, non-manifold vertices and seam/border intersections.
+    VERTEX_KIND_LOCKED,
+};
+
+// Marks a missing neighbour in the border and seam links.
+static const uint32_t iNoVertex = ~0u;
+
+// Weight of the quadrics that keep borders and seams in place, relative to the surface quadrics.
+static const float fEdgeQuadricWeight = 10.0f;
+
+// Maximum cosine of the angle between a triangle's normal before and after a collapse, below which the collapse
+// is considered to flip the triangle.
+static const float fMinNormalAgreement = 0.25f;
+
+
+// Symmetric 4x4 matrix accumulating squared distances to a set of planes, weighted by area.
+struct Quadric {
+    float a2, b2, c2, d2;
+    float ab, ac, ad, bc, bd, cd;
+    // Sum of the weights of all the planes.
+    float fWeight;
+
+    // Accumulate another quadric.
+    void Add(const Quadric &qdrOther) {
+        a2 += qdrOther.a2; b2 += qdrOther.b2; c2 += qdrOther.c2; d2 += qdrOther.d2;
+        ab += qdrOther.ab; ac += qdrOther.ac; ad += qdrOther.ad;
+        bc += qdrOther.bc; bd += qdrOther.bd; cd += qdrOther.cd;
+        fWeight += qdrOther.fWeight;
+    }
+
+    // Build the quadric of the plane with normal n and distance d, weighted by w.
+    static Quadric FromPlane(const glm::vec3 &vecNormal, float fDistance, float fWeight) {
+        Quadric qdrPlane;
+        const float a = vecNormal.x, b = vecNormal.y, c = vecNormal.z, d = fDistance;
+        qdrPlane.a2 = a * a * fWeight; qdrPlane.b2 = b * b * fWeight; qdrPlane.c2 = c * c * fWeight; qdrPlane.d2 = d * d * fWeight;
+        qdrPlane.ab = a * b * fWeight; qdrPlane.ac = a * c * fWeight; qdrPlane.ad = a * d * fWeight;
+        qdrPlane.bc = b * c * fWeight; qdrPlane.bd = b * d * fWeight; qdrPlane.cd = c * d * fWeight;
+        qdrPlane.fWeight = fWeight;
+        return qdrPlane;
+    }
+
+    // Weighted average squared distance of a point to all the planes.
+    float Evaluate(const glm::vec3 &vecPoint) const {
+        const float x = vecPoint.x, y = vecPoint.y, z = vecPoint.z;
+        const float fError =
+            a2 * x * x + b2 * y * y + c2 * z * z + d2 +
+            2.0f * (ab * x * y + ac * x * z + bc * y * z) +
+            2.0f * (ad * x + bd * y + cd * z);
+        return fWeight > 0.0f ? std::max(fError, 0.0f) / fWeight : 0.0f;
+    }
+};
+
+
+// A possible collapse of one vertex onto another.
+struct Collapse {
+    // Vertex that moves, and the vertex it moves onto.
+    uint32_t iFrom;
+    uint32_t iTo;
+    // Squared distance error introduced by the collapse.
+    float fError;
+};
+
+
+// Hashes positions by their bytes.
+struct PositionHasher {
+    size_t operator()(const glm::vec3 &vecPosition) const {
+        uint32_t aulBits[3];
+        memcpy(aulBits, &vecPosition, sizeof(aulBits));
+        return (aulBits[0] * 73856093u) ^ (aulBits[1] * 19349663u) ^ (aulBits[2] * 83492791u);
+    }
+};
+
+// Compares positions by their bytes.
+struct PositionEqual {
+    bool operator()(const glm::vec3 &vecFirst, const glm::vec3 &vecSecond) const {
+        return memcmp(&vecFirst, &vecSecond, sizeof(glm::vec3)) == 0;
+    }
+};
+
+// Make a key for a directed edge.
+static uint64_t EdgeKey(uint32_t iFrom, uint32_t iTo) {
+    return (uint64_t(iFrom) << 32) | iTo;
+}
+
+
+// Simplify an indexed triangle list using quadric error metrics.
+std::vector<uint32_t> SimplifyMesh(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, size_t ctTargetIndices, float fTargetError, float &fResultError) {
+    fResultError = 0.0f;
+    std::vector<uint32_t> aiResult(aiIndices);
+    const size_t ctVertices = avVertices.size();
+    if (aiResult.size() <= ctTargetIndices || ctVertices == 0) {
+        return aiResult;
+    }
+
+    // work with positions scaled to a unit box, so errors and thresholds don't depend on the mesh size
+    glm::vec3 vecMin = avVertices[0].vecPosition;
+    glm::vec3 vecMax = avVertices[0].vecPosition;
+    for (const VertexSource &vVertex : avVertices) {
+        vecMin = glm::min(vecMin, vVertex.vecPosition);
+        vecMax = glm::max(vecMax, vVertex.vecPosition);
+    }
+    const glm::vec3 vecExtent = vecMax - vecMin;
+    const float fExtent = std::max(vecExtent.x, std::max(vecExtent.y, std::max(vecExtent.z, 1e-30f)));
+    std::vector<glm::vec3> avecPositions(ctVertices);
+    for (size_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+        avecPositions[iVertex] = (avVertices[iVertex].vecPosition - vecMin) / fExtent;
+    }
+
+    // find vertices that share a position - they are one vertex for the topology, and differ only in attributes
+    std::vector<uint32_t> aiPosition(ctVertices);
+    std::vector<uint32_t> aiNextWedge(ctVertices);
+    {
+        std::unordered_map<glm::vec3, uint32_t, PositionHasher, PositionEqual> mapPositions;
+        mapPositions.reserve(ctVertices);
+        for (uint32_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+            auto itPosition = mapPositions.emplace(avVertices[iVertex].vecPosition, iVertex).first;
+            const uint32_t iFirst = itPosition->second;
+            aiPosition[iVertex] = iFirst;
+            // link the vertex into the circular list of vertices with the same position
+            if (iFirst == iVertex) {
+                aiNextWedge[iVertex] = iVertex;
+            } else {
+                aiNextWedge[iVertex] = aiNextWedge[iFirst];
+                aiNextWedge[iFirst] = iVertex;
+            }
+        }
+    }
+
+    // collect directed edges, for vertices and for positions
+    std::unordered_set<uint64_t> setVertexEdges;
+    std::unordered_set<uint64_t> setPositionEdges;
+    setVertexEdges.reserve(aiResult.size());
+    setPositionEdges.reserve(aiResult.size());
+    for (size_t iIndex = 0; iIndex < aiResult.size(); iIndex += 3) {
+        for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+            const uint32_t iFrom = aiResult[iIndex + iCorner];
+            const uint32_t iTo = aiResult[iIndex + (iCorner + 1) % 3];
+            setVertexEdges.insert(EdgeKey(iFrom, iTo));
+            setPositionEdges.insert(EdgeKey(aiPosition[iFrom], aiPosition[iTo]));
+        }
+    }
+
+    // link open edges - an edge without its reverse is on a border (for positions) or a seam (for vertices)
+    std::vector<uint32_t> aiBorderNext(ctVertices, iNoVertex), aiBorderPrev(ctVertices, iNoVertex);
+    std::vector<uint32_t> aiSeamNext(ctVertices, iNoVertex), aiSeamPrev(ctVertices, iNoVertex);
+    std::vector<uint8_t> actOpenEdges(ctVertices, 0);
+    std::vector<uint8_t> actSeamEdges(ctVertices, 0);
+    for (const uint64_t ullEdge : setPositionEdges) {
+        const uint32_t iFrom = uint32_t(ullEdge >> 32), iTo = uint32_t(ullEdge);
+        if (setPositionEdges.count(EdgeKey(iTo, iFrom)) == 0) {
+            aiBorderNext[iFrom] = iTo;
+            aiBorderPrev[iTo] = iFrom;
+            actOpenEdges[iFrom]++;
+            actOpenEdges[iTo]++;
+        }
+    }
+    for (const uint64_t ullEdge : setVertexEdges) {
+        const uint32_t iFrom = uint32_t(ullEdge >> 32), iTo = uint32_t(ullEdge);
+        const bool bPositionClosed = setPositionEdges.count(EdgeKey(aiPosition[iTo], aiPosition[iFrom])) != 0;
+        if (setVertexEdges.count(EdgeKey(iTo, iFrom)) == 0 && bPositionClosed) {
+            aiSeamNext[iFrom] = iTo;
+            aiSeamPrev[iTo] = iFrom;
+            actSeamEdges[iFrom]++;
+            actSeamEdges[iTo]++;
+        }
+    }
+
+    // classify the vertices
+    std::vector<uint8_t> aeKinds(ctVertices, VERTEX_KIND_LOCKED);
+    for (uint32_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+        const uint32_t iPosition = aiPosition[iVertex];
+        const uint32_t iSibling = aiNextWedge[iVertex];
+        const bool bSingleWedge = iSibling == iVertex;
+        const bool bTwoWedges = !bSingleWedge && aiNextWedge[iSibling] == iVertex;
+
+        if (bSingleWedge && actOpenEdges[iPosition] == 0) {
+            aeKinds[iVertex] = VERTEX_KIND_MANIFOLD;
+        } else if (bSingleWedge && actOpenEdges[iPosition] == 2 && aiBorderNext[iPosition] != iNoVertex && aiBorderPrev[iPosition] != iNoVertex) {
+            aeKinds[iVertex] = VERTEX_KIND_BORDER;
+        } else if (bTwoWedges && actOpenEdges[iPosition] == 0 && actSeamEdges[iVertex] == 2 && actSeamEdges[iSibling] == 2
+            && aiSeamNext[iVertex] != iNoVertex && aiSeamPrev[iVertex] != iNoVertex
+            && aiSeamNext[iSibling] != iNoVertex && aiSeamPrev[iSibling] != iNoVertex) {
+            // collapsing a seam vertex relinks the seam on both sides, so both wedges need both of their neighbours
+            aeKinds[iVertex] = VERTEX_KIND_SEAM;
+        }
+    }
+
+    // accumulate quadrics for each position, from the planes of the triangles around it
+    std::vector<Quadric> aqdrQuadrics(ctVertices, Quadric());
+    for (size_t iIndex = 0; iIndex < aiResult.size(); iIndex += 3) {
+        const uint32_t i0 = aiPosition[aiResult[iIndex + 0]], i1 = aiPosition[aiResult[iIndex + 1]], i2 = aiPosition[aiResult[iIndex + 2]];
+        const glm::vec3 vecCross = glm::cross(avecPositions[i1] - avecPositions[i0], avecPositions[i2] - avecPositions[i0]);
+        const float fArea = glm::length(vecCross);
+        if (fArea <= 0.0f) {
+            continue;
+        }
+        const glm::vec3 vecNormal = vecCross / fArea;
+        const Quadric qdrPlane = Quadric::FromPlane(vecNormal, -glm::dot(vecNormal, avecPositions[i0]), fArea);
+        aqdrQuadrics[i0].Add(qdrPlane);
+        aqdrQuadrics[i1].Add(qdrPlane);
+        aqdrQuadrics[i2].Add(qdrPlane);
+
+        // borders and seams get a plane perpendicular to the triangle through the edge, which keeps them from moving sideways
+        for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+            const uint32_t iFrom = aiResult[iIndex + iCorner];
+            const uint32_t iTo = aiResult[iIndex + (iCorner + 1) % 3];
+            const uint32_t iPositionFrom = aiPosition[iFrom], iPositionTo = aiPosition[iTo];
+            if (aiBorderNext[iPositionFrom] != iPositionTo && aiSeamNext[iFrom] != iTo) {
+                continue;
+            }
+            const glm::vec3 vecEdge = avecPositions[iPositionTo] - avecPositions[iPositionFrom];
+            const float fLength = glm::length(vecEdge);
+            if (fLength <= 0.0f) {
+                continue;
+            }
+            const glm::vec3 vecEdgeNormal = glm::normalize(glm::cross(vecEdge, vecNormal));
+            const Quadric qdrEdge = Quadric::FromPlane(vecEdgeNormal, -glm::dot(vecEdgeNormal, avecPositions[iPositionFrom]), fLength * fLength * fEdgeQuadricWeight);
+            aqdrQuadrics[iPositionFrom].Add(qdrEdge);
+            aqdrQuadrics[iPositionTo].Add(qdrEdge);
+        }
+    }
+
+    const float fMaxError = fTargetError * fTargetError;
+    float fWorstError = 0.0f;
+    std::vector<Collapse> acolCandidates;
+    std::vector<uint32_t> aiRemap(ctVertices);
+    std::vector<uint8_t> abTouched(ctVertices);
+    std::vector<uint32_t> aiTriangleOffsets(ctVertices + 1);
+    std::vector<uint32_t> aiTriangles;
+
+    // collapse edges in passes, until the target is reached or no more collapses are possible
+    while (aiResult.size() > ctTargetIndices) {
+        const size_t ctTriangles = aiResult.size() / 3;
+
+        // build position to triangle adjacency, for the flip checks
+        std::fill(aiTriangleOffsets.begin(), aiTriangleOffsets.end(), 0);
+        for (const uint32_t iVertex : aiResult) {
+            aiTriangleOffsets[aiPosition[iVertex] + 1]++;
+        }
+        for (size_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+            aiTriangleOffsets[iVertex + 1] += aiTriangleOffsets[iVertex];
+        }
+        aiTriangles.resize(aiResult.size());
+        {
+            std::vector<uint32_t> aiFill(aiTriangleOffsets.begin(), aiTriangleOffsets.end() - 1);
+            for (size_t iIndex = 0; iIndex < aiResult.size(); iIndex++) {
+                aiTriangles[aiFill[aiPosition[aiResult[iIndex]]]++] = static_cast<uint32_t>(iIndex / 3);
+            }
+        }
+
+        // gather all allowed collapses along the edges of the triangles
+        acolCandidates.clear();
+        for (size_t iIndex = 0; iIndex < aiResult.size(); iIndex += 3) {
+            for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+                const uint32_t iA = aiResult[iIndex + iCorner];
+                const uint32_t iB = aiResult[iIndex + (iCorner + 1) % 3];
+                const uint32_t aiEnds[2][2] = { { iA, iB }, { iB, iA } };
+                for (const auto &aiEnd : aiEnds) {
+                    const uint32_t iFrom = aiEnd[0], iTo = aiEnd[1];
+                    const uint32_t iPositionFrom = aiPosition[iFrom], iPositionTo = aiPosition[iTo];
+                    bool bAllowed = false;
+                    switch (aeKinds[iFrom]) {
+                    case VERTEX_KIND_MANIFOLD:
+                        bAllowed = true;
+                        break;
+                    case VERTEX_KIND_BORDER:
+                        bAllowed = aiBorderNext[iPositionFrom] == iPositionTo || aiBorderPrev[iPositionFrom] == iPositionTo;
+                        break;
+                    case VERTEX_KIND_SEAM:
+                        // both sides of the seam must have a matching seam edge
+                        if (aeKinds[iTo] == VERTEX_KIND_SEAM && (aiSeamNext[iFrom] == iTo || aiSeamPrev[iFrom] == iTo)) {
+                            const uint32_t iFromSibling = aiNextWedge[iFrom], iToSibling = aiNextWedge[iTo];
+                            bAllowed = aiSeamNext[iFromSibling] == iToSibling || aiSeamPrev[iFromSibling] == iToSibling;
+                        }
+                        break;
+                    default:
+                        break;
+                    }
+                    if (bAllowed && iPositionFrom != iPositionTo) {
+                        const float fError = aqdrQuadrics[iPositionFrom].Evaluate(avecPositions[iPositionTo]);
+                        acolCandidates.push_back({ iFrom, iTo, fError });
+                    }
+                }
+            }
+        }
+        if (acolCandidates.empty()) {
+            break;
+        }
+
+        // try the cheapest collapses first
+        std::sort(acolCandidates.begin(), acolCandidates.end(), [](const Collapse &colFirst, const Collapse &colSecond) {
+            return colFirst.fError < colSecond.fError;
+        });
+
+        // each collapse removes about two triangles
+        const size_t ctTargetTriangles = ctTargetIndices / 3;
+        const size_t ctCollapseGoal = std::max<size_t>((ctTriangles - ctTargetTriangles) / 2, 1);
+        size_t ctCollapses = 0;
+        for (uint32_t iVertex = 0; iVertex < ctVertices; iVertex++) {
+            aiRemap[iVertex] = iVertex;
+        }
+        std::fill(abTouched.begin(), abTouched.end(), 0);
+
+        for (const Collapse &colCollapse : acolCandidates) {
+            if (ctCollapses >= ctCollapseGoal || colCollapse.fError > fMaxError) {
+                break;
+            }
+            const uint32_t iPositionFrom = aiPosition[colCollapse.iFrom];
+            const uint32_t iPositionTo = aiPosition[colCollapse.iTo];
+            // only one collapse per neighbourhood in each pass, so the flip checks see up to date geometry
+            if (abTouched[iPositionFrom] || abTouched[iPositionTo]) {
+                continue;
+            }
+
+            // reject collapses that would flip any of the triangles around the moving vertex
+            bool bFlips = false;
+            const glm::vec3 &vecTarget = avecPositions[iPositionTo];
+            for (uint32_t iAdjacent = aiTriangleOffsets[iPositionFrom]; iAdjacent < aiTriangleOffsets[iPositionFrom + 1] && !bFlips; iAdjacent++) {
+                const uint32_t iTriangle = aiTriangles[iAdjacent];
+                uint32_t aiCorners[3];
+                for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+                    aiCorners[iCorner] = aiPosition[aiResult[iTriangle * 3 + iCorner]];
+                }
+                // triangles containing both ends disappear, they can't flip
+                if (aiCorners[0] == iPositionTo || aiCorners[1] == iPositionTo || aiCorners[2] == iPositionTo) {
+                    continue;
+                }
+                glm::vec3 avecCorners[3];
+                glm::vec3 avecMoved[3];
+                for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+                    avecCorners[iCorner] = avecPositions[aiCorners[iCorner]];
+                    avecMoved[iCorner] = aiCorners[iCorner] == iPositionFrom ? vecTarget : avecCorners[iCorner];
+                }
+                const glm::vec3 vecBefore = glm::cross(avecCorners[1] - avecCorners[0], avecCorners[2] - avecCorners[0]);
+                const glm::vec3 vecAfter = glm::cross(avecMoved[1] - avecMoved[0], avecMoved[2] - avecMoved[0]);
+                bFlips = glm::dot(vecBefore, vecAfter) <= fMinNormalAgreement * glm::length(vecBefore) * glm::length(vecAfter);
+            }
+            if (bFlips) {
+                continue;
+            }
+
+            // collapse the vertex, and for seams its sibling on the other side of the seam
+            aiRemap[colCollapse.iFrom] = colCollapse.iTo;
+            if (aeKinds[colCollapse.iFrom] == VERTEX_KIND_SEAM) {
+                const uint32_t iFromSibling = aiNextWedge[colCollapse.iFrom];
+                const uint32_t iToSibling = aiNextWedge[colCollapse.iTo];
+                aiRemap[iFromSibling] = iToSibling;
+                // relink the seam on both sides around the removed vertices
+                const uint32_t aiPairs[2][2] = { { colCollapse.iFrom, colCollapse.iTo }, { iFromSibling, iToSibling } };
+                for (const auto &aiPair : aiPairs) {
+                    const uint32_t iFrom = aiPair[0], iTo = aiPair[1];
+                    if (aiSeamNext[iFrom] == iTo) {
+                        aiSeamPrev[iTo] = aiSeamPrev[iFrom];
+                        if (aiSeamPrev[iFrom] != iNoVertex) {
+                            aiSeamNext[aiSeamPrev[iFrom]] = iTo;
+                        }
+                    } else {
+                        aiSeamNext[iTo] = aiSeamNext[iFrom];
+                        if (aiSeamNext[iFrom] != iNoVertex) {
+                            aiSeamPrev[aiSeamNext[iFrom]] = iTo;
+                        }
+                    }
+                }
+            } else if (aeKinds[colCollapse.iFrom] == VERTEX_KIND_BORDER) {
+                // relink the border around the removed vertex
+                if (aiBorderNext[iPositionFrom] == iPositionTo) {
+                    aiBorderPrev[iPositionTo] = aiBorderPrev[iPositionFrom];
+                    aiBorderNext[aiBorderPrev[iPositionFrom]] = iPositionTo;
+                } else {
+                    aiBorderNext[iPositionTo] = aiBorderNext[iPositionFrom];
+                    aiBorderPrev[aiBorderNext[iPositionFrom]] = iPositionTo;
+                }
+            }
+            aqdrQuadrics[iPositionTo].Add(aqdrQuadrics[iPositionFrom]);
+            fWorstError = std::max(fWorstError, colCollapse.fError);
+            ctCollapses++;
+
+            // lock the neighbourhood of the moved vertex for the rest of the pass
+            for (uint32_t iAdjacent = aiTriangleOffsets[iPositionFrom]; iAdjacent < aiTriangleOffsets[iPositionFrom + 1]; iAdjacent++) {
+                const uint32_t iTriangle = aiTriangles[iAdjacent];
+                for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+                    abTouched[aiPosition[aiResult[iTriangle * 3 + iCorner]]] = 1;
+                }
+            }
+        }
+        if (ctCollapses == 0) {
+            break;
+        }
+
+        // apply the collapses and drop the triangles that became degenerate
+        size_t ctWritten = 0;
+        for (size_t iIndex = 0; iIndex < aiResult.size(); iIndex += 3) {
+            const uint32_t i0 = aiRemap[aiResult[iIndex + 0]], i1 = aiRemap[aiResult[iIndex + 1]], i2 = aiRemap[aiResult[iIndex + 2]];
+            const uint32_t iPosition0 = aiPosition[i0], iPosition1 = aiPosition[i1], iPosition2 = aiPosition[i2];
+            if (iPosition0 == iPosition1 || iPosition1 == iPosition2 || iPosition0 == iPosition2) {
+                continue;
+            }
+            aiResult[ctWritten++] = i0;
+            aiResult[ctWritten++] = i1;
+            aiResult[ctWritten++] = i2;
+        }
+        aiResult.resize(ctWritten);
+    }
+
+    // report the error in object space
+    fResultError = std::sqrt(fWorstError) * fExtent;
+    return aiResult;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "VertexFormats.h"
+
+// Mesh simplification using quadric error metrics (Garland, Heckbert 1997). Edges are collapsed onto one of their
+// endpoints, so the simplified index buffer references the original vertices and can share the vertex buffer with
+// the full detail mesh. Open borders and attribute seams are preserved - vertices on them only move along them.
+
+// Simplify an indexed triangle list until it has at most ctTargetIndices indices, or until the next collapse would
+// move the surface by more than fTargetError (relative to the mesh extent). Returns the simplified index buffer and
+// stores the largest error introduced, in object space units, in fResultError.
+std::vector<uint32_t> SimplifyMesh(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, size_t ctTargetIndices, float fTargetError, float &fResultError);
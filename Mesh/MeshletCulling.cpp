@@ -0,0 +1,145 @@
+#include "../PrecompiledHeader.h"
+#include "MeshletCulling.h"
+
+// use SSE for the plane tests on all targets that guarantee it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHLET_CULLING_SSE 1
+#include <xmmintrin.h>
+#else
+#define MESHLET_CULLING_SSE 0
+#endif
+
+
+// Store a plane into the frustum, normalized.
+static void SetFrustumPlane(CullingFrustum &cfFrustum, uint32_t iPlane, const glm::vec4 &vecPlane) {
+    const float fLength = glm::length(glm::vec3(vecPlane));
+    const float fScale = fLength > 0.0f ? 1.0f / fLength : 0.0f;
+    cfFrustum.afNormalX[iPlane] = vecPlane.x * fScale;
+    cfFrustum.afNormalY[iPlane] = vecPlane.y * fScale;
+    cfFrustum.afNormalZ[iPlane] = vecPlane.z * fScale;
+    cfFrustum.afDistance[iPlane] = vecPlane.w * fScale;
+}
+
+
+// Extract the frustum planes from a view-projection transform.
+void ExtractFrustumPlanes(const glm::mat4 &tViewProjection, CullingFrustum &cfFrustum) {
+    // rows of the transform (glm matrices are stored by columns)
+    glm::vec4 avecRows[4];
+    for (uint32_t iRow = 0; iRow < 4; iRow++) {
+        avecRows[iRow] = glm::vec4(tViewProjection[0][iRow], tViewProjection[1][iRow], tViewProjection[2][iRow], tViewProjection[3][iRow]);
+    }
+
+    // left, right, bottom, top
+    SetFrustumPlane(cfFrustum, 0, avecRows[3] + avecRows[0]);
+    SetFrustumPlane(cfFrustum, 1, avecRows[3] - avecRows[0]);
+    SetFrustumPlane(cfFrustum, 2, avecRows[3] + avecRows[1]);
+    SetFrustumPlane(cfFrustum, 3, avecRows[3] - avecRows[1]);
+    // near and far - Vulkan's depth range is 0 to 1, so the near plane is just the third row
+    SetFrustumPlane(cfFrustum, 4, avecRows[2]);
+    SetFrustumPlane(cfFrustum, 5, avecRows[3] - avecRows[2]);
+    // padding planes, every point is in front of them
+    for (uint32_t iPlane = 6; iPlane < 8; iPlane++) {
+        SetFrustumPlane(cfFrustum, iPlane, glm::vec4(0.0f, 0.0f, 1.0f, std::numeric_limits<float>::max()));
+    }
+}
+
+
+// Transform the frustum planes into the space of a rigid object.
+void TransformFrustumToObject(const CullingFrustum &cfWorld, const glm::mat4 &tObjectToWorld, CullingFrustum &cfObject) {
+    for (uint32_t iPlane = 0; iPlane < 8; iPlane++) {
+        const glm::vec4 vecWorld(cfWorld.afNormalX[iPlane], cfWorld.afNormalY[iPlane], cfWorld.afNormalZ[iPlane], cfWorld.afDistance[iPlane]);
+        // planes transform by the inverse transpose, so the inverse of the inverse transpose is just the transpose
+        glm::vec4 vecObject;
+        for (uint32_t iComponent = 0; iComponent < 4; iComponent++) {
+            vecObject[iComponent] = glm::dot(tObjectToWorld[iComponent], vecWorld);
+        }
+        // keep the padding planes as they are, they would overflow
+        if (iPlane >= 6) {
+            vecObject = vecWorld;
+        }
+        SetFrustumPlane(cfObject, iPlane, vecObject);
+    }
+}
+
+
+// Is any part of the sphere inside the frustum?
+bool IsSphereInFrustum(const CullingFrustum &cfFrustum, const glm::vec3 &vecCenter, float fRadius) {
+#if MESHLET_CULLING_SSE
+    const __m128 vX = _mm_set1_ps(vecCenter.x);
+    const __m128 vY = _mm_set1_ps(vecCenter.y);
+    const __m128 vZ = _mm_set1_ps(vecCenter.z);
+    const __m128 vNegativeRadius = _mm_set1_ps(-fRadius);
+    int iOutside = 0;
+    // test four planes at a time - the sphere is outside if it's fully behind any of them
+    for (uint32_t iPlane = 0; iPlane < 8; iPlane += 4) {
+        __m128 vDistance = _mm_loadu_ps(&cfFrustum.afDistance[iPlane]);
+        vDistance = _mm_add_ps(vDistance, _mm_mul_ps(_mm_loadu_ps(&cfFrustum.afNormalX[iPlane]), vX));
+        vDistance = _mm_add_ps(vDistance, _mm_mul_ps(_mm_loadu_ps(&cfFrustum.afNormalY[iPlane]), vY));
+        vDistance = _mm_add_ps(vDistance, _mm_mul_ps(_mm_loadu_ps(&cfFrustum.afNormalZ[iPlane]), vZ));
+        iOutside |= _mm_movemask_ps(_mm_cmplt_ps(vDistance, vNegativeRadius));
+    }
+    return iOutside == 0;
+#else
+    // the sphere is outside if it's fully behind any of the planes
+    for (uint32_t iPlane = 0; iPlane < 6; iPlane++) {
+        const float fDistance = cfFrustum.afNormalX[iPlane] * vecCenter.x + cfFrustum.afNormalY[iPlane] * vecCenter.y
+            + cfFrustum.afNormalZ[iPlane] * vecCenter.z + cfFrustum.afDistance[iPlane];
+        if (fDistance < -fRadius) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+
+// Are all the meshlet's triangles facing away from the camera?
+bool IsMeshletBackfacing(const Meshlet &msMeshlet, const glm::vec3 &vecCameraPosition) {
+    // every point of the bounding sphere must see the back side of every normal in the cone
+    const glm::vec3 vecToMeshlet = msMeshlet.vecCenter - vecCameraPosition;
+    return glm::dot(vecToMeshlet, msMeshlet.vecConeAxis) >= msMeshlet.fConeCutoff * glm::length(vecToMeshlet) + msMeshlet.fRadius;
+}
+
+
+// Cull a range of meshlets of one object and write indirect draw commands for the visible ones.
+uint32_t CullMeshlets(const Meshlet *amsMeshlets, uint32_t ctMeshlets, const CullingFrustum &cfObjectFrustum, const glm::vec3 &vecObjectCamera, VkDrawIndexedIndirectCommand *adicCommands, MeshletCullingStatistics &mcsStatistics) {
+    uint32_t ctCommands = 0;
+    mcsStatistics.ctTested += ctMeshlets;
+    // the command being built is kept locally - the output is usually mapped GPU memory, which is slow to read back
+    VkDrawIndexedIndirectCommand dicPending = {};
+
+    for (uint32_t iMeshlet = 0; iMeshlet < ctMeshlets; iMeshlet++) {
+        const Meshlet &msMeshlet = amsMeshlets[iMeshlet];
+        // cheapest test first
+        if (IsMeshletBackfacing(msMeshlet, vecObjectCamera)) {
+            mcsStatistics.ctBackfaceCulled++;
+            continue;
+        }
+        if (!IsSphereInFrustum(cfObjectFrustum, msMeshlet.vecCenter, msMeshlet.fRadius)) {
+            mcsStatistics.ctFrustumCulled++;
+            continue;
+        }
+
+        // extend the pending command if this meshlet directly follows it in the index buffer
+        if (dicPending.indexCount > 0 && dicPending.firstIndex + dicPending.indexCount == msMeshlet.iFirstIndex) {
+            dicPending.indexCount += msMeshlet.ctIndices;
+            continue;
+        }
+
+        // otherwise write out the pending command and start a new one
+        if (dicPending.indexCount > 0) {
+            adicCommands[ctCommands++] = dicPending;
+        }
+        dicPending.indexCount = msMeshlet.ctIndices;
+        dicPending.instanceCount = 1;
+        dicPending.firstIndex = msMeshlet.iFirstIndex;
+        dicPending.vertexOffset = 0;
+        dicPending.firstInstance = 0;
+    }
+
+    // write out the last command
+    if (dicPending.indexCount > 0) {
+        adicCommands[ctCommands++] = dicPending;
+    }
+    return ctCommands;
+}
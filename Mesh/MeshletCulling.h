@@ -0,0 +1,37 @@
+#pragma once
+#include "Meshlets.h"
+
+// Per-meshlet frustum and backface cone culling on the CPU. Visible meshlets are written out directly as indirect
+// draw commands. Plane tests use SSE when the target supports it, with a scalar fallback otherwise.
+
+// Frustum planes, stored as a structure of arrays so that four planes are tested at once.
+// Padded to eight planes with planes that never cull anything.
+struct CullingFrustum {
+    float afNormalX[8];
+    float afNormalY[8];
+    float afNormalZ[8];
+    float afDistance[8];
+};
+
+// Extract the frustum planes from a view-projection transform. Planes face inwards and are normalized.
+void ExtractFrustumPlanes(const glm::mat4 &tViewProjection, CullingFrustum &cfFrustum);
+// Transform the frustum planes by the inverse of a rigid (rotation, translation, uniform scale) object transform,
+// so that object space bounds can be tested against them directly.
+void TransformFrustumToObject(const CullingFrustum &cfWorld, const glm::mat4 &tObjectToWorld, CullingFrustum &cfObject);
+
+// Is any part of the sphere inside the frustum?
+bool IsSphereInFrustum(const CullingFrustum &cfFrustum, const glm::vec3 &vecCenter, float fRadius);
+// Are all the meshlet's triangles facing away from the camera? The camera position is in object space.
+bool IsMeshletBackfacing(const Meshlet &msMeshlet, const glm::vec3 &vecCameraPosition);
+
+// Number of meshlets tested and rejected by culling.
+struct MeshletCullingStatistics {
+    uint32_t ctTested;
+    uint32_t ctFrustumCulled;
+    uint32_t ctBackfaceCulled;
+};
+
+// Cull a range of meshlets of one object and write indirect draw commands for the visible ones. Visible meshlets that
+// are adjacent in the index buffer are merged into a single command. Returns the number of commands written,
+// which is at most ctMeshlets.
+uint32_t CullMeshlets(const Meshlet *amsMeshlets, uint32_t ctMeshlets, const CullingFrustum &cfObjectFrustum, const glm::vec3 &vecObjectCamera, VkDrawIndexedIndirectCommand *adicCommands, MeshletCullingStatistics &mcsStatistics);
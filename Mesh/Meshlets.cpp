@@ -0,0 +1,105 @@
+#include "../PrecompiledHeader.h"
+#include "Meshlets.h"
+
+
+// Calculate the bounding sphere and normal cone of a meshlet.
+static void ComputeMeshletBounds(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, Meshlet &msMeshlet) {
+    // bounding box of the meshlet's triangles, its center is the center of the sphere
+    glm::vec3 vecMin = avVertices[aiIndices[msMeshlet.iFirstIndex]].vecPosition;
+    glm::vec3 vecMax = vecMin;
+    for (uint32_t iIndex = msMeshlet.iFirstIndex; iIndex < msMeshlet.iFirstIndex + msMeshlet.ctIndices; iIndex++) {
+        vecMin = glm::min(vecMin, avVertices[aiIndices[iIndex]].vecPosition);
+        vecMax = glm::max(vecMax, avVertices[aiIndices[iIndex]].vecPosition);
+    }
+    msMeshlet.vecCenter = (vecMin + vecMax) * 0.5f;
+    msMeshlet.fRadius = 0.0f;
+    for (uint32_t iIndex = msMeshlet.iFirstIndex; iIndex < msMeshlet.iFirstIndex + msMeshlet.ctIndices; iIndex++) {
+        msMeshlet.fRadius = std::max(msMeshlet.fRadius, glm::length(avVertices[aiIndices[iIndex]].vecPosition - msMeshlet.vecCenter));
+    }
+
+    // the cone axis is the average of the triangle normals
+    std::vector<glm::vec3> avecNormals;
+    avecNormals.reserve(msMeshlet.ctIndices / 3);
+    glm::vec3 vecAxis(0.0f);
+    for (uint32_t iIndex = msMeshlet.iFirstIndex; iIndex < msMeshlet.iFirstIndex + msMeshlet.ctIndices; iIndex += 3) {
+        const glm::vec3 &vecA = avVertices[aiIndices[iIndex + 0]].vecPosition;
+        const glm::vec3 &vecB = avVertices[aiIndices[iIndex + 1]].vecPosition;
+        const glm::vec3 &vecC = avVertices[aiIndices[iIndex + 2]].vecPosition;
+        const glm::vec3 vecCross = glm::cross(vecB - vecA, vecC - vecA);
+        const float fLength = glm::length(vecCross);
+        // degenerate triangles are never visible, they don't limit the cone
+        if (fLength <= 0.0f) {
+            continue;
+        }
+        avecNormals.push_back(vecCross / fLength);
+        vecAxis += avecNormals.back();
+    }
+
+    // by default, the meshlet can't be backface culled
+    msMeshlet.vecConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    msMeshlet.fConeCutoff = 1.0f;
+    const float fAxisLength = glm::length(vecAxis);
+    if (fAxisLength <= 0.0f) {
+        return;
+    }
+    msMeshlet.vecConeAxis = vecAxis / fAxisLength;
+
+    // the cone spread is given by the normal furthest from the axis
+    float fMinDot = 1.0f;
+    for (const glm::vec3 &vecNormal : avecNormals) {
+        fMinDot = std::min(fMinDot, glm::dot(vecNormal, msMeshlet.vecConeAxis));
+    }
+    // if the normals span a hemisphere or more, some triangle always faces the camera
+    if (fMinDot <= 0.0f) {
+        return;
+    }
+    msMeshlet.fConeCutoff = std::sqrt(1.0f - fMinDot * fMinDot);
+}
+
+
+// Split a range of the index buffer into meshlets, in the order of its triangles.
+void BuildMeshlets(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, uint32_t iFirstIndex, uint32_t ctIndices, std::vector<Meshlet> &amsMeshlets) {
+    // meshlet each vertex was last added to, to count unique vertices without clearing anything between meshlets
+    std::vector<uint32_t> aiVertexMeshlet(avVertices.size(), ~0u);
+
+    Meshlet msCurrent = {};
+    msCurrent.iFirstIndex = iFirstIndex;
+    uint32_t ctCurrentVertices = 0;
+    uint32_t iCurrentMeshlet = static_cast<uint32_t>(amsMeshlets.size());
+
+    for (uint32_t iIndex = iFirstIndex; iIndex < iFirstIndex + ctIndices; iIndex += 3) {
+        // count the vertices of the triangle that the meshlet doesn't have yet
+        uint32_t ctNewVertices = 0;
+        for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+            if (aiVertexMeshlet[aiIndices[iIndex + iCorner]] != iCurrentMeshlet) {
+                ctNewVertices++;
+            }
+        }
+
+        // if the triangle doesn't fit, close the meshlet and start a new one
+        if (ctCurrentVertices + ctNewVertices > ctMaxMeshletVertices || msCurrent.ctIndices / 3 + 1 > ctMaxMeshletTriangles) {
+            ComputeMeshletBounds(avVertices, aiIndices, msCurrent);
+            amsMeshlets.push_back(msCurrent);
+            msCurrent = {};
+            msCurrent.iFirstIndex = iIndex;
+            ctCurrentVertices = 0;
+            iCurrentMeshlet++;
+        }
+
+        // add the triangle
+        for (uint32_t iCorner = 0; iCorner < 3; iCorner++) {
+            uint32_t &iVertexMeshlet = aiVertexMeshlet[aiIndices[iIndex + iCorner]];
+            if (iVertexMeshlet != iCurrentMeshlet) {
+                iVertexMeshlet = iCurrentMeshlet;
+                ctCurrentVertices++;
+            }
+        }
+        msCurrent.ctIndices += 3;
+    }
+
+    // close the last meshlet
+    if (msCurrent.ctIndices > 0) {
+        ComputeMeshletBounds(avVertices, aiIndices, msCurrent);
+        amsMeshlets.push_back(msCurrent);
+    }
+}
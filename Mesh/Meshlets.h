@@ -0,0 +1,30 @@
+#pragma once
+#include "VertexFormats.h"
+
+// Meshlets (clusters) - small pieces of a mesh that are culled individually. Each meshlet is a contiguous range of
+// the mesh's index buffer, with bounds for frustum culling and a cone of its triangle normals for backface culling.
+
+// Largest number of unique vertices referenced by one meshlet.
+const uint32_t ctMaxMeshletVertices = 64;
+// Largest number of triangles in one meshlet.
+const uint32_t ctMaxMeshletTriangles = 124;
+
+// One meshlet of a mesh. Bounds are in object space.
+struct Meshlet {
+    // Center of the bounding sphere.
+    glm::vec3 vecCenter;
+    // Radius of the bounding sphere.
+    float fRadius;
+    // Average direction of the triangle normals.
+    glm::vec3 vecConeAxis;
+    // Sine of the angle between the cone axis and the furthest normal; 1 if the meshlet can never be backface culled.
+    float fConeCutoff;
+    // First index of the meshlet in the index buffer.
+    uint32_t iFirstIndex;
+    // Number of indices in the meshlet.
+    uint32_t ctIndices;
+};
+
+// Split a range of the index buffer into meshlets, in the order of its triangles, and append them to amsMeshlets.
+// The triangles are expected to already be ordered for locality, so consecutive ones form compact meshlets.
+void BuildMeshlets(const std::vector<VertexSource> &avVertices, const std::vector<uint32_t> &aiIndices, uint32_t iFirstIndex, uint32_t ctIndices, std::vector<Meshlet> &amsMeshlets);
@@ -0,0 +1,164 @@
+#include "../PrecompiledHeader.h"
+#include "VertexFormats.h"
+
+#include <glm/gtc/packing.hpp>
+
+
+// Get the transform from quantized to object space.
+glm::mat4 VertexQuantization::GetPositionTransform() const {
+    // scale from [-1, 1] to the bounds size, then move to the bounds center
+    glm::mat4 tTransform = glm::translate(glm::mat4(1.0f), vecPositionOffset);
+    return glm::scale(tTransform, glm::vec3(fPositionScale));
+}
+
+
+// Get the texture coordinate scale (xy) and offset (zw), in the form the vertex shader expects.
+glm::vec4 VertexQuantization::GetTexCoordTransform() const {
+    return glm::vec4(vecTexCoordScale.x, vecTexCoordScale.y, vecTexCoordOffset.x, vecTexCoordOffset.y);
+}
+
+
+// Compute quantization parameters that cover all the given vertices.
+VertexQuantization ComputeVertexQuantization(const std::vector<VertexSource> &avVertices) {
+    VertexQuantization vqQuantization = {};
+    // an empty mesh gets the identity mapping
+    if (avVertices.empty()) {
+        vqQuantization.fPositionScale = 1.0f;
+        vqQuantization.vecTexCoordScale = glm::vec2(1.0f, 1.0f);
+        return vqQuantization;
+    }
+
+    // find the bounds of positions and texture coordinates
+    glm::vec3 vecPositionMin = avVertices[0].vecPosition;
+    glm::vec3 vecPositionMax = avVertices[0].vecPosition;
+    glm::vec2 vecTexCoordMin = avVertices[0].vecTexCoords;
+    glm::vec2 vecTexCoordMax = avVertices[0].vecTexCoords;
+    for (const VertexSource &vVertex : avVertices) {
+        vecPositionMin = glm::min(vecPositionMin, vVertex.vecPosition);
+        vecPositionMax = glm::max(vecPositionMax, vVertex.vecPosition);
+        vecTexCoordMin = glm::min(vecTexCoordMin, vVertex.vecTexCoords);
+        vecTexCoordMax = glm::max(vecTexCoordMax, vVertex.vecTexCoords);
+    }
+
+    // positions are centered and scaled uniformly by the largest half extent
+    vqQuantization.vecPositionOffset = (vecPositionMin + vecPositionMax) * 0.5f;
+    glm::vec3 vecHalfExtent = (vecPositionMax - vecPositionMin) * 0.5f;
+    vqQuantization.fPositionScale = std::max(vecHalfExtent.x, std::max(vecHalfExtent.y, vecHalfExtent.z));
+    // guard against degenerate meshes (a single point)
+    if (vqQuantization.fPositionScale <= 0.0f) {
+        vqQuantization.fPositionScale = 1.0f;
+    }
+
+    // texture coordinates are mapped to [0, 1] per axis
+    vqQuantization.vecTexCoordOffset = vecTexCoordMin;
+    vqQuantization.vecTexCoordScale = vecTexCoordMax - vecTexCoordMin;
+    if (vqQuantization.vecTexCoordScale.x <= 0.0f) {
+        vqQuantization.vecTexCoordScale.x = 1.0f;
+    }
+    if (vqQuantization.vecTexCoordScale.y <= 0.0f) {
+        vqQuantization.vecTexCoordScale.y = 1.0f;
+    }
+
+    return vqQuantization;
+}
+
+
+// Map a position to [-1, 1] relative to the mesh bounds.
+static glm::vec3 NormalizePosition(const glm::vec3 &vecPosition, const VertexQuantization &vqQuantization) {
+    return glm::clamp((vecPosition - vqQuantization.vecPositionOffset) / vqQuantization.fPositionScale, -1.0f, 1.0f);
+}
+
+
+// Quantize texture coordinates to [0, 1] relative to the mesh UV bounds.
+static UNorm16x2 QuantizeTexCoords(const glm::vec2 &vecTexCoords, const VertexQuantization &vqQuantization) {
+    glm::vec2 vecNormalized = glm::clamp((vecTexCoords - vqQuantization.vecTexCoordOffset) / vqQuantization.vecTexCoordScale, 0.0f, 1.0f);
+    return { glm::packUnorm1x16(vecNormalized.x), glm::packUnorm1x16(vecNormalized.y) };
+}
+
+
+// Convert a full precision vertex to the float layout.
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &, VertexFloat &vVertex) {
+    vVertex.vecPosition = vSource.vecPosition;
+    vVertex.vecTexCoords = vSource.vecTexCoords;
+    vVertex.vecNormal = vSource.vecNormal;
+}
+
+
+// Convert a full precision vertex to the 16 bit normalized layout.
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexQuantized &vVertex) {
+    glm::vec3 vecPosition = NormalizePosition(vSource.vecPosition, vqQuantization);
+    vVertex.vecPosition = {
+        static_cast<int16_t>(glm::packSnorm1x16(vecPosition.x)),
+        static_cast<int16_t>(glm::packSnorm1x16(vecPosition.y)),
+        static_cast<int16_t>(glm::packSnorm1x16(vecPosition.z)),
+        0,
+    };
+    vVertex.vecTexCoords = QuantizeTexCoords(vSource.vecTexCoords, vqQuantization);
+    vVertex.vecNormal = EncodeOctahedralNormal(vSource.vecNormal);
+}
+
+
+// Convert a full precision vertex to the 16 bit normalized layout with color.
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexQuantizedColor &vVertex) {
+    VertexQuantized vQuantized;
+    QuantizeVertex(vSource, vqQuantization, vQuantized);
+    vVertex.vecPosition = vQuantized.vecPosition;
+    vVertex.vecTexCoords = vQuantized.vecTexCoords;
+    vVertex.vecNormal = vQuantized.vecNormal;
+
+    glm::vec4 colColor = glm::clamp(vSource.colColor, 0.0f, 1.0f);
+    vVertex.colColor = {
+        glm::packUnorm1x8(colColor.x),
+        glm::packUnorm1x8(colColor.y),
+        glm::packUnorm1x8(colColor.z),
+        glm::packUnorm1x8(colColor.w),
+    };
+}
+
+
+// Convert a full precision vertex to the half float layout.
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexHalf &vVertex) {
+    glm::vec3 vecPosition = NormalizePosition(vSource.vecPosition, vqQuantization);
+    vVertex.vecPosition = {
+        glm::packHalf1x16(vecPosition.x),
+        glm::packHalf1x16(vecPosition.y),
+        glm::packHalf1x16(vecPosition.z),
+        0,
+    };
+    vVertex.vecTexCoords = QuantizeTexCoords(vSource.vecTexCoords, vqQuantization);
+    vVertex.vecNormal = EncodeOctahedralNormal(vSource.vecNormal);
+}
+
+
+// Encode a unit normal using the octahedral mapping.
+OctNormal16 EncodeOctahedralNormal(const glm::vec3 &vecNormal) {
+    // project the normal onto the octahedron |x| + |y| + |z| = 1
+    float fL1Norm = std::abs(vecNormal.x) + std::abs(vecNormal.y) + std::abs(vecNormal.z);
+    // missing normals (all zeros) encode as +Z
+    if (fL1Norm <= 0.0f) {
+        return { 0, 0 };
+    }
+    glm::vec2 vecEncoded(vecNormal.x / fL1Norm, vecNormal.y / fL1Norm);
+
+    // fold the lower hemisphere over the diagonals
+    if (vecNormal.z < 0.0f) {
+        glm::vec2 vecFolded(
+            (1.0f - std::abs(vecEncoded.y)) * (vecEncoded.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(vecEncoded.x)) * (vecEncoded.y >= 0.0f ? 1.0f : -1.0f));
+        vecEncoded = vecFolded;
+    }
+
+    return { static_cast<int16_t>(glm::packSnorm1x16(vecEncoded.x)), static_cast<int16_t>(glm::packSnorm1x16(vecEncoded.y)) };
+}
+
+
+// Decode an octahedral normal back to a unit vector.
+glm::vec3 DecodeOctahedralNormal(const OctNormal16 &nrmNormal) {
+    glm::vec2 vecEncoded(std::max(nrmNormal.x / 32767.0f, -1.0f), std::max(nrmNormal.y / 32767.0f, -1.0f));
+    glm::vec3 vecNormal(vecEncoded.x, vecEncoded.y, 1.0f - std::abs(vecEncoded.x) - std::abs(vecEncoded.y));
+    // unfold the lower hemisphere
+    float fFold = std::max(-vecNormal.z, 0.0f);
+    vecNormal.x += vecNormal.x >= 0.0f ? -fFold : fFold;
+    vecNormal.y += vecNormal.y >= 0.0f ? -fFold : fFold;
+    return glm::normalize(vecNormal);
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+// Vertex layouts used for meshes. Attributes are stored in compact quantized formats and restored to their
+// original range in the vertex shader (or by the fixed function vertex fetch, for normalized formats).
+// Binding and attribute descriptions for each layout are generated at compile time from the list of its members,
+// so adding a layout only requires declaring the struct and specializing VertexLayout for it.
+
+// Position as four half floats. The fourth component is padding, it keeps the attribute 8-byte aligned.
+struct Half4 {
+    uint16_t x, y, z, w;
+};
+
+// Position as four signed 16 bit normalized integers, in [-1, 1] relative to the mesh bounds.
+struct SNorm16x4 {
+    int16_t x, y, z, w;
+};
+
+// Texture coordinates as two unsigned 16 bit normalized integers, in [0, 1] relative to the mesh UV bounds.
+struct UNorm16x2 {
+    uint16_t u, v;
+};
+
+// Normal encoded with the octahedral mapping, as two signed 16 bit normalized integers.
+struct OctNormal16 {
+    int16_t x, y;
+};
+
+// Color as four unsigned 8 bit normalized integers.
+struct UNorm8x4 {
+    uint8_t r, g, b, a;
+};
+
+
+// Maps the C++ type of a vertex attribute to the Vulkan format the vertex fetch should read it as.
+template<typename TAttribute> struct VertexAttributeFormat;
+template<> struct VertexAttributeFormat<glm::vec2> { static constexpr VkFormat Get() { return VK_FORMAT_R32G32_SFLOAT; } };
+template<> struct VertexAttributeFormat<glm::vec3> { static constexpr VkFormat Get() { return VK_FORMAT_R32G32B32_SFLOAT; } };
+template<> struct VertexAttributeFormat<glm::vec4> { static constexpr VkFormat Get() { return VK_FORMAT_R32G32B32A32_SFLOAT; } };
+template<> struct VertexAttributeFormat<Half4> { static constexpr VkFormat Get() { return VK_FORMAT_R16G16B16A16_SFLOAT; } };
+template<> struct VertexAttributeFormat<SNorm16x4> { static constexpr VkFormat Get() { return VK_FORMAT_R16G16B16A16_SNORM; } };
+template<> struct VertexAttributeFormat<UNorm16x2> { static constexpr VkFormat Get() { return VK_FORMAT_R16G16_UNORM; } };
+template<> struct VertexAttributeFormat<OctNormal16> { static constexpr VkFormat Get() { return VK_FORMAT_R16G16_SNORM; } };
+template<> struct VertexAttributeFormat<UNorm8x4> { static constexpr VkFormat Get() { return VK_FORMAT_R8G8B8A8_UNORM; } };
+
+// One attribute of a vertex layout - shader location, C++ type and offset from the start of the vertex.
+template<uint32_t iLocation, typename TAttribute, size_t slOffset>
+struct VertexAttribute {
+    // Describe the attribute to the Vulkan API. All attributes come from binding 0.
+    static constexpr VkVertexInputAttributeDescription GetDescription() {
+        return { iLocation, 0, VertexAttributeFormat<TAttribute>::Get(), static_cast<uint32_t>(slOffset) };
+    }
+};
+
+// Generates the descriptions of a vertex layout from the list of its attributes.
+template<typename TVertex, typename... TAttributes>
+struct VertexLayoutDescription {
+    // Number of attributes in the layout.
+    static constexpr size_t ctAttributes = sizeof...(TAttributes);
+
+    // Describe to the Vulkan API how to handle vertex data.
+    static constexpr VkVertexInputBindingDescription GetBindingDescription() {
+        // binding 0, stride is the size of the vertex, move to next data entry after each vertex
+        return { 0, static_cast<uint32_t>(sizeof(TVertex)), VK_VERTEX_INPUT_RATE_VERTEX };
+    }
+
+    // Describe each individual vertex attribute.
+    static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(TAttributes)> GetAttributeDescriptions() {
+        return { { TAttributes::GetDescription()... } };
+    }
+};
+
+// Layout description of a vertex type. Specialized for each vertex type below.
+template<typename TVertex> struct VertexLayout;
+
+
+// Full precision vertex. Used as the source when loading and processing meshes, never uploaded to the GPU.
+struct VertexSource {
+    glm::vec3 vecPosition;
+    glm::vec2 vecTexCoords;
+    glm::vec3 vecNormal;
+    glm::vec4 colColor;
+};
+
+// Uncompressed GPU vertex, 32 bytes. Kept as a reference for comparing quantization errors.
+struct VertexFloat {
+    glm::vec3 vecPosition;
+    glm::vec2 vecTexCoords;
+    glm::vec3 vecNormal;
+};
+template<> struct VertexLayout<VertexFloat> : VertexLayoutDescription<VertexFloat,
+    VertexAttribute<0, decltype(VertexFloat::vecPosition), offsetof(VertexFloat, vecPosition)>,
+    VertexAttribute<1, decltype(VertexFloat::vecTexCoords), offsetof(VertexFloat, vecTexCoords)>,
+    VertexAttribute<2, decltype(VertexFloat::vecNormal), offsetof(VertexFloat, vecNormal)>> {};
+
+// Quantized vertex with 16 bit normalized positions, 16 bytes.
+struct VertexQuantized {
+    SNorm16x4 vecPosition;
+    UNorm16x2 vecTexCoords;
+    OctNormal16 vecNormal;
+};
+template<> struct VertexLayout<VertexQuantized> : VertexLayoutDescription<VertexQuantized,
+    VertexAttribute<0, decltype(VertexQuantized::vecPosition), offsetof(VertexQuantized, vecPosition)>,
+    VertexAttribute<1, decltype(VertexQuantized::vecTexCoords), offsetof(VertexQuantized, vecTexCoords)>,
+    VertexAttribute<2, decltype(VertexQuantized::vecNormal), offsetof(VertexQuantized, vecNormal)>> {};
+
+// Position of a quantized vertex, 8 bytes. A separate stream for passes that only need positions, like the depth
+// pre-pass, so that they don't fetch the other attributes.
+struct VertexPosition {
+    SNorm16x4 vecPosition;
+};
+template<> struct VertexLayout<VertexPosition> : VertexLayoutDescription<VertexPosition,
+    VertexAttribute<0, decltype(VertexPosition::vecPosition), offsetof(VertexPosition, vecPosition)>> {};
+
+// Quantized vertex with 16 bit normalized positions and a per-vertex color, 20 bytes.
+struct VertexQuantizedColor {
+    SNorm16x4 vecPosition;
+    UNorm16x2 vecTexCoords;
+    OctNormal16 vecNormal;
+    UNorm8x4 colColor;
+};
+template<> struct VertexLayout<VertexQuantizedColor> : VertexLayoutDescription<VertexQuantizedColor,
+    VertexAttribute<0, decltype(VertexQuantizedColor::vecPosition), offsetof(VertexQuantizedColor, vecPosition)>,
+    VertexAttribute<1, decltype(VertexQuantizedColor::vecTexCoords), offsetof(VertexQuantizedColor, vecTexCoords)>,
+    VertexAttribute<2, decltype(VertexQuantizedColor::vecNormal), offsetof(VertexQuantizedColor, vecNormal)>,
+    VertexAttribute<3, decltype(VertexQuantizedColor::colColor), offsetof(VertexQuantizedColor, colColor)>> {};
+
+// Quantized vertex with half float positions, 16 bytes. Better precision near the mesh center than VertexQuantized.
+struct VertexHalf {
+    Half4 vecPosition;
+    UNorm16x2 vecTexCoords;
+    OctNormal16 vecNormal;
+};
+template<> struct VertexLayout<VertexHalf> : VertexLayoutDescription<VertexHalf,
+    VertexAttribute<0, decltype(VertexHalf::vecPosition), offsetof(VertexHalf, vecPosition)>,
+    VertexAttribute<1, decltype(VertexHalf::vecTexCoords), offsetof(VertexHalf, vecTexCoords)>,
+    VertexAttribute<2, decltype(VertexHalf::vecNormal), offsetof(VertexHalf, vecNormal)>> {};
+
+// make sure the compiler didn't pad the layouts
+static_assert(sizeof(VertexFloat) == 32, "VertexFloat must be tightly packed");
+static_assert(sizeof(VertexQuantized) == 16, "VertexQuantized must be tightly packed");
+static_assert(sizeof(VertexPosition) == 8, "VertexPosition must be tightly packed");
+static_assert(sizeof(VertexQuantizedColor) == 20, "VertexQuantizedColor must be tightly packed");
+static_assert(sizeof(VertexHalf) == 16, "VertexHalf must be tightly packed");
+
+
+// Per-mesh parameters needed to restore quantized attributes to their original range.
+struct VertexQuantization {
+    // Center of the position bounds.
+    glm::vec3 vecPositionOffset;
+    // Scale that maps [-1, 1] to the position bounds. Uniform, so that normals don't need a separate transform.
+    float fPositionScale;
+    // Minimum of the texture coordinate bounds.
+    glm::vec2 vecTexCoordOffset;
+    // Size of the texture coordinate bounds.
+    glm::vec2 vecTexCoordScale;
+
+    // Get the transform from quantized to object space. Folded into the model transform, so it costs nothing per vertex.
+    glm::mat4 GetPositionTransform() const;
+    // Get the texture coordinate scale (xy) and offset (zw), in the form the vertex shader expects.
+    glm::vec4 GetTexCoordTransform() const;
+};
+
+// Compute quantization parameters that cover all the given vertices.
+VertexQuantization ComputeVertexQuantization(const std::vector<VertexSource> &avVertices);
+
+// Convert a full precision vertex to each of the GPU layouts.
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexFloat &vVertex);
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexQuantized &vVertex);
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexQuantizedColor &vVertex);
+void QuantizeVertex(const VertexSource &vSource, const VertexQuantization &vqQuantization, VertexHalf &vVertex);
+
+// Convert an array of full precision vertices to a GPU layout.
+template<typename TVertex>
+void QuantizeVertices(const std::vector<VertexSource> &avSource, const VertexQuantization &vqQuantization, std::vector<TVertex> &avVertices) {
+    avVertices.resize(avSource.size());
+    for (size_t iVertex = 0; iVertex < avSource.size(); iVertex++) {
+        QuantizeVertex(avSource[iVertex], vqQuantization, avVertices[iVertex]);
+    }
+}
+
+// Encode a unit normal using the octahedral mapping.
+OctNormal16 EncodeOctahedralNormal(const glm::vec3 &vecNormal);
+// Decode an octahedral normal back to a unit vector.
+glm::vec3 DecodeOctahedralNormal(const OctNormal16 &nrmNormal);
@@ -1,6 +1,24 @@
 #include "PrecompiledHeader.h"
 #include "Options.h"
 
+#include <sys/stat.h>
+
+// Config file read when none is given on the command line.
+static const char *strDefaultConfigPath = "options.cfg";
+// How often the config file is checked for modifications.
+static const std::chrono::milliseconds tmConfigCheckInterval(250);
+
+
+// Strip whitespace from both ends of a string.
+static std::string Trim(const std::string &strText) {
+    const size_t iFirst = strText.find_first_not_of(" \t\r\n");
+    if (iFirst == std::string::npos) {
+        return "";
+    }
+    const size_t iLast = strText.find_last_not_of(" \t\r\n");
+    return strText.substr(iFirst, iLast - iFirst + 1);
+}
+
 
 // Default constructor initializes the options to hardcoded values (i.e. defaults).
 Options::Options()
@@ -12,6 +30,42 @@ Options::Options()
     // use the Vulkan APi by default
     _optGfxAPIType = GfxAPIType::GFX_API_TYPE_VULKAN;
 
+    // draw the sphere, it cooks quickly
+    _strModelPath = "d:/Work/VulcanTutorial/Shaders/sphere.obj";
+    // switch to a coarser level of detail when the difference is at most one pixel
+    _fLodPixelError = 1.0f;
+
+    // render continuously, with the scene animated
+    _bRenderOnDemand = false;
+    _bAnimateScene = true;
+    // simulate at 60 Hz
+    _fSimulationRate = 60.0f;
+
+    // render as fast as presentation allows, with the present mode and image count picked for the surface
+    _fTargetFrameRate = 0.0f;
+    _optPresentMode = PresentMode::PRESENT_MODE_AUTO;
+    _ctSwapChainImages = 0;
+    // filter textures with 16x anisotropy
+    _fMaxAnisotropy = 16.0f;
+    // no multisampling
+    _ctMsaaSamples = 1;
+    // render at the window's resolution
+    _fResolutionScale = 1.0f;
+    // use the depth pre-pass when fragments are shaded 1.3 times per visible pixel or more
+    _optDepthPrepassMode = DepthPrepassMode::DEPTH_PREPASS_AUTO;
+    _fDepthPrepassOverdraw = 1.3f;
+    // cull occluded objects
+    _bOcclusionCulling = true;
+    // run jobs on all hardware threads
+    _ctJobThreads = 0;
+    _bJobBenchmark = false;
+    _bBvhBenchmark = false;
+
+    // Null specific
+
+    // enough frames for stable timings
+    _ctNullFrames = 1000;
+
     // Vulkan specific
 
     // enable validation layers only in debug builds
@@ -20,6 +74,332 @@ Options::Options()
     #else
         _optShouldUseValiationLayers = true;
     #endif
+
+    // pick the physical device by its capabilities
+    _iPhysicalDevice = -1;
+    _strPhysicalDeviceName = "";
+
+    // nothing loaded and nobody listening yet
+    _tmConfigModified = 0;
+    _iNextListener = 0;
+}
+
+
+// Describe the options stored in this object.
+std::vector<Options::OptionEntry> Options::DescribeOptions() {
+    return {
+        { "WindowWidth",          OPTION_TYPE_UINT,               &_dimWindowWidth,              OPTION_CHANGE_RESTART },
+        { "WindowHeight",         OPTION_TYPE_UINT,               &_dimWindowHeight,             OPTION_CHANGE_RESTART },
+        { "GfxAPI",               OPTION_TYPE_GFX_API,            &_optGfxAPIType,               OPTION_CHANGE_RESTART },
+        { "ModelPath",            OPTION_TYPE_STRING,             &_strModelPath,                OPTION_CHANGE_RESTART },
+        { "LodPixelError",        OPTION_TYPE_FLOAT,              &_fLodPixelError,              0 },
+        { "RenderOnDemand",       OPTION_TYPE_BOOL,               &_bRenderOnDemand,             0 },
+        { "AnimateScene",         OPTION_TYPE_BOOL,               &_bAnimateScene,               0 },
+        { "SimulationRate",       OPTION_TYPE_FLOAT,              &_fSimulationRate,             0 },
+        { "TargetFrameRate",      OPTION_TYPE_FLOAT,              &_fTargetFrameRate,            OPTION_CHANGE_FRAME_PACING },
+        { "PresentMode",          OPTION_TYPE_PRESENT_MODE,       &_optPresentMode,              OPTION_CHANGE_SWAP_CHAIN },
+        { "SwapChainImageCount",  OPTION_TYPE_UINT,               &_ctSwapChainImages,           OPTION_CHANGE_SWAP_CHAIN },
+        { "MaxAnisotropy",        OPTION_TYPE_FLOAT,              &_fMaxAnisotropy,              OPTION_CHANGE_SAMPLER },
+        { "MsaaSampleCount",      OPTION_TYPE_UINT,               &_ctMsaaSamples,               OPTION_CHANGE_RENDER_TARGETS },
+        { "ResolutionScale",      OPTION_TYPE_FLOAT,              &_fResolutionScale,            OPTION_CHANGE_RENDER_TARGETS },
+        { "DepthPrepass",         OPTION_TYPE_DEPTH_PREPASS_MODE, &_optDepthPrepassMode,         OPTION_CHANGE_DEPTH_PREPASS },
+        { "DepthPrepassOverdraw", OPTION_TYPE_FLOAT,              &_fDepthPrepassOverdraw,       OPTION_CHANGE_DEPTH_PREPASS },
+        { "OcclusionCulling",     OPTION_TYPE_BOOL,               &_bOcclusionCulling,           OPTION_CHANGE_RENDER_TARGETS },
+        { "JobThreads",           OPTION_TYPE_UINT,               &_ctJobThreads,                OPTION_CHANGE_RESTART },
+        { "JobBenchmark",         OPTION_TYPE_BOOL,               &_bJobBenchmark,               OPTION_CHANGE_RESTART },
+        { "BvhBenchmark",         OPTION_TYPE_BOOL,               &_bBvhBenchmark,               OPTION_CHANGE_RESTART },
+        { "NullFrameCount",       OPTION_TYPE_UINT,               &_ctNullFrames,                0 },
+        { "ValidationLayers",     OPTION_TYPE_BOOL,               &_optShouldUseValiationLayers, OPTION_CHANGE_RESTART },
+        { "PhysicalDeviceIndex",  OPTION_TYPE_INT,                &_iPhysicalDevice,             OPTION_CHANGE_RESTART },
+        { "PhysicalDeviceName",   OPTION_TYPE_STRING,             &_strPhysicalDeviceName,       OPTION_CHANGE_RESTART },
+    };
+}
+
+
+// Load the options from the config file and the command line.
+void Options::Load(int ctArguments, char *astrArguments[]) {
+    Options &options = GetInstance();
+    options._strConfigPath = strDefaultConfigPath;
+    options._astrOverrides.clear();
+
+    // collect the options from the command line, the first argument is the executable
+    bool bExplicitConfig = false;
+    for (int iArgument = 1; iArgument < ctArguments; iArgument++) {
+        const std::string strArgument = astrArguments[iArgument];
+        const size_t iEquals = strArgument.find('=');
+        if (strArgument.compare(0, 2, "--") != 0 || iEquals == std::string::npos) {
+            throw std::runtime_error("Invalid command line argument '" + strArgument + "', expected --<name>=<value>");
+        }
+        const std::string strName = strArgument.substr(2, iEquals - 2);
+        const std::string strValue = strArgument.substr(iEquals + 1);
+        // the config file is chosen here, everything else is an option
+        if (strName == "config") {
+            options._strConfigPath = strValue;
+            bExplicitConfig = true;
+        } else {
+            options._astrOverrides.push_back({ strName, strValue });
+        }
+    }
+
+    // a config file given explicitly must exist, the default one is optional
+    options._tmConfigModified = GetModificationTime(options._strConfigPath);
+    if (bExplicitConfig && options._tmConfigModified == 0) {
+        throw std::runtime_error("Config file " + options._strConfigPath + " not found");
+    }
+    options._tmLastCheck = std::chrono::high_resolution_clock::now();
+
+    // nothing was created from the options yet, so nobody needs to be notified, and all of them can be taken over
+    options.Rebuild(true);
+}
+
+
+// Reload the config file if it changed since it was last read, and notify the listeners about the changes.
+bool Options::ReloadIfModified(const std::function<void()> &fnBeforeChange) {
+    Options &options = GetInstance();
+    // options that were never loaded have no file to watch
+    if (options._strConfigPath.empty()) {
+        return false;
+    }
+
+    // don't touch the file system every frame
+    const auto tmNow = std::chrono::high_resolution_clock::now();
+    if (tmNow - options._tmLastCheck < tmConfigCheckInterval) {
+        return false;
+    }
+    options._tmLastCheck = tmNow;
+
+    // nothing to do if the file wasn't modified
+    const time_t tmModified = GetModificationTime(options._strConfigPath);
+    if (tmModified == options._tmConfigModified) {
+        return false;
+    }
+    options._tmConfigModified = tmModified;
+    if (fnBeforeChange) {
+        fnBeforeChange();
+    }
+
+    // rebuild the options - if the file has errors, the current options are kept, the application keeps running
+    uint32_t flgChanged = 0;
+    try {
+        flgChanged = options.Rebuild(false);
+    } catch (const std::runtime_error &e) {
+        std::cout << "Config file " << options._strConfigPath << " not applied: " << e.what() << std::endl;
+        return false;
+    }
+
+    if (flgChanged & OPTION_CHANGE_RESTART) {
+        std::cout << "Some of the changed options take effect only after a restart" << std::endl;
+    }
+    // let the listeners rebuild what the changes affect
+    if (flgChanged != 0) {
+        for (const auto &dicListener : options._dicListeners) {
+            dicListener.second(flgChanged);
+        }
+    }
+    return true;
 }
 
 
+// Register a function to call with a mask of OptionChange flags when options change.
+uint32_t Options::AddChangeListener(const std::function<void(uint32_t)> &fnListener) {
+    Options &options = GetInstance();
+    const uint32_t iListener = options._iNextListener++;
+    options._dicListeners[iListener] = fnListener;
+    return iListener;
+}
+
+
+// Remove a change listener.
+void Options::RemoveChangeListener(uint32_t iListener) {
+    GetInstance()._dicListeners.erase(iListener);
+}
+
+
+// Build the options anew from the defaults, the config file and the command line, and take them over.
+uint32_t Options::Rebuild(bool bTakeRestartOptions) {
+    // build the new options separately, so that an error leaves the current ones untouched
+    Options optNew;
+    optNew.ReadFile(_strConfigPath);
+    for (const auto &strOverride : _astrOverrides) {
+        optNew.SetOption(strOverride.first, strOverride.second);
+    }
+    // the simulation step is derived from the rate
+    if (optNew._fSimulationRate <= 0.0f) {
+        throw std::runtime_error("SimulationRate must be positive");
+    }
+
+    // take over the values that changed, collecting what they affect - the ones needing a restart keep the value the
+    // running application was created with, so that the getters keep agreeing with it
+    const std::vector<OptionEntry> aoeCurrent = DescribeOptions();
+    const std::vector<OptionEntry> aoeNew = optNew.DescribeOptions();
+    uint32_t flgChanged = 0;
+    for (size_t iOption = 0; iOption < aoeCurrent.size(); iOption++) {
+        if (!IsValueEqual(aoeCurrent[iOption], aoeNew[iOption])) {
+            if (bTakeRestartOptions || !(aoeCurrent[iOption].flgChange & OPTION_CHANGE_RESTART)) {
+                CopyValue(aoeCurrent[iOption], aoeNew[iOption]);
+            }
+            flgChanged |= aoeCurrent[iOption].flgChange;
+            std::cout << "Option " << aoeCurrent[iOption].strName << " changed" << std::endl;
+        }
+    }
+    return flgChanged;
+}
+
+
+// Read options from a config file. Returns false if the file can't be opened.
+bool Options::ReadFile(const std::string &strPath) {
+    std::ifstream fileConfig(strPath);
+    if (!fileConfig.is_open()) {
+        return false;
+    }
+
+    std::string strLine;
+    uint32_t iLine = 0;
+    while (std::getline(fileConfig, strLine)) {
+        iLine++;
+        // skip empty lines and comments
+        strLine = Trim(strLine);
+        if (strLine.empty() || strLine[0] == '#') {
+            continue;
+        }
+        // split the line into the name and the value
+        const size_t iEquals = strLine.find('=');
+        if (iEquals == std::string::npos) {
+            throw std::runtime_error(strPath + "(" + std::to_string(iLine) + "): expected <name> = <value>");
+        }
+        SetOption(Trim(strLine.substr(0, iEquals)), Trim(strLine.substr(iEquals + 1)));
+    }
+    return true;
+}
+
+
+// Set an option by name, parsing the value.
+void Options::SetOption(const std::string &strName, const std::string &strValue) {
+    for (const OptionEntry &oeOption : DescribeOptions()) {
+        if (strName == oeOption.strName) {
+            ParseValue(oeOption, strValue);
+            return;
+        }
+    }
+    throw std::runtime_error("Unknown option " + strName);
+}
+
+
+// Parse a value into an option.
+void Options::ParseValue(const OptionEntry &oeOption, const std::string &strValue) {
+    const std::string strError = "Invalid value '" + strValue + "' for option " + oeOption.strName;
+    // the number parsers throw logic errors, and accept trailing garbage that has to be checked for
+    try {
+        size_t ctParsed = 0;
+        switch (oeOption.otType) {
+        case OPTION_TYPE_UINT:
+            if (!strValue.empty() && strValue[0] == '-') {
+                throw std::runtime_error(strError);
+            }
+            *static_cast<uint32_t*>(oeOption.pValue) = static_cast<uint32_t>(std::stoul(strValue, &ctParsed));
+            break;
+        case OPTION_TYPE_INT:
+            *static_cast<int32_t*>(oeOption.pValue) = static_cast<int32_t>(std::stol(strValue, &ctParsed));
+            break;
+        case OPTION_TYPE_FLOAT:
+            *static_cast<float*>(oeOption.pValue) = std::stof(strValue, &ctParsed);
+            break;
+        case OPTION_TYPE_BOOL:
+            if (strValue == "true" || strValue == "1" || strValue == "on") {
+                *static_cast<bool*>(oeOption.pValue) = true;
+            } else if (strValue == "false" || strValue == "0" || strValue == "off") {
+                *static_cast<bool*>(oeOption.pValue) = false;
+            } else {
+                throw std::runtime_error(strError);
+            }
+            ctParsed = strValue.size();
+            break;
+        case OPTION_TYPE_STRING:
+            *static_cast<std::string*>(oeOption.pValue) = strValue;
+            ctParsed = strValue.size();
+            break;
+        case OPTION_TYPE_GFX_API:
+            if (strValue == "vulkan") {
+                *static_cast<GfxAPIType*>(oeOption.pValue) = GfxAPIType::GFX_API_TYPE_VULKAN;
+            } else if (strValue == "null") {
+                *static_cast<GfxAPIType*>(oeOption.pValue) = GfxAPIType::GFX_API_TYPE_NULL;
+            } else {
+                throw std::runtime_error(strError);
+            }
+            ctParsed = strValue.size();
+            break;
+        case OPTION_TYPE_PRESENT_MODE:
+            if (strValue == "auto") {
+                *static_cast<PresentMode*>(oeOption.pValue) = PresentMode::PRESENT_MODE_AUTO;
+            } else if (strValue == "fifo") {
+                *static_cast<PresentMode*>(oeOption.pValue) = PresentMode::PRESENT_MODE_FIFO;
+            } else if (strValue == "mailbox") {
+                *static_cast<PresentMode*>(oeOption.pValue) = PresentMode::PRESENT_MODE_MAILBOX;
+            } else if (strValue == "immediate") {
+                *static_cast<PresentMode*>(oeOption.pValue) = PresentMode::PRESENT_MODE_IMMEDIATE;
+            } else {
+                throw std::runtime_error(strError);
+            }
+            ctParsed = strValue.size();
+            break;
+        case OPTION_TYPE_DEPTH_PREPASS_MODE:
+            if (strValue == "auto") {
+                *static_cast<DepthPrepassMode*>(oeOption.pValue) = DepthPrepassMode::DEPTH_PREPASS_AUTO;
+            } else if (strValue == "off") {
+                *static_cast<DepthPrepassMode*>(oeOption.pValue) = DepthPrepassMode::DEPTH_PREPASS_OFF;
+            } else if (strValue == "on") {
+                *static_cast<DepthPrepassMode*>(oeOption.pValue) = DepthPrepassMode::DEPTH_PREPASS_ON;
+            } else {
+                throw std::runtime_error(strError);
+            }
+            ctParsed = strValue.size();
+            break;
+        }
+        if (ctParsed != strValue.size()) {
+            throw std::runtime_error(strError);
+        }
+    } catch (const std::logic_error &) {
+        throw std::runtime_error(strError);
+    }
+}
+
+
+// Do two entries for the same option hold the same value?
+bool Options::IsValueEqual(const OptionEntry &oeFirst, const OptionEntry &oeSecond) {
+    switch (oeFirst.otType) {
+    case OPTION_TYPE_UINT:               return *static_cast<const uint32_t*>(oeFirst.pValue) == *static_cast<const uint32_t*>(oeSecond.pValue);
+    case OPTION_TYPE_INT:                return *static_cast<const int32_t*>(oeFirst.pValue) == *static_cast<const int32_t*>(oeSecond.pValue);
+    case OPTION_TYPE_FLOAT:              return *static_cast<const float*>(oeFirst.pValue) == *static_cast<const float*>(oeSecond.pValue);
+    case OPTION_TYPE_BOOL:               return *static_cast<const bool*>(oeFirst.pValue) == *static_cast<const bool*>(oeSecond.pValue);
+    case OPTION_TYPE_STRING:             return *static_cast<const std::string*>(oeFirst.pValue) == *static_cast<const std::string*>(oeSecond.pValue);
+    case OPTION_TYPE_GFX_API:            return *static_cast<const GfxAPIType*>(oeFirst.pValue) == *static_cast<const GfxAPIType*>(oeSecond.pValue);
+    case OPTION_TYPE_PRESENT_MODE:       return *static_cast<const PresentMode*>(oeFirst.pValue) == *static_cast<const PresentMode*>(oeSecond.pValue);
+    case OPTION_TYPE_DEPTH_PREPASS_MODE: return *static_cast<const DepthPrepassMode*>(oeFirst.pValue) == *static_cast<const DepthPrepassMode*>(oeSecond.pValue);
+    }
+    return false;
+}
+
+
+// Copy the value of an option between two entries for it.
+void Options::CopyValue(const OptionEntry &oeDestination, const OptionEntry &oeSource) {
+    switch (oeDestination.otType) {
+    case OPTION_TYPE_UINT:               *static_cast<uint32_t*>(oeDestination.pValue) = *static_cast<const uint32_t*>(oeSource.pValue); break;
+    case OPTION_TYPE_INT:                *static_cast<int32_t*>(oeDestination.pValue) = *static_cast<const int32_t*>(oeSource.pValue); break;
+    case OPTION_TYPE_FLOAT:              *static_cast<float*>(oeDestination.pValue) = *static_cast<const float*>(oeSource.pValue); break;
+    case OPTION_TYPE_BOOL:               *static_cast<bool*>(oeDestination.pValue) = *static_cast<const bool*>(oeSource.pValue); break;
+    case OPTION_TYPE_STRING:             *static_cast<std::string*>(oeDestination.pValue) = *static_cast<const std::string*>(oeSource.pValue); break;
+    case OPTION_TYPE_GFX_API:            *static_cast<GfxAPIType*>(oeDestination.pValue) = *static_cast<const GfxAPIType*>(oeSource.pValue); break;
+    case OPTION_TYPE_PRESENT_MODE:       *static_cast<PresentMode*>(oeDestination.pValue) = *static_cast<const PresentMode*>(oeSource.pValue); break;
+    case OPTION_TYPE_DEPTH_PREPASS_MODE: *static_cast<DepthPrepassMode*>(oeDestination.pValue) = *static_cast<const DepthPrepassMode*>(oeSource.pValue); break;
+    }
+}
+
+
+// Get the modification time of a file, or 0 if it doesn't exist.
+time_t Options::GetModificationTime(const std::string &strPath) {
+    struct stat statFile;
+    if (stat(strPath.c_str(), &statFile) != 0) {
+        return 0;
+    }
+    return statFile.st_mtime;
+}
@@ -1,18 +1,53 @@
 #pragma once
 #include "GfxAPI/GfxAPI.h"
+#include <functional>
+#include <ctime>
+
+// Groups of options by what has to be rebuilt when they change. Change listeners get a mask of these. Options read
+// every frame, like the level of detail error, take effect without any of them.
+enum OptionChange {
+    // present mode and swap chain image count - the swap chain is replaced
+    OPTION_CHANGE_SWAP_CHAIN = 1 << 0,
+    // texture filtering - the sampler is recreated
+    OPTION_CHANGE_SAMPLER = 1 << 1,
+    // target frame rate - the frame pacer is reset
+    OPTION_CHANGE_FRAME_PACING = 1 << 2,
+    // multisampling, occlusion culling and resolution scale - the render targets, and the render pass and pipeline using them, are recreated
+    OPTION_CHANGE_RENDER_TARGETS = 1 << 3,
+    // depth pre-pass selection - the scene's overdraw is measured again
+    OPTION_CHANGE_DEPTH_PREPASS = 1 << 4,
+    // options only read when the application starts, like the window size or the graphics API
+    OPTION_CHANGE_RESTART = 1 << 5,
+};
 
 // Implementation of application options. They are implemented as a singleton with read-only access from the outside.
-// This is the initial implementation witht he intention to have all options in one place and not scattered around the code.
-// Future implementation should add loading/saving options from a file, changing them on the fly, marking as 'dirty' when changed etc.
+// Options start at their defaults, then the config file and the command line override them. The config file is
+// watched while the application runs, and listeners are notified about what changed, so that they can rebuild only
+// the objects the changed options affect.
+// Each line of the config file has the form <name> = <value>, and lines starting with # are comments. On the command
+// line, --config=<path> selects the config file (options.cfg by default), and --<name>=<value> sets an option. The
+// command line takes precedence over the config file, also when the file is reloaded.
 class Options
 {
 public:
     // Singleton getter for the options.
     static const Options &Get() {
-        static Options singOptions;
-        return singOptions;
+        return GetInstance();
     }
 
+    // Load the options from the config file and the command line. Throws if an option is unknown or invalid.
+    static void Load(int ctArguments, char *astrArguments[]);
+    // Reload the config file if it changed since it was last read, and notify the listeners about the changes.
+    // The file is only checked a few times per second, so this can be called every frame. Returns true if the file
+    // was reloaded, even if no option changed. fnBeforeChange, if given, is called before the options change, so that
+    // other threads can finish using them.
+    static bool ReloadIfModified(const std::function<void()> &fnBeforeChange = nullptr);
+
+    // Register a function to call with a mask of OptionChange flags when options change. Returns an id for removing it.
+    static uint32_t AddChangeListener(const std::function<void(uint32_t)> &fnListener);
+    // Remove a change listener.
+    static void RemoveChangeListener(uint32_t iListener);
+
 public:
     // Get the desired width of the application window.
     uint32_t GetWindowWidth() const { return _dimWindowWidth; }
@@ -22,16 +57,111 @@ public:
     // Get the graphics API type the application should use.
     enum GfxAPIType GetGfxAPIType() const { return _optGfxAPIType; }
 
+    // Get the path of the OBJ file the scene's objects are drawn with.
+    const std::string &GetModelPath() const { return _strModelPath; }
+    // Get the largest error, in pixels, that a mesh level of detail may introduce on screen.
+    float GetLodPixelError() const { return _fLodPixelError; }
+
+    // Should frames only be rendered when something changes the image, instead of continuously?
+    bool ShouldRenderOnDemand() const { return _bRenderOnDemand; }
+    // Should the objects in the scene move?
+    bool ShouldAnimateScene() const { return _bAnimateScene; }
+    // Get the number of simulation steps per second.
+    float GetSimulationRate() const { return _fSimulationRate; }
+
+    // Get the frame rate to pace rendering to, or zero to render as fast as presentation allows.
+    float GetTargetFrameRate() const { return _fTargetFrameRate; }
+    // Get the requested present mode.
+    enum PresentMode GetPresentMode() const { return _optPresentMode; }
+    // Get the requested number of swap chain images, or zero to use one more than the surface's minimum.
+    uint32_t GetSwapChainImageCount() const { return _ctSwapChainImages; }
+    // Get the largest anisotropy for texture filtering, 1 to disable anisotropic filtering.
+    float GetMaxAnisotropy() const { return _fMaxAnisotropy; }
+    // Get the requested number of samples per pixel for multisampling, 1 to disable multisampling.
+    uint32_t GetMsaaSampleCount() const { return _ctMsaaSamples; }
+    // Get the scale of the rendering resolution relative to the window, 1 to render at the window's resolution.
+    float GetResolutionScale() const { return _fResolutionScale; }
+    // Get whether the depth pre-pass is used, or chosen by the measured overdraw.
+    enum DepthPrepassMode GetDepthPrepassMode() const { return _optDepthPrepassMode; }
+    // Get the overdraw - fragments shaded per visible fragment - from which the automatic mode uses the depth pre-pass.
+    float GetDepthPrepassOverdraw() const { return _fDepthPrepassOverdraw; }
+    // Should objects hidden behind the previous frame's depth be culled on the GPU?
+    bool ShouldUseOcclusionCulling() const { return _bOcclusionCulling; }
+
+    // Get the number of threads that run jobs, including the one waiting for them, or zero for one per hardware thread.
+    uint32_t GetJobThreadCount() const { return _ctJobThreads; }
+    // Should the application measure how the job system scales, instead of running?
+    bool ShouldRunJobBenchmark() const { return _bJobBenchmark; }
+    // Should the application measure the scene hierarchy against brute-force culling, instead of running?
+    bool ShouldRunBvhBenchmark() const { return _bBvhBenchmark; }
+
+    // Null specific
+
+    // Get the number of frames the Null API renders before the application exits.
+    uint32_t GetNullFrameCount() const { return _ctNullFrames; }
+
     // Vulkan specific
 
     // Should the application use validation layers and error callback?
     bool ShouldUseValidationLayers() const { return _optShouldUseValiationLayers;  }
+    // Get the index of the physical device to render on, or -1 to pick the best one.
+    int32_t GetPhysicalDeviceIndex() const { return _iPhysicalDevice; }
+    // Get a part of the name of the physical device to render on, or an empty string to pick the best one.
+    const std::string &GetPhysicalDeviceName() const { return _strPhysicalDeviceName; }
 
 private:
     // Options objects shouldnt be created or destroyed from the outside.
     Options();
     ~Options() {};
 
+    // The singleton instance, writable for loading.
+    static Options &GetInstance() {
+        static Options singOptions;
+        return singOptions;
+    }
+
+    // How an option's value is stored and parsed.
+    enum OptionType {
+        OPTION_TYPE_UINT,
+        OPTION_TYPE_INT,
+        OPTION_TYPE_FLOAT,
+        OPTION_TYPE_BOOL,
+        OPTION_TYPE_STRING,
+        OPTION_TYPE_GFX_API,
+        OPTION_TYPE_PRESENT_MODE,
+        OPTION_TYPE_DEPTH_PREPASS_MODE,
+    };
+
+    // An option, as it is named in the config file and on the command line.
+    struct OptionEntry {
+        const char *strName;
+        OptionType otType;
+        // Where the value is stored.
+        void *pValue;
+        // What has to be rebuilt when the option changes - a mask of OptionChange flags.
+        uint32_t flgChange;
+    };
+
+    // Describe the options stored in this object.
+    std::vector<OptionEntry> DescribeOptions();
+    // Set an option by name, parsing the value. Throws if the option is unknown or the value invalid.
+    void SetOption(const std::string &strName, const std::string &strValue);
+    // Read options from a config file. Returns false if the file can't be opened.
+    bool ReadFile(const std::string &strPath);
+    // Build the options anew from the defaults, the config file and the command line, and take them over. Options
+    // that need a restart are only taken over with bTakeRestartOptions, at startup, but their changes are reported
+    // either way. Returns a mask of OptionChange flags for the options that changed.
+    uint32_t Rebuild(bool bTakeRestartOptions);
+
+    // Parse a value into an option. Throws if it is invalid.
+    static void ParseValue(const OptionEntry &oeOption, const std::string &strValue);
+    // Do two entries for the same option hold the same value?
+    static bool IsValueEqual(const OptionEntry &oeFirst, const OptionEntry &oeSecond);
+    // Copy the value of an option between two entries for it.
+    static void CopyValue(const OptionEntry &oeDestination, const OptionEntry &oeSource);
+    // Get the modification time of a file, or 0 if it doesn't exist.
+    static time_t GetModificationTime(const std::string &strPath);
+
 private:
     // Width and height of the application window.
     uint32_t _dimWindowWidth;
@@ -40,9 +170,67 @@ private:
     // Which graphics API should the application use (Vulkan/Null...)
     enum GfxAPIType _optGfxAPIType;
 
+    // Model drawn by the scene's objects. It is cooked when first loaded, which prints its vertex cache statistics and
+    // levels of detail.
+    std::string _strModelPath;
+    // Largest on-screen error, in pixels, allowed when selecting mesh levels of detail.
+    float _fLodPixelError;
+
+    // Render only when input, a resize, animation or an option change requires a new image? The application sleeps
+    // in between, which saves the CPU and GPU for static scenes.
+    bool _bRenderOnDemand;
+    // Do the objects in the scene move? A static scene lets on-demand rendering idle.
+    bool _bAnimateScene;
+    // Simulation steps per second, independent of the frame rate. Frames interpolate between the steps.
+    float _fSimulationRate;
+
+    // Frame rate the frame pacer targets, zero for no pacing.
+    float _fTargetFrameRate;
+    // Present mode and number of swap chain images to request. Unsupported values fall back to automatic selection.
+    enum PresentMode _optPresentMode;
+    uint32_t _ctSwapChainImages;
+    // Largest anisotropy for texture filtering. Clamped to what the device supports.
+    float _fMaxAnisotropy;
+    // Samples per pixel for multisampling. Lowered to the nearest count the device supports.
+    uint32_t _ctMsaaSamples;
+    // Scale of the rendering resolution relative to the window. The rendered image is scaled to the window.
+    float _fResolutionScale;
+    // Depth pre-pass mode, and the overdraw from which the automatic mode uses the pre-pass.
+    enum DepthPrepassMode _optDepthPrepassMode;
+    float _fDepthPrepassOverdraw;
+    // Should objects be tested against a depth pyramid before they are drawn? Unused with multisampling.
+    bool _bOcclusionCulling;
+
+    // Threads running jobs, zero for one per hardware thread.
+    uint32_t _ctJobThreads;
+    // Run the job system benchmark and exit?
+    bool _bJobBenchmark;
+    // Run the scene hierarchy benchmark and exit?
+    bool _bBvhBenchmark;
+
+    // Null specific
+
+    // Number of frames to render with the Null API, which has no window to close.
+    uint32_t _ctNullFrames;
+
     // Vulkan specific
 
     // Should the application use validation layers and error callback?
     bool _optShouldUseValiationLayers;
-};
 
+    // Physical device to render on, by index or by a part of the name. By default, the best one is picked.
+    int32_t _iPhysicalDevice;
+    std::string _strPhysicalDeviceName;
+
+private:
+    // Config file, and options set on the command line, applied over the file's.
+    std::string _strConfigPath;
+    std::vector<std::pair<std::string, std::string>> _astrOverrides;
+    // Modification time of the config file when it was last read, and when it was last checked.
+    time_t _tmConfigModified;
+    std::chrono::high_resolution_clock::time_point _tmLastCheck;
+
+    // Functions to notify about changes, by id.
+    std::map<uint32_t, std::function<void(uint32_t)>> _dicListeners;
+    uint32_t _iNextListener;
+};
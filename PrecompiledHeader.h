@@ -18,6 +18,7 @@
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include "ThirdParty/stb_image.h"
 #include "ThirdParty/tiny_obj_loader.h"
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "../PrecompiledHeader.h"
+#include "BvhBenchmark.h"
+#include "SceneBvh.h"
+#include "../Jobs/JobSystem.h"
+
+#include <functional>
+#include <limits>
+
+// Numbers of objects measured.
+static const uint32_t actBenchmarkObjects[] = { 10000, 100000, 1000000 };
+// Objects per parallel-for range of the brute-force culling.
+static const uint32_t ctObjectsPerRange = 1024;
+// Runs per measurement - the fastest one is reported, which is the least disturbed by the rest of the system.
+static const uint32_t ctBenchmarkRuns = 10;
+// Rays cast per picking run.
+static const uint32_t ctBenchmarkRays = 1000;
+
+
+// Run fnRun a number of times and return the fastest run in seconds. The first run warms up the caches and the
+// threads, and isn't measured.
+static double MeasureFastestRun(const std::function<void()> &fnRun) {
+    double tmBest = std::numeric_limits<double>::max();
+    for (uint32_t iRun = 0; iRun <= ctBenchmarkRuns; iRun++) {
+        const auto tmStart = std::chrono::high_resolution_clock::now();
+        fnRun();
+        const double tmRun = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tmStart).count();
+        if (iRun > 0) {
+            tmBest = std::min(tmBest, tmRun);
+        }
+    }
+    return tmBest;
+}
+
+
+// Measure the scene hierarchy against brute-force culling.
+void RunBvhBenchmark() {
+    uint32_t ulSeed = 1;
+    auto fnRandom = [&ulSeed]() {
+        ulSeed = ulSeed * 1664525u + 1013904223u;
+        return (ulSeed >> 8) / float(1 << 24);
+    };
+
+    std::cout << "Scene hierarchy benchmark, " << JobSystem::GetWorkerCount() + 1 << " threads:" << std::endl;
+    for (uint32_t ctObjects : actBenchmarkObjects) {
+        // objects scattered in a cube that grows with their number, so that they are always as dense, and a camera at
+        // its side that sees part of it
+        const float fSide = 10.0f * std::cbrt(static_cast<float>(ctObjects));
+        std::vector<glm::vec4> avecSpheres(ctObjects);
+        for (glm::vec4 &vecSphere : avecSpheres) {
+            vecSphere = glm::vec4((glm::vec3(fnRandom(), fnRandom(), fnRandom()) - 0.5f) * fSide, 0.5f + fnRandom());
+        }
+        // the same objects after moving a little, for refitting
+        std::vector<glm::vec4> avecMoved(avecSpheres);
+        for (glm::vec4 &vecSphere : avecMoved) {
+            vecSphere += glm::vec4(glm::vec3(fnRandom(), fnRandom(), fnRandom()) - 0.5f, 0.0f);
+        }
+        const glm::vec3 vecCamera = glm::vec3(0.0f, -0.75f * fSide, 0.0f);
+        const glm::mat4 tView = glm::lookAt(vecCamera, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        const glm::mat4 tProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, fSide);
+        CullingFrustum cfFrustum;
+        ExtractFrustumPlanes(tProjection * tView, cfFrustum);
+
+        // brute force, testing every object
+        uint32_t ctBruteForceVisible = 0;
+        const double tmBruteForce = MeasureFastestRun([&]() {
+            ctBruteForceVisible = 0;
+            for (const glm::vec4 &vecSphere : avecSpheres) {
+                ctBruteForceVisible += IsSphereInFrustum(cfFrustum, glm::vec3(vecSphere), vecSphere.w) ? 1 : 0;
+            }
+        });
+        // the same spread over the threads - visible objects per range, each written by one job only
+        std::vector<uint32_t> actRangeVisible((ctObjects + ctObjectsPerRange - 1) / ctObjectsPerRange);
+        const double tmParallelBruteForce = MeasureFastestRun([&]() {
+            JobSystem::ParallelFor(ctObjects, ctObjectsPerRange, [&](uint32_t iBegin, uint32_t iEnd) {
+                uint32_t ctVisible = 0;
+                for (uint32_t iObject = iBegin; iObject < iEnd; iObject++) {
+                    ctVisible += IsSphereInFrustum(cfFrustum, glm::vec3(avecSpheres[iObject]), avecSpheres[iObject].w) ? 1 : 0;
+                }
+                actRangeVisible[iBegin / ctObjectsPerRange] = ctVisible;
+            });
+        });
+
+        // the hierarchy - refitting alternates between the two positions, so that every run moves the objects
+        SceneBvh bvhObjects;
+        const double tmBuild = MeasureFastestRun([&]() { bvhObjects.Build(avecSpheres.data(), ctObjects); });
+        bool bMoved = false;
+        const double tmRefit = MeasureFastestRun([&]() {
+            bMoved = !bMoved;
+            bvhObjects.Refit(bMoved ? avecMoved.data() : avecSpheres.data());
+        });
+        const float fDegradation = bvhObjects.GetRefitDegradation();
+        bvhObjects.Build(avecSpheres.data(), ctObjects);
+        std::vector<uint32_t> aiVisible;
+        aiVisible.reserve(ctObjects);
+        LinearArena arScratch;
+        const double tmCull = MeasureFastestRun([&]() {
+            aiVisible.clear();
+            arScratch.Reset();
+            bvhObjects.CullFrustum(cfFrustum, aiVisible, arScratch);
+        });
+
+        // picking, with rays from the camera into the cube
+        std::vector<glm::vec3> avecRayTargets(ctBenchmarkRays);
+        for (glm::vec3 &vecTarget : avecRayTargets) {
+            vecTarget = (glm::vec3(fnRandom(), fnRandom(), fnRandom()) - 0.5f) * fSide;
+        }
+        uint32_t ctHits = 0;
+        const double tmRays = MeasureFastestRun([&]() {
+            ctHits = 0;
+            for (const glm::vec3 &vecTarget : avecRayTargets) {
+                float fDistance;
+                arScratch.Reset();
+                ctHits += bvhObjects.Raycast(vecCamera, glm::normalize(vecTarget - vecCamera), fDistance, arScratch) != SceneBvh::iNoObject ? 1 : 0;
+            }
+        });
+
+        std::cout << "  " << ctObjects << " objects, " << ctBruteForceVisible << " visible by brute force, " << aiVisible.size() << " by the hierarchy:" << std::endl
+            << "    brute force " << tmBruteForce * 1000.0 << " ms, on all threads " << tmParallelBruteForce * 1000.0 << " ms" << std::endl
+            << "    hierarchy culling " << tmCull * 1000.0 << " ms, speedup " << tmBruteForce / tmCull << " over brute force on one thread" << std::endl
+            << "    build " << tmBuild * 1000.0 << " ms, refit " << tmRefit * 1000.0 << " ms, refit cost " << fDegradation << " times the built one" << std::endl
+            << "    picking " << tmRays / ctBenchmarkRays * 1000000.0 << " us per ray, " << ctHits << " of " << ctBenchmarkRays << " rays hit" << std::endl;
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Measure the scene hierarchy against brute-force culling, with 10 thousand, 100 thousand and a million objects.
+// Brute force tests every object's sphere with SSE, on one thread and spread over the job system. The hierarchy is
+// built in parallel, refitted after the objects move, and traversed on one thread. Prints the time of each, and of
+// picking with rays through the hierarchy.
+void RunBvhBenchmark();
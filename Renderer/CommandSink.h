@@ -0,0 +1,27 @@
+#pragma once
+
+// Receiver of the commands the renderer builds for a frame. The renderer is API independent - it describes the frame
+// with these commands and refers to resources by small ids, and each graphics API translates them to its own command
+// buffers and objects. The Null API captures them instead, to measure the renderer without a GPU.
+class CommandSink {
+public:
+    virtual ~CommandSink() {};
+
+    // Begin the main render pass, clearing color and depth. The pass starts with the depth pre-pass subpass.
+    virtual void BeginRenderPass() = 0;
+    // Move from the depth pre-pass subpass to the subpass that shades the scene.
+    virtual void NextSubpass() = 0;
+    // End the main render pass.
+    virtual void EndRenderPass() = 0;
+
+    // Bind a graphics pipeline.
+    virtual void BindPipeline(uint32_t iPipeline) = 0;
+    // Bind the vertex and index buffers of a mesh.
+    virtual void BindMeshBuffers(uint32_t iMesh) = 0;
+    // Bind a descriptor set holding per-frame data.
+    virtual void BindDescriptorSet(uint32_t iDescriptorSet) = 0;
+    // Set the per-draw constants.
+    virtual void PushConstants(const void *pData, uint32_t ctSize) = 0;
+    // Issue a range of draw commands from the frame's indirect buffer.
+    virtual void DrawIndexedIndirect(uint32_t iFirstCommand, uint32_t ctCommands) = 0;
+};
@@ -0,0 +1,83 @@
+#include "../PrecompiledHeader.h"
+#include "DepthPrepassSelector.h"
+
+
+// Start deciding anew, for a new scene or new options.
+void DepthPrepassSelector::Initialize(DepthPrepassMode dpmMode, float fOverdrawThreshold) {
+    _dpmMode = dpmMode;
+    _fOverdrawThreshold = fOverdrawThreshold;
+    _fOverdraw = 0.0f;
+    _bPrepass = dpmMode == DEPTH_PREPASS_ON;
+
+    // the automatic mode measures the scene again
+    _iMeasuredFrame = 0;
+    _actMeasuredInvocations.fill(0);
+}
+
+
+// Should the next frame be rendered with the depth pre-pass?
+bool DepthPrepassSelector::ShouldUsePrepass() const {
+    // while measuring, the first half of the frames is rendered without the pre-pass and the second half with it
+    if (_dpmMode == DEPTH_PREPASS_AUTO && _iMeasuredFrame < 2 * ctMeasuredFrames) {
+        return _iMeasuredFrame >= ctMeasuredFrames;
+    }
+    return _bPrepass;
+}
+
+
+// Record the fragment shader invocations of a finished frame, rendered with or without the pre-pass.
+void DepthPrepassSelector::EndFrame(bool bPrepass, int64_t ctFragmentInvocations) {
+    const bool bMeasuring = _dpmMode == DEPTH_PREPASS_AUTO && _iMeasuredFrame < 2 * ctMeasuredFrames;
+
+    // without statistics there is nothing to decide by, and drawing the geometry twice is not a safe bet
+    if (ctFragmentInvocations < 0) {
+        if (bMeasuring) {
+            _iMeasuredFrame = 2 * ctMeasuredFrames;
+            _bPrepass = false;
+            std::cout << "Depth pre-pass: overdraw can't be measured on this device, not used" << std::endl;
+        }
+        return;
+    }
+
+    _actFrames[bPrepass]++;
+    _actTotalInvocations[bPrepass] += ctFragmentInvocations;
+    if (!bMeasuring) {
+        return;
+    }
+
+    _actMeasuredInvocations[bPrepass] += ctFragmentInvocations;
+    _iMeasuredFrame++;
+    if (_iMeasuredFrame < 2 * ctMeasuredFrames) {
+        return;
+    }
+
+    // with the pre-pass, each visible sample is shaded once, so the ratio is the number of times the scene shades a
+    // visible fragment - an empty view has no overdraw
+    _fOverdraw = 1.0f;
+    if (_actMeasuredInvocations[true] > 0) {
+        _fOverdraw = static_cast<float>(static_cast<double>(_actMeasuredInvocations[false]) / _actMeasuredInvocations[true]);
+    }
+    _bPrepass = _fOverdraw >= _fOverdrawThreshold;
+    std::cout << "Depth pre-pass: overdraw " << _fOverdraw << ", " << (_bPrepass ? "used" : "not used") << std::endl;
+}
+
+
+// Print the average invocations per frame with and without the pre-pass, and the decision.
+void DepthPrepassSelector::Report() const {
+    if (_actFrames[false] == 0 && _actFrames[true] == 0) {
+        return;
+    }
+
+    std::cout << "Fragment shader invocations:" << std::endl;
+    if (_actFrames[false] > 0) {
+        std::cout << "  without depth pre-pass " << _actTotalInvocations[false] / _actFrames[false] << " per frame, "
+            << _actFrames[false] << " frames" << std::endl;
+    }
+    if (_actFrames[true] > 0) {
+        std::cout << "  with depth pre-pass " << _actTotalInvocations[true] / _actFrames[true] << " per frame, "
+            << _actFrames[true] << " frames" << std::endl;
+    }
+    if (_fOverdraw > 0.0f) {
+        std::cout << "  measured overdraw " << _fOverdraw << ", pre-pass " << (_bPrepass ? "used" : "not used") << std::endl;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "../GfxAPI/GfxAPI.h"
+
+// Decides whether a scene is rendered with a depth pre-pass. The pre-pass draws the scene's depth first, so that the
+// main pass shades each visible pixel once instead of every fragment that passes the depth test at the time it is
+// drawn. That pays off only when the scene has enough overdraw to outweigh drawing the geometry twice. In the automatic
+// mode, the first frames of a scene are rendered without and then with the pre-pass, and the overdraw is measured as
+// the ratio of their fragment shader invocations. Also counts the invocations of all frames, with and without it.
+class DepthPrepassSelector {
+public:
+    DepthPrepassSelector() : _dpmMode(DEPTH_PREPASS_AUTO), _fOverdrawThreshold(0.0f), _fOverdraw(0.0f), _bPrepass(false), _iMeasuredFrame(0) {
+        _actFrames.fill(0);
+        _actTotalInvocations.fill(0);
+        _actMeasuredInvocations.fill(0);
+    };
+    ~DepthPrepassSelector() {};
+
+    // Start deciding anew, for a new scene or new options. The automatic mode uses the pre-pass from the given overdraw.
+    void Initialize(DepthPrepassMode dpmMode, float fOverdrawThreshold);
+
+    // Should the next frame be rendered with the depth pre-pass?
+    bool ShouldUsePrepass() const;
+    // Record the fragment shader invocations of a finished frame, rendered with or without the pre-pass. Pass a
+    // negative count if the device can't measure them.
+    void EndFrame(bool bPrepass, int64_t ctFragmentInvocations);
+
+    // Print the average invocations per frame with and without the pre-pass, and the decision.
+    void Report() const;
+
+private:
+    // Number of frames measured in each mode before deciding.
+    static const uint32_t ctMeasuredFrames = 8;
+
+    // Requested mode, and the overdraw from which the automatic mode uses the pre-pass.
+    DepthPrepassMode _dpmMode;
+    float _fOverdrawThreshold;
+    // Measured overdraw - fragments shaded per visible fragment - or zero if it wasn't measured.
+    float _fOverdraw;
+    // Is the pre-pass used, once decided?
+    bool _bPrepass;
+
+    // Frames measured since the selection started. The first half of the measurement is without the pre-pass.
+    uint32_t _iMeasuredFrame;
+    // Fragment shader invocations during the measurement, without and with the pre-pass.
+    std::array<uint64_t, 2> _actMeasuredInvocations;
+
+    // Measured frames and their fragment shader invocations, without and with the pre-pass, over the whole run.
+    std::array<uint64_t, 2> _actFrames;
+    std::array<uint64_t, 2> _actTotalInvocations;
+};
@@ -0,0 +1,169 @@
+#include "../PrecompiledHeader.h"
+#include "FramePacer.h"
+
+#include <thread>
+
+// Time added to the predicted work duration, to absorb variation the recent frames didn't show.
+static const double tmWorkMargin = 0.0005;
+// Shortest time to spin at the end of a wait.
+static const double tmMinSpinThreshold = 0.00025;
+
+
+// Convert a duration in seconds to the clock's duration.
+template<typename Duration>
+static Duration FromSeconds(double tmSeconds) {
+    return std::chrono::duration_cast<Duration>(std::chrono::duration<double>(tmSeconds));
+}
+
+
+// Convert the clock's duration to seconds.
+template<typename Duration>
+static double ToSeconds(Duration tmDuration) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(tmDuration).count();
+}
+
+
+// Set the frame rate to pace to.
+void FramePacer::Initialize(float fTargetFrameRate) {
+    std::lock_guard<std::mutex> lock(_mtxState);
+    _tmFramePeriod = fTargetFrameRate > 0.0f ? 1.0 / fTargetFrameRate : 0.0;
+    _bDeadlineSet = false;
+}
+
+
+// Start a new rhythm after rendering paused.
+void FramePacer::Resume() {
+    std::lock_guard<std::mutex> lock(_mtxState);
+    // the next frame sets the first deadline again, and its distance to the frame before the pause isn't jitter
+    _bDeadlineSet = false;
+    _bResumed = true;
+}
+
+
+// Wait until the next frame should start, and return its start.
+FramePacer::Clock::time_point FramePacer::WaitForFrameStart() {
+    // start as late as possible while still finishing the work by the deadline - the render thread may move the
+    // deadline meanwhile, which only affects the frame after this one
+    bool bWait = false;
+    Clock::time_point tmStart;
+    {
+        std::lock_guard<std::mutex> lock(_mtxState);
+        if (_tmFramePeriod > 0.0 && _bDeadlineSet) {
+            tmStart = _tmDeadline - FromSeconds<Clock::duration>(PredictWorkDuration());
+            bWait = true;
+        }
+    }
+    if (bWait) {
+        WaitUntil(tmStart);
+    }
+
+    const Clock::time_point tmFrameStart = Clock::now();
+
+    // the first paced frame sets the rhythm
+    std::lock_guard<std::mutex> lock(_mtxState);
+    if (_tmFramePeriod > 0.0 && !_bDeadlineSet) {
+        _tmDeadline = tmFrameStart + FromSeconds<Clock::duration>(_tmFramePeriod);
+        _bDeadlineSet = true;
+    }
+    return tmFrameStart;
+}
+
+
+// Mark the end of a frame, when the GPU finished it.
+void FramePacer::EndFrame(Clock::time_point tmFrameStart, Clock::time_point tmCpuEnd, double tmGpuDuration) {
+    const Clock::time_point tmFrameEnd = Clock::now();
+    std::lock_guard<std::mutex> lock(_mtxState);
+
+    // without a GPU measurement, everything after the submission counts as GPU time - the CPU time includes the time
+    // the frame waited for the render thread, which delays its display just the same
+    const double tmCpuDuration = ToSeconds(tmCpuEnd - tmFrameStart);
+    if (tmGpuDuration < 0.0) {
+        tmGpuDuration = ToSeconds(tmFrameEnd - tmCpuEnd);
+    }
+    _atmRecentWork[_iRecentWork] = tmCpuDuration + tmGpuDuration;
+    _iRecentWork = (_iRecentWork + 1) % ctRecentFrames;
+
+    // the frame start is when input was sampled, the frame end is when the image is ready for display
+    const double tmLatency = ToSeconds(tmFrameEnd - tmFrameStart);
+    _tmTotalCpu += tmCpuDuration;
+    _tmTotalGpu += tmGpuDuration;
+    _tmTotalLatency += tmLatency;
+    _tmMaxLatency = std::max(_tmMaxLatency, tmLatency);
+    // jitter is measured on the intervals between frame ends, which is what the display sees
+    if (_ctFrames > 0 && !_bResumed) {
+        const double tmInterval = ToSeconds(tmFrameEnd - _tmPreviousFrameEnd);
+        _tmTotalInterval += tmInterval;
+        _tmTotalIntervalSquared += tmInterval * tmInterval;
+        _ctIntervals++;
+    }
+    _tmPreviousFrameEnd = tmFrameEnd;
+    _bResumed = false;
+    _ctFrames++;
+
+    if (_tmFramePeriod > 0.0) {
+        if (tmFrameEnd > _tmDeadline) {
+            _ctMissedDeadlines++;
+        }
+        // move to the next deadline that leaves enough time for the work, skipping the ones a late frame made unreachable
+        const Clock::duration tmPeriod = FromSeconds<Clock::duration>(_tmFramePeriod);
+        const Clock::time_point tmEarliestEnd = tmFrameEnd + FromSeconds<Clock::duration>(PredictWorkDuration());
+        _tmDeadline += tmPeriod;
+        while (_tmDeadline < tmEarliestEnd) {
+            _tmDeadline += tmPeriod;
+        }
+    }
+}
+
+
+// Predict how long the next frame's work will take.
+double FramePacer::PredictWorkDuration() const {
+    // the slowest of the recent frames, so that occasional slower frames still make their deadline
+    double tmWork = 0.0;
+    for (double tmRecentWork : _atmRecentWork) {
+        tmWork = std::max(tmWork, tmRecentWork);
+    }
+    return tmWork + tmWorkMargin;
+}
+
+
+// Wait until a point in time. Sleeps while the deadline is far, then spins.
+void FramePacer::WaitUntil(Clock::time_point tmDeadline) {
+    const Clock::time_point tmSleepStart = Clock::now();
+    const double tmRemaining = ToSeconds(tmDeadline - tmSleepStart);
+
+    // sleep through all but the last part of the wait, which the sleep might overshoot
+    if (tmRemaining > _tmSpinThreshold) {
+        const double tmSleep = tmRemaining - _tmSpinThreshold;
+        std::this_thread::sleep_for(FromSeconds<std::chrono::microseconds>(tmSleep));
+
+        // learn how much sleeps overshoot - grow right away when they overshoot more, shrink slowly otherwise
+        const double tmOversleep = ToSeconds(Clock::now() - tmSleepStart) - tmSleep;
+        _tmSpinThreshold = std::max(std::max(tmOversleep * 1.25, _tmSpinThreshold * 0.99), tmMinSpinThreshold);
+    }
+
+    // spin for the rest, giving the time slice away so other threads can run
+    while (Clock::now() < tmDeadline) {
+        std::this_thread::yield();
+    }
+}
+
+
+// Print the achieved frame rate, work durations, latency and jitter.
+void FramePacer::Report() const {
+    if (_ctIntervals == 0) {
+        return;
+    }
+
+    const double fFrames = _ctFrames;
+    const double tmAverageInterval = _tmTotalInterval / _ctIntervals;
+    const double tmJitter = std::sqrt(std::max(_tmTotalIntervalSquared / _ctIntervals - tmAverageInterval * tmAverageInterval, 0.0));
+    std::cout << "Frame pacing, " << _ctFrames << " frames:" << std::endl
+        << "  " << 1.0 / tmAverageInterval << " fps";
+    if (_tmFramePeriod > 0.0) {
+        std::cout << " (target " << 1.0 / _tmFramePeriod << "), " << _ctMissedDeadlines << " missed deadlines";
+    }
+    std::cout << std::endl
+        << "  CPU " << _tmTotalCpu / fFrames * 1000.0 << " ms, GPU " << _tmTotalGpu / fFrames * 1000.0 << " ms per frame" << std::endl
+        << "  latency " << _tmTotalLatency / fFrames * 1000.0 << " ms average, " << _tmMaxLatency * 1000.0 << " ms max, jitter "
+        << tmJitter * 1000.0 << " ms" << std::endl;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <mutex>
+
+// Paces frames to a target frame rate with the least latency. Each frame has a deadline, one frame period after the
+// previous one, and the pacer delays the start of the frame - and with it, the sampling of input - until just enough
+// time is left to do the frame's CPU and GPU work before the deadline. The work duration is predicted from the recent
+// frames. Waits sleep for most of the time and spin for the rest, since sleeping alone overshoots by up to the
+// scheduler's granularity. Also measures the achieved latency and jitter. Frames start on the main thread and end on
+// the render thread, so the state shared by both is guarded by a mutex, which is never held while waiting.
+class FramePacer {
+public:
+    typedef std::chrono::high_resolution_clock Clock;
+
+public:
+    FramePacer() : _tmFramePeriod(0.0), _tmSpinThreshold(0.002), _iRecentWork(0), _ctFrames(0), _ctMissedDeadlines(0), _ctIntervals(0),
+        _tmTotalCpu(0.0), _tmTotalGpu(0.0), _tmTotalLatency(0.0), _tmMaxLatency(0.0), _tmTotalInterval(0.0), _tmTotalIntervalSquared(0.0),
+        _bDeadlineSet(false), _bResumed(false) {
+        _atmRecentWork.fill(0.0);
+    };
+    ~FramePacer() {};
+
+    // Set the frame rate to pace to. With zero, frames start right away and are only measured.
+    void Initialize(float fTargetFrameRate);
+    // Start a new rhythm after rendering paused, so that the pause doesn't count as a late frame or as jitter.
+    void Resume();
+
+    // Wait until the next frame should start, and return its start. Called on the main thread, before input is sampled.
+    Clock::time_point WaitForFrameStart();
+    // Mark the end of a frame, when the GPU finished it. Pass the frame's start, the end of its CPU work - when it was
+    // submitted to the GPU - and the GPU time in seconds, or a negative value if it wasn't measured. The time between
+    // the submission and the end of the frame is used then. Frames that are abandoned are simply not ended.
+    void EndFrame(Clock::time_point tmFrameStart, Clock::time_point tmCpuEnd, double tmGpuDuration);
+
+    // Print the achieved frame rate, work durations, latency and jitter. Called once no frames are in flight.
+    void Report() const;
+
+private:
+    // Wait until a point in time. Sleeps while the deadline is far, then spins.
+    void WaitUntil(Clock::time_point tmDeadline);
+    // Predict how long the next frame's work will take.
+    double PredictWorkDuration() const;
+
+private:
+    // Number of recent frames the work duration is predicted from.
+    static const uint32_t ctRecentFrames = 16;
+
+    // Time between deadlines, in seconds, or zero if frames aren't paced.
+    double _tmFramePeriod;
+    // Waits shorter than this are spun instead of slept, in seconds. Adapts to how much sleeps overshoot. Only used
+    // by the main thread.
+    double _tmSpinThreshold;
+
+    // Guards the rest of the state.
+    std::mutex _mtxState;
+    // Time the next frame to end should be finished by.
+    Clock::time_point _tmDeadline;
+    // End of the previous frame.
+    Clock::time_point _tmPreviousFrameEnd;
+
+    // CPU plus GPU durations of the recent frames, in seconds.
+    std::array<double, ctRecentFrames> _atmRecentWork;
+    uint32_t _iRecentWork;
+
+    // Statistics - frames measured, deadlines missed, and sums of durations and intervals between frames, in seconds.
+    uint32_t _ctFrames;
+    uint32_t _ctMissedDeadlines;
+    uint32_t _ctIntervals;
+    double _tmTotalCpu;
+    double _tmTotalGpu;
+    double _tmTotalLatency;
+    double _tmMaxLatency;
+    double _tmTotalInterval;
+    double _tmTotalIntervalSquared;
+
+    // Has the first deadline been set?
+    bool _bDeadlineSet;
+    // Did rendering pause before the current frame? The interval to the previous frame isn't measured then.
+    bool _bResumed;
+};
@@ -0,0 +1,376 @@
+#include "../PrecompiledHeader.h"
+#include "SceneBvh.h"
+#include "../Jobs/JobSystem.h"
+
+#include <limits>
+
+// Number of bins the objects are sorted into along each axis, to find the cheapest split.
+static const uint32_t ctSahBins = 16;
+// Nodes with more objects are always split.
+static const uint32_t ctMaxLeafObjects = 8;
+// Nodes with at least this many objects build their children in parallel.
+static const uint32_t ctParallelBuildObjects = 4096;
+// Relative costs of visiting a node and testing an object, for the surface area heuristic.
+static const float fTraversalCost = 1.0f;
+static const float fIntersectionCost = 1.0f;
+// Planes of the culling frustum - the padding planes never cull anything.
+static const uint32_t ctFrustumPlanes = 6;
+// Nodes the traversal stacks have room for up front - enough for the depth of well balanced hierarchies.
+static const uint32_t ctStackReserve = 64;
+
+
+// Surface area of a box.
+static float GetSurfaceArea(const glm::vec3 &vecMin, const glm::vec3 &vecMax) {
+    const glm::vec3 vecExtent = vecMax - vecMin;
+    return 2.0f * (vecExtent.x * vecExtent.y + vecExtent.y * vecExtent.z + vecExtent.z * vecExtent.x);
+}
+
+
+// Does the ray hit the box before fMaxDistance? Writes where it enters the box to fEntry.
+static bool IntersectRayBox(const glm::vec3 &vecOrigin, const glm::vec3 &vecInverseDirection, const glm::vec3 &vecMin, const glm::vec3 &vecMax,
+    float fMaxDistance, float &fEntry) {
+    // distances to the two planes of each slab, and the overlap of the three ranges
+    const glm::vec3 vecToMin = (vecMin - vecOrigin) * vecInverseDirection;
+    const glm::vec3 vecToMax = (vecMax - vecOrigin) * vecInverseDirection;
+    const glm::vec3 vecNear = glm::min(vecToMin, vecToMax);
+    const glm::vec3 vecFar = glm::max(vecToMin, vecToMax);
+    fEntry = std::max(std::max(vecNear.x, vecNear.y), std::max(vecNear.z, 0.0f));
+    const float fExit = std::min(std::min(vecFar.x, vecFar.y), std::min(vecFar.z, fMaxDistance));
+    return fEntry <= fExit;
+}
+
+
+// Distance along the ray to where it hits the sphere, or a negative value if it misses.
+static float IntersectRaySphere(const glm::vec3 &vecOrigin, const glm::vec3 &vecDirection, const glm::vec4 &vecSphere) {
+    const glm::vec3 vecToCenter = glm::vec3(vecSphere) - vecOrigin;
+    const float fAlongRay = glm::dot(vecToCenter, vecDirection);
+    const float fMissSquared = glm::dot(vecToCenter, vecToCenter) - fAlongRay * fAlongRay;
+    const float fRadiusSquared = vecSphere.w * vecSphere.w;
+    if (fMissSquared > fRadiusSquared) {
+        return -1.0f;
+    }
+    // the near hit, or the far one if the ray starts inside
+    const float fHalfChord = std::sqrt(fRadiusSquared - fMissSquared);
+    return fAlongRay - fHalfChord >= 0.0f ? fAlongRay - fHalfChord : fAlongRay + fHalfChord;
+}
+
+
+// Build the hierarchy over the objects' bounding spheres.
+void SceneBvh::Build(const glm::vec4 *avecSpheres, uint32_t ctObjects) {
+    _aiObjects.resize(ctObjects);
+    for (uint32_t iObject = 0; iObject < ctObjects; iObject++) {
+        _aiObjects[iObject] = iObject;
+    }
+    _anodNodes.clear();
+    _avecSpheres.clear();
+    _fBuildCost = 0.0f;
+    _fCost = 0.0f;
+    if (ctObjects == 0) {
+        return;
+    }
+
+    // no leaf is empty, so there are at most 2n-1 nodes - they are all there before the build starts, so that the
+    // parallel parts of it can fill them in without locking
+    _anodNodes.resize(2 * ctObjects - 1);
+    std::atomic<uint32_t> ctNodes(1);
+    BuildNode(0, 0, ctObjects, avecSpheres, ctNodes);
+    _anodNodes.resize(ctNodes.load());
+
+    // keep the spheres in the order of the leaves, so that the leaves read them from consecutive memory
+    _avecSpheres.resize(ctObjects);
+    for (uint32_t iObject = 0; iObject < ctObjects; iObject++) {
+        _avecSpheres[iObject] = avecSpheres[_aiObjects[iObject]];
+    }
+    _fBuildCost = ComputeCost();
+    _fCost = _fBuildCost;
+}
+
+
+// Update the boxes for moved objects.
+void SceneBvh::Refit(const glm::vec4 *avecSpheres) {
+    for (uint32_t iObject = 0; iObject < _aiObjects.size(); iObject++) {
+        _avecSpheres[iObject] = avecSpheres[_aiObjects[iObject]];
+    }
+
+    // children come after their parents, so going backwards refits the children before their parents
+    for (uint32_t iNode = static_cast<uint32_t>(_anodNodes.size()); iNode-- > 0;) {
+        BvhNode &nodNode = _anodNodes[iNode];
+        if (nodNode.ctObjects == 0) {
+            const BvhNode &nodFirst = _anodNodes[nodNode.iFirst];
+            const BvhNode &nodSecond = _anodNodes[nodNode.iFirst + 1];
+            nodNode.vecMin = glm::min(nodFirst.vecMin, nodSecond.vecMin);
+            nodNode.vecMax = glm::max(nodFirst.vecMax, nodSecond.vecMax);
+            continue;
+        }
+        nodNode.vecMin = glm::vec3(std::numeric_limits<float>::max());
+        nodNode.vecMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (uint32_t iObject = nodNode.iFirst; iObject < nodNode.iFirst + nodNode.ctObjects; iObject++) {
+            const glm::vec4 &vecSphere = _avecSpheres[iObject];
+            nodNode.vecMin = glm::min(nodNode.vecMin, glm::vec3(vecSphere) - vecSphere.w);
+            nodNode.vecMax = glm::max(nodNode.vecMax, glm::vec3(vecSphere) + vecSphere.w);
+        }
+    }
+    _fCost = ComputeCost();
+}
+
+
+// Add the objects that are at least partly inside the frustum to aiVisible.
+void SceneBvh::CullFrustum(const CullingFrustum &cfFrustum, std::vector<uint32_t> &aiVisible, LinearArena &arScratch) const {
+    if (_anodNodes.empty()) {
+        return;
+    }
+
+    // nodes to visit, each with the planes it still needs testing against - a node entirely inside a plane has all
+    // its children inside it too
+    struct NodeToVisit {
+        uint32_t iNode;
+        uint32_t flgPlanes;
+    };
+    ArenaVector<NodeToVisit> anvStack(arScratch);
+    // the stack holds about one node per level, and the arena doesn't reuse what a growing vector leaves behind
+    anvStack.reserve(ctStackReserve);
+    anvStack.push_back({ 0, (1u << ctFrustumPlanes) - 1 });
+    while (!anvStack.empty()) {
+        const NodeToVisit nvVisit = anvStack.back();
+        anvStack.pop_back();
+        const BvhNode &nodNode = _anodNodes[nvVisit.iNode];
+
+        // test the box against the remaining planes - it is outside if it's fully behind any of them
+        const glm::vec3 vecCenter = (nodNode.vecMin + nodNode.vecMax) * 0.5f;
+        const glm::vec3 vecHalfExtent = (nodNode.vecMax - nodNode.vecMin) * 0.5f;
+        uint32_t flgPlanes = nvVisit.flgPlanes;
+        bool bOutside = false;
+        for (uint32_t iPlane = 0; iPlane < ctFrustumPlanes && !bOutside; iPlane++) {
+            if ((flgPlanes & (1u << iPlane)) == 0) {
+                continue;
+            }
+            const float fDistance = cfFrustum.afNormalX[iPlane] * vecCenter.x + cfFrustum.afNormalY[iPlane] * vecCenter.y
+                + cfFrustum.afNormalZ[iPlane] * vecCenter.z + cfFrustum.afDistance[iPlane];
+            const float fExtent = std::abs(cfFrustum.afNormalX[iPlane]) * vecHalfExtent.x + std::abs(cfFrustum.afNormalY[iPlane]) * vecHalfExtent.y
+                + std::abs(cfFrustum.afNormalZ[iPlane]) * vecHalfExtent.z;
+            bOutside = fDistance < -fExtent;
+            if (fDistance >= fExtent) {
+                flgPlanes &= ~(1u << iPlane);
+            }
+        }
+        if (bOutside) {
+            continue;
+        }
+
+        if (nodNode.ctObjects == 0) {
+            anvStack.push_back({ nodNode.iFirst, flgPlanes });
+            anvStack.push_back({ nodNode.iFirst + 1, flgPlanes });
+            continue;
+        }
+        // a leaf inside all planes is visible as a whole, the others test their objects
+        for (uint32_t iObject = nodNode.iFirst; iObject < nodNode.iFirst + nodNode.ctObjects; iObject++) {
+            const glm::vec4 &vecSphere = _avecSpheres[iObject];
+            if (flgPlanes == 0 || IsSphereInFrustum(cfFrustum, glm::vec3(vecSphere), vecSphere.w)) {
+                aiVisible.push_back(_aiObjects[iObject]);
+            }
+        }
+    }
+}
+
+
+// Find the nearest object hit by a ray.
+uint32_t SceneBvh::Raycast(const glm::vec3 &vecOrigin, const glm::vec3 &vecDirection, float &fDistance, LinearArena &arScratch) const {
+    fDistance = std::numeric_limits<float>::max();
+    uint32_t iHitObject = iNoObject;
+    if (_anodNodes.empty()) {
+        return iHitObject;
+    }
+
+    // zero direction components give infinities, which the slab test handles
+    const glm::vec3 vecInverseDirection = 1.0f / vecDirection;
+    float fEntry;
+    if (!IntersectRayBox(vecOrigin, vecInverseDirection, _anodNodes[0].vecMin, _anodNodes[0].vecMax, fDistance, fEntry)) {
+        return iHitObject;
+    }
+
+    // nodes to visit, with where the ray enters them - nodes entered beyond the nearest hit so far are skipped
+    struct NodeToVisit {
+        uint32_t iNode;
+        float fEntry;
+    };
+    ArenaVector<NodeToVisit> anvStack(arScratch);
+    anvStack.reserve(ctStackReserve);
+    anvStack.push_back({ 0, fEntry });
+    while (!anvStack.empty()) {
+        const NodeToVisit nvVisit = anvStack.back();
+        anvStack.pop_back();
+        if (nvVisit.fEntry > fDistance) {
+            continue;
+        }
+        const BvhNode &nodNode = _anodNodes[nvVisit.iNode];
+
+        if (nodNode.ctObjects > 0) {
+            for (uint32_t iObject = nodNode.iFirst; iObject < nodNode.iFirst + nodNode.ctObjects; iObject++) {
+                const float fHit = IntersectRaySphere(vecOrigin, vecDirection, _avecSpheres[iObject]);
+                if (fHit >= 0.0f && fHit < fDistance) {
+                    fDistance = fHit;
+                    iHitObject = _aiObjects[iObject];
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first, so that its hits prune the farther one
+        float fFirstEntry, fSecondEntry;
+        const BvhNode &nodFirst = _anodNodes[nodNode.iFirst];
+        const BvhNode &nodSecond = _anodNodes[nodNode.iFirst + 1];
+        const bool bFirstHit = IntersectRayBox(vecOrigin, vecInverseDirection, nodFirst.vecMin, nodFirst.vecMax, fDistance, fFirstEntry);
+        const bool bSecondHit = IntersectRayBox(vecOrigin, vecInverseDirection, nodSecond.vecMin, nodSecond.vecMax, fDistance, fSecondEntry);
+        if (bFirstHit && bSecondHit) {
+            if (fFirstEntry <= fSecondEntry) {
+                anvStack.push_back({ nodNode.iFirst + 1, fSecondEntry });
+                anvStack.push_back({ nodNode.iFirst, fFirstEntry });
+            }
+            else {
+                anvStack.push_back({ nodNode.iFirst, fFirstEntry });
+                anvStack.push_back({ nodNode.iFirst + 1, fSecondEntry });
+            }
+        }
+        else if (bFirstHit) {
+            anvStack.push_back({ nodNode.iFirst, fFirstEntry });
+        }
+        else if (bSecondHit) {
+            anvStack.push_back({ nodNode.iFirst + 1, fSecondEntry });
+        }
+    }
+    if (iHitObject == iNoObject) {
+        fDistance = 0.0f;
+    }
+    return iHitObject;
+}
+
+
+// Build the node for a range of _aiObjects, and its subtree.
+void SceneBvh::BuildNode(uint32_t iNode, uint32_t iBegin, uint32_t iEnd, const glm::vec4 *avecSpheres, std::atomic<uint32_t> &ctNodes) {
+    // bounds of the spheres, and of their centers, which decide where the objects go
+    BvhNode &nodNode = _anodNodes[iNode];
+    nodNode.vecMin = glm::vec3(std::numeric_limits<float>::max());
+    nodNode.vecMax = glm::vec3(-std::numeric_limits<float>::max());
+    glm::vec3 vecCenterMin = nodNode.vecMin;
+    glm::vec3 vecCenterMax = nodNode.vecMax;
+    for (uint32_t iObject = iBegin; iObject < iEnd; iObject++) {
+        const glm::vec4 &vecSphere = avecSpheres[_aiObjects[iObject]];
+        nodNode.vecMin = glm::min(nodNode.vecMin, glm::vec3(vecSphere) - vecSphere.w);
+        nodNode.vecMax = glm::max(nodNode.vecMax, glm::vec3(vecSphere) + vecSphere.w);
+        vecCenterMin = glm::min(vecCenterMin, glm::vec3(vecSphere));
+        vecCenterMax = glm::max(vecCenterMax, glm::vec3(vecSphere));
+    }
+    const uint32_t ctObjects = iEnd - iBegin;
+    nodNode.iFirst = iBegin;
+    nodNode.ctObjects = ctObjects;
+    if (ctObjects == 1) {
+        return;
+    }
+
+    // sort the objects into bins by their centers along each axis, and find the split between bins with the lowest
+    // cost - the area of each side, relative to the parent, times the objects in it
+    const glm::vec3 vecCenterExtent = vecCenterMax - vecCenterMin;
+    auto fnGetBin = [&](uint32_t iObject, uint32_t iAxis) {
+        const float fOffset = (avecSpheres[iObject][iAxis] - vecCenterMin[iAxis]) / vecCenterExtent[iAxis];
+        return std::min(static_cast<uint32_t>(fOffset * ctSahBins), ctSahBins - 1);
+    };
+    float fBestCost = std::numeric_limits<float>::max();
+    uint32_t iBestAxis = 0;
+    uint32_t iBestBin = 0;
+    for (uint32_t iAxis = 0; iAxis < 3; iAxis++) {
+        if (vecCenterExtent[iAxis] <= 0.0f) {
+            continue;
+        }
+        struct SahBin {
+            glm::vec3 vecMin;
+            glm::vec3 vecMax;
+            uint32_t ctObjects;
+        };
+        std::array<SahBin, ctSahBins> asbBins;
+        for (SahBin &sbBin : asbBins) {
+            sbBin = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()), 0 };
+        }
+        for (uint32_t iObject = iBegin; iObject < iEnd; iObject++) {
+            const glm::vec4 &vecSphere = avecSpheres[_aiObjects[iObject]];
+            SahBin &sbBin = asbBins[fnGetBin(_aiObjects[iObject], iAxis)];
+            sbBin.vecMin = glm::min(sbBin.vecMin, glm::vec3(vecSphere) - vecSphere.w);
+            sbBin.vecMax = glm::max(sbBin.vecMax, glm::vec3(vecSphere) + vecSphere.w);
+            sbBin.ctObjects++;
+        }
+
+        // sweep from the right for the sides above each split, then from the left, pricing each split
+        std::array<float, ctSahBins> afRightCost;
+        glm::vec3 vecMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 vecMax = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t ctSide = 0;
+        for (uint32_t iBin = ctSahBins - 1; iBin > 0; iBin--) {
+            vecMin = glm::min(vecMin, asbBins[iBin].vecMin);
+            vecMax = glm::max(vecMax, asbBins[iBin].vecMax);
+            ctSide += asbBins[iBin].ctObjects;
+            afRightCost[iBin] = ctSide > 0 ? GetSurfaceArea(vecMin, vecMax) * ctSide : 0.0f;
+        }
+        vecMin = glm::vec3(std::numeric_limits<float>::max());
+        vecMax = glm::vec3(-std::numeric_limits<float>::max());
+        ctSide = 0;
+        for (uint32_t iBin = 0; iBin < ctSahBins - 1; iBin++) {
+            vecMin = glm::min(vecMin, asbBins[iBin].vecMin);
+            vecMax = glm::max(vecMax, asbBins[iBin].vecMax);
+            ctSide += asbBins[iBin].ctObjects;
+            // a split with an empty side doesn't split anything
+            if (ctSide == 0 || ctSide == ctObjects) {
+                continue;
+            }
+            const float fCost = GetSurfaceArea(vecMin, vecMax) * ctSide + afRightCost[iBin + 1];
+            if (fCost < fBestCost) {
+                fBestCost = fCost;
+                iBestAxis = iAxis;
+                iBestBin = iBin;
+            }
+        }
+    }
+
+    // keep a leaf when splitting doesn't pay off, unless it has too many objects
+    const bool bCanSplit = fBestCost < std::numeric_limits<float>::max();
+    const float fSplitCost = fTraversalCost + fIntersectionCost * fBestCost / GetSurfaceArea(nodNode.vecMin, nodNode.vecMax);
+    if (ctObjects <= ctMaxLeafObjects && (!bCanSplit || fSplitCost >= fIntersectionCost * ctObjects)) {
+        return;
+    }
+
+    // split at the best bin, or in the middle when all centers are in the same place
+    uint32_t iSplit = iBegin + ctObjects / 2;
+    if (bCanSplit) {
+        const auto itSplit = std::partition(_aiObjects.begin() + iBegin, _aiObjects.begin() + iEnd,
+            [&](uint32_t iObject) { return fnGetBin(iObject, iBestAxis) <= iBestBin; });
+        iSplit = static_cast<uint32_t>(itSplit - _aiObjects.begin());
+    }
+
+    // the children are taken as a pair, so that the second one follows the first
+    const uint32_t iFirstChild = ctNodes.fetch_add(2);
+    nodNode.iFirst = iFirstChild;
+    nodNode.ctObjects = 0;
+    if (ctObjects >= ctParallelBuildObjects) {
+        // the children's ranges don't overlap, so one is built by another thread while this one builds the other
+        JobCounter jcFirstChild;
+        JobSystem::Submit([this, iFirstChild, iBegin, iSplit, avecSpheres, &ctNodes]() {
+            BuildNode(iFirstChild, iBegin, iSplit, avecSpheres, ctNodes);
+        }, &jcFirstChild);
+        BuildNode(iFirstChild + 1, iSplit, iEnd, avecSpheres, ctNodes);
+        JobSystem::Wait(jcFirstChild);
+    }
+    else {
+        BuildNode(iFirstChild, iBegin, iSplit, avecSpheres, ctNodes);
+        BuildNode(iFirstChild + 1, iSplit, iEnd, avecSpheres, ctNodes);
+    }
+}
+
+
+// Compute the cost of the hierarchy.
+float SceneBvh::ComputeCost() const {
+    // each node is visited by the rays that hit its box - in proportion to its area relative to the root's
+    float fCost = 0.0f;
+    for (const BvhNode &nodNode : _anodNodes) {
+        const float fArea = GetSurfaceArea(nodNode.vecMin, nodNode.vecMax);
+        fCost += nodNode.ctObjects == 0 ? fTraversalCost * fArea : fIntersectionCost * nodNode.ctObjects * fArea;
+    }
+    return fCost / std::max(GetSurfaceArea(_anodNodes[0].vecMin, _anodNodes[0].vecMax), std::numeric_limits<float>::min());
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "../Mesh/MeshletCulling.h"
+#include "../Memory/FrameArena.h"
+#include <atomic>
+
+// Bounding volume hierarchy over the objects of a scene, for culling them against the camera frustum and picking them
+// with rays without testing every object. Objects are bounding spheres, nodes are axis aligned boxes.
+// The hierarchy is built with the surface area heuristic, splitting large nodes in parallel on the job system. Moved
+// objects are refitted - the tree stays and only the boxes follow the objects, so it gets worse as the objects move
+// apart and should be rebuilt once GetRefitDegradation() grows too large.
+class SceneBvh {
+public:
+    SceneBvh() : _fBuildCost(0.0f), _fCost(0.0f) {};
+    ~SceneBvh() {};
+
+    // Returned by rays that hit no object.
+    static const uint32_t iNoObject = 0xFFFFFFFF;
+
+    // Build the hierarchy over the objects' bounding spheres - center in xyz, radius in w.
+    void Build(const glm::vec4 *avecSpheres, uint32_t ctObjects);
+    // Update the boxes for moved objects, keeping the hierarchy. Pass the spheres of the objects it was built over.
+    void Refit(const glm::vec4 *avecSpheres);
+    // Get how much worse refitting made the hierarchy - its cost relative to the cost when it was built.
+    float GetRefitDegradation() const { return _fBuildCost > 0.0f ? _fCost / _fBuildCost : 1.0f; }
+    // Get the number of objects the hierarchy was built over.
+    uint32_t GetObjectCount() const { return static_cast<uint32_t>(_aiObjects.size()); }
+
+    // Add the objects that are at least partly inside the frustum to aiVisible. The traversal's scratch memory is
+    // taken from arScratch.
+    void CullFrustum(const CullingFrustum &cfFrustum, std::vector<uint32_t> &aiVisible, LinearArena &arScratch) const;
+    // Find the nearest object hit by a ray with a normalized direction. Returns the object and writes the distance to
+    // the hit to fDistance, or returns iNoObject if nothing is hit. The scratch memory is taken from arScratch.
+    uint32_t Raycast(const glm::vec3 &vecOrigin, const glm::vec3 &vecDirection, float &fDistance, LinearArena &arScratch) const;
+
+private:
+    // A node of the hierarchy, half a cache line.
+    struct BvhNode {
+        glm::vec3 vecMin;
+        // For inner nodes the first child - the second one follows it. For leaves the first object in _aiObjects.
+        uint32_t iFirst;
+        glm::vec3 vecMax;
+        // Number of objects of a leaf, zero for inner nodes.
+        uint32_t ctObjects;
+    };
+
+    // Build the node for a range of _aiObjects, and its subtree. New nodes are taken from ctNodes.
+    void BuildNode(uint32_t iNode, uint32_t iBegin, uint32_t iEnd, const glm::vec4 *avecSpheres, std::atomic<uint32_t> &ctNodes);
+    // Compute the cost of the hierarchy - the expected cost of tracing a ray through it.
+    float ComputeCost() const;
+
+private:
+    // Nodes, the root first. Children always come after their parents.
+    std::vector<BvhNode> _anodNodes;
+    // Objects in the order of the leaves, each leaf has a range of them.
+    std::vector<uint32_t> _aiObjects;
+    // Bounding spheres of the objects, in the order of the leaves.
+    std::vector<glm::vec4> _avecSpheres;
+    // Cost of the hierarchy when it was built, and now.
+    float _fBuildCost;
+    float _fCost;
+};
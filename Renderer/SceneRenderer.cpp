@@ -0,0 +1,291 @@
+#include "../PrecompiledHeader.h"
+#include "SceneRenderer.h"
+#include "../Options.h"
+#include "../Jobs/JobSystem.h"
+
+#include <cstring>
+
+// Number of objects culled by one job.
+static const uint32_t ctObjectsPerCullJob = 8;
+// The hierarchy is rebuilt once refitting makes it this many times as costly to traverse as when it was built.
+static const float fMaxRefitDegradation = 1.5f;
+
+
+// Load the model and create the given number of objects.
+void SceneRenderer::Initialize(uint32_t ctObjects) {
+    // load the optimized and quantized mesh, cooking it if needed
+    _meshModel = LoadCookedMesh(Options::Get().GetModelPath());
+
+    // the objects are placed by the first frame's packet
+    SceneObject objObject = {};
+    // nothing is known about occlusion yet, so all objects start in the early phase
+    objObject.bVisible = true;
+    _aobjObjects.assign(ctObjects, objObject);
+    _avecObjectSpheres.resize(ctObjects);
+    _aiObjectsInFrustum.reserve(ctObjects);
+    _adiDraws.reserve(ctObjects);
+}
+
+
+// Update the camera projection for a new render extent.
+void SceneRenderer::SetExtent(uint32_t dimWidth, uint32_t dimHeight) {
+    _dimWidth = dimWidth;
+    _dimHeight = dimHeight;
+
+    // calculate the prijection transform, far enough to see the whole scene
+    const float fFieldOfView = glm::radians(45.0f);
+    _tProjection = glm::perspective(fFieldOfView, dimWidth / (float) dimHeight, 0.1f, 100.0f);
+    // remember how world sizes map to pixels, for selecting levels of detail
+    _fProjectionScale = dimHeight / (2.0f * std::tan(fFieldOfView * 0.5f));
+    // correct for the difference between OpenGL and Vulkan regarding the direction of the Y clip coordinate axis
+    _tProjection[1][1] *= -1;
+}
+
+
+// Get the largest number of indirect draw commands a frame can produce.
+uint32_t SceneRenderer::GetMaxIndirectCommands() const {
+    // each visible meshlet needs at most one command, and the full detail level has the most meshlets - each object
+    // has room for that many
+    return _meshModel.almLods[0].ctMeshlets * static_cast<uint32_t>(_aobjObjects.size());
+}
+
+
+// Run the frame logic for the scene state in a packet.
+void SceneRenderer::PrepareFrame(const FramePacket &fpPacket, UniformBufferObject &uboUniforms, VkDrawIndexedIndirectCommand *adicCommands,
+    OcclusionCandidate *aocCandidates, FrameArena &faFrame) {
+    // move the camera and the objects to where the simulation put them
+    UpdateCamera(fpPacket);
+    UpdateObjects(fpPacket);
+    UpdateHierarchy();
+    // decide how detailed each object should be
+    SelectLods();
+    // find the visible parts of the objects
+    CullObjects(adicCommands, faFrame);
+    // order the draws
+    SortDraws();
+    // split the objects by their visibility in the last frame, and pass their bounds to the occlusion test
+    WriteOcclusionCandidates(aocCandidates);
+
+    // pack the frame constants
+    uboUniforms.tView = _tView;
+    uboUniforms.tProjection = _tProjection;
+    uboUniforms.tViewProjection = _tViewProjection;
+}
+
+
+// Take over the camera of a packet.
+void SceneRenderer::UpdateCamera(const FramePacket &fpPacket) {
+    // calculate the view transform
+    _vecCameraPosition = fpPacket.vecCameraPosition;
+    _tView = glm::lookAt(_vecCameraPosition, fpPacket.vecCameraTarget, glm::vec3(0.0f, 0.0f, 1.0f));
+    // combine view and projection once here instead of once per vertex
+    _tViewProjection = _tProjection * _tView;
+    // the culling frustum changes with the camera too
+    ExtractFrustumPlanes(_tViewProjection, _cfFrustum);
+}
+
+
+// Take over the object transforms of a packet.
+void SceneRenderer::UpdateObjects(const FramePacket &fpPacket) {
+    assert(fpPacket.atObjectTransforms.size() == _aobjObjects.size());
+    // the quantization is the same for all objects
+    const glm::mat4 tDequantize = _meshModel.vqQuantization.GetPositionTransform();
+    const glm::vec4 vecTexCoordTransform = _meshModel.vqQuantization.GetTexCoordTransform();
+    // the bounding box of the quantized positions is [-1, 1] scaled, so the sphere around it is sqrt(3) times the scale
+    const float fRadius = std::sqrt(3.0f) * _meshModel.vqQuantization.fPositionScale;
+
+    for (uint32_t iObject = 0; iObject < _aobjObjects.size(); iObject++) {
+        SceneObject &objObject = _aobjObjects[iObject];
+        // the model transform will be pushed to the shader when the command buffer is recorded
+        objObject.tWorld = fpPacket.atObjectTransforms[iObject];
+        objObject.vecPosition = glm::vec3(objObject.tWorld[3]);
+        // fold the position dequantization into the model transform, so the shader doesn't need to do it per vertex
+        objObject.dcDraw.tModel = objObject.tWorld * tDequantize;
+        // texture coordinates are dequantized in the shader
+        objObject.dcDraw.vecTexCoordTransform = vecTexCoordTransform;
+        // the model transform maps the center of the quantized bounds to the world
+        _avecObjectSpheres[iObject] = glm::vec4(glm::vec3(objObject.dcDraw.tModel * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)), fRadius);
+    }
+}
+
+
+// Refit the hierarchy to the moved objects, or rebuild it.
+void SceneRenderer::UpdateHierarchy() {
+    // refitting is much cheaper than building, as long as the objects stay close to where they were at the build
+    if (_bvhObjects.GetObjectCount() == _aobjObjects.size()) {
+        _bvhObjects.Refit(_avecObjectSpheres.data());
+        if (_bvhObjects.GetRefitDegradation() <= fMaxRefitDegradation) {
+            return;
+        }
+    }
+    _bvhObjects.Build(_avecObjectSpheres.data(), static_cast<uint32_t>(_aobjObjects.size()));
+}
+
+
+// Select the level of detail for each object.
+void SceneRenderer::SelectLods() {
+    const float fMaxPixelError = Options::Get().GetLodPixelError();
+    for (SceneObject &objObject : _aobjObjects) {
+        // pick the coarsest level of detail that doesn't visibly differ from the full one at this distance
+        const float fDistance = glm::length(objObject.vecPosition - _vecCameraPosition);
+        // the errors are measured in model space, so grow them by the largest scale of the world transform
+        const float fScale = std::max(glm::length(glm::vec3(objObject.tWorld[0])),
+            std::max(glm::length(glm::vec3(objObject.tWorld[1])), glm::length(glm::vec3(objObject.tWorld[2]))));
+        objObject.iLod = SelectMeshLod(_meshModel.almLods, fScale, fDistance, _fProjectionScale, fMaxPixelError);
+    }
+}
+
+
+// Cull the meshlets of all objects, writing draw commands for the visible ones.
+void SceneRenderer::CullObjects(VkDrawIndexedIndirectCommand *adicCommands, FrameArena &faFrame) {
+    // objects outside the frustum draw nothing, whole subtrees of them are skipped by the hierarchy
+    for (SceneObject &objObject : _aobjObjects) {
+        objObject.ctCommands = 0;
+        objObject.mcsCulling = {};
+    }
+    _aiObjectsInFrustum.clear();
+    _bvhObjects.CullFrustum(_cfFrustum, _aiObjectsInFrustum, faFrame.GetArena());
+
+    // each object writes its commands to its own range, with room for all meshlets of the most detailed level, so that
+    // the objects are culled in parallel - the draws refer to the ranges, which don't need to be contiguous
+    const uint32_t ctMaxObjectCommands = _meshModel.almLods[0].ctMeshlets;
+    JobSystem::ParallelFor(static_cast<uint32_t>(_aiObjectsInFrustum.size()), ctObjectsPerCullJob, [&](uint32_t iBegin, uint32_t iEnd) {
+        for (uint32_t iInFrustum = iBegin; iInFrustum < iEnd; iInFrustum++) {
+            const uint32_t iObject = _aiObjectsInFrustum[iInFrustum];
+            SceneObject &objObject = _aobjObjects[iObject];
+            // bring the frustum and the camera into object space, so the meshlet bounds don't need transforming
+            CullingFrustum cfObjectFrustum;
+            TransformFrustumToObject(_cfFrustum, objObject.tWorld, cfObjectFrustum);
+            const glm::vec3 vecObjectCamera = glm::vec3(glm::inverse(objObject.tWorld) * glm::vec4(_vecCameraPosition, 1.0f));
+
+            // cull the meshlets of the selected level of detail, writing the commands for the visible ones
+            const MeshLod &mlLod = _meshModel.almLods[objObject.iLod];
+            objObject.iFirstCommand = iObject * ctMaxObjectCommands;
+            objObject.ctCommands = CullMeshlets(&_meshModel.amsMeshlets[mlLod.iFirstMeshlet], mlLod.ctMeshlets, cfObjectFrustum, vecObjectCamera,
+                adicCommands + objObject.iFirstCommand, objObject.mcsCulling);
+        }
+    });
+
+    // sum up the results of the objects
+    _mcsCulling = {};
+    for (const SceneObject &objObject : _aobjObjects) {
+        _mcsCulling.ctTested += objObject.mcsCulling.ctTested;
+        _mcsCulling.ctFrustumCulled += objObject.mcsCulling.ctFrustumCulled;
+        _mcsCulling.ctBackfaceCulled += objObject.mcsCulling.ctBackfaceCulled;
+    }
+}
+
+
+// Sort the visible objects into the draw order.
+void SceneRenderer::SortDraws() {
+    _adiDraws.clear();
+    for (uint32_t iObject = 0; iObject < _aobjObjects.size(); iObject++) {
+        const SceneObject &objObject = _aobjObjects[iObject];
+        // objects that were culled entirely are not drawn
+        if (objObject.ctCommands == 0) {
+            continue;
+        }
+        // state first, then distance - positive floats sort correctly by their bits
+        const float fDistance = glm::length(objObject.vecPosition - _vecCameraPosition);
+        uint32_t ulDistanceBits;
+        memcpy(&ulDistanceBits, &fDistance, sizeof(ulDistanceBits));
+        const uint64_t ullState = (uint64_t(iMainPipeline) << 8) | iModelMesh;
+        _adiDraws.push_back({ (ullState << 32) | ulDistanceBits, iObject });
+    }
+
+    // front to back, so that early depth testing rejects hidden fragments
+    std::sort(_adiDraws.begin(), _adiDraws.end(), [](const DrawItem &diFirst, const DrawItem &diSecond) {
+        return diFirst.ullSortKey < diSecond.ullSortKey;
+    });
+}
+
+
+// Write the bounds of the objects for the occlusion test, and split them into the early and the late phase.
+void SceneRenderer::WriteOcclusionCandidates(OcclusionCandidate *aocCandidates) {
+    // without occlusion culling, everything is drawn in the early phase
+    if (aocCandidates == nullptr) {
+        for (SceneObject &objObject : _aobjObjects) {
+            objObject.bLate = false;
+        }
+        return;
+    }
+
+    for (uint32_t iObject = 0; iObject < _aobjObjects.size(); iObject++) {
+        SceneObject &objObject = _aobjObjects[iObject];
+        // objects visible in the last frame are drawn right away - their depth is what the others are tested against
+        objObject.bLate = !objObject.bVisible;
+
+        OcclusionCandidate &ocCandidate = aocCandidates[iObject];
+        ocCandidate.vecSphere = _avecObjectSpheres[iObject];
+        ocCandidate.iFirstCommand = objObject.iFirstCommand;
+        ocCandidate.ctCommands = objObject.ctCommands;
+        ocCandidate.bLate = objObject.bLate ? 1 : 0;
+        ocCandidate.ulPadding = 0;
+    }
+}
+
+
+// Take over the occlusion test results of the executed frame.
+void SceneRenderer::ApplyOcclusionResults(const uint32_t *abVisible) {
+    _ocsOcclusion = {};
+    for (uint32_t iObject = 0; iObject < _aobjObjects.size(); iObject++) {
+        SceneObject &objObject = _aobjObjects[iObject];
+        const bool bVisible = abVisible[iObject] != 0;
+        // only the late objects are culled by the test - the early ones were drawn before it
+        if (objObject.bLate && objObject.ctCommands > 0) {
+            _ocsOcclusion.ctTested++;
+            if (!bVisible) {
+                _ocsOcclusion.ctOccluded++;
+            }
+        }
+        // the next frame draws the object early if it is visible now
+        objObject.bVisible = bVisible;
+    }
+}
+
+
+// Record the draws of the prepared frame, of the objects in the early or in the late phase.
+void SceneRenderer::RecordFrame(CommandSink &csSink, bool bLatePhase) const {
+    csSink.BeginRenderPass();
+
+    // lay down the depth of the visible surfaces first, so that the main pass only shades the fragments that remain
+    // visible - without the pre-pass, its subpass stays empty
+    if (_bDepthPrepass) {
+        RecordDraws(csSink, iDepthPrepassPipeline, iModelMeshPositions, bLatePhase);
+    }
+    csSink.NextSubpass();
+    RecordDraws(csSink, _bDepthPrepass ? iDepthEqualPipeline : iMainPipeline, iModelMesh, bLatePhase);
+
+    csSink.EndRenderPass();
+}
+
+
+// Record the draws of the visible objects in a phase, with the given pipeline and mesh stream.
+void SceneRenderer::RecordDraws(CommandSink &csSink, uint32_t iPipeline, uint32_t iMesh, bool bLatePhase) const {
+    // state is only bound when it changes between draws - the sort key groups draws with the same state
+    uint64_t ullBoundState = ~0ull;
+    for (const DrawItem &diDraw : _adiDraws) {
+        const SceneObject &objObject = _aobjObjects[diDraw.iObject];
+        // the other phase draws this object
+        if (objObject.bLate != bLatePhase) {
+            continue;
+        }
+
+        const uint64_t ullState = diDraw.ullSortKey >> 32;
+        if (ullState != ullBoundState) {
+            // issue the command to bind the graphics pipeline - the scene only uses the main pipeline and the model's mesh,
+            // so their variant for this pass is given directly
+            csSink.BindPipeline(iPipeline);
+            // bind the vertex and index buffers
+            csSink.BindMeshBuffers(iMesh);
+            // bind the descriptor sets - they only hold per-frame data, so they are bound once per pipeline
+            csSink.BindDescriptorSet(iFrameDescriptorSet);
+            ullBoundState = ullState;
+        }
+
+        // push the per-draw data - it is stored in the command buffer, so no memory writes or descriptor binds are needed
+        csSink.PushConstants(&objObject.dcDraw, sizeof(DrawConstants));
+        // draw the visible meshlets of the object, with the commands culling wrote to the indirect buffer
+        csSink.DrawIndexedIndirect(objObject.iFirstCommand, objObject.ctCommands);
+    }
+}
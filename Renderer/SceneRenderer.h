@@ -0,0 +1,188 @@
+#pragma once
+#include "CommandSink.h"
+#include "SceneSimulation.h"
+#include "SceneBvh.h"
+#include "../Mesh/MeshCache.h"
+#include "../Mesh/MeshletCulling.h"
+#include "../Memory/FrameArena.h"
+
+// Uniform buffer description. Holds only data that is constant for the whole frame.
+struct UniformBufferObject {
+    // View transform.
+    glm::mat4 tView;
+    // Projection transform.
+    glm::mat4 tProjection;
+    // Precomputed view-projection transform, so the vertex shader doesn't have to multiply them per vertex.
+    glm::mat4 tViewProjection;
+};
+
+// Per-draw data, passed to the vertex shader through push constants.
+// Must stay within the 128 bytes that every implementation guarantees for push constants.
+struct DrawConstants {
+    // Model transform, with the position dequantization folded in.
+    glm::mat4 tModel;
+    // Texture coordinate dequantization - scale in xy, offset in zw.
+    glm::vec4 vecTexCoordTransform;
+};
+
+// Bounds and draw range of an object, for testing it against the depth pyramid on the GPU. The layout matches the
+// candidate buffer of the occlusion shader.
+struct OcclusionCandidate {
+    // Bounding sphere in world space - center in xyz, radius in w.
+    glm::vec4 vecSphere;
+    // Range of the object's draw commands in the indirect buffer.
+    uint32_t iFirstCommand;
+    uint32_t ctCommands;
+    // Is the object drawn in the late phase? Its commands are emptied if the test finds it occluded.
+    uint32_t bLate;
+    uint32_t ulPadding;
+};
+static_assert(sizeof(OcclusionCandidate) == 32, "OcclusionCandidate must match the shader's layout");
+
+// Occlusion culling results of a frame.
+struct OcclusionStatistics {
+    // Objects with visible meshlets that were tested in the late phase, and those of them found occluded.
+    uint32_t ctTested;
+    uint32_t ctOccluded;
+};
+
+// Ids of the resources the renderer's commands refer to. The graphics API maps them to its own objects.
+// The tutorial scene uses one of each, plus the depth pre-pass variants of the pipeline and the mesh.
+const uint32_t iMainPipeline = 0;
+// Main pipeline after a depth pre-pass - tests for equal depth and doesn't write it.
+const uint32_t iDepthEqualPipeline = 1;
+// Depth-only pipeline of the pre-pass, with no fragment shader.
+const uint32_t iDepthPrepassPipeline = 2;
+const uint32_t iModelMesh = 0;
+// Position-only vertex stream of the model's mesh, for the depth pre-pass.
+const uint32_t iModelMeshPositions = 1;
+const uint32_t iFrameDescriptorSet = 0;
+// Number of pipeline and mesh ids, for the API's tables of the objects they map to.
+const uint32_t ctRendererPipelines = 3;
+const uint32_t ctRendererMeshes = 2;
+
+// API independent part of rendering. Each frame takes over the camera and object transforms from a frame packet,
+// selects levels of detail, culls and sorts the objects, packs the uniforms and builds the list of draws. The graphics
+// API provides the memory the uniforms and indirect commands are written to, and a sink that the draw commands are
+// recorded into. Runs on the render thread - the scene is moved by the SceneSimulation on the main thread.
+class SceneRenderer {
+public:
+    SceneRenderer() : _dimWidth(0), _dimHeight(0), _fProjectionScale(0.0f), _bDepthPrepass(false), _ocsOcclusion() {};
+    ~SceneRenderer() {};
+
+    // Load the model and create the given number of objects, to be placed by the frame packets.
+    void Initialize(uint32_t ctObjects);
+    // Update the camera projection for a new render extent.
+    void SetExtent(uint32_t dimWidth, uint32_t dimHeight);
+
+    // Get the cooked model, for uploading its vertices and indices.
+    const CookedMesh &GetModel() const { return _meshModel; }
+    // Get the largest number of indirect draw commands a frame can produce.
+    uint32_t GetMaxIndirectCommands() const;
+
+    // Get the number of objects in the scene.
+    uint32_t GetObjectCount() const { return static_cast<uint32_t>(_aobjObjects.size()); }
+
+    // Run the frame logic for the scene state in a packet. Writes the frame uniforms, and the draw commands of the
+    // visible meshlets to adicCommands, which must hold GetMaxIndirectCommands() commands. With occlusion culling,
+    // the objects' bounds are written to aocCandidates, which must hold GetObjectCount() candidates, and the objects
+    // that weren't visible in the last frame are moved to the late phase. Pass nullptr to draw all in the early phase.
+    // Transient data of the frame is allocated from faFrame.
+    void PrepareFrame(const FramePacket &fpPacket, UniformBufferObject &uboUniforms, VkDrawIndexedIndirectCommand *adicCommands,
+        OcclusionCandidate *aocCandidates, FrameArena &faFrame);
+    // Record the draws of the prepared frame, of the objects in the early or in the late phase.
+    void RecordFrame(CommandSink &csSink, bool bLatePhase) const;
+    // Take over the occlusion test results of the executed frame - a flag per object, non-zero if it is visible.
+    void ApplyOcclusionResults(const uint32_t *abVisible);
+    // Set whether the recorded frames lay down depth in a pre-pass before shading.
+    void SetDepthPrepass(bool bDepthPrepass) { _bDepthPrepass = bDepthPrepass; }
+
+    // Get the culling results of the last prepared frame.
+    const MeshletCullingStatistics &GetCullingStatistics() const { return _mcsCulling; }
+    // Get the number of objects drawn in the last prepared frame.
+    uint32_t GetDrawnObjectCount() const { return static_cast<uint32_t>(_adiDraws.size()); }
+    // Get the occlusion culling results of the last executed frame.
+    const OcclusionStatistics &GetOcclusionStatistics() const { return _ocsOcclusion; }
+
+private:
+    // An instance of the model placed in the scene.
+    struct SceneObject {
+        // Position of the object in the world, from its transform.
+        glm::vec3 vecPosition;
+        // Object to world transform, without the quantization.
+        glm::mat4 tWorld;
+        // Per-draw constants, pushed when recording the draw.
+        DrawConstants dcDraw;
+        // Level of detail selected for the current frame.
+        uint32_t iLod;
+        // Range of the object's draw commands in the indirect buffer, for the current frame.
+        uint32_t iFirstCommand;
+        uint32_t ctCommands;
+        // Culling results of the object's meshlets, for the current frame.
+        MeshletCullingStatistics mcsCulling;
+        // Was the object visible in the last occlusion test? Objects that were are drawn in the early phase, before
+        // the test, and the others in the late phase, if the test finds them visible.
+        bool bVisible;
+        bool bLate;
+    };
+
+    // An object to draw in the current frame, with the key that decides the draw order.
+    struct DrawItem {
+        // Pipeline and mesh in the high bits, so that state changes are minimized, then distance, front to back.
+        uint64_t ullSortKey;
+        // Index of the object.
+        uint32_t iObject;
+    };
+
+    // Take over the camera of a packet.
+    void UpdateCamera(const FramePacket &fpPacket);
+    // Take over the object transforms of a packet.
+    void UpdateObjects(const FramePacket &fpPacket);
+    // Refit the hierarchy to the moved objects, or rebuild it if refitting made it too slow to traverse.
+    void UpdateHierarchy();
+    // Select the level of detail for each object.
+    void SelectLods();
+    // Cull the objects against the frustum through the hierarchy, then the meshlets of the objects in it, writing
+    // draw commands for the visible ones. The objects' meshlets are culled in parallel.
+    void CullObjects(VkDrawIndexedIndirectCommand *adicCommands, FrameArena &faFrame);
+    // Sort the visible objects into the draw order.
+    void SortDraws();
+    // Write the bounds of the objects for the occlusion test, and split them into the early and the late phase.
+    void WriteOcclusionCandidates(OcclusionCandidate *aocCandidates);
+    // Record the draws of the visible objects in a phase, with the given pipeline and mesh stream.
+    void RecordDraws(CommandSink &csSink, uint32_t iPipeline, uint32_t iMesh, bool bLatePhase) const;
+
+private:
+    // Cooked model data - levels of detail, meshlets and quantization.
+    CookedMesh _meshModel;
+    // Objects in the scene.
+    std::vector<SceneObject> _aobjObjects;
+    // Bounding spheres of the objects in the world, center in xyz and radius in w.
+    std::vector<glm::vec4> _avecObjectSpheres;
+    // Hierarchy over the objects' bounding spheres.
+    SceneBvh _bvhObjects;
+    // Objects at least partly inside the frustum in the current frame.
+    std::vector<uint32_t> _aiObjectsInFrustum;
+    // Objects to draw in the current frame, in order.
+    std::vector<DrawItem> _adiDraws;
+
+    // Render extent.
+    uint32_t _dimWidth;
+    uint32_t _dimHeight;
+    // Position of the camera.
+    glm::vec3 _vecCameraPosition;
+    // Camera transforms. The projection is set by the extent, the view by each frame's packet.
+    glm::mat4 _tView;
+    glm::mat4 _tProjection;
+    glm::mat4 _tViewProjection;
+    // Converts sizes at unit distance from the camera to pixels, for selecting levels of detail.
+    float _fProjectionScale;
+    // Planes of the camera frustum in world space.
+    CullingFrustum _cfFrustum;
+    // Culling results for the last frame.
+    MeshletCullingStatistics _mcsCulling;
+    // Is depth laid down in a pre-pass?
+    bool _bDepthPrepass;
+    // Occlusion culling results for the last executed frame.
+    OcclusionStatistics _ocsOcclusion;
+};
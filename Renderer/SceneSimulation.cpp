@@ -0,0 +1,45 @@
+#include "../PrecompiledHeader.h"
+#include "SceneSimulation.h"
+#include "../Options.h"
+
+
+// Place the objects in the scene.
+// The tutorial scene is a grid of objects receding from the camera, so that distant ones use coarser levels of detail.
+void SceneSimulation::Initialize() {
+    // number of objects along each side of the grid, and the distance between them
+    const uint32_t ctGridSize = 8;
+    const float fGridSpacing = 3.0f;
+
+    for (uint32_t iRow = 0; iRow < ctGridSize; iRow++) {
+        for (uint32_t iColumn = 0; iColumn < ctGridSize; iColumn++) {
+            // the grid starts at the origin and extends away from the camera
+            _tsTransforms.Add(glm::vec3(-fGridSpacing * iColumn, -fGridSpacing * iRow, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f);
+        }
+    }
+}
+
+
+// Advance the scene by one step of the given length.
+// The tutorial scene rotates the objects 45 degrees per second, while animation is on.
+void SceneSimulation::Step(float tmStep) {
+    _tsTransforms.BeginStep();
+    if (Options::Get().ShouldAnimateScene()) {
+        _fRotation += tmStep * glm::radians(-45.0f);
+        const glm::quat qRotation = glm::angleAxis(_fRotation, glm::vec3(0.0f, 0.0f, 1.0f));
+        for (uint32_t iObject = 0; iObject < _tsTransforms.GetCount(); iObject++) {
+            _tsTransforms.SetRotation(iObject, qRotation);
+        }
+    }
+}
+
+
+// Write the state of the scene between the last two steps to a packet.
+void SceneSimulation::WriteFramePacket(float fInterpolation, FramePacket &fpPacket) const {
+    // the camera looks at the first object, the grid recedes behind it
+    fpPacket.vecCameraPosition = glm::vec3(2.0f, 2.0f, 2.0f);
+    fpPacket.vecCameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    // the matrices go straight into the packet, which keeps its memory from earlier frames, so this doesn't allocate
+    fpPacket.atObjectTransforms.resize(_tsTransforms.GetCount());
+    _tsTransforms.ComputeWorldMatrices(fInterpolation, fpPacket.atObjectTransforms.data());
+}
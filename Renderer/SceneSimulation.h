@@ -0,0 +1,42 @@
+#pragma once
+#include "TransformStore.h"
+
+// State of the scene at one point in time - everything the render thread needs from the main thread to render a
+// frame. The main thread fills a packet while the render thread renders the previous one.
+struct FramePacket {
+    // When the frame started, i.e. when the input it shows was sampled.
+    std::chrono::high_resolution_clock::time_point tmFrameStart;
+    // Camera position, and the point it looks at.
+    glm::vec3 vecCameraPosition;
+    glm::vec3 vecCameraTarget;
+    // Object to world transforms, one per object in the order the scene placed them. Each is a request to draw the
+    // object - the renderer decides how, or whether it is visible at all.
+    std::vector<glm::mat4> atObjectTransforms;
+};
+
+// Main thread part of the scene. Places the objects and moves them in fixed time steps, independent of the frame rate,
+// so that every run with the same steps is the same. Frames are rendered between the last two steps, and the packets
+// written for them interpolate the two states. Doesn't touch anything the render thread uses.
+class SceneSimulation {
+public:
+    SceneSimulation() : _fRotation(0.0f) {};
+    ~SceneSimulation() {};
+
+    // Place the objects in the scene.
+    void Initialize();
+
+    // Get the number of objects in the scene.
+    uint32_t GetObjectCount() const { return _tsTransforms.GetCount(); }
+
+    // Advance the scene by one step of the given length, in seconds.
+    void Step(float tmStep);
+    // Write the state of the scene between the last two steps to a packet - with zero the state before the last step,
+    // with one the state after it.
+    void WriteFramePacket(float fInterpolation, FramePacket &fpPacket) const;
+
+private:
+    // Transforms of the objects, one per object.
+    TransformStore _tsTransforms;
+    // Rotation of the objects about their vertical axis, in radians, after the last step.
+    float _fRotation;
+};
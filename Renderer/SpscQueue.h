@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+
+// Lock-free queue between one producer thread and one consumer thread, holding a fixed number of items. Items live
+// in the queue and are written and read in place, so that items owning memory keep it from one use to the next. The
+// producer fills the item BeginPush returns and publishes it with EndPush, the consumer reads the item Front returns
+// and releases it with Pop. Neither blocks - waiting for an item or for room is left to the caller.
+template<typename Item, uint32_t ctCapacity>
+class SpscQueue {
+    // the positions wrap around at 2^32, which stays consistent with the slot index only for powers of two
+    static_assert(ctCapacity > 0 && (ctCapacity & (ctCapacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : _iHead(0), _iTail(0) {};
+    ~SpscQueue() {};
+
+    // Forbid copying, the positions are shared between threads.
+    SpscQueue(SpscQueue const &) = delete;
+    void operator = (SpscQueue const &) = delete;
+
+    // Get the item to fill next, or nullptr if the queue is full. Called by the producer.
+    Item *BeginPush() {
+        const uint32_t iTail = _iTail.load(std::memory_order_relaxed);
+        // the consumer's release of an item must be seen before the item is overwritten
+        if (iTail - _iHead.load(std::memory_order_acquire) == ctCapacity) {
+            return nullptr;
+        }
+        return &_aItems[iTail % ctCapacity];
+    }
+    // Publish the item returned by BeginPush to the consumer. Called by the producer.
+    void EndPush() {
+        // the item's contents must be seen before the new tail
+        _iTail.store(_iTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Get the oldest published item, or nullptr if the queue is empty. Called by the consumer.
+    Item *Front() {
+        const uint32_t iHead = _iHead.load(std::memory_order_relaxed);
+        if (iHead == _iTail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &_aItems[iHead % ctCapacity];
+    }
+    // Release the item returned by Front back to the producer. Called by the consumer.
+    void Pop() {
+        _iHead.store(_iHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Is the queue full? Exact when called by the producer, only a hint for the consumer.
+    bool IsFull() const { return _iTail.load(std::memory_order_acquire) - _iHead.load(std::memory_order_acquire) == ctCapacity; }
+
+private:
+    // Items, used round robin.
+    std::array<Item, ctCapacity> _aItems;
+    // Positions of the oldest published item and of the next item to fill, counting all items ever pushed. Each is
+    // written by one thread only, and they are kept on separate cache lines so that the threads don't contend for one.
+    alignas(64) std::atomic<uint32_t> _iHead;
+    alignas(64) std::atomic<uint32_t> _iTail;
+};
@@ -0,0 +1,299 @@
+#include "../PrecompiledHeader.h"
+#include "TransformStore.h"
+#include "../Jobs/JobSystem.h"
+
+// SSE is always there on x64, AVX only when the compiler may use it, e.g. with /arch:AVX2
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_STORE_SSE 1
+#include <immintrin.h>
+#else
+#define TRANSFORM_STORE_SSE 0
+#endif
+#if TRANSFORM_STORE_SSE && defined(__AVX__)
+#define TRANSFORM_STORE_AVX 1
+#else
+#define TRANSFORM_STORE_AVX 0
+#endif
+
+// Transforms per parallel-for range - a multiple of the widest batch, so that only the last range has a scalar tail.
+static const uint32_t ctTransformsPerJob = 256;
+
+
+// A transform's component in one lane - the fallback where there is no SIMD, and for the transforms after the last
+// full batch.
+struct LanesScalar {
+    typedef float Type;
+    static const uint32_t ctWidth = 1;
+
+    static Type Load(const float *afValues) { return *afValues; }
+    static Type Set(float fValue) { return fValue; }
+    static Type Add(Type a, Type b) { return a + b; }
+    static Type Sub(Type a, Type b) { return a - b; }
+    static Type Mul(Type a, Type b) { return a * b; }
+    static Type Div(Type a, Type b) { return a / b; }
+    static Type Sqrt(Type a) { return std::sqrt(a); }
+    // Negate a where the sign is negative.
+    static Type FlipSign(Type a, Type fSign) { return fSign < 0.0f ? -a : a; }
+    // Write column iColumn of the matrix.
+    static void StoreColumn(glm::mat4 *atMatrices, uint32_t iColumn, Type x, Type y, Type z, Type w) {
+        atMatrices[0][iColumn] = glm::vec4(x, y, z, w);
+    }
+};
+
+#if TRANSFORM_STORE_SSE
+// A component of four consecutive transforms in the lanes of an SSE register.
+struct LanesSse {
+    typedef __m128 Type;
+    static const uint32_t ctWidth = 4;
+
+    static Type Load(const float *afValues) { return _mm_loadu_ps(afValues); }
+    static Type Set(float fValue) { return _mm_set1_ps(fValue); }
+    static Type Add(Type a, Type b) { return _mm_add_ps(a, b); }
+    static Type Sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+    static Type Mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+    static Type Div(Type a, Type b) { return _mm_div_ps(a, b); }
+    static Type Sqrt(Type a) { return _mm_sqrt_ps(a); }
+    // Negate the lanes of a where the sign is negative, by moving the sign's sign bit over.
+    static Type FlipSign(Type a, Type vSign) { return _mm_xor_ps(a, _mm_and_ps(vSign, _mm_set1_ps(-0.0f))); }
+    // Write column iColumn of the four matrices - the lanes hold a component of each, so they are transposed into
+    // one column per matrix.
+    static void StoreColumn(glm::mat4 *atMatrices, uint32_t iColumn, Type x, Type y, Type z, Type w) {
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(reinterpret_cast<float *>(&atMatrices[0]) + iColumn * 4, x);
+        _mm_storeu_ps(reinterpret_cast<float *>(&atMatrices[1]) + iColumn * 4, y);
+        _mm_storeu_ps(reinterpret_cast<float *>(&atMatrices[2]) + iColumn * 4, z);
+        _mm_storeu_ps(reinterpret_cast<float *>(&atMatrices[3]) + iColumn * 4, w);
+    }
+};
+#endif
+
+#if TRANSFORM_STORE_AVX
+// A component of eight consecutive transforms in the lanes of an AVX register.
+struct LanesAvx {
+    typedef __m256 Type;
+    static const uint32_t ctWidth = 8;
+
+    static Type Load(const float *afValues) { return _mm256_loadu_ps(afValues); }
+    static Type Set(float fValue) { return _mm256_set1_ps(fValue); }
+    static Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+    static Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+    static Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+    static Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+    static Type Sqrt(Type a) { return _mm256_sqrt_ps(a); }
+    // Negate the lanes of a where the sign is negative, by moving the sign's sign bit over.
+    static Type FlipSign(Type a, Type vSign) { return _mm256_xor_ps(a, _mm256_and_ps(vSign, _mm256_set1_ps(-0.0f))); }
+    // Write column iColumn of the eight matrices - each half is transposed like four SSE lanes.
+    static void StoreColumn(glm::mat4 *atMatrices, uint32_t iColumn, Type x, Type y, Type z, Type w) {
+        LanesSse::StoreColumn(atMatrices, iColumn, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+            _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+        LanesSse::StoreColumn(atMatrices + 4, iColumn, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+            _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+    }
+};
+#endif
+
+
+// Multiply a matrix by its parent's world matrix, in place.
+static void MultiplyByParent(const glm::mat4 &tParent, glm::mat4 &tTransform) {
+#if TRANSFORM_STORE_SSE
+    // every column of the result is the parent's columns weighted by the same column of the transform
+    const float *afParent = reinterpret_cast<const float *>(&tParent);
+    float *afTransform = reinterpret_cast<float *>(&tTransform);
+    const __m128 vParent0 = _mm_loadu_ps(afParent);
+    const __m128 vParent1 = _mm_loadu_ps(afParent + 4);
+    const __m128 vParent2 = _mm_loadu_ps(afParent + 8);
+    const __m128 vParent3 = _mm_loadu_ps(afParent + 12);
+    for (uint32_t iColumn = 0; iColumn < 4; iColumn++) {
+        float *afColumn = afTransform + iColumn * 4;
+        __m128 vColumn = _mm_mul_ps(vParent0, _mm_set1_ps(afColumn[0]));
+        vColumn = _mm_add_ps(vColumn, _mm_mul_ps(vParent1, _mm_set1_ps(afColumn[1])));
+        vColumn = _mm_add_ps(vColumn, _mm_mul_ps(vParent2, _mm_set1_ps(afColumn[2])));
+        vColumn = _mm_add_ps(vColumn, _mm_mul_ps(vParent3, _mm_set1_ps(afColumn[3])));
+        _mm_storeu_ps(afColumn, vColumn);
+    }
+#else
+    tTransform = tParent * tTransform;
+#endif
+}
+
+
+// Add a transform.
+uint32_t TransformStore::Add(const glm::vec3 &vecPosition, const glm::quat &qRotation, float fScale, uint32_t iParent) {
+    // the levels must stay contiguous, so a transform may only start the level after the last one
+    const uint32_t iTransform = GetCount();
+    uint32_t iLevel = 0;
+    if (iParent != iNoParent) {
+        if (iParent >= iTransform) {
+            throw std::runtime_error("transform's parent must be added before it");
+        }
+        iLevel = _aiLevel[iParent] + 1;
+    }
+    const uint32_t iLastLevel = _aiLevelStart.empty() ? 0 : static_cast<uint32_t>(_aiLevelStart.size()) - 1;
+    if (iLevel < iLastLevel || iLevel > iLastLevel + 1) {
+        throw std::runtime_error("transforms must be added level by level");
+    }
+    if (_aiLevelStart.empty() || iLevel > iLastLevel) {
+        _aiLevelStart.push_back(iTransform);
+    }
+    _aiParent.push_back(iParent);
+    _aiLevel.push_back(iLevel);
+
+    // a new transform doesn't move during its first step
+    for (TransformState *ptsState : { &_tsPrevious, &_tsCurrent }) {
+        ptsState->afPositionX.push_back(vecPosition.x);
+        ptsState->afPositionY.push_back(vecPosition.y);
+        ptsState->afPositionZ.push_back(vecPosition.z);
+        ptsState->afRotationX.push_back(qRotation.x);
+        ptsState->afRotationY.push_back(qRotation.y);
+        ptsState->afRotationZ.push_back(qRotation.z);
+        ptsState->afRotationW.push_back(qRotation.w);
+        ptsState->afScale.push_back(fScale);
+    }
+    return iTransform;
+}
+
+
+// Start a simulation step.
+void TransformStore::BeginStep() {
+    // copying keeps the memory of both states, so steps don't allocate
+    _tsPrevious.afPositionX = _tsCurrent.afPositionX;
+    _tsPrevious.afPositionY = _tsCurrent.afPositionY;
+    _tsPrevious.afPositionZ = _tsCurrent.afPositionZ;
+    _tsPrevious.afRotationX = _tsCurrent.afRotationX;
+    _tsPrevious.afRotationY = _tsCurrent.afRotationY;
+    _tsPrevious.afRotationZ = _tsCurrent.afRotationZ;
+    _tsPrevious.afRotationW = _tsCurrent.afRotationW;
+    _tsPrevious.afScale = _tsCurrent.afScale;
+}
+
+
+// Set a transform's position after the step.
+void TransformStore::SetPosition(uint32_t iTransform, const glm::vec3 &vecPosition) {
+    _tsCurrent.afPositionX[iTransform] = vecPosition.x;
+    _tsCurrent.afPositionY[iTransform] = vecPosition.y;
+    _tsCurrent.afPositionZ[iTransform] = vecPosition.z;
+}
+
+
+// Set a transform's rotation after the step.
+void TransformStore::SetRotation(uint32_t iTransform, const glm::quat &qRotation) {
+    _tsCurrent.afRotationX[iTransform] = qRotation.x;
+    _tsCurrent.afRotationY[iTransform] = qRotation.y;
+    _tsCurrent.afRotationZ[iTransform] = qRotation.z;
+    _tsCurrent.afRotationW[iTransform] = qRotation.w;
+}
+
+
+// Set a transform's scale after the step.
+void TransformStore::SetScale(uint32_t iTransform, float fScale) {
+    _tsCurrent.afScale[iTransform] = fScale;
+}
+
+
+// Compute the world matrices of all transforms.
+void TransformStore::ComputeWorldMatrices(float fInterpolation, glm::mat4 *atWorld) const {
+    // a level needs its parents' world matrices, so the levels are computed one after the other
+    for (uint32_t iLevel = 0; iLevel < _aiLevelStart.size(); iLevel++) {
+        const uint32_t iLevelBegin = _aiLevelStart[iLevel];
+        const uint32_t iLevelEnd = iLevel + 1 < _aiLevelStart.size() ? _aiLevelStart[iLevel + 1] : GetCount();
+        JobSystem::ParallelFor(iLevelEnd - iLevelBegin, ctTransformsPerJob, [&](uint32_t iBegin, uint32_t iEnd) {
+            ComputeLocalMatrices(iLevelBegin + iBegin, iLevelBegin + iEnd, fInterpolation, atWorld);
+            // roots are already in the world
+            if (iLevel > 0) {
+                for (uint32_t iTransform = iLevelBegin + iBegin; iTransform < iLevelBegin + iEnd; iTransform++) {
+                    MultiplyByParent(atWorld[_aiParent[iTransform]], atWorld[iTransform]);
+                }
+            }
+        });
+    }
+}
+
+
+// Compute the matrices of a range of transforms relative to their parents.
+void TransformStore::ComputeLocalMatrices(uint32_t iBegin, uint32_t iEnd, float fInterpolation, glm::mat4 *atLocal) const {
+    // the widest batches first, then the narrower ones for what is left
+    uint32_t iTransform = iBegin;
+#if TRANSFORM_STORE_AVX
+    for (; iTransform + LanesAvx::ctWidth <= iEnd; iTransform += LanesAvx::ctWidth) {
+        ComputeLocalBatch<LanesAvx>(iTransform, fInterpolation, atLocal);
+    }
+#endif
+#if TRANSFORM_STORE_SSE
+    for (; iTransform + LanesSse::ctWidth <= iEnd; iTransform += LanesSse::ctWidth) {
+        ComputeLocalBatch<LanesSse>(iTransform, fInterpolation, atLocal);
+    }
+#endif
+    for (; iTransform < iEnd; iTransform++) {
+        ComputeLocalBatch<LanesScalar>(iTransform, fInterpolation, atLocal);
+    }
+}
+
+
+// Compute the matrices of a batch of consecutive transforms.
+template<typename Lanes>
+void TransformStore::ComputeLocalBatch(uint32_t iFirst, float fInterpolation, glm::mat4 *atLocal) const {
+    typedef typename Lanes::Type Type;
+    const Type vInterpolation = Lanes::Set(fInterpolation);
+    const Type vZero = Lanes::Set(0.0f);
+    const Type vOne = Lanes::Set(1.0f);
+    // interpolate linearly between the states
+    auto fnInterpolate = [&](const std::vector<float> &afPrevious, const std::vector<float> &afCurrent) {
+        const Type vPrevious = Lanes::Load(&afPrevious[iFirst]);
+        return Lanes::Add(vPrevious, Lanes::Mul(Lanes::Sub(Lanes::Load(&afCurrent[iFirst]), vPrevious), vInterpolation));
+    };
+
+    const Type vPositionX = fnInterpolate(_tsPrevious.afPositionX, _tsCurrent.afPositionX);
+    const Type vPositionY = fnInterpolate(_tsPrevious.afPositionY, _tsCurrent.afPositionY);
+    const Type vPositionZ = fnInterpolate(_tsPrevious.afPositionZ, _tsCurrent.afPositionZ);
+    const Type vScale = fnInterpolate(_tsPrevious.afScale, _tsCurrent.afScale);
+
+    // the rotations are interpolated linearly and normalized, which is close enough to a slerp for the small angles
+    // of a step - the previous one is negated if needed, so that they take the shorter way around
+    Type vPreviousX = Lanes::Load(&_tsPrevious.afRotationX[iFirst]);
+    Type vPreviousY = Lanes::Load(&_tsPrevious.afRotationY[iFirst]);
+    Type vPreviousZ = Lanes::Load(&_tsPrevious.afRotationZ[iFirst]);
+    Type vPreviousW = Lanes::Load(&_tsPrevious.afRotationW[iFirst]);
+    const Type vCurrentX = Lanes::Load(&_tsCurrent.afRotationX[iFirst]);
+    const Type vCurrentY = Lanes::Load(&_tsCurrent.afRotationY[iFirst]);
+    const Type vCurrentZ = Lanes::Load(&_tsCurrent.afRotationZ[iFirst]);
+    const Type vCurrentW = Lanes::Load(&_tsCurrent.afRotationW[iFirst]);
+    const Type vDot = Lanes::Add(Lanes::Add(Lanes::Mul(vPreviousX, vCurrentX), Lanes::Mul(vPreviousY, vCurrentY)),
+        Lanes::Add(Lanes::Mul(vPreviousZ, vCurrentZ), Lanes::Mul(vPreviousW, vCurrentW)));
+    vPreviousX = Lanes::FlipSign(vPreviousX, vDot);
+    vPreviousY = Lanes::FlipSign(vPreviousY, vDot);
+    vPreviousZ = Lanes::FlipSign(vPreviousZ, vDot);
+    vPreviousW = Lanes::FlipSign(vPreviousW, vDot);
+    Type vX = Lanes::Add(vPreviousX, Lanes::Mul(Lanes::Sub(vCurrentX, vPreviousX), vInterpolation));
+    Type vY = Lanes::Add(vPreviousY, Lanes::Mul(Lanes::Sub(vCurrentY, vPreviousY), vInterpolation));
+    Type vZ = Lanes::Add(vPreviousZ, Lanes::Mul(Lanes::Sub(vCurrentZ, vPreviousZ), vInterpolation));
+    Type vW = Lanes::Add(vPreviousW, Lanes::Mul(Lanes::Sub(vCurrentW, vPreviousW), vInterpolation));
+    const Type vLength = Lanes::Sqrt(Lanes::Add(Lanes::Add(Lanes::Mul(vX, vX), Lanes::Mul(vY, vY)), Lanes::Add(Lanes::Mul(vZ, vZ), Lanes::Mul(vW, vW))));
+    const Type vInverseLength = Lanes::Div(vOne, vLength);
+    vX = Lanes::Mul(vX, vInverseLength);
+    vY = Lanes::Mul(vY, vInverseLength);
+    vZ = Lanes::Mul(vZ, vInverseLength);
+    vW = Lanes::Mul(vW, vInverseLength);
+
+    // rotation matrix of the quaternion, with the scale applied to its columns
+    const Type vX2 = Lanes::Add(vX, vX);
+    const Type vY2 = Lanes::Add(vY, vY);
+    const Type vZ2 = Lanes::Add(vZ, vZ);
+    const Type vXX = Lanes::Mul(vX, vX2);
+    const Type vYY = Lanes::Mul(vY, vY2);
+    const Type vZZ = Lanes::Mul(vZ, vZ2);
+    const Type vXY = Lanes::Mul(vX, vY2);
+    const Type vXZ = Lanes::Mul(vX, vZ2);
+    const Type vYZ = Lanes::Mul(vY, vZ2);
+    const Type vWX = Lanes::Mul(vW, vX2);
+    const Type vWY = Lanes::Mul(vW, vY2);
+    const Type vWZ = Lanes::Mul(vW, vZ2);
+
+    glm::mat4 *atBatch = atLocal + iFirst;
+    Lanes::StoreColumn(atBatch, 0, Lanes::Mul(Lanes::Sub(vOne, Lanes::Add(vYY, vZZ)), vScale),
+        Lanes::Mul(Lanes::Add(vXY, vWZ), vScale), Lanes::Mul(Lanes::Sub(vXZ, vWY), vScale), vZero);
+    Lanes::StoreColumn(atBatch, 1, Lanes::Mul(Lanes::Sub(vXY, vWZ), vScale),
+        Lanes::Mul(Lanes::Sub(vOne, Lanes::Add(vXX, vZZ)), vScale), Lanes::Mul(Lanes::Add(vYZ, vWX), vScale), vZero);
+    Lanes::StoreColumn(atBatch, 2, Lanes::Mul(Lanes::Add(vXZ, vWY), vScale),
+        Lanes::Mul(Lanes::Sub(vYZ, vWX), vScale), Lanes::Mul(Lanes::Sub(vOne, Lanes::Add(vXX, vYY)), vScale), vZero);
+    Lanes::StoreColumn(atBatch, 3, vPositionX, vPositionY, vPositionZ, vOne);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Transforms of many objects - position, rotation and uniform scale relative to a parent, or to the world for roots.
+// Each component is kept in its own array, so that consecutive transforms load straight into SIMD lanes, and world
+// matrices are computed in batches of 8 with AVX, 4 with SSE, or one at a time where neither is available.
+// The store keeps the state before and after the last simulation step, and the matrices interpolate between the two.
+// Transforms are added level by level - all roots first, then their children, and so on - so that each level is a
+// contiguous range whose parents are all in earlier levels, and a level can be computed in parallel.
+class TransformStore {
+public:
+    TransformStore() {};
+    ~TransformStore() {};
+
+    // Parent of root transforms.
+    static const uint32_t iNoParent = 0xFFFFFFFF;
+
+    // Add a transform, at the same depth as the last one or one deeper. Returns its index.
+    uint32_t Add(const glm::vec3 &vecPosition, const glm::quat &qRotation, float fScale, uint32_t iParent = iNoParent);
+    // Get the number of transforms.
+    uint32_t GetCount() const { return static_cast<uint32_t>(_aiParent.size()); }
+
+    // Start a simulation step - the current state becomes the state before the step.
+    void BeginStep();
+    // Set parts of a transform, in the state after the step.
+    void SetPosition(uint32_t iTransform, const glm::vec3 &vecPosition);
+    void SetRotation(uint32_t iTransform, const glm::quat &qRotation);
+    void SetScale(uint32_t iTransform, float fScale);
+
+    // Compute the world matrices of all transforms, between the state before the last step and after it as given by
+    // fInterpolation. atWorld must have room for all transforms. Each level's matrices are computed in parallel.
+    void ComputeWorldMatrices(float fInterpolation, glm::mat4 *atWorld) const;
+
+private:
+    // Compute the matrices of a range of transforms relative to their parents.
+    void ComputeLocalMatrices(uint32_t iBegin, uint32_t iEnd, float fInterpolation, glm::mat4 *atLocal) const;
+    // Compute the matrices of a batch of consecutive transforms, as many as the lanes hold.
+    template<typename Lanes>
+    void ComputeLocalBatch(uint32_t iFirst, float fInterpolation, glm::mat4 *atLocal) const;
+
+private:
+    // State of the transforms at one point in time, a separate array per component.
+    struct TransformState {
+        std::vector<float> afPositionX;
+        std::vector<float> afPositionY;
+        std::vector<float> afPositionZ;
+        std::vector<float> afRotationX;
+        std::vector<float> afRotationY;
+        std::vector<float> afRotationZ;
+        std::vector<float> afRotationW;
+        std::vector<float> afScale;
+    };
+    // State before the last step, and after it.
+    TransformState _tsPrevious;
+    TransformState _tsCurrent;
+    // Parent of each transform.
+    std::vector<uint32_t> _aiParent;
+    // Depth of each transform, zero for roots.
+    std::vector<uint32_t> _aiLevel;
+    // First transform of each level.
+    std::vector<uint32_t> _aiLevelStart;
+};
@@ -1,2 +1,5 @@
 c:\VulkanSDK\1.0.49.0\Bin\glslangValidator.exe -V shader.vert
-c:\VulkanSDK\1.0.49.0\Bin\glslangValidator.exe -V shader.frag
\ No newline at end of file
+c:\VulkanSDK\1.0.49.0\Bin\glslangValidator.exe -V shader.frag
+c:\VulkanSDK\1.0.49.0\Bin\glslangValidator.exe -V depth.vert -o depth_vert.spv
+c:\VulkanSDK\1.0.49.0\Bin\glslangValidator.exe -V hiz.comp -o hiz_comp.spv
+c:\VulkanSDK\1.0.49.0\Bin\glslangValidator.exe -V occlusion.comp -o occlusion_comp.spv
\ No newline at end of file
@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Vertex shader of the depth pre-pass. Reads only positions, and there is no fragment shader - the pass only writes depth.
+
+// Uniform buffer description. Holds only data that is constant for the whole frame.
+layout(binding = 0) uniform UniformBufferObject {
+    // View transform.
+    mat4 tView;
+    // Projection transform.
+    mat4 tProjection;
+    // Precomputed view-projection transform.
+    mat4 tViewProjection;
+} ubo;
+
+// Per-draw data, passed through push constants.
+layout(push_constant) uniform DrawConstants {
+    // Model transform, with the position dequantization folded in.
+    mat4 tModel;
+    // Texture coordinate dequantization - scale in xy, offset in zw. Not used here.
+    vec4 vecTexCoordTransform;
+} draw;
+
+// Quantized position, from the position-only vertex stream.
+layout(location = 0) in vec4 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+// the main pass tests for equal depth, so the position has to be computed exactly as in the main vertex shader
+invariant gl_Position;
+
+void main() {
+    gl_Position = ubo.tViewProjection * draw.tModel * vec4(inPosition.xyz, 1.0);
+}
\ No newline at end of file
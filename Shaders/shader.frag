@@ -3,7 +3,7 @@
 
 layout(binding = 1) uniform sampler2D texSampler;
 
-layout(location = 0) in vec3 fragColor;
+layout(location = 0) in vec3 fragNormal;
 layout(location = 1) in vec2 fragTextureCoord;
 
 layout(location = 0) out vec4 outColor;
@@ -1,29 +1,50 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-// Uniform buffer description.
+// Uniform buffer description. Holds only data that is constant for the whole frame.
 layout(binding = 0) uniform UniformBufferObject {
-    // Model transform.
-    mat4 tModel;
     // View transform.
     mat4 tView;
     // Projection transform.
     mat4 tProjection;
+    // Precomputed view-projection transform.
+    mat4 tViewProjection;
 } ubo;
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTextureCoord;
+// Per-draw data, passed through push constants.
+layout(push_constant) uniform DrawConstants {
+    // Model transform, with the position dequantization folded in.
+    mat4 tModel;
+    // Texture coordinate dequantization - scale in xy, offset in zw.
+    vec4 vecTexCoordTransform;
+} draw;
+
+// Quantized vertex attributes. Normalized formats are already converted to float by the vertex fetch.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inTextureCoord;
+layout(location = 2) in vec2 inNormal;
 
 out gl_PerVertex {
     vec4 gl_Position;
 };
+// the depth pre-pass computes positions the same way, and the main pass tests for equal depth, so both have to
+// produce exactly the same values
+invariant gl_Position;
 
-layout(location = 0) out vec3 fragColor;
+layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec2 fragTextureCoord;
 
+// Decode an octahedral normal back to a unit vector.
+vec3 DecodeOctahedralNormal(vec2 vecEncoded) {
+    vec3 vecNormal = vec3(vecEncoded, 1.0 - abs(vecEncoded.x) - abs(vecEncoded.y));
+    // unfold the lower hemisphere
+    float fFold = max(-vecNormal.z, 0.0);
+    vecNormal.xy += mix(vec2(fFold), vec2(-fFold), greaterThanEqual(vecNormal.xy, vec2(0.0)));
+    return normalize(vecNormal);
+}
+
 void main() {
-    gl_Position = ubo.tProjection * ubo.tView * ubo.tModel * vec4(inPosition, 1.0);
-    fragColor = inColor;
-	fragTextureCoord = inTextureCoord;
+    gl_Position = ubo.tViewProjection * draw.tModel * vec4(inPosition.xyz, 1.0);
+    fragNormal = normalize(mat3(draw.tModel) * DecodeOctahedralNormal(inNormal));
+	fragTextureCoord = inTextureCoord * draw.vecTexCoordTransform.xy + draw.vecTexCoordTransform.zw;
 }
\ No newline at end of file
@@ -3,12 +3,15 @@
 #include <stdexcept>
 
 #include "Application.h"
+#include "Options.h"
 
 
-int main() {
+int main(int argc, char *argv[]) {
 	Application app;
 
 	try {
+		// load the options before anything is created from them
+		Options::Load(argc, argv);
 		app.Run();
 	}
 	catch (const std::runtime_error& e) {